@@ -0,0 +1,109 @@
+/**********************************************************
+ * Running statistics of the measures per field.
+ * ---
+ * Minimum, maximum, mean and standard deviation of every
+ * measure since reset(), without storing the measures:
+ * Welford's update of the mean and of the sum of squared
+ * differences M2 per added value. Integer math only, the
+ * mean is a Q8 of the 1/100 units, M2 a Q16 in 64 bit.
+ * Undefined values are not counted, a field without
+ * values is undefined in all statistics.
+ * Shared by the sketch and the host tests (beehive-simulator).
+ **********************************************************/
+#ifndef __AGGREGATOR_H__
+#define __AGGREGATOR_H__
+
+#include <stdint.h>
+
+#ifndef UNDEFINED_VALUE
+  #define UNDEFINED_VALUE -32768
+#endif
+
+template <uint8_t FIELDS>
+class Aggregator {
+  public:
+    Aggregator() {
+      reset();
+    }
+
+    void reset() {
+      measures = 0;
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        fields[i].count = 0;
+        fields[i].mean = 0;
+        fields[i].m2 = 0;
+      }
+    }
+
+    void add(const int16_t* values) {
+      if (measures < 0xFFFF) measures++;
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        if (values[i] == UNDEFINED_VALUE) continue;
+        Field& field = fields[i];
+        if (field.count == 0xFFFF) continue;
+        if (field.count == 0 || values[i] < field.minimum) field.minimum = values[i];
+        if (field.count == 0 || values[i] > field.maximum) field.maximum = values[i];
+        field.count++;
+        int32_t value = (int32_t)values[i] * 256;
+        int32_t delta = value - field.mean;
+        field.mean += delta / field.count;
+        field.m2 += (int64_t)delta * (value - field.mean);
+      }
+    }
+
+    // measures added, with or without defined values
+    inline
+    uint16_t count() { return measures; }
+
+    inline
+    int16_t minimum(uint8_t field) { return fields[field].count > 0 ? fields[field].minimum : UNDEFINED_VALUE; }
+
+    inline
+    int16_t maximum(uint8_t field) { return fields[field].count > 0 ? fields[field].maximum : UNDEFINED_VALUE; }
+
+    // rounded to the 1/100 units of the values
+    int16_t mean(uint8_t field) {
+      if (fields[field].count == 0) return UNDEFINED_VALUE;
+      int32_t mean = fields[field].mean;
+      return mean >= 0 ? (mean + 128) / 256 : -((-mean + 128) / 256);
+    }
+
+    // population standard deviation, rounded to the 1/100 units of the values
+    int16_t deviation(uint8_t field) {
+      if (fields[field].count == 0) return UNDEFINED_VALUE;
+      uint64_t variance = fields[field].m2 > 0 ? (uint64_t)fields[field].m2 / fields[field].count : 0;
+      uint32_t root = squareRoot(variance);
+      return (root + 128) / 256;
+    }
+
+  private:
+    typedef struct {
+      uint16_t count;
+      int16_t minimum;
+      int16_t maximum;
+      int32_t mean;   // Q8
+      int64_t m2;     // Q16
+    } Field;
+
+    Field fields[FIELDS];
+    uint16_t measures = 0;
+
+    // floor of the square root, bit by bit
+    static uint32_t squareRoot(uint64_t value) {
+      uint64_t root = 0;
+      uint64_t bit = 1ULL << 62;
+      while (bit > value) bit >>= 2;
+      while (bit != 0) {
+        if (value >= root + bit) {
+          value -= root + bit;
+          root = (root >> 1) + bit;
+        } else {
+          root >>= 1;
+        }
+        bit >>= 2;
+      }
+      return (uint32_t)root;
+    }
+};
+
+#endif
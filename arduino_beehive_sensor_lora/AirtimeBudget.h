@@ -0,0 +1,144 @@
+/**********************************************************
+ * Time-on-air accounting and budget of the uplinks (EU868).
+ * ---
+ * Time-on-air of a frame after the Semtech LoRa modem
+ * formula (AN1200.13) from spreading factor, bandwidth,
+ * coding rate and PHY payload (application payload and
+ * 13 bytes LoRaWAN overhead), explicit header with CRC.
+ * Rolling totals of the last hour (6 buckets of 10 min) and
+ * of the last day (24 buckets of 1 h) are kept against:
+ * - 36 s per hour, the 1% duty cycle of the EU868 g-bands,
+ *   conservative as all channels count together
+ * - 30 s per day, the TTN fair use policy
+ * Frames of normal priority may use the whole budget, low
+ * priority frames (confirmations, diagnostics) leave
+ * AIRTIME_RESERVE percent of it for the measures.
+ * Confirmed frames count with all trials and the datarate
+ * step down of the MAC (see LoRaMacDirect.h).
+ **********************************************************/
+#ifndef __AIRTIMEBUDGET_H__
+#define __AIRTIMEBUDGET_H__
+
+#include <stdint.h>
+
+#define AIRTIME_FRAME_OVERHEAD 13        // MHDR, FHDR without options, FPort, MIC
+#define AIRTIME_HOUR_BUDGET    36000UL   // ms, 1% duty cycle
+#define AIRTIME_DAY_BUDGET     30000UL   // ms, TTN fair use
+#define AIRTIME_RESERVE        20        // percent of the budgets kept from low priority frames
+#define AIRTIME_SLOT_MS        600000UL  // 10 min
+#define AIRTIME_HOUR_SLOTS     6
+#define AIRTIME_DAY_SLOTS      24
+
+#define FRAME_PRIORITY_LOW     0
+#define FRAME_PRIORITY_NORMAL  1
+
+typedef uint64_t (*TimeFunction)();
+
+class AirtimeBudget {
+  public:
+    // us on air, bandwidth in kHz, coding rate 1..4 for 4/5..4/8
+    static uint32_t timeOnAir(uint8_t spreadingFactor, uint16_t bandwidth, uint8_t codingRate, uint8_t phyPayload) {
+      uint32_t symbol = ((uint32_t)1000 << spreadingFactor) / bandwidth;
+      uint8_t lowDatarateOptimize = (bandwidth == 125 && spreadingFactor >= 11) ? 1 : 0;
+      int16_t bits = 8 * (int16_t)phyPayload - 4 * spreadingFactor + 28 + 16;
+      int16_t perSymbol = 4 * (spreadingFactor - 2 * lowDatarateOptimize);
+      uint16_t payloadSymbols = 8 + (bits > 0 ? (bits + perSymbol - 1) / perSymbol * (codingRate + 4) : 0);
+      return (8 * 4 + 17) * symbol / 4 + payloadSymbols * symbol;
+    }
+
+    // us on air of an application payload with EU868 datarate DR0..6
+    static uint32_t frameTime(uint8_t datarate, uint8_t payload) {
+      uint8_t spreadingFactor = datarate >= 5 ? 7 : 12 - datarate;
+      return timeOnAir(spreadingFactor, datarate == 6 ? 250 : 125, 1, AIRTIME_FRAME_OVERHEAD + payload);
+    }
+
+    // us on air of all trials, the datarate steps down every second trial
+    static uint32_t trialsTime(uint8_t datarate, uint8_t payload, uint8_t trials) {
+      uint32_t total = 0;
+      for (uint8_t trial = 0; trial < trials; trial++) {
+        uint8_t step = trial / 2;
+        total += frameTime(datarate > step ? datarate - step : 0, payload);
+      }
+      return total;
+    }
+
+    void begin(TimeFunction time) {
+      timeFunction = time;
+    }
+
+    void add(uint32_t us) {
+      advance();
+      uint32_t ms = (us + 500) / 1000;
+      slotMs[currentSlot % AIRTIME_HOUR_SLOTS] += ms;
+      hourMs[currentHour % AIRTIME_DAY_SLOTS] += ms;
+      totalMs += ms;
+    }
+
+    bool allows(uint32_t us, uint8_t priority) {
+      uint32_t ms = (us + 500) / 1000;
+      uint8_t share = priority == FRAME_PRIORITY_LOW ? 100 - AIRTIME_RESERVE : 100;
+      return lastHour() + ms <= AIRTIME_HOUR_BUDGET * share / 100
+          && lastDay() + ms <= AIRTIME_DAY_BUDGET * share / 100;
+    }
+
+    // number of trials (1..trials) a confirmed frame may use, 0 if none fits
+    uint8_t affordableTrials(uint8_t datarate, uint8_t payload, uint8_t trials, uint8_t priority) {
+      while (trials > 0 && !allows(trialsTime(datarate, payload, trials), priority)) {
+        trials--;
+      }
+      return trials;
+    }
+
+    // ms on air in the last 60 min
+    uint32_t lastHour() {
+      advance();
+      uint32_t sum = 0;
+      for (uint8_t i = 0; i < AIRTIME_HOUR_SLOTS; i++) sum += slotMs[i];
+      return sum;
+    }
+
+    // ms on air in the last 24 h
+    uint32_t lastDay() {
+      advance();
+      uint32_t sum = 0;
+      for (uint8_t i = 0; i < AIRTIME_DAY_SLOTS; i++) sum += hourMs[i];
+      return sum;
+    }
+
+    // ms on air since boot
+    inline
+    uint32_t total() { return totalMs; }
+
+    // frames deferred or dropped for the budget
+    inline
+    uint16_t deferred() { return deferredFrames; }
+
+    inline
+    void defer() { deferredFrames++; }
+
+  private:
+    TimeFunction timeFunction = 0;
+    uint32_t currentSlot = 0;
+    uint32_t currentHour = 0;
+    uint32_t slotMs[AIRTIME_HOUR_SLOTS] = {0};
+    uint32_t hourMs[AIRTIME_DAY_SLOTS] = {0};
+    uint32_t totalMs = 0;
+    uint16_t deferredFrames = 0;
+
+    // clears the buckets that passed since the last call
+    void advance() {
+      if (timeFunction == 0) return;
+      uint32_t slot = timeFunction() / AIRTIME_SLOT_MS;
+      for (uint32_t next = currentSlot + 1; next <= slot && next <= currentSlot + AIRTIME_HOUR_SLOTS; next++) {
+        slotMs[next % AIRTIME_HOUR_SLOTS] = 0;
+      }
+      currentSlot = slot;
+      uint32_t hour = slot / AIRTIME_HOUR_SLOTS;
+      for (uint32_t next = currentHour + 1; next <= hour && next <= currentHour + AIRTIME_DAY_SLOTS; next++) {
+        hourMs[next % AIRTIME_DAY_SLOTS] = 0;
+      }
+      currentHour = hour;
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+/**********************************************************
+ * Detector of sudden changes for an immediate alert.
+ * ---
+ * A swarm leaves with several kilograms of bees within
+ * minutes, a theft lifts the whole hive. While idle, the
+ * baseline follows every measure of the weight and of the
+ * brood nest temperatures (the fields from ALERT_FIRST_BROOD
+ * on). A change beyond the arm limit of a field arms the
+ * detector, the sketch measures at a short interval then.
+ * While armed:
+ * - ALERT_CONFIRMATIONS measures in a row beyond the alert
+ *   step raise the alert once, the baseline moves to the
+ *   new level
+ * - ALERT_CALM_MEASURES measures in a row back within the
+ *   arm limits or ALERT_ARMED_MEASURES in total disarm it
+ *   (eg. a beekeeper at the hive, a slow drift)
+ * Undefined values do not count. Field order of message v1.
+ **********************************************************/
+#ifndef __ALERTDETECTOR_H__
+#define __ALERTDETECTOR_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef UNDEFINED_VALUE
+  #define UNDEFINED_VALUE -32768
+#endif
+
+#define ALERT_WEIGHT          0x01
+#define ALERT_TEMPERATURE     0x02
+
+#define ALERT_WEIGHT_FIELD       1
+#define ALERT_FIRST_BROOD        6   // lower, middle and upper thermometer
+#define ALERT_CONFIRMATIONS      2
+#define ALERT_CALM_MEASURES      4
+#define ALERT_ARMED_MEASURES    40
+
+typedef struct {
+  int16_t armWeight;         // 1/100 kg
+  int16_t alertWeight;
+  int16_t armTemperature;    // 1/100 C
+  int16_t alertTemperature;
+} AlertLimits;
+
+template <uint8_t FIELDS>
+class AlertDetector {
+  public:
+    AlertDetector(const AlertLimits& limits) : limits(limits) {}
+
+    // called with the values of every measure (1/100 units), returns the ALERT_* flags raised, 0 without
+    uint8_t update(const int16_t* values) {
+      if (!initialized) {
+        memcpy(baseline, values, sizeof(baseline));
+        initialized = true;
+        return 0;
+      }
+      uint8_t beyondArm = exceeded(values, limits.armWeight, limits.armTemperature);
+      uint8_t beyondAlert = exceeded(values, limits.alertWeight, limits.alertTemperature);
+      if (armedMeasures == 0) {
+        if (beyondArm == 0) {
+          memcpy(baseline, values, sizeof(baseline));
+          return 0;
+        }
+        confirmations = 0;
+        calm = 0;
+      }
+      armedMeasures++;
+      if (beyondAlert != 0) {
+        calm = 0;
+        if (++confirmations >= ALERT_CONFIRMATIONS) {
+          memcpy(before, baseline, sizeof(before));
+          memcpy(after, values, sizeof(after));
+          disarm(values);
+          return beyondAlert;
+        }
+      } else {
+        confirmations = 0;
+        calm = beyondArm == 0 ? calm + 1 : 0;
+        if (calm >= ALERT_CALM_MEASURES) {
+          disarm(values);
+          return 0;
+        }
+      }
+      if (armedMeasures >= ALERT_ARMED_MEASURES) {
+        disarm(values);
+      }
+      return 0;
+    }
+
+    inline
+    bool isArmed() { return armedMeasures > 0; }
+
+    // values of the last alert: the baseline before and the measure that raised it
+    inline
+    const int16_t* alertBefore() { return before; }
+    inline
+    const int16_t* alertAfter() { return after; }
+
+    // brood nest field with the largest change of the last alert, UNDEFINED_VALUE without thermometer
+    int16_t alertBroodField() {
+      int16_t field = UNDEFINED_VALUE;
+      int32_t largest = -1;
+      for (uint8_t i = ALERT_FIRST_BROOD; i < FIELDS; i++) {
+        int32_t change = difference(after[i], before[i]);
+        if (change > largest) {
+          largest = change;
+          field = i;
+        }
+      }
+      return field;
+    }
+
+  private:
+    AlertLimits limits;
+    int16_t baseline[FIELDS];
+    int16_t before[FIELDS];
+    int16_t after[FIELDS];
+    bool initialized = false;
+    uint8_t armedMeasures = 0;
+    uint8_t confirmations = 0;
+    uint8_t calm = 0;
+
+    void disarm(const int16_t* values) {
+      memcpy(baseline, values, sizeof(baseline));
+      armedMeasures = 0;
+    }
+
+    uint8_t exceeded(const int16_t* values, int16_t weight, int16_t temperature) {
+      uint8_t flags = 0;
+      if (FIELDS > ALERT_WEIGHT_FIELD && difference(values[ALERT_WEIGHT_FIELD], baseline[ALERT_WEIGHT_FIELD]) >= weight) {
+        flags |= ALERT_WEIGHT;
+      }
+      for (uint8_t i = ALERT_FIRST_BROOD; i < FIELDS; i++) {
+        if (difference(values[i], baseline[i]) >= temperature) {
+          flags |= ALERT_TEMPERATURE;
+        }
+      }
+      return flags;
+    }
+
+    // absolute difference, -1 if a value is undefined
+    static int32_t difference(int16_t value, int16_t reference) {
+      if (value == UNDEFINED_VALUE || reference == UNDEFINED_VALUE) return -1;
+      int32_t d = (int32_t)value - reference;
+      return d < 0 ? -d : d;
+    }
+};
+
+#endif
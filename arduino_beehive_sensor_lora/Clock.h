@@ -0,0 +1,78 @@
+/**********************************************************
+ * Monotonic 64 bit clock in ms since boot.
+ * ---
+ * CubeCell: the RTC (TimerGetCurrentTime) keeps running in
+ * deep sleep, sleep needs no estimate.
+ * AVR: millis() of timer0 while awake, plus the watchdog
+ * periods slept in power down. The watchdog oscillator is
+ * off by up to 10%; calibrate() measures its period against
+ * timer0 and scales the slept periods. Sleep timed by another
+ * source (eg. the HX711 conversions) is added unscaled.
+ * The 32 bit sources wrap after 49.7 days, now() has to be
+ * called at least once in that time.
+ **********************************************************/
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#if !defined(__ASR6501__)
+  #include <avr/wdt.h>
+#endif
+
+#define WATCHDOG_CALIBRATION_MS 250  // WDTO_250MS
+
+class Clock {
+  public:
+    uint64_t now() {
+      #if defined(__ASR6501__)
+        uint32_t source = TimerGetCurrentTime();
+      #else
+        uint32_t source = millis();
+      #endif
+      elapsedMs += (uint32_t)(source - lastSourceMs);
+      lastSourceMs = source;
+      return elapsedMs + sleptUs / 1000;
+    }
+
+    // nominal watchdog periods slept (AVR), the RTC counts sleep by itself (CubeCell)
+    void addSleep(unsigned long nominalMs) {
+      #if !defined(__ASR6501__)
+        sleptUs += (uint64_t)nominalMs * watchdogPermille;
+      #else
+        (void)nominalMs;
+      #endif
+    }
+
+    // sleep timed by another source (AVR)
+    void addSleepMs(unsigned long ms) {
+      #if !defined(__ASR6501__)
+        sleptUs += (uint64_t)ms * 1000;
+      #else
+        (void)ms;
+      #endif
+    }
+
+    // measures the watchdog period against timer0 while awake (AVR),
+    // the ISR(WDT_vect) of the LowPower library disables the watchdog again
+    void calibrate() {
+      #if !defined(__ASR6501__)
+        noInterrupts();
+        wdt_reset();
+        WDTCSR |= _BV(WDCE) | _BV(WDE);
+        WDTCSR = _BV(WDIE) | WDTO_250MS;
+        interrupts();
+        unsigned long start = micros();
+        while (WDTCSR & _BV(WDIE)) {}
+        unsigned long period = micros() - start;
+        watchdogPermille = period / WATCHDOG_CALIBRATION_MS;
+        Serial.print(F("Watchdog period ")); Serial.print(watchdogPermille / 10.0); Serial.println(F(" %"));
+      #endif
+    }
+
+  private:
+    uint64_t elapsedMs = 0;
+    uint32_t lastSourceMs = 0;
+    uint64_t sleptUs = 0;
+    unsigned long watchdogPermille = 1000;  // actual per nominal watchdog period
+};
+
+#endif
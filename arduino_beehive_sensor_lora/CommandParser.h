@@ -0,0 +1,133 @@
+/**********************************************************
+ * Downlink commands changing the settings of the sketch.
+ * ---
+ * Downlinks on COMMAND_PORT start with the protocol version
+ * (COMMAND_VERSION) followed by one or more commands, each
+ * an id byte and its value (big endian):
+ *  0x01 measure interval   min, max (2 x uint16, minutes),
+ *                          equal bounds for a fixed interval
+ *  0x02 unconditional      uint16, minutes, at least half
+ *                          the max measure interval
+ *  0x03 weight limit       uint16, 1/100 kg
+ *  0x04 temperature limit  uint16, 1/100 C
+ *  0x05 humidity limit     uint16, 1/100 %
+ *  0x06 confirmation       uint16, minutes, 0 never
+ *  0x07 datarate           uint8, DR_0..DR_5 without ADR,
+ *                          SETTINGS_DATARATE_DEFAULT as built
+ *  0x7F defaults           no value, the settings as built
+ * eg. 01 01 000A 003C 03 0014: measure every 10 to 60 min,
+ * weight limit 0.20 kg.
+ * A downlink is applied completely or not at all, parse()
+ * returns the first error.
+ **********************************************************/
+#ifndef __COMMANDPARSER_H__
+#define __COMMANDPARSER_H__
+
+#include <stdint.h>
+
+#define COMMAND_PORT     10
+#define COMMAND_VERSION   1
+#define COMMAND_MAX_SIZE 51  // payload of DR0..2 (EU868)
+
+#define COMMAND_MEASURE_INTERVAL       0x01
+#define COMMAND_UNCONDITIONAL_INTERVAL 0x02
+#define COMMAND_LIMIT_WEIGHT           0x03
+#define COMMAND_LIMIT_TEMPERATURE      0x04
+#define COMMAND_LIMIT_HUMIDITY         0x05
+#define COMMAND_CONFIRMATION_INTERVAL  0x06
+#define COMMAND_DATARATE               0x07
+#define COMMAND_DEFAULTS               0x7F
+
+// parse() results
+#define COMMAND_OK             0
+#define COMMAND_BAD_VERSION    1
+#define COMMAND_UNKNOWN        2
+#define COMMAND_TRUNCATED      3
+#define COMMAND_OUT_OF_RANGE   4
+
+#define COMMAND_MAX_INTERVAL    720  // minutes, the missed wakeup timeout of the sketch
+#define COMMAND_MAX_LIMIT     10000  // 1/100 units
+#define COMMAND_MAX_DATARATE      5  // DR_5, SF7 (EU868)
+#define SETTINGS_DATARATE_DEFAULT 0xFF
+
+typedef struct {
+  uint16_t minInterval;            // minutes between measures, see MeasureScheduler.h
+  uint16_t maxInterval;
+  uint16_t unconditionalInterval;  // minutes, a sample is sent at least every interval
+  uint16_t confirmationInterval;   // minutes between link validations (link check or confirmed uplink), 0 never
+  int16_t  limitWeight;            // 1/100 kg, LIMIT_*_DIFF of hasChanged()
+  int16_t  limitTemperature;       // 1/100 C
+  int16_t  limitHumidity;          // 1/100 %
+  uint8_t  datarate;               // DR_0..DR_5, SETTINGS_DATARATE_DEFAULT
+} Settings;
+
+class CommandParser {
+  public:
+    // applies the commands of a downlink to settings, unchanged on error
+    static uint8_t parse(const uint8_t* buffer, uint8_t size, const Settings& defaults, Settings* settings) {
+      if (size < 1 || buffer[0] != COMMAND_VERSION) return COMMAND_BAD_VERSION;
+      Settings next = *settings;
+      uint8_t position = 1;
+      while (position < size) {
+        uint8_t command = buffer[position++];
+        uint8_t length = valueSize(command);
+        if (length == 0xFF) return COMMAND_UNKNOWN;
+        if (position + length > size) return COMMAND_TRUNCATED;
+        const uint8_t* value = buffer + position;
+        position += length;
+        switch (command) {
+          case COMMAND_MEASURE_INTERVAL:
+            next.minInterval = readShort(value);
+            next.maxInterval = readShort(value + 2);
+            break;
+          case COMMAND_UNCONDITIONAL_INTERVAL: next.unconditionalInterval = readShort(value); break;
+          case COMMAND_LIMIT_WEIGHT:           next.limitWeight = readShort(value); break;
+          case COMMAND_LIMIT_TEMPERATURE:      next.limitTemperature = readShort(value); break;
+          case COMMAND_LIMIT_HUMIDITY:         next.limitHumidity = readShort(value); break;
+          case COMMAND_CONFIRMATION_INTERVAL:  next.confirmationInterval = readShort(value); break;
+          case COMMAND_DATARATE:               next.datarate = value[0]; break;
+          case COMMAND_DEFAULTS:               next = defaults; break;
+        }
+      }
+      if (!isValid(next)) return COMMAND_OUT_OF_RANGE;
+      *settings = next;
+      return COMMAND_OK;
+    }
+
+    // settings within the ranges of the commands, eg. loaded from storage; the sketch sends
+    // half a measure interval before the unconditional interval ends
+    static bool isValid(const Settings& settings) {
+      return settings.minInterval >= 1 && settings.minInterval <= settings.maxInterval
+          && settings.maxInterval <= COMMAND_MAX_INTERVAL
+          && settings.unconditionalInterval <= COMMAND_MAX_INTERVAL
+          && (uint32_t)settings.unconditionalInterval * 2 >= settings.maxInterval
+          && isLimit(settings.limitWeight) && isLimit(settings.limitTemperature) && isLimit(settings.limitHumidity)
+          && (settings.datarate <= COMMAND_MAX_DATARATE || settings.datarate == SETTINGS_DATARATE_DEFAULT);
+    }
+
+  private:
+    // bytes of the value, 0xFF for unknown commands
+    static uint8_t valueSize(uint8_t command) {
+      switch (command) {
+        case COMMAND_MEASURE_INTERVAL: return 4;
+        case COMMAND_UNCONDITIONAL_INTERVAL:
+        case COMMAND_LIMIT_WEIGHT:
+        case COMMAND_LIMIT_TEMPERATURE:
+        case COMMAND_LIMIT_HUMIDITY:
+        case COMMAND_CONFIRMATION_INTERVAL: return 2;
+        case COMMAND_DATARATE: return 1;
+        case COMMAND_DEFAULTS: return 0;
+        default: return 0xFF;
+      }
+    }
+
+    static uint16_t readShort(const uint8_t* value) {
+      return ((uint16_t)value[0] << 8) | value[1];
+    }
+
+    static bool isLimit(int16_t limit) {
+      return limit >= 1 && limit <= COMMAND_MAX_LIMIT;
+    }
+};
+
+#endif
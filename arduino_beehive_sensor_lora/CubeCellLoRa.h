@@ -10,8 +10,8 @@
 class CubeCellLoRa {
   public:
 
-    void begin() {
-      lora.init();
+    void begin(TimeFunction time) {
+      lora.init(time);
     }
 
     void tick() {
@@ -19,18 +19,18 @@ class CubeCellLoRa {
     }
 
     void join() {
+      if (lora.resumeSession()) return;
       Serial.print("Device joining: ");
       printBufferAsString(DEV_EUI, sizeof(DEV_EUI));
       lora.joinOTAA(DEV_EUI, APP_EUI, APP_KEY);
       //lora.joinABP(DEVADDR, NWKSKEY, APPSKEY);
     }
 
-    void reset(unsigned long seqNumber) {
-      // TODO uplink count
-      //lora.joinABP(DEVADDR, NWKSKEY, APPSKEY);
+    void reset(unsigned long /* seqNumber */) {
+      // session and uplink counter are kept by the MAC, see SessionStore.h
     }
 
-    unsigned long send(uint8_t *message, uint8_t len, bool confirmation) {
+    unsigned long send(uint8_t *message, uint8_t len, bool confirmation, uint8_t port = 1) {
         // Check if there is not a current TX/RX job running
         if (isTransmitting()) {
             Serial.println(F("OP_TXRXPEND, not sending"));
@@ -38,7 +38,7 @@ class CubeCellLoRa {
             // Prepare upstream data transmission at the next possible time.
             Serial.print("Message: ");
             printBufferAsString(message, len);
-            LoRaMacStatus_t status = lora.send(1, message, len, confirmation);
+            LoRaMacStatus_t status = lora.send(port, message, len, confirmation);
             if (status == LORAMAC_STATUS_OK) {
               Serial.println(F("Sending uplink packet"));
             } else {
@@ -49,8 +49,31 @@ class CubeCellLoRa {
         return seqNumber();
     }
 
+    // empty frame for pending MAC commands or downlinks, see isFlushPending()
+    void flush() {
+      if (lora.flush() == LORAMAC_STATUS_OK) {
+        Serial.println(F("Sending flush uplink"));
+      } else {
+        Serial.println(F("Flush failed"));
+      }
+    }
+
+    // LinkCheckReq in the next uplink, see linkCheck()
+    void requestLinkCheck() {
+      lora.requestLinkCheck();
+    }
+
+    LinkCheck linkCheck() {
+      return lora.linkCheck();
+    }
+
     unsigned long seqNumber() {
-      return 0;
+      return lora.upLinkCounter();
+    }
+
+    // joins again after the next reset
+    void forgetSession() {
+      lora.forgetSession();
     }
 
     void clear() {
@@ -64,6 +87,33 @@ class CubeCellLoRa {
       return lora.isTxPending();
     }
 
+    // the MAC asks for an uplink (MLME_SCHEDULE_UPLINK) or the server has more downlinks (FramePending)
+    bool isFlushPending() {
+      return lora.isFlushPending();
+    }
+
+    uint8_t maxPayload() {
+      return lora.maxPayload();
+    }
+
+    bool isWithinBudget(uint8_t len, bool confirmation, uint8_t priority) {
+      return lora.isWithinBudget(len, confirmation, priority);
+    }
+
+    AirtimeBudget& airtime() {
+      return lora.airtime();
+    }
+
+    // fixed datarate without ADR, SETTINGS_DATARATE_DEFAULT the one of the link quality (see DatarateManager.h)
+    // or DEFAULT_DATARATE with ADR
+    void setDatarate(uint8_t datarate) {
+      lora.setDatarate(datarate);
+    }
+
+    void onReceive(ReceiveHandler handler) {
+      lora.onReceive(handler);
+    }
+
   private:
     LoRaDirect lora = LoRaDirect();
   
@@ -0,0 +1,125 @@
+/**********************************************************
+ * Datarate of the uplinks from the link quality (EU868).
+ * ---
+ * Every link report is turned into the margin of the link
+ * at DR0 (SF12) in dB:
+ * - downlinks (data or ack): the smaller of the SNR above
+ *   the SF12 demodulation limit and the RSSI above the SF12
+ *   sensitivity
+ * - LinkCheckAns: the demodulation margin of the uplink at
+ *   the gateway plus the steps of its datarate
+ * Each datarate step costs DATARATE_STEP_TENTHS / 10 dB.
+ * The uplinks use the fastest datarate that keeps
+ * DATARATE_MARGIN dB of the average of the last reports.
+ * Without reports the datarate stays; it falls back one step
+ * after DATARATE_FAILURES unacknowledged confirmed frames or
+ * unanswered link checks in a row or DATARATE_STALE_UPLINKS
+ * uplinks without a report, and the history starts over.
+ * Used in place of the network ADR (DATARATE_ADAPTIVE 1),
+ * with DATARATE_ADAPTIVE 0 the wrappers keep the default
+ * datarate and the ADR of the MAC.
+ **********************************************************/
+#ifndef __DATARATEMANAGER_H__
+#define __DATARATEMANAGER_H__
+
+#include <stdint.h>
+
+#ifndef DATARATE_ADAPTIVE
+  #define DATARATE_ADAPTIVE 1
+#endif
+
+#define DATARATE_MIN            0     // DR0, SF12
+#define DATARATE_MAX            5     // DR5, SF7 125 kHz
+#define DATARATE_HISTORY        8     // reports averaged
+#define DATARATE_MIN_REPORTS    2     // before the first change
+#define DATARATE_MARGIN         6     // dB kept from the average margin
+#define DATARATE_STEP_TENTHS   25     // 1/10 dB margin per datarate step
+#define DATARATE_FAILURES       2     // unacknowledged confirmed frames
+#define DATARATE_STALE_UPLINKS 32     // uplinks without a report
+#define DATARATE_SNR_LIMIT    -20     // dB, SF12 demodulation limit
+#define DATARATE_RSSI_LIMIT  -137     // dBm, SF12 sensitivity at 125 kHz
+
+class DatarateManager {
+  public:
+    void begin(uint8_t datarate) {
+      current = datarate;
+      count = 0;
+      next = 0;
+      failures = 0;
+      silentUplinks = 0;
+    }
+
+    // downlink received by the node, RSSI in dBm, SNR in dB
+    void addDownlink(int16_t rssi, int8_t snr) {
+      int16_t snrMargin = snr - DATARATE_SNR_LIMIT;
+      int16_t rssiMargin = rssi - DATARATE_RSSI_LIMIT;
+      add(snrMargin < rssiMargin ? snrMargin : rssiMargin);
+    }
+
+    // LinkCheckAns of an uplink at datarate, margin in dB
+    void addLinkCheck(uint8_t margin, uint8_t datarate) {
+      add(margin + (int16_t)datarate * DATARATE_STEP_TENTHS / 10);
+    }
+
+    // result of a confirmed uplink or a link check
+    void addConfirmation(bool acknowledged) {
+      if (acknowledged) {
+        failures = 0;
+      } else if (++failures >= DATARATE_FAILURES) {
+        fallBack();
+      }
+    }
+
+    // every uplink
+    void addUplink() {
+      if (++silentUplinks >= DATARATE_STALE_UPLINKS) {
+        fallBack();
+      }
+    }
+
+    inline
+    uint8_t datarate() { return current; }
+
+    // average margin at DR0 in dB, 0 without reports
+    int16_t margin() {
+      if (count == 0) return 0;
+      int16_t sum = 0;
+      for (uint8_t i = 0; i < count; i++) sum += history[i];
+      return sum / count;
+    }
+
+  private:
+    int8_t history[DATARATE_HISTORY];
+    uint8_t count = 0;
+    uint8_t next = 0;
+    uint8_t current = DATARATE_MIN;
+    uint8_t failures = 0;
+    uint8_t silentUplinks = 0;
+
+    void add(int16_t report) {
+      history[next] = report < -128 ? -128 : report > 127 ? 127 : report;
+      next = (next + 1) % DATARATE_HISTORY;
+      if (count < DATARATE_HISTORY) count++;
+      silentUplinks = 0;
+      if (count >= DATARATE_MIN_REPORTS) {
+        current = fastest(margin());
+      }
+    }
+
+    static uint8_t fastest(int16_t margin) {
+      int16_t spare = margin - DATARATE_MARGIN;
+      if (spare <= 0) return DATARATE_MIN;
+      int16_t steps = spare * 10 / DATARATE_STEP_TENTHS;
+      return steps < DATARATE_MAX - DATARATE_MIN ? DATARATE_MIN + steps : DATARATE_MAX;
+    }
+
+    void fallBack() {
+      if (current > DATARATE_MIN) current--;
+      count = 0;
+      next = 0;
+      failures = 0;
+      silentUplinks = 0;
+    }
+};
+
+#endif
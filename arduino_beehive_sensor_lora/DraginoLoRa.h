@@ -11,6 +11,29 @@
 #include <lmic.h>
 #include <hal/hal.h>
 #include "credentials.h"
+#include "AirtimeBudget.h"
+#include "DatarateManager.h"
+
+#define CONFIRMED_TRIALS 8  // TXCONF_ATTEMPTS of LMIC
+#define DEFAULT_DATARATE DR_SF12
+#define LINK_CHECK_UPLINKS 3  // with ADRACKReq until the check fails, the network may answer a later one
+
+// application payload of a downlink
+typedef void (*ReceiveHandler)(uint8_t port, const uint8_t* data, uint8_t size);
+ReceiveHandler receiveHandler = 0;
+// link reports of onEvent()
+DatarateManager datarates;
+// airtime of the frames completed in onEvent()
+AirtimeBudget airtimeBudget;
+u1_t sentLength = 0;
+dr_t sentDatarate = DEFAULT_DATARATE;
+
+// state of requestLinkCheck(), answered in the downlink of the next uplink
+typedef enum { LINK_CHECK_NONE, LINK_CHECK_PENDING, LINK_CHECK_PASSED, LINK_CHECK_FAILED } LinkCheck;
+LinkCheck linkCheckState = LINK_CHECK_NONE;
+bool linkCheckSent = false;
+u1_t linkCheckUplinks = 0;  // sent without a downlink
+u4_t sentSeqnoDn = 0;  // a received downlink increments it
 
 // Pin mapping Dragino Shield
 const lmic_pinmap lmic_pins = {
@@ -23,7 +46,8 @@ const lmic_pinmap lmic_pins = {
 class DraginoLoRa {
   public:
 
-    void begin() {
+    void begin(TimeFunction time) {
+      airtimeBudget.begin(time);
       os_init();
   
       // Set up the channels used by the things network - EU863-870
@@ -38,14 +62,15 @@ class DraginoLoRa {
       LMIC_setupChannel(7, 867900000, DR_RANGE_MAP(DR_SF12, DR_SF7),  BAND_CENTI);      // g-band
       LMIC_setupChannel(8, 868800000, DR_RANGE_MAP(DR_FSK,  DR_FSK),  BAND_MILLI);      // g2-band
 
-      // Disable link check validation
-      LMIC_setLinkCheckMode(0);
-  
       // TTN uses SF9 for its RX2 window.
       LMIC.dn2Dr = DR_SF9;
 
       // Reset the MAC state. Session and pending data transfers will be discarded.
       LMIC_reset();
+      datarates.begin(DEFAULT_DATARATE);
+      linkCheckState = LINK_CHECK_NONE;
+      linkCheckSent = false;
+      linkCheckUplinks = 0;
     }
 
     void tick() {
@@ -54,8 +79,26 @@ class DraginoLoRa {
 
     void join() {
       Serial.println(F("ABP join"));
-      LMIC_setSession (0x1, DEVADDR, NWKSKEY, APPSKEY);
-      LMIC_setDrTxpow(DR_SF12, 14); // note: txpow seems to be ignored by the library
+      // device address msb first as shown by the network server
+      devaddr_t address = (devaddr_t)DEVADDR[0] << 24 | (devaddr_t)DEVADDR[1] << 16 | DEVADDR[2] << 8 | DEVADDR[3];
+      LMIC_setSession (0x1, address, NWKSKEY, APPSKEY);
+      // ADRACKReq after silent uplinks, EV_LINK_DEAD without answer, see requestLinkCheck()
+      LMIC_setLinkCheckMode(1);
+      if (fixedDatarate || DATARATE_ADAPTIVE) LMIC_setAdrMode(0);
+      LMIC_setDrTxpow(uplinkDatarate(), 14); // note: txpow seems to be ignored by the library
+    }
+
+    // DR_SF12..DR_SF7 without ADR, others the datarate of the link quality (see DatarateManager.h)
+    // or DEFAULT_DATARATE with ADR
+    void setDatarate(uint8_t dr) {
+      fixedDatarate = dr <= DR_SF7;
+      datarate = fixedDatarate ? dr : (uint8_t)DEFAULT_DATARATE;
+      LMIC_setAdrMode(fixedDatarate || DATARATE_ADAPTIVE ? 0 : 1);
+      LMIC_setDrTxpow(uplinkDatarate(), 14);
+    }
+
+    void onReceive(ReceiveHandler handler) {
+      receiveHandler = handler;
     }
 
     void reset(unsigned long seqNumber) {
@@ -68,7 +111,7 @@ class DraginoLoRa {
       LMIC.seqnoUp = seqNumber;
     }
 
-    unsigned long send(uint8_t *message, uint8_t len, bool confirmation) {
+    unsigned long send(uint8_t *message, uint8_t len, bool confirmation, uint8_t port = 1) {
         // Check if there is not a current TX/RX job running
         if (isTransmitting()) {
             Serial.println(F("OP_TXRXPEND, not sending"));
@@ -76,36 +119,93 @@ class DraginoLoRa {
             // Prepare upstream data transmission at the next possible time.
             Serial.print(F("Message: "));
             printBufferAsString(message, len); 
-            LMIC_setTxData2(1, message, len, confirmation ? 1 : 0);
+            if (!fixedDatarate && DATARATE_ADAPTIVE) LMIC_setDrTxpow(uplinkDatarate(), 14);
+            if (linkCheckState == LINK_CHECK_PENDING) {
+              // ADRACKReq in this frame, LMIC counts from the first one to EV_LINK_DEAD
+              if (LMIC.adrAckReq < 0) LMIC.adrAckReq = 0;
+              linkCheckSent = true;
+            }
+            sentSeqnoDn = LMIC.seqnoDn;
+            sentLength = len;
+            sentDatarate = LMIC.datarate;
+            LMIC_setTxData2(port, message, len, confirmation ? 1 : 0);
             Serial.println(F("Sending uplink packet"));
         }
         return seqNumber();
     }
 
+    // LMIC answers MAC commands in the next frame and does not report pending downlinks
+    void flush() {
+    }
+
+    // LMIC sends no LinkCheckReq: the ADRACKReq bit of the next uplinks asks the network for a downlink,
+    // the check fails after LINK_CHECK_UPLINKS of them without one, see linkCheck()
+    void requestLinkCheck() {
+      if (linkCheckState != LINK_CHECK_PENDING) {
+        linkCheckState = LINK_CHECK_PENDING;
+        linkCheckSent = false;
+        linkCheckUplinks = 0;
+      }
+    }
+
+    LinkCheck linkCheck() {
+      return linkCheckState;
+    }
+
     unsigned long seqNumber() {
       return LMIC.seqnoUp;
     }
 
     void clear() {
       LMIC_clrTxData();
+      linkCheckSent = false;
     }
 
     bool isTransmitting() {
       return LMIC.opmode & OP_TXRXPEND;
     }
 
+    bool isFlushPending() {
+      return false;
+    }
+
     bool isJoining() {
       return false;
     }
 
+    // EU868 application payload size of the next uplink
+    uint8_t maxPayload() {
+      static const uint8_t MAX_PAYLOAD[] = { 51, 51, 51, 115, 222, 222, 222 };
+      dr_t dr = uplinkDatarate();
+      return dr < sizeof(MAX_PAYLOAD) ? MAX_PAYLOAD[dr] : 51;
+    }
+
+    // LMIC sends all trials of a confirmed frame, its worst case has to fit
+    bool isWithinBudget(uint8_t len, bool confirmation, uint8_t priority) {
+      uint32_t airtime = AirtimeBudget::trialsTime(uplinkDatarate(), len, confirmation ? CONFIRMED_TRIALS : 1);
+      return airtimeBudget.allows(airtime, priority);
+    }
+
+    AirtimeBudget& airtime() {
+      return airtimeBudget;
+    }
+
   private:
+    dr_t datarate = DEFAULT_DATARATE;
+    bool fixedDatarate = false;
+
+    dr_t uplinkDatarate() {
+      if (fixedDatarate || !DATARATE_ADAPTIVE) return datarate;
+      return datarates.datarate();
+    }
+
     void printBufferAsString(byte* buffer, int length) {
-      Serial.print("\"");
+      Serial.print('"');
       for (uint8_t i = 0; i < length; i++) {
-        if (buffer[i] < 16) Serial.print("0");
+        if (buffer[i] < 16) Serial.print('0');
         Serial.print(buffer[i], HEX);
       }
-      Serial.println("\"");
+      Serial.println('"');
     }
 
 };
@@ -117,10 +217,31 @@ void onEvent(ev_t ev) {
         if (LMIC.txrxFlags & TXRX_ACK) {
           Serial.println(F("Received ack"));
         }
+        // RSSI + 64 and SNR * 4 of the SX127x registers
+        bool received = LMIC.seqnoDn != sentSeqnoDn;
+        if (received) {
+          datarates.addDownlink(LMIC.rssi - 64, LMIC.snr / 4);
+        }
+        if (linkCheckSent) {
+          linkCheckSent = false;
+          if (received || ++linkCheckUplinks >= LINK_CHECK_UPLINKS) {
+            linkCheckState = received ? LINK_CHECK_PASSED : LINK_CHECK_FAILED;
+            datarates.addConfirmation(received);
+          }
+        }
+        if (LMIC.pendTxConf) {
+          datarates.addConfirmation(LMIC.txrxFlags & TXRX_ACK);
+        }
+        datarates.addUplink();
+        // all trials of a confirmed frame, the datarate steps down like AirtimeBudget::trialsTime()
+        airtimeBudget.add(AirtimeBudget::trialsTime(sentDatarate, sentLength, LMIC.txCnt + 1));
         if (LMIC.dataLen) {
-          Serial.println(F("Received "));
-          Serial.println(LMIC.dataLen);
+          Serial.print(F("Received "));
+          Serial.print(LMIC.dataLen);
           Serial.println(F(" bytes of payload"));
+          if ((LMIC.txrxFlags & TXRX_PORT) && receiveHandler != 0) {
+            receiveHandler(LMIC.frame[LMIC.dataBeg - 1], LMIC.frame + LMIC.dataBeg, LMIC.dataLen);
+          }
         }
     } else if (ev == EV_SCAN_TIMEOUT) {
         Serial.println(F("EV_SCAN_TIMEOUT"));
@@ -156,8 +277,8 @@ void onEvent(ev_t ev) {
 // These callbacks are only used in over-the-air activation, so they are
 // left empty here (we cannot leave them out completely unless
 // DISABLE_JOIN is set in config.h, otherwise the linker will complain).
-void os_getArtEui (u1_t* buf) { }
-void os_getDevEui (u1_t* buf) { }
-void os_getDevKey (u1_t* buf) { }
+void os_getArtEui (u1_t* /* buf */) { }
+void os_getDevEui (u1_t* /* buf */) { }
+void os_getDevKey (u1_t* /* buf */) { }
 
 #endif
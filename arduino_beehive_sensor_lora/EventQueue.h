@@ -0,0 +1,75 @@
+/**********************************************************
+ * Lock-free queue of events from interrupt context.
+ * ---
+ * Ring of SIZE entries (a power of 2 up to 128) with a
+ * single producer (the interrupts) and a single consumer
+ * (the loop). The producer only writes the head, the
+ * consumer only the tail, both one byte wide, so the
+ * consumer does not disable interrupts: an entry is written
+ * before the head publishes it and read before the tail
+ * releases it. A full queue drops the event and counts it.
+ * AVR: interrupts do not preempt each other, push() is a
+ * single producer as is.
+ * CubeCell: the NVIC of the Cortex-M0 lets an interrupt of
+ * higher priority preempt another (eg. the RTC timer and the
+ * button GPIO), push() disables interrupts instead of
+ * relying on equal priorities set by the core.
+ **********************************************************/
+#ifndef __EVENTQUEUE_H__
+#define __EVENTQUEUE_H__
+
+#include <stdint.h>
+#if defined(__ASR6501__)
+  #include <Arduino.h>
+#endif
+
+template <typename EVENT, uint8_t SIZE>
+class EventQueue {
+  public:
+    // producer: interrupt context
+    bool push(EVENT event) {
+      #if defined(__ASR6501__)
+        noInterrupts();
+        bool pushed = pushEvent(event);
+        interrupts();
+        return pushed;
+      #else
+        return pushEvent(event);
+      #endif
+    }
+
+    // consumer: the loop
+    bool pop(EVENT* event) {
+      uint8_t tail = this->tail;
+      if (tail == head) return false;
+      *event = events[tail & (SIZE - 1)];
+      this->tail = tail + 1;
+      return true;
+    }
+
+    inline
+    bool isEmpty() { return tail == head; }
+
+    // events lost in a full queue
+    inline
+    uint8_t lost() { return dropped; }
+
+  private:
+    bool pushEvent(EVENT event) {
+      uint8_t head = this->head;
+      if ((uint8_t)(head - tail) >= SIZE) {
+        if (dropped < 0xFF) dropped++;
+        return false;
+      }
+      events[head & (SIZE - 1)] = event;
+      this->head = head + 1;
+      return true;
+    }
+
+    volatile EVENT events[SIZE];
+    volatile uint8_t head = 0;
+    volatile uint8_t tail = 0;
+    volatile uint8_t dropped = 0;
+};
+
+#endif
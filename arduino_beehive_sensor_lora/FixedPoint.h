@@ -0,0 +1,147 @@
+/**********************************************************
+ * Integer conversion of the raw sensor readings to the
+ * 1/100 units of the sensor message.
+ * ---
+ * The ATmega has no FPU, the float path pulls in soft-float
+ * code. Differences to the float path of asShort():
+ * - temperature: DS18B20 raw value in 1/128 C (as returned
+ *   by DallasTemperature::getTemp), bit-exact
+ * - voltage: mV, exact; the float path truncates x/1000.0
+ *   and may be 1/100 V lower
+ * - humidity, roof temperature: the DHT library returns
+ *   floats only, rounded to the 1/10 of the sensor instead
+ *   of truncated; the float path may be 1/100 lower
+ * - weight: the rational (sum - n*offset) / (n*divider) is
+ *   exact, the temperature compensation is a Q16 factor in
+ *   1/100 kg per 1/128 C, the result is within 1/100 kg
+ * Undefined readings become UNDEFINED_VALUE.
+ * The load cell drift may instead follow a piecewise linear
+ * model of CompensationPoints (PROGMEM on AVR) over the outer
+ * temperature, optionally filtered by lag() for the thermal
+ * lag of the load cell; compensation-fit of the simulator
+ * fits both to recorded data.
+ * Shared by the sketch and the host tests (beehive-simulator).
+ **********************************************************/
+#ifndef __FIXEDPOINT_H__
+#define __FIXEDPOINT_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVR__)
+  #include <avr/pgmspace.h>
+#else
+  #ifndef PROGMEM
+    #define PROGMEM
+  #endif
+  #ifndef memcpy_P
+    #define memcpy_P memcpy
+  #endif
+#endif
+
+#ifndef UNDEFINED_VALUE
+  #define UNDEFINED_VALUE -32768
+#endif
+
+#define FIXED_DISCONNECTED_RAW -7040  // DEVICE_DISCONNECTED_RAW, -55 C
+#define FIXED_WEIGHT_FRACTION     16  // 1/16 of 1/100 kg while compensating
+#define FIXED_LAG_FRACTION        16  // 1/16 of 1/128 C of the filtered temperature
+#define FIXED_LAG_ALPHA         4096  // Q12 weight of the new reading
+
+// compile-time constants of the float calibration, see calibration.h
+#define FIXED_COMPENSATION_FACTOR(factor) ((int32_t)((factor) * 51200.0 + ((factor) < 0 ? -0.5 : 0.5)))
+#define FIXED_COMPENSATION_OFFSET(offset) ((int32_t)((offset) * 100.0 * FIXED_WEIGHT_FRACTION + ((offset) < 0 ? -0.5 : 0.5)))
+#define FIXED_COMPENSATION_POINT(celsius, drift) \
+  { (int16_t)((celsius) * 128.0 + ((celsius) < 0 ? -0.5 : 0.5)), FIXED_COMPENSATION_OFFSET(drift) }
+
+typedef struct {
+  int16_t temperature;  // 1/128 C, ascending
+  int32_t drift;        // 1/16 of 1/100 kg, FIXED_COMPENSATION_OFFSET
+} CompensationPoint;
+
+typedef struct {
+  int32_t offset;    // raw reading with zero weight
+  int32_t divider;   // raw counts per kg
+  int32_t factor;    // 1/100 kg per 1/128 C in Q16, FIXED_COMPENSATION_FACTOR
+  int32_t constant;  // 1/16 of 1/100 kg, FIXED_COMPENSATION_OFFSET
+  const CompensationPoint* points;  // replaces factor and constant with 2 or more points
+  uint8_t pointCount;
+} WeightCalibration;
+
+class FixedPoint {
+  public:
+    // 1/128 C to 1/100 C, raw * 100 / 128 truncated like the float path
+    static int16_t temperature(int16_t raw) {
+      if (raw <= FIXED_DISCONNECTED_RAW) return UNDEFINED_VALUE;
+      return (int32_t)raw * 25 / 32;
+    }
+
+    // mV to 1/100 V
+    static int16_t voltage(int32_t millivolts) {
+      return millivolts / 10;
+    }
+
+    // DHT value with a resolution of 1/10 to 1/100
+    static int16_t tenths(float value) {
+      if (value != value) return UNDEFINED_VALUE;  // NaN
+      int16_t tenths = value < 0 ? (int16_t)(value * 10 - 0.5f) : (int16_t)(value * 10 + 0.5f);
+      return tenths * 10;
+    }
+
+    // average of samples raw readings minus the compensation at the outer temperature (1/128 C),
+    // undefined for a divider of 0 (uncalibrated)
+    static int16_t weight(int32_t sum, uint8_t samples, int32_t outerRaw, const WeightCalibration& calibration) {
+      if (samples == 0 || calibration.divider == 0) return UNDEFINED_VALUE;
+      int32_t counts = sum - (int32_t)samples * calibration.offset;
+      int32_t divisor = (int32_t)samples * calibration.divider;
+      // counts * 100 * 16 / divisor without overflow
+      int32_t whole = counts / divisor;
+      int32_t rest = counts % divisor;
+      int32_t scaled = whole * 100 * FIXED_WEIGHT_FRACTION + rest * 100 / divisor * FIXED_WEIGHT_FRACTION
+                     + (rest * 100 % divisor) * FIXED_WEIGHT_FRACTION / divisor;
+      if (outerRaw > FIXED_DISCONNECTED_RAW) {
+        scaled -= drift(outerRaw, calibration);
+      }
+      return scaled / FIXED_WEIGHT_FRACTION;
+    }
+
+    // load cell drift in 1/16 of 1/100 kg at the outer temperature (1/128 C),
+    // interpolated between the points, extrapolated by the outer segments
+    static int32_t drift(int32_t outerRaw, const WeightCalibration& calibration) {
+      if (calibration.pointCount < 2) {
+        return calibration.factor * outerRaw / (65536 / FIXED_WEIGHT_FRACTION) + calibration.constant;
+      }
+      CompensationPoint lower, upper;
+      memcpy_P(&lower, calibration.points, sizeof(lower));
+      memcpy_P(&upper, calibration.points + 1, sizeof(upper));
+      for (uint8_t i = 2; i < calibration.pointCount && outerRaw > upper.temperature; i++) {
+        lower = upper;
+        memcpy_P(&upper, calibration.points + i, sizeof(upper));
+      }
+      int32_t span = upper.temperature - lower.temperature;
+      if (span <= 0) return lower.drift;
+      return lower.drift + (upper.drift - lower.drift) * (outerRaw - lower.temperature) / span;
+    }
+
+    // first order low pass of the temperature (1/128 C) with the time constant lagMs,
+    // filtered in 1/FIXED_LAG_FRACTION of 1/128 C, starts at the first connected reading
+    static int32_t lag(int32_t filtered, bool started, int16_t raw, uint32_t elapsedMs, uint32_t lagMs) {
+      if (raw <= FIXED_DISCONNECTED_RAW) return filtered;
+      int32_t reading = (int32_t)raw * FIXED_LAG_FRACTION;
+      uint32_t lagSeconds = lagMs / 1000;
+      if (!started || lagSeconds == 0) return reading;
+      // alpha = elapsed / (lag + elapsed) in seconds, settled after 8 time constants,
+      // 32 bit for a lag up to 36 h
+      uint32_t elapsed = elapsedMs / 1000;
+      if (elapsed / 8 >= lagSeconds) return reading;
+      int32_t alpha = elapsed * FIXED_LAG_ALPHA / (lagSeconds + elapsed);
+      return filtered + (reading - filtered) * alpha / FIXED_LAG_ALPHA;
+    }
+
+    // filtered temperature of lag() in 1/128 C
+    static int16_t lagged(int32_t filtered) {
+      return filtered / FIXED_LAG_FRACTION;
+    }
+};
+
+#endif
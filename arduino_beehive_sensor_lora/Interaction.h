@@ -4,6 +4,11 @@
  * ---
  * Arduino Uno/Dragino Mini Dev: Only digital pins 2/3 can
  * be used with interrupts.
+ * The interrupt only notes the first edge of a press with
+ * its time, the bounces until it is checked in the loop are
+ * ignored; the button counts as pressed if it is still down
+ * BUTTON_DEBOUNCE ms after the edge. The loop does not wait
+ * for it, the check is queued again until then.
  * - capacitor (eg. 200nF) parallel to the button to debounce?
  **********************************************************/
 #ifndef __INTERACTION_H__
@@ -18,6 +23,7 @@
   #define BUTTON_INTERRUPT digitalPinToInterrupt(BUTTON_PIN)
   #define LED_PIN    A2
 #endif
+#define BUTTON_DEBOUNCE 5  // ms
 
 #if(LoraWan_RGB==1)
 #include "CubeCell_NeoPixel.h"
@@ -67,9 +73,27 @@ class Interaction {
       attachInterrupt(BUTTON_INTERRUPT, handler, FALLING);
     }
 
+    // interrupt context: true on the first edge of a press
+    bool notePress() {
+      if (pressPending) return false;
+      pressPending = true;
+      pressMs = millis();
+      return true;
+    }
+
+    // interrupt context: a press that could not be handled
+    inline
+    void forgetPress() { pressPending = false; }
+
+    // loop context: BUTTON_DEBOUNCE ms passed since the edge
+    inline
+    bool isPressSettled() { return millis() - pressMs >= BUTTON_DEBOUNCE; }
+
+    // loop context: still down once settled (see isPressSettled()), the next edge starts a new press
     bool checkSwitchPressed() {
-      delayMicroseconds(5000);
-      return ! digitalRead(BUTTON_PIN);
+      bool pressed = ! digitalRead(BUTTON_PIN);
+      pressPending = false;
+      return pressed;
     }
 
     void setLed(bool state) {
@@ -82,6 +106,10 @@ class Interaction {
         }
       #endif
     }
+
+  private:
+    volatile bool pressPending = false;
+    volatile unsigned long pressMs = 0;
 };
 
 #endif
@@ -0,0 +1,190 @@
+/**********************************************************
+ * Append-only journal of the sensor samples in
+ * non-volatile memory.
+ * ---
+ * Every sample is written to the next of SLOTS fixed size
+ * records of a ring (see JournalStore.h for the flash rows
+ * and the EEPROM), with a 16 bit sequence number, the node
+ * time in minutes and the sequence of the last sample known
+ * to be delivered. Record layout (little endian):
+ *  sequence (2), minutes (3), acknowledged (2),
+ *  values (2 per field, 1/100 units), checksum (2)
+ * A record with a wrong checksum is not part of the journal.
+ * begin() finds the newest record after a reset, appends
+ * continue behind it; the node time continues at its
+ * minutes (time without power is not counted). The
+ * acknowledged sequence is kept in RAM and written with the
+ * next sample, a reset before loses it and samples are sent
+ * twice at worst. Storing into a full ring overwrites the
+ * oldest record.
+ * Shared by the sketch and the host tests (beehive-simulator).
+ **********************************************************/
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <stdint.h>
+
+#define JOURNAL_HEADER_SIZE 7
+#define JOURNAL_RECORD_SIZE(fields) (JOURNAL_HEADER_SIZE + 2 * (fields) + 2)
+#define JOURNAL_MAX_MINUTES 0xFFFFFFUL  // 24 bit, ~31 years
+
+// sequence a before b, with wrap around
+inline bool isSequenceBefore(uint16_t a, uint16_t b) {
+  return (int16_t)(a - b) < 0;
+}
+
+template <class Storage, uint16_t SLOTS, uint8_t FIELDS>
+class Journal {
+  public:
+    typedef struct {
+      uint16_t sequence;
+      uint32_t minutes;       // node time
+      uint16_t acknowledged;  // delivered up to this sequence when written
+      int16_t  values[FIELDS];
+    } Record;
+
+    static const uint8_t RECORD_SIZE = JOURNAL_RECORD_SIZE(FIELDS);
+
+    // finds the newest record, false if the journal is empty
+    bool begin() {
+      stored = 0;
+      head = 0;
+      nextSequence = 0;
+      acked = nextSequence - 1;
+      startMinutes = 0;
+      bool found = false;
+      Record newest;
+      for (uint16_t slot = 0; slot < SLOTS; slot++) {
+        Record record;
+        if (!load(slot, &record)) continue;
+        if (!found || isSequenceBefore(newest.sequence, record.sequence)) {
+          newest = record;
+          head = (slot + 1) % SLOTS;
+          found = true;
+        }
+      }
+      if (!found) return false;
+      nextSequence = newest.sequence + 1;
+      acked = newest.acknowledged;
+      startMinutes = newest.minutes;
+      // the consecutive records before the newest one
+      while (stored < SLOTS) {
+        Record record;
+        uint16_t slot = (head + SLOTS - 1 - stored) % SLOTS;
+        if (!load(slot, &record) || record.sequence != (uint16_t)(newest.sequence - stored)) break;
+        stored++;
+      }
+      if (isSequenceBefore(acked, oldest() - 1)) {
+        acked = oldest() - 1;
+      }
+      return true;
+    }
+
+    // returns the sequence of the sample
+    uint16_t append(const int16_t* values, uint32_t minutes) {
+      Record record;
+      record.sequence = nextSequence++;
+      record.minutes = minutes & JOURNAL_MAX_MINUTES;
+      record.acknowledged = acked;
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        record.values[i] = values[i];
+      }
+      uint8_t bytes[RECORD_SIZE];
+      encode(record, bytes);
+      storage.write(head, bytes, RECORD_SIZE);
+      head = (head + 1) % SLOTS;
+      if (stored < SLOTS) stored++;
+      if (isSequenceBefore(acked, oldest() - 1)) {
+        acked = oldest() - 1;
+      }
+      return record.sequence;
+    }
+
+    // false if the sample is not in the journal (any more)
+    bool read(uint16_t sequence, Record* record) {
+      uint16_t age = (uint16_t)(nextSequence - 1 - sequence);
+      if (age >= stored) return false;
+      return load((head + SLOTS - 1 - age) % SLOTS, record) && record->sequence == sequence;
+    }
+
+    // all samples up to the sequence were delivered
+    void acknowledge(uint16_t sequence) {
+      if (isSequenceBefore(acked, sequence) && !isSequenceBefore(last(), sequence)) {
+        acked = sequence;
+      }
+    }
+
+    inline
+    uint16_t acknowledged() { return acked; }
+
+    inline
+    uint16_t oldest() { return nextSequence - stored; }
+
+    // sequence of the newest sample, oldest() - 1 if empty
+    inline
+    uint16_t last() { return nextSequence - 1; }
+
+    inline
+    uint16_t count() { return stored; }
+
+    // node time of the newest sample at begin(), the clock continues from there
+    inline
+    uint32_t minutesAtBegin() { return startMinutes; }
+
+    static void encode(const Record& record, uint8_t* bytes) {
+      writeShort(bytes, record.sequence);
+      writeShort(bytes + 2, record.minutes & 0xFFFF);
+      bytes[4] = (record.minutes >> 16) & 0xFF;
+      writeShort(bytes + 5, record.acknowledged);
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        writeShort(bytes + JOURNAL_HEADER_SIZE + 2 * i, (uint16_t)record.values[i]);
+      }
+      writeShort(bytes + RECORD_SIZE - 2, checksum(bytes));
+    }
+
+    // false if the checksum does not match
+    static bool decode(const uint8_t* bytes, Record* record) {
+      if (readShort(bytes + RECORD_SIZE - 2) != checksum(bytes)) return false;
+      record->sequence = readShort(bytes);
+      record->minutes = readShort(bytes + 2) | ((uint32_t)bytes[4] << 16);
+      record->acknowledged = readShort(bytes + 5);
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        record->values[i] = (int16_t)readShort(bytes + JOURNAL_HEADER_SIZE + 2 * i);
+      }
+      return true;
+    }
+
+  private:
+    Storage storage;
+    uint16_t head = 0;          // slot of the next record
+    uint16_t stored = 0;        // consecutive records up to the newest
+    uint16_t nextSequence = 0;
+    uint16_t acked = 0xFFFF;
+    uint32_t startMinutes = 0;
+
+    bool load(uint16_t slot, Record* record) {
+      uint8_t bytes[RECORD_SIZE];
+      storage.read(slot, bytes, RECORD_SIZE);
+      return decode(bytes, record);
+    }
+
+    static void writeShort(uint8_t* bytes, uint16_t value) {
+      bytes[0] = value & 0xFF;
+      bytes[1] = value >> 8;
+    }
+
+    static uint16_t readShort(const uint8_t* bytes) {
+      return bytes[0] | ((uint16_t)bytes[1] << 8);
+    }
+
+    // FNV-1a of the record without the checksum, folded to 16 bit
+    static uint16_t checksum(const uint8_t* bytes) {
+      uint32_t hash = 2166136261UL;
+      for (uint8_t i = 0; i < RECORD_SIZE - 2; i++) {
+        hash = (hash ^ bytes[i]) * 16777619UL;
+      }
+      return (hash >> 16) ^ (hash & 0xFFFF);
+    }
+};
+
+#endif
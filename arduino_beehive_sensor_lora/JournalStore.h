@@ -0,0 +1,66 @@
+/**********************************************************
+ * Non-volatile slots of the sample journal, see Journal.h.
+ * ---
+ * CubeCell: JOURNAL_FLASH_ROWS flash rows below the session
+ * rows (see SessionStore.h), whole records per row. The
+ * ring moves on row by row, so each row is erased once per
+ * record it holds on every pass over the journal (288
+ * records, 9 per row).
+ * AVR: the EEPROM behind the settings record (see
+ * SettingsStore.h), only the changed bytes are written.
+ **********************************************************/
+#ifndef __JOURNALSTORE_H__
+#define __JOURNALSTORE_H__
+
+#include <Arduino.h>
+#if !defined(__ASR6501__)
+  #include <avr/eeprom.h>
+#endif
+#include "Journal.h"
+
+#define JOURNAL_FLASH_ADDR    0x1C000  // SESSION_FLASH_ADDR - JOURNAL_FLASH_ROWS rows
+#define JOURNAL_FLASH_ROW     256
+#define JOURNAL_FLASH_ROWS    32
+#define JOURNAL_EEPROM_ADDR   32       // behind the settings record
+#define JOURNAL_EEPROM_SIZE   (1024 - JOURNAL_EEPROM_ADDR)
+
+#if defined(__ASR6501__)
+  #define JOURNAL_SLOTS(fields) (JOURNAL_FLASH_ROWS * (JOURNAL_FLASH_ROW / JOURNAL_RECORD_SIZE(fields)))
+#else
+  #define JOURNAL_SLOTS(fields) (JOURNAL_EEPROM_SIZE / JOURNAL_RECORD_SIZE(fields))
+#endif
+
+template <uint8_t RECORD_SIZE>
+class JournalStore {
+  public:
+    void read(uint16_t slot, uint8_t* data, uint8_t size) {
+      #if defined(__ASR6501__)
+        FLASH_read_at(address(slot), data, size);
+      #else
+        eeprom_read_block(data, (const void*)address(slot), size);
+      #endif
+    }
+
+    void write(uint16_t slot, const uint8_t* data, uint8_t size) {
+      #if defined(__ASR6501__)
+        FLASH_update(address(slot), data, size);
+      #else
+        eeprom_update_block(data, (void*)address(slot), size);
+      #endif
+    }
+
+  private:
+    #if defined(__ASR6501__)
+      uint32_t address(uint16_t slot) {
+        const uint16_t perRow = JOURNAL_FLASH_ROW / RECORD_SIZE;
+        return JOURNAL_FLASH_ADDR + (uint32_t)(slot / perRow) * JOURNAL_FLASH_ROW + (slot % perRow) * RECORD_SIZE;
+      }
+    #else
+      // EEPROM addresses are pointers of the eeprom_* functions
+      uintptr_t address(uint16_t slot) {
+        return JOURNAL_EEPROM_ADDR + (uintptr_t)slot * RECORD_SIZE;
+      }
+    #endif
+};
+
+#endif
@@ -22,8 +22,18 @@ LoRaMacCallback_t macCallback;
 
 boolean LoRaDirect::joinPending = false;
 boolean LoRaDirect::txPending = false;
+boolean LoRaDirect::flushPending = false;
+LinkCheck LoRaDirect::linkCheckState = LINK_CHECK_NONE;
+SessionStore LoRaDirect::store;
+SessionRecord LoRaDirect::session;
+AirtimeBudget LoRaDirect::budget;
+uint8_t LoRaDirect::txSize = 0;
+int8_t LoRaDirect::datarate = DATARATE_AUTO;
+DatarateManager LoRaDirect::manager;
+ReceiveHandler LoRaDirect::receiveHandler = NULL;
 
-void LoRaDirect::init() {
+void LoRaDirect::init(TimeFunction time) {
+  budget.begin(time);
   macPrimitive.MacMcpsConfirm = mcpsConfirm;
   macPrimitive.MacMcpsIndication = mcpsIndication;
   macPrimitive.MacMlmeConfirm = mlmeConfirm;
@@ -34,11 +44,18 @@ void LoRaDirect::init() {
 
   MibRequestConfirm_t mibReq;
   mibReq.Type = MIB_ADR;
-  mibReq.Param.AdrEnable = LORAWAN_ADR;
+  mibReq.Param.AdrEnable = DATARATE_ADAPTIVE ? false : LORAWAN_ADR;
   LoRaMacMibSetRequestConfirm( &mibReq );
+  manager.begin(DEFAULT_DATARATE);
 
   LoRaDirect::joinPending = false;
   LoRaDirect::txPending = false;
+  LoRaDirect::flushPending = false;
+  LoRaDirect::linkCheckState = LINK_CHECK_NONE;
+
+  if (!store.load(&session)) {
+    memset(&session, 0, sizeof(session));
+  }
 }
 
 void LoRaDirect::tick() {
@@ -85,6 +102,124 @@ void LoRaDirect::joinABP(uint32_t deviceAddress, uint8_t nwkSessionKey[], uint8_
 }
 
 
+// session of the last join from flash, false if there is none
+bool LoRaDirect::resumeSession() {
+  if (session.devAddr == 0) return false;
+  Serial.print("Resume session at counter "); Serial.println(session.upLinkLimit);
+
+  MibRequestConfirm_t mibReq;
+  mibReq.Type = MIB_NET_ID;
+  mibReq.Param.NetID = session.netId;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  mibReq.Type = MIB_DEV_ADDR;
+  mibReq.Param.DevAddr = session.devAddr;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  mibReq.Type = MIB_NWK_SKEY;
+  mibReq.Param.NwkSKey = session.nwkSKey;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  mibReq.Type = MIB_APP_SKEY;
+  mibReq.Param.AppSKey = session.appSKey;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  mibReq.Type = MIB_UPLINK_COUNTER;
+  mibReq.Param.UpLinkCounter = session.upLinkLimit;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  mibReq.Type = MIB_DOWNLINK_COUNTER;
+  mibReq.Param.DownLinkCounter = session.downLinkCounter;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  mibReq.Type = MIB_NETWORK_JOINED;
+  mibReq.Param.IsNetworkJoined = true;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+
+  // counters below the new limit may be used before the next save
+  saveSession(session.upLinkLimit + SESSION_FCNT_RESERVE);
+  LoRaDirect::joinPending = false;
+  return true;
+}
+
+// the next reset joins again
+void LoRaDirect::forgetSession() {
+  session.devAddr = 0;
+  store.save(&session);
+}
+
+uint32_t LoRaDirect::upLinkCounter() {
+  MibRequestConfirm_t mibReq;
+  mibReq.Type = MIB_UPLINK_COUNTER;
+  LoRaMacMibGetRequestConfirm( &mibReq );
+  return mibReq.Param.UpLinkCounter;
+}
+
+void LoRaDirect::saveSession(uint32_t upLinkLimit) {
+  MibRequestConfirm_t mibReq;
+  mibReq.Type = MIB_NET_ID;
+  LoRaMacMibGetRequestConfirm( &mibReq );
+  session.netId = mibReq.Param.NetID;
+
+  mibReq.Type = MIB_DEV_ADDR;
+  LoRaMacMibGetRequestConfirm( &mibReq );
+  session.devAddr = mibReq.Param.DevAddr;
+
+  mibReq.Type = MIB_NWK_SKEY;
+  LoRaMacMibGetRequestConfirm( &mibReq );
+  memcpy(session.nwkSKey, mibReq.Param.NwkSKey, sizeof(session.nwkSKey));
+
+  mibReq.Type = MIB_APP_SKEY;
+  LoRaMacMibGetRequestConfirm( &mibReq );
+  memcpy(session.appSKey, mibReq.Param.AppSKey, sizeof(session.appSKey));
+
+  mibReq.Type = MIB_DOWNLINK_COUNTER;
+  LoRaMacMibGetRequestConfirm( &mibReq );
+  session.downLinkCounter = mibReq.Param.DownLinkCounter;
+
+  session.upLinkLimit = upLinkLimit;
+  store.save(&session);
+}
+
+// application payload size of the next uplink, less pending MAC commands
+uint8_t LoRaDirect::maxPayload() {
+  selectDatarate();
+  LoRaMacTxInfo_t txInfo;
+  LoRaMacQueryTxPossible(0, &txInfo);
+  return txInfo.MaxPossiblePayload;
+}
+
+// DR_0..DR_5 without ADR, others DATARATE_AUTO
+void LoRaDirect::setDatarate(uint8_t datarate) {
+  bool fixed = datarate <= DR_5;
+  LoRaDirect::datarate = fixed ? (int8_t)datarate : DATARATE_AUTO;
+  MibRequestConfirm_t mibReq;
+  mibReq.Type = MIB_ADR;
+  mibReq.Param.AdrEnable = fixed || DATARATE_ADAPTIVE ? false : LORAWAN_ADR;
+  LoRaMacMibSetRequestConfirm( &mibReq );
+}
+
+// the fixed datarate, the one of the link quality or DEFAULT_DATARATE with ADR
+int8_t LoRaDirect::uplinkDatarate() {
+  if (datarate != DATARATE_AUTO) return datarate;
+  return DATARATE_ADAPTIVE ? manager.datarate() : DEFAULT_DATARATE;
+}
+
+// the MAC checks the payload size against its datarate, set by the ADR or the last uplink
+void LoRaDirect::selectDatarate() {
+  if (datarate == DATARATE_AUTO && !DATARATE_ADAPTIVE) return;
+  MibRequestConfirm_t mibReq;
+  mibReq.Type = MIB_CHANNELS_DATARATE;
+  mibReq.Param.ChannelsDatarate = uplinkDatarate();
+  LoRaMacMibSetRequestConfirm( &mibReq );
+}
+
+// a confirmed frame needs the budget for at least one retransmission, send() limits the trials to the budget
+bool LoRaDirect::isWithinBudget(uint8_t messageSize, bool confirmReception, uint8_t priority) {
+  uint8_t trials = budget.affordableTrials(uplinkDatarate(), messageSize, confirmReception ? CONFIRMED_TRIALS : 1, priority);
+  return trials > (confirmReception ? 1 : 0);
+}
+
 LoRaMacStatus_t LoRaDirect::send(uint8_t applicationPort, uint8_t message[], uint8_t messageSize, bool confirmReception) {
   MibRequestConfirm_t mibReq;
   mibReq.Type = MIB_DEVICE_CLASS;
@@ -95,73 +230,132 @@ LoRaMacStatus_t LoRaDirect::send(uint8_t applicationPort, uint8_t message[], uin
     LoRaMacMibSetRequestConfirm( &mibReq );
   }
 
+  selectDatarate();
   McpsReq_t mcpsReq;
   LoRaMacTxInfo_t txInfo;
   if( LoRaMacQueryTxPossible( messageSize, &txInfo ) != LORAMAC_STATUS_OK ) {
-    // Send empty frame in order to flush MAC commands
-    mcpsReq.Type = MCPS_UNCONFIRMED;
-    mcpsReq.Req.Unconfirmed.fBuffer = NULL;
-    mcpsReq.Req.Unconfirmed.fBufferSize = 0;
-    mcpsReq.Req.Unconfirmed.Datarate = DEFAULT_DATARATE;
+    // pending MAC commands leave no room for the message, they go in a flush() frame of their own
+    LoRaDirect::flushPending = true;
+    return LORAMAC_STATUS_LENGTH_ERROR;
+  }
+  if( confirmReception ) {
+    mcpsReq.Type = MCPS_CONFIRMED;
+    mcpsReq.Req.Confirmed.fPort = applicationPort;
+    mcpsReq.Req.Confirmed.fBuffer = message;
+    mcpsReq.Req.Confirmed.fBufferSize = messageSize;
+    // retransmissions are low priority, at least the first trial is sent
+    uint8_t trials = budget.affordableTrials(uplinkDatarate(), messageSize, CONFIRMED_TRIALS, FRAME_PRIORITY_LOW);
+    mcpsReq.Req.Confirmed.NbTrials = trials > 0 ? trials : 1;
+    mcpsReq.Req.Confirmed.Datarate = uplinkDatarate();
   } else {
-    if( confirmReception ) {
-      mcpsReq.Type = MCPS_CONFIRMED;
-      mcpsReq.Req.Confirmed.fPort = applicationPort;
-      mcpsReq.Req.Confirmed.fBuffer = message;
-      mcpsReq.Req.Confirmed.fBufferSize = messageSize;
-      mcpsReq.Req.Confirmed.NbTrials = CONFIRMED_TRIALS;
-      mcpsReq.Req.Confirmed.Datarate = DEFAULT_DATARATE;
-    } else {
-      mcpsReq.Type = MCPS_UNCONFIRMED;
-      mcpsReq.Req.Unconfirmed.fPort = applicationPort;
-      mcpsReq.Req.Unconfirmed.fBuffer = message;
-      mcpsReq.Req.Unconfirmed.fBufferSize = messageSize;
-      mcpsReq.Req.Unconfirmed.Datarate = DEFAULT_DATARATE;
-    }
+    mcpsReq.Type = MCPS_UNCONFIRMED;
+    mcpsReq.Req.Unconfirmed.fPort = applicationPort;
+    mcpsReq.Req.Unconfirmed.fBuffer = message;
+    mcpsReq.Req.Unconfirmed.fBufferSize = messageSize;
+    mcpsReq.Req.Unconfirmed.Datarate = uplinkDatarate();
   }
   LoRaMacStatus_t status = LoRaMacMcpsRequest(&mcpsReq);
   if (status == LORAMAC_STATUS_OK) {
     LoRaDirect::txPending = true;
+    LoRaDirect::txSize = messageSize;
   }
   return status;
 }
 
+// empty unconfirmed frame, carries the pending MAC commands and opens the RX windows for pending downlinks
+LoRaMacStatus_t LoRaDirect::flush() {
+  McpsReq_t mcpsReq;
+  mcpsReq.Type = MCPS_UNCONFIRMED;
+  mcpsReq.Req.Unconfirmed.fBuffer = NULL;
+  mcpsReq.Req.Unconfirmed.fBufferSize = 0;
+  mcpsReq.Req.Unconfirmed.Datarate = uplinkDatarate();
+  LoRaMacStatus_t status = LoRaMacMcpsRequest(&mcpsReq);
+  if (status == LORAMAC_STATUS_OK) {
+    LoRaDirect::flushPending = false;
+    LoRaDirect::txPending = true;
+    LoRaDirect::txSize = 0;
+  }
+  return status;
+}
+
+// LinkCheckReq in the next uplink, the answer (or its absence) is reported by mlmeConfirm
+void LoRaDirect::requestLinkCheck() {
+  if (linkCheckState == LINK_CHECK_PENDING) return;
+  MlmeReq_t mlmeReq;
+  mlmeReq.Type = MLME_LINK_CHECK;
+  if (LoRaMacMlmeRequest( &mlmeReq ) == LORAMAC_STATUS_OK) {
+    linkCheckState = LINK_CHECK_PENDING;
+  }
+}
+
 void LoRaDirect::mcpsConfirm( McpsConfirm_t *mcpsConfirm ) { 
-  printStatus("MCPS Confirmation: ", mcpsConfirm->Status);
-  Serial.print("Datarate: "); Serial.println(mcpsConfirm->Datarate);
-  Serial.print("TxPower: "); Serial.println(mcpsConfirm->TxPower);
-  Serial.print("Retries: "); Serial.println(mcpsConfirm->NbRetries);
-  Serial.print("AckReceived: "); Serial.println(mcpsConfirm->AckReceived);
-  Serial.print("Counter: "); Serial.println(mcpsConfirm->UpLinkCounter);
+  printStatus(LOG_MCPS_CONFIRM, "MCPS Confirmation: ", mcpsConfirm->Status);
+  LOG_DEBUG(LOG_UPLINK, mcpsConfirm->Datarate, mcpsConfirm->NbRetries);
   LoRaDirect::txPending = false;
+  if (mcpsConfirm->McpsRequest == MCPS_CONFIRMED) {
+    manager.addConfirmation(mcpsConfirm->AckReceived);
+  }
+  manager.addUplink();
+
+  // conservative if the MAC reports the datarate of the last trial
+  uint8_t trials = mcpsConfirm->NbRetries > 0 ? mcpsConfirm->NbRetries : 1;
+  budget.add(AirtimeBudget::trialsTime(mcpsConfirm->Datarate, txSize, trials));
+  uint32_t lastHour = budget.lastHour();
+  uint32_t lastDay = budget.lastDay();
+  LOG_DEBUG(LOG_AIRTIME_HOUR, 0, (int16_t)(lastHour < INT16_MAX ? lastHour : INT16_MAX));
+  LOG_DEBUG(LOG_AIRTIME_DAY, 0, (int16_t)(lastDay < INT16_MAX ? lastDay : INT16_MAX));
+
+  uint32_t counter = upLinkCounter();
+  if (counter >= session.upLinkLimit) {
+    saveSession(counter + SESSION_FCNT_RESERVE);
+  }
 }
 
 void LoRaDirect::mlmeConfirm( MlmeConfirm_t *mlmeConfirm ) { 
-  printStatus("MLME Confirmation: ", mlmeConfirm->Status); 
+  printStatus(LOG_MLME_CONFIRM, "MLME Confirmation: ", mlmeConfirm->Status);
+  if (mlmeConfirm->MlmeRequest == MLME_LINK_CHECK) {
+    // answered in the downlink of a data frame, its airtime is accounted by mcpsConfirm
+    bool answered = mlmeConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK;
+    if (answered) {
+      manager.addLinkCheck(mlmeConfirm->DemodMargin, uplinkDatarate());
+      LOG_DEBUG(LOG_LINK_CHECK, mlmeConfirm->NbGateways, mlmeConfirm->DemodMargin);
+    }
+    manager.addConfirmation(answered);
+    linkCheckState = answered ? LINK_CHECK_PASSED : LINK_CHECK_FAILED;
+    return;
+  }
+  budget.add(mlmeConfirm->TxTimeOnAir * 1000);
   if (mlmeConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK) {
     Serial.println("Joined!");
     LoRaDirect::joinPending = false;
+    session.joins++;
+    saveSession(SESSION_FCNT_RESERVE);
   }
 }
 
 void LoRaDirect::mcpsIndication( McpsIndication_t *mcpsIndication ) {
-  printStatus("MCPS Indication: ", mcpsIndication->Status);
+  printStatus(LOG_MCPS_INDICATION, "MCPS Indication: ", mcpsIndication->Status);
   if( mcpsIndication->Status != LORAMAC_EVENT_INFO_STATUS_OK ) {
     return;
   }
 //  printf( "receive data: rssi = %d, snr = %d, datarate = %d\r\n", mcpsIndication->Rssi, (int)mcpsIndication->Snr,(int)mcpsIndication->RxDatarate);
+  manager.addDownlink(mcpsIndication->Rssi, mcpsIndication->Snr);
+  LOG_DEBUG(LOG_LINK_MARGIN, manager.datarate(), manager.margin());
 
   if( mcpsIndication->FramePending ) {
     // The server signals that it has pending data to be sent.
     // We schedule an uplink as soon as possible to flush the server.
     Serial.println("Frame pending");
-//    OnTxNextPacketTimerEvent();
+    LoRaDirect::flushPending = true;
   }
 
   if( mcpsIndication->RxData ) {
     Serial.print(mcpsIndication->RxSlot ? "RXWIN2 " : "RXWIN1 ");
     Serial.print(mcpsIndication->Port); Serial.print(": ");
     Serial.print(mcpsIndication->BufferSize); Serial.println(" bytes");
+    if (receiveHandler != NULL && mcpsIndication->Port > 0) {
+      receiveHandler(mcpsIndication->Port, mcpsIndication->Buffer, mcpsIndication->BufferSize);
+    }
 //    printf("+REV DATA:%s,RXSIZE %d,PORT %d\r\n",mcpsIndication->RxSlot?"RXWIN2":"RXWIN1",mcpsIndication->BufferSize,mcpsIndication->Port);
 //    printf("+REV DATA:");
 //    for( uint8_t i = 0; i < mcpsIndication->BufferSize; i++ ) {
@@ -172,11 +366,11 @@ void LoRaDirect::mcpsIndication( McpsIndication_t *mcpsIndication ) {
 }
 
 void LoRaDirect::mlmeIndication( MlmeIndication_t *mlmeIndication ) {
-  printStatus("MLME Indication: ", mlmeIndication->Status);
+  printStatus(LOG_MLME_INDICATION, "MLME Indication: ", mlmeIndication->Status);
   switch( mlmeIndication->MlmeIndication ) {
     case MLME_SCHEDULE_UPLINK: { // The MAC signals that we shall provide an uplink as soon as possible
       Serial.println("Schedule Uplink");
-//      OnTxNextPacketTimerEvent( );
+      LoRaDirect::flushPending = true;
       break;
     }
     default: {
@@ -185,7 +379,12 @@ void LoRaDirect::mlmeIndication( MlmeIndication_t *mlmeIndication ) {
   }
 }
 
-void LoRaDirect::printStatus( char* prefix, LoRaMacEventInfoStatus_t status ) {
+// deferred: the status code, the log decoder knows the names
+void LoRaDirect::printStatus( uint8_t callback, const char* prefix, LoRaMacEventInfoStatus_t status ) {
+  (void)callback; (void)prefix; (void)status;  // unused with some LOG_DEFERRED and LOG_LEVEL
+#if LOG_DEFERRED
+  LOG_DEBUG(LOG_MAC_STATUS, callback, status);
+#elif LOG_LEVEL >= LOG_LEVEL_DEBUG
   Serial.print(prefix);
   switch (status) {
     case LORAMAC_EVENT_INFO_STATUS_OK: {
@@ -257,6 +456,7 @@ void LoRaDirect::printStatus( char* prefix, LoRaMacEventInfoStatus_t status ) {
       break;
     }
   }
+#endif
 }
 
 
@@ -6,6 +6,10 @@
 #define __LORAMACDIRECT_H__
 
 #include <LoRaWan_102.h>
+#include "SessionStore.h"
+#include "AirtimeBudget.h"
+#include "DatarateManager.h"
+#include "Log.h"
 
 /*!
 * Number of trials to transmit the frame, if the LoRaMAC layer did not
@@ -33,26 +37,59 @@
  * Default datarate
  */
 #define DEFAULT_DATARATE DR_2
+#define DATARATE_AUTO    -1    // DatarateManager.h or ADR, see setDatarate()
+
+// application payload of a downlink
+typedef void (*ReceiveHandler)(uint8_t port, const uint8_t* data, uint8_t size);
+
+// state of requestLinkCheck(), answered in the downlink of the next uplink
+typedef enum { LINK_CHECK_NONE, LINK_CHECK_PENDING, LINK_CHECK_PASSED, LINK_CHECK_FAILED } LinkCheck;
 
 class LoRaDirect {
 public:
-    void init();
+    void init(TimeFunction time);
     void tick();
     void joinOTAA(uint8_t devEui[], uint8_t appEui[], uint8_t appKey[]);
     void joinABP(uint32_t deviceAddress, uint8_t nwkSessionKey[], uint8_t appSessionKey[]);
+    bool resumeSession();
+    void forgetSession();
+    static uint32_t upLinkCounter();
     LoRaMacStatus_t send(uint8_t applicationPort, uint8_t message[], uint8_t messageSize, bool confirmReception);
+    LoRaMacStatus_t flush();
+    void requestLinkCheck();
+    LinkCheck linkCheck() { return LoRaDirect::linkCheckState; }
     boolean isJoinPending() { return LoRaDirect::joinPending; }
     boolean isTxPending() { return LoRaDirect::txPending; }
+    boolean isFlushPending() { return LoRaDirect::flushPending; }
+    uint8_t maxPayload();
+    bool isWithinBudget(uint8_t messageSize, bool confirmReception, uint8_t priority);
+    AirtimeBudget& airtime() { return LoRaDirect::budget; }
+    DatarateManager& datarates() { return LoRaDirect::manager; }
+    void setDatarate(uint8_t datarate);
+    void onReceive(ReceiveHandler handler) { LoRaDirect::receiveHandler = handler; }
 
 private:
     static boolean joinPending;
     static boolean txPending;
+    static boolean flushPending;
+    static LinkCheck linkCheckState;
+    static SessionStore store;
+    static SessionRecord session;
+    static AirtimeBudget budget;
+    static uint8_t txSize;
+    static int8_t datarate;
+    static DatarateManager manager;
+    static ReceiveHandler receiveHandler;
+
+    static void saveSession(uint32_t upLinkLimit);
+    static int8_t uplinkDatarate();
+    static void selectDatarate();
 
     static void mcpsConfirm( McpsConfirm_t *mcpsConfirm );
     static void mlmeConfirm( MlmeConfirm_t *mlmeConfirm );
     static void mcpsIndication( McpsIndication_t *mcpsIndication );
     static void mlmeIndication( MlmeIndication_t *mlmeIndication );
-    static void printStatus( char* prefix, LoRaMacEventInfoStatus_t status );
+    static void printStatus( uint8_t callback, const char* prefix, LoRaMacEventInfoStatus_t status );
 };
 
 #endif
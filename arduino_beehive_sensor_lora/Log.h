@@ -0,0 +1,216 @@
+/**********************************************************
+ * Logging of the cyclic events with compile-time levels.
+ * ---
+ * LOG_LEVEL selects the events compiled in, the calls of
+ * higher levels compile to nothing:
+ *  0 none, 1 error, 2 info, 3 debug
+ * An event has an id (see LOG_EVENTS), an index (eg. the
+ * thermometer) and a 16 bit value (eg. 1/100 C).
+ * LOG_DEFERRED 0 prints the events as text at once.
+ * LOG_DEFERRED 1 writes them as 8 byte records (ms since
+ * boot, id, index, value) into a RAM ring of LOG_RING_SIZE
+ * records, the oldest are overwritten. Log::drain() prints
+ * them as "LOG <16 hex digits>" lines, in manual mode or on
+ * request; log-decoder of the beehive simulator turns them
+ * back into text.
+ * Shared by the sketch, LoRaMacDirect.cpp and the host
+ * tools, the ring is a single instance in all of them.
+ **********************************************************/
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdint.h>
+
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_INFO   2
+#define LOG_LEVEL_DEBUG  3
+
+#ifndef LOG_LEVEL
+  #define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+#ifndef LOG_DEFERRED
+  #define LOG_DEFERRED 1
+#endif
+#ifndef LOG_RING_SIZE
+  #if defined(__ASR6501__)
+    #define LOG_RING_SIZE 64
+  #else
+    #define LOG_RING_SIZE 16  // SRAM of the ATmega328
+  #endif
+#endif
+
+#define LOG_RECORD_SIZE  8
+#define LOG_PREFIX       "LOG "
+
+// id, name, divisor of the value, unit
+#define LOG_EVENTS(EVENT) \
+  EVENT(LOG_THERMOMETER,      "thermometer",      100, "C")  \
+  EVENT(LOG_ROOF_TEMPERATURE, "roof temperature", 100, "C")  \
+  EVENT(LOG_ROOF_HUMIDITY,    "roof humidity",    100, "%")  \
+  EVENT(LOG_WEIGHT,           "weight",           100, "kg") \
+  EVENT(LOG_BATTERY,          "battery",          100, "V")  \
+  EVENT(LOG_MAC_STATUS,       "mac status",         1, "")   \
+  EVENT(LOG_UPLINK,           "uplink at datarate", 1, "retries") \
+  EVENT(LOG_AIRTIME_HOUR,     "airtime last hour",  1, "ms") \
+  EVENT(LOG_AIRTIME_DAY,      "airtime last day",   1, "ms") \
+  EVENT(LOG_COMMAND,          "downlink command",   1, "status") \
+  EVENT(LOG_LINK_MARGIN,      "link margin at DR0", 1, "dB") \
+  EVENT(LOG_LINK_CHECK,       "link check gateways", 1, "dB margin") \
+  EVENT(LOG_UNUSED_STACK,     "unused stack",       1, "bytes")
+
+#define LOG_EVENT_ID(id, name, divisor, unit) id,
+typedef enum { LOG_EVENTS(LOG_EVENT_ID) LOG_EVENT_COUNT } LogEventId;
+#undef LOG_EVENT_ID
+
+// index of LOG_MAC_STATUS
+#define LOG_MCPS_CONFIRM     0
+#define LOG_MLME_CONFIRM     1
+#define LOG_MCPS_INDICATION  2
+#define LOG_MLME_INDICATION  3
+
+typedef struct {
+  const char* name;
+  int16_t divisor;
+  const char* unit;
+} LogEvent;
+
+typedef struct {
+  uint32_t time;   // ms since boot
+  uint8_t  event;
+  uint8_t  index;
+  int16_t  value;
+} LogRecord;
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(event, index, value) Log::write(event, index, value)
+#else
+  #define LOG_ERROR(event, index, value) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(event, index, value) Log::write(event, index, value)
+#else
+  #define LOG_INFO(event, index, value) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(event, index, value) Log::write(event, index, value)
+#else
+  #define LOG_DEBUG(event, index, value) do {} while (0)
+#endif
+
+class Log {
+  public:
+    typedef uint64_t (*TimeFunction)();
+
+    static const LogEvent& event(uint8_t id) {
+      #define LOG_EVENT_ENTRY(id, name, divisor, unit) {name, divisor, unit},
+      static const LogEvent events[] = { LOG_EVENTS(LOG_EVENT_ENTRY) {"unknown", 1, ""} };
+      #undef LOG_EVENT_ENTRY
+      return events[id < LOG_EVENT_COUNT ? id : (uint8_t)LOG_EVENT_COUNT];
+    }
+
+    static void begin(TimeFunction time) {
+      ring().time = time;
+    }
+
+    static void write(uint8_t event, uint8_t index, int16_t value) {
+      #if LOG_DEFERRED
+        Ring& log = ring();
+        LogRecord& record = log.records[(log.first + log.count) % LOG_RING_SIZE];
+        record.time = log.time != 0 ? (uint32_t)log.time() : 0;
+        record.event = event;
+        record.index = index;
+        record.value = value;
+        if (log.count < LOG_RING_SIZE) {
+          log.count++;
+        } else {
+          log.first = (log.first + 1) % LOG_RING_SIZE;
+          log.lost++;
+        }
+      #else
+        print(event, index, value);
+      #endif
+    }
+
+    // records in the ring, oldest first
+    static uint8_t count() { return ring().count; }
+    static const LogRecord& record(uint8_t i) { return ring().records[(ring().first + i) % LOG_RING_SIZE]; }
+    // records overwritten since the last drain
+    static uint16_t lost() { return ring().lost; }
+
+    // prints and clears the ring
+    static void drain() {
+      Ring& log = ring();
+      if (log.lost > 0) {
+        Serial.print(log.lost); Serial.println(F(" log records lost"));
+      }
+      char line[2 * LOG_RECORD_SIZE + 1];
+      for (uint8_t i = 0; i < log.count; i++) {
+        format(record(i), line);
+        Serial.print(F(LOG_PREFIX)); Serial.println(line);
+      }
+      log.first = 0;
+      log.count = 0;
+      log.lost = 0;
+    }
+
+    // 16 hex digits, big endian
+    static void format(const LogRecord& record, char* line) {
+      uint8_t bytes[LOG_RECORD_SIZE] = {
+        (uint8_t)(record.time >> 24), (uint8_t)(record.time >> 16), (uint8_t)(record.time >> 8), (uint8_t)record.time,
+        record.event, record.index, (uint8_t)((uint16_t)record.value >> 8), (uint8_t)record.value
+      };
+      const char* digits = "0123456789ABCDEF";
+      for (uint8_t i = 0; i < LOG_RECORD_SIZE; i++) {
+        line[2 * i] = digits[bytes[i] >> 4];
+        line[2 * i + 1] = digits[bytes[i] & 0x0F];
+      }
+      line[2 * LOG_RECORD_SIZE] = 0;
+    }
+
+    // record of the hex digits after the prefix, false if malformed
+    static bool parse(const char* line, LogRecord* record) {
+      uint8_t bytes[LOG_RECORD_SIZE];
+      for (uint8_t i = 0; i < 2 * LOG_RECORD_SIZE; i++) {
+        char c = line[i];
+        int8_t nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (nibble < 0) return false;
+        bytes[i / 2] = (i & 1) ? (bytes[i / 2] | nibble) : (nibble << 4);
+      }
+      record->time = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+      record->event = bytes[4];
+      record->index = bytes[5];
+      record->value = (int16_t)(((uint16_t)bytes[6] << 8) | bytes[7]);
+      return true;
+    }
+
+  private:
+    typedef struct {
+      LogRecord records[LOG_RING_SIZE];
+      uint8_t first;
+      uint8_t count;
+      uint16_t lost;
+      TimeFunction time;
+    } Ring;
+
+    // one instance over all translation units, zero initialized
+    static Ring& ring() {
+      static Ring instance;
+      return instance;
+    }
+
+  #if !LOG_DEFERRED
+    static void print(uint8_t id, uint8_t index, int16_t value) {
+      const LogEvent& e = event(id);
+      Serial.print(e.name); Serial.print(' '); Serial.print(index); Serial.print(F(": "));
+      if (e.divisor > 1) {
+        Serial.print((float)value / e.divisor);
+      } else {
+        Serial.print(value);
+      }
+      Serial.print(' '); Serial.println(e.unit);
+    }
+  #endif
+};
+
+#endif
@@ -0,0 +1,137 @@
+/**********************************************************
+ * Adaptive interval between two measures.
+ * ---
+ * The rate of change of every field is taken from two
+ * consecutive measures in units of its change limit (the
+ * LIMIT_*_DIFF of hasChanged()) per hour, changes below
+ * 1/8 of the limit count as noise. The next interval is
+ * the time the fastest field needs for half its limit,
+ * within the min/max bounds:
+ * - active: the rate follows increases immediately and
+ *   decays with 1/4 per measure
+ * - daily: the rate of the same hour of the last days,
+ *   to be awake before the morning activity starts. The
+ *   node has no wall clock, hours count since boot.
+ * - battery: below the saving voltage the interval is
+ *   doubled, below the low voltage it is the max bound
+ * - quiet: no activity, the max bound
+ * Field 0 is the battery voltage (1/100 V), a field with
+ * limit 0 does not count.
+ **********************************************************/
+#ifndef __MEASURESCHEDULER_H__
+#define __MEASURESCHEDULER_H__
+
+#include <stdint.h>
+
+#ifndef UNDEFINED_VALUE
+  #define UNDEFINED_VALUE -32768
+#endif
+
+#define SCHEDULE_ACTIVE    0
+#define SCHEDULE_DAILY     1
+#define SCHEDULE_BATTERY   2
+#define SCHEDULE_QUIET     3
+
+#define SCHEDULE_RATE_UNIT  256  // rate in 1/256 limits per hour
+#define SCHEDULE_TARGET     128  // half a limit per interval
+#define SCHEDULE_NOISE        8  // changes below 1/8 limit
+#define SCHEDULE_HOURS       24
+#define SCHEDULE_HOUR_MS 3600000UL
+
+typedef struct {
+  unsigned long minInterval;  // ms
+  unsigned long maxInterval;  // ms
+  int16_t savingVoltage;      // 1/100 V, intervals doubled below
+  int16_t lowVoltage;         // 1/100 V, max interval below
+} ScheduleBounds;
+
+template <uint8_t FIELDS>
+class MeasureScheduler {
+  public:
+    MeasureScheduler(const int16_t* limits, ScheduleBounds bounds, unsigned long initialInterval)
+    : limits(limits), bounds(bounds), nextInterval(initialInterval) {
+      for (uint8_t h = 0; h < SCHEDULE_HOURS; h++) profile[h] = 0;
+    }
+
+    // called with the values of every measure (1/100 units), returns the interval to the next measure in ms
+    unsigned long update(const int16_t* values, uint64_t time) {
+      if (measured && time > lastTime) {
+        uint16_t rate = changeRate(values, time - lastTime);
+        activity = rate > activity ? rate : activity - (activity - rate) / 4;
+        uint16_t& hourly = profile[hour(time)];
+        hourly += ((int32_t)rate - hourly) / 8;
+        schedule(values[0], time);
+      }
+      for (uint8_t i = 0; i < FIELDS; i++) lastValues[i] = values[i];
+      lastTime = time;
+      measured = true;
+      return nextInterval;
+    }
+
+    // eg. changed by a downlink command, the next interval is within the new bounds
+    void setBounds(ScheduleBounds bounds) {
+      this->bounds = bounds;
+      if (nextInterval < bounds.minInterval) nextInterval = bounds.minInterval;
+      if (nextInterval > bounds.maxInterval) nextInterval = bounds.maxInterval;
+    }
+
+    inline
+    unsigned long interval() { return nextInterval; }
+
+    inline
+    uint8_t reason() { return nextReason; }
+
+    // smoothed rate in 1/256 limits per hour
+    inline
+    uint16_t rate() { return activity; }
+
+  private:
+    const int16_t* limits;
+    ScheduleBounds bounds;
+    unsigned long nextInterval;
+    uint8_t nextReason = SCHEDULE_QUIET;
+    int16_t lastValues[FIELDS];
+    uint64_t lastTime = 0;
+    bool measured = false;
+    uint16_t activity = 0;
+    uint16_t profile[SCHEDULE_HOURS];
+
+    static uint8_t hour(uint64_t time) {
+      return (time / SCHEDULE_HOUR_MS) % SCHEDULE_HOURS;
+    }
+
+    // max rate of change of all fields since the last measure
+    uint16_t changeRate(const int16_t* values, uint64_t elapsed) {
+      uint32_t fastest = 0;
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        if (limits[i] <= 0 || values[i] == UNDEFINED_VALUE || lastValues[i] == UNDEFINED_VALUE) continue;
+        int32_t change = (int32_t)values[i] - lastValues[i];
+        if (change < 0) change = -change;
+        if (change == 0 || change * SCHEDULE_NOISE < limits[i]) continue;
+        uint64_t rate = (uint64_t)change * SCHEDULE_RATE_UNIT * SCHEDULE_HOUR_MS / limits[i] / elapsed;
+        if (rate > fastest) fastest = rate > 0xFFFF ? 0xFFFF : rate;
+      }
+      return fastest;
+    }
+
+    void schedule(int16_t battery, uint64_t time) {
+      uint16_t expected = profile[hour(time + nextInterval)];
+      uint16_t rate = activity >= expected ? activity : expected;
+      nextReason = activity >= expected ? SCHEDULE_ACTIVE : SCHEDULE_DAILY;
+      nextInterval = rate > 0 ? (uint32_t)((uint64_t)SCHEDULE_TARGET * SCHEDULE_HOUR_MS / rate) : bounds.maxInterval;
+      if (nextInterval >= bounds.maxInterval) {
+        nextReason = SCHEDULE_QUIET;
+      }
+      if (battery != UNDEFINED_VALUE && battery < bounds.lowVoltage) {
+        nextInterval = bounds.maxInterval;
+        nextReason = SCHEDULE_BATTERY;
+      } else if (battery != UNDEFINED_VALUE && battery < bounds.savingVoltage) {
+        nextInterval *= 2;
+        nextReason = SCHEDULE_BATTERY;
+      }
+      if (nextInterval < bounds.minInterval) nextInterval = bounds.minInterval;
+      if (nextInterval > bounds.maxInterval) nextInterval = bounds.maxInterval;
+    }
+};
+
+#endif
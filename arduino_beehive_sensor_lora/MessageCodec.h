@@ -0,0 +1,659 @@
+/**********************************************************
+ * Codec of the compact sensor messages v1, v2, of the
+ * diagnostics, backfill, statistics and alert messages.
+ * ---
+ * Variable length, bit packed encoding (MSB first) of the
+ * sensor values in 1/100 units as in message v0:
+ *  byte 0: message version 1
+ *  byte 1: field count (bits 7-4), delta flag (bit 3),
+ *          id of the absolute frame (bits 2-0)
+ *  bits:   presence bitmap, one bit per field in field order,
+ *          undefined values are not transmitted
+ *          absolute frame: value - minimum, field width bits
+ *          delta frame: 4 bit width n, n bits zigzag encoded
+ *          difference to the absolute frame with the id
+ *          (n = 0: unchanged)
+ *  padded with 0 bits to full bytes
+ * Field order as message v0: battery, weight, roof humidity,
+ * roof temperature, thermometers.
+ * Delta frames can only be decoded with the referenced
+ * absolute frame, a receiver has to keep the last one.
+ * Message v2 is a batch of samples in one bitstream:
+ *  byte 0: message version 2
+ *  byte 1: field count (bits 7-4), sample count (bits 3-0)
+ *  per sample, oldest first: 8 bit age in minutes, 1 bit
+ *  delta flag, the bits of an absolute frame or of a delta
+ *  frame to the previous sample (see above)
+ *  optional schedule: 8 bit interval to the next measure in
+ *  minutes, 2 bit reason, 6 bit rate of change in 1/8
+ *  limits per hour (see MeasureScheduler.h), present if 16
+ *  or more bits follow the samples
+ * A batch decodes without any earlier message.
+ * Message 3 holds diagnostics of the node since boot:
+ *  byte 0: message version 3
+ *  byte 1: state count (bits 7-4)
+ *  per state: time in s, entries, timeouts, longest stay in
+ *  s; then the airtime in s and the deferred frames; each
+ *  as 5 bit width n and n bits unsigned value
+ * Message 4 replays samples of the journal (see Journal.h)
+ * that may have been lost, in a bitstream as message v2:
+ *  byte 0: message version 4
+ *  byte 1: field count (bits 7-4), sample count (bits 3-0)
+ *  16 bit journal sequence of the first sample, the others
+ *  follow consecutively; 16 bit age of the first sample in
+ *  minutes; per sample, oldest first: 8 bit minutes after
+ *  the previous sample (not for the first), 1 bit delta flag
+ *  and the bits of an absolute or delta frame
+ * Message 5 holds the statistics of the measures of
+ * consecutive intervals (see Aggregator.h):
+ *  byte 0: message version 5
+ *  byte 1: field count (bits 7-4), interval count (bits 3-0)
+ *  counter of the minutes since the end of the newest
+ *  interval (as in the diagnostics); per interval, oldest
+ *  first: counters of its minutes and of its measures,
+ *  presence bit per field; per present field the minimum as
+ *  in an absolute frame, a 4 bit width n and n bits each of
+ *  maximum - minimum, mean - minimum and the standard
+ *  deviation
+ * Message 6 is an immediate alert (see AlertDetector.h):
+ *  byte 0: message version 6
+ *  byte 1: brood nest field (bits 7-4, 0 without), alert
+ *          flags (bits 3-0)
+ *  16 bit each: weight before and after the change, the
+ *  temperature of the brood nest field before and after
+ * Shared by the sketch and the host tests (beehive-simulator).
+ **********************************************************/
+#ifndef __MESSAGECODEC_H__
+#define __MESSAGECODEC_H__
+
+#include <stdint.h>
+
+#ifndef UNDEFINED_VALUE
+  #define UNDEFINED_VALUE -32768
+#endif
+
+#define MESSAGE_V1              1
+#define MESSAGE_V1_HEADER       2
+#define MESSAGE_V1_MAX_FIELDS  15
+#define MESSAGE_V1_DELTA     0x08
+#define MESSAGE_V1_ID_MASK   0x07
+#define MESSAGE_V1_WIDTH_BITS   4
+#define MESSAGE_V1_MAX_SIZE    (MESSAGE_V1_HEADER + (MESSAGE_V1_MAX_FIELDS * (1 + MESSAGE_V1_WIDTH_BITS + 15) + 7) / 8)
+
+#define MESSAGE_V2              2
+#define MESSAGE_V2_HEADER       2
+#define MESSAGE_V2_MAX_SAMPLES 15
+#define MESSAGE_V2_SAMPLE_MASK 0x0F
+#define MESSAGE_V2_AGE_BITS     8
+#define MESSAGE_V2_MAX_AGE    255  // minutes
+#define MESSAGE_V2_SCHEDULE_BITS 16
+// bits of an absolute sample of count defined fields (the widths of MESSAGE_V1_FORMAT)
+// and of an unchanged one, for the samples of count fields that fit a payload of size
+// bytes: the first absolute, the rest unchanged
+#define MESSAGE_V2_ABSOLUTE_BITS(count) (MESSAGE_V2_AGE_BITS + 1 + (count) + 10 + 15 + 14 * ((count) - 2))
+#define MESSAGE_V2_UNCHANGED_BITS(count) (MESSAGE_V2_AGE_BITS + 1 + (count) * (1 + MESSAGE_V1_WIDTH_BITS))
+#define MESSAGE_V2_FITTING(size, count) \
+  (1 + (((size) - MESSAGE_V2_HEADER) * 8 - MESSAGE_V2_ABSOLUTE_BITS(count)) / MESSAGE_V2_UNCHANGED_BITS(count))
+#define MESSAGE_V2_SAMPLES(size, count) \
+  (MESSAGE_V2_FITTING(size, count) < MESSAGE_V2_MAX_SAMPLES ? MESSAGE_V2_FITTING(size, count) : MESSAGE_V2_MAX_SAMPLES)
+
+#define MESSAGE_BACKFILL           4
+#define MESSAGE_BACKFILL_HEADER    2
+#define MESSAGE_BACKFILL_MAX_AGE   0xFFFF  // minutes, ~45 days
+#define MESSAGE_BACKFILL_MAX_STEP  255     // minutes between samples
+
+#define MESSAGE_AGGREGATE          5
+#define MESSAGE_AGGREGATE_HEADER   2
+#define MESSAGE_AGGREGATE_MASK  0x0F
+
+#define MESSAGE_ALERT              6
+#define MESSAGE_ALERT_HEADER       2
+#define MESSAGE_ALERT_SIZE        10
+#define MESSAGE_ALERT_MASK      0x0F
+
+#define MESSAGE_DIAGNOSTICS        3
+#define MESSAGE_DIAGNOSTICS_HEADER 2
+#define MESSAGE_COUNTER_WIDTH_BITS 5
+#define MESSAGE_MAX_STATES        15
+
+typedef struct {
+  uint8_t interval;  // minutes to the next measure
+  uint8_t reason;    // 0..3
+  uint8_t rate;      // 1/8 limits per hour, 0..63
+} ScheduleReport;
+
+typedef struct {
+  uint32_t time;         // s
+  uint32_t entries;
+  uint32_t timeouts;
+  uint32_t maxDuration;  // s
+} StateReport;
+
+typedef struct {
+  uint32_t minutes;
+  uint32_t measures;
+} AggregateWindow;
+
+typedef struct {
+  int16_t minimum;   // UNDEFINED_VALUE without measures
+  int16_t maximum;
+  int16_t mean;
+  int16_t deviation;
+} FieldStatistics;
+
+typedef struct {
+  uint8_t flags;          // ALERT_* of AlertDetector.h
+  uint8_t broodField;     // field of the brood temperatures, 0 without
+  int16_t weightBefore;   // 1/100 kg, UNDEFINED_VALUE without
+  int16_t weight;
+  int16_t broodBefore;    // 1/100 C, UNDEFINED_VALUE without
+  int16_t brood;
+} AlertReport;
+
+typedef struct {
+  int16_t minimum;
+  uint8_t bits;
+} FieldFormat;
+
+// battery 0..10.23 V, weight -163.84..163.83 kg, humidity 0..163.83 %, temperatures -81.92..81.91 C
+static const FieldFormat MESSAGE_V1_FORMAT[] = {
+  {      0, 10 },
+  { -16384, 15 },
+  {      0, 14 },
+  {  -8192, 14 }
+};
+
+class BitWriter {
+  public:
+    BitWriter(uint8_t* buffer, uint8_t size) : buffer(buffer), size(size) {
+      for (uint8_t i = 0; i < size; i++) buffer[i] = 0;
+    }
+
+    void write(uint32_t value, uint8_t bits) {
+      while (bits > 0) {
+        bits--;
+        if ((position >> 3) >= size) {
+          overflow = true;
+          return;
+        }
+        if ((value >> bits) & 1) {
+          buffer[position >> 3] |= 0x80 >> (position & 7);
+        }
+        position++;
+      }
+    }
+
+    inline
+    uint8_t length() { return overflow ? 0 : (position + 7) >> 3; }
+
+  private:
+    uint8_t* buffer;
+    uint8_t size;
+    uint16_t position = 0;
+    bool overflow = false;
+};
+
+class BitReader {
+  public:
+    BitReader(const uint8_t* buffer, uint8_t length) : buffer(buffer), length(length) {}
+
+    uint32_t read(uint8_t bits) {
+      uint32_t value = 0;
+      while (bits > 0) {
+        bits--;
+        if ((position >> 3) >= length) {
+          underflow = true;
+          return 0;
+        }
+        value = (value << 1) | ((buffer[position >> 3] >> (7 - (position & 7))) & 1);
+        position++;
+      }
+      return value;
+    }
+
+    inline
+    bool failed() { return underflow; }
+
+    inline
+    uint16_t remaining() { return underflow ? 0 : (uint16_t)length * 8 - position; }
+
+  private:
+    const uint8_t* buffer;
+    uint8_t length;
+    uint16_t position = 0;
+    bool underflow = false;
+};
+
+class MessageCodec {
+  public:
+    // returns the message length, 0 if a value does not fit (send message v0 instead)
+    static uint8_t encodeAbsolute(const int16_t* values, uint8_t count, uint8_t id, uint8_t* buffer, uint8_t size) {
+      if (count > MESSAGE_V1_MAX_FIELDS || size < MESSAGE_V1_HEADER) return 0;
+      buffer[0] = MESSAGE_V1;
+      buffer[1] = (count << 4) | (id & MESSAGE_V1_ID_MASK);
+      BitWriter writer(buffer + MESSAGE_V1_HEADER, size - MESSAGE_V1_HEADER);
+      if (!writeAbsolute(writer, values, count)) return 0;
+      return finish(writer, count);
+    }
+
+    // returns the message length, 0 if a difference to the reference does not fit
+    static uint8_t encodeDelta(const int16_t* values, const int16_t* reference, uint8_t count, uint8_t id, uint8_t* buffer, uint8_t size) {
+      if (count > MESSAGE_V1_MAX_FIELDS || size < MESSAGE_V1_HEADER) return 0;
+      buffer[0] = MESSAGE_V1;
+      buffer[1] = (count << 4) | MESSAGE_V1_DELTA | (id & MESSAGE_V1_ID_MASK);
+      BitWriter writer(buffer + MESSAGE_V1_HEADER, size - MESSAGE_V1_HEADER);
+      if (!writeDelta(writer, values, reference, count)) return 0;
+      return finish(writer, count);
+    }
+
+    // decodes values (absolute) or differences (delta frame), undefined values as UNDEFINED_VALUE
+    static bool decode(const uint8_t* buffer, uint8_t length, int16_t* values, uint8_t maxCount, uint8_t* count, uint8_t* id, bool* delta) {
+      if (length < MESSAGE_V1_HEADER || buffer[0] != MESSAGE_V1) return false;
+      *count = buffer[1] >> 4;
+      *delta = (buffer[1] & MESSAGE_V1_DELTA) != 0;
+      *id = buffer[1] & MESSAGE_V1_ID_MASK;
+      if (*count > maxCount) return false;
+      BitReader reader(buffer + MESSAGE_V1_HEADER, length - MESSAGE_V1_HEADER);
+      if (*delta) {
+        readDelta(reader, values, *count);
+      } else {
+        readAbsolute(reader, values, *count);
+      }
+      return !reader.failed();
+    }
+
+    // turns the decoded differences of a delta frame into values
+    static bool applyDelta(int16_t* values, const int16_t* reference, uint8_t count) {
+      for (uint8_t i = 0; i < count; i++) {
+        if (values[i] == UNDEFINED_VALUE) continue;
+        if (reference[i] == UNDEFINED_VALUE) return false;
+        values[i] += reference[i];
+      }
+      return true;
+    }
+
+    // message v2: samples (oldest first, count values each) with their age in minutes and
+    // an optional schedule, returns the message length, 0 if the samples do not fit
+    static uint8_t encodeBatch(const int16_t* values, const uint8_t* ages, uint8_t samples, uint8_t count, uint8_t* buffer, uint8_t size,
+                               const ScheduleReport* schedule = 0) {
+      ArraySamples source = { values, ages, count };
+      return encodeBatch(source, samples, count, buffer, size, schedule);
+    }
+
+    // as above, the samples read in place from source.values(s) and source.age(s), 0 the oldest
+    // (eg. a ring buffer without a copy on the stack)
+    template <typename SAMPLES>
+    static uint8_t encodeBatch(SAMPLES& source, uint8_t samples, uint8_t count, uint8_t* buffer, uint8_t size,
+                               const ScheduleReport* schedule = 0) {
+      if (count > MESSAGE_V1_MAX_FIELDS || samples > MESSAGE_V2_MAX_SAMPLES || size < MESSAGE_V2_HEADER) return 0;
+      buffer[0] = MESSAGE_V2;
+      buffer[1] = (count << 4) | samples;
+      BitWriter writer(buffer + MESSAGE_V2_HEADER, size - MESSAGE_V2_HEADER);
+      const int16_t* previous = 0;
+      for (uint8_t s = 0; s < samples; s++) {
+        const int16_t* sample = source.values(s);
+        writer.write(source.age(s), MESSAGE_V2_AGE_BITS);
+        if (s > 0 && isDeltaEncodable(sample, previous, count)) {
+          writer.write(1, 1);
+          writeDelta(writer, sample, previous, count);
+        } else {
+          writer.write(0, 1);
+          if (!writeAbsolute(writer, sample, count)) return 0;
+        }
+        previous = sample;
+      }
+      if (schedule != 0) {
+        writer.write(schedule->interval, 8);
+        writer.write(schedule->reason, 2);
+        writer.write(schedule->rate < 63 ? schedule->rate : 63, 6);
+      }
+      uint8_t length = writer.length();
+      return length > 0 || samples == 0 ? MESSAGE_V2_HEADER + length : 0;
+    }
+
+    // decodes the samples of message v2 into values (samples * count), the schedule
+    // is set if present and requested
+    static bool decodeBatch(const uint8_t* buffer, uint8_t length, int16_t* values, uint8_t* ages, uint8_t maxValues, uint8_t* samples, uint8_t* count,
+                            ScheduleReport* schedule = 0, bool* scheduled = 0) {
+      if (length < MESSAGE_V2_HEADER || buffer[0] != MESSAGE_V2) return false;
+      *count = buffer[1] >> 4;
+      *samples = buffer[1] & MESSAGE_V2_SAMPLE_MASK;
+      if (*samples * *count > maxValues) return false;
+      BitReader reader(buffer + MESSAGE_V2_HEADER, length - MESSAGE_V2_HEADER);
+      for (uint8_t s = 0; s < *samples; s++) {
+        int16_t* sample = values + s * *count;
+        ages[s] = reader.read(MESSAGE_V2_AGE_BITS);
+        if (reader.read(1)) {
+          if (s == 0) return false;
+          readDelta(reader, sample, *count);
+          if (!applyDelta(sample, sample - *count, *count)) return false;
+        } else {
+          readAbsolute(reader, sample, *count);
+        }
+      }
+      bool present = reader.remaining() >= MESSAGE_V2_SCHEDULE_BITS;
+      if (present && schedule != 0) {
+        schedule->interval = reader.read(8);
+        schedule->reason = reader.read(2);
+        schedule->rate = reader.read(6);
+      }
+      if (scheduled != 0) *scheduled = present;
+      return !reader.failed();
+    }
+
+    // message 4: consecutive journal samples from sequence on (oldest first, count values each)
+    // with their age in minutes, returns the message length, 0 if the samples do not fit
+    static uint8_t encodeBackfill(const int16_t* values, const uint16_t* ages, uint8_t samples, uint8_t count, uint16_t sequence,
+                                  uint8_t* buffer, uint8_t size) {
+      if (count > MESSAGE_V1_MAX_FIELDS || samples > MESSAGE_V2_MAX_SAMPLES || size < MESSAGE_BACKFILL_HEADER) return 0;
+      buffer[0] = MESSAGE_BACKFILL;
+      buffer[1] = (count << 4) | samples;
+      BitWriter writer(buffer + MESSAGE_BACKFILL_HEADER, size - MESSAGE_BACKFILL_HEADER);
+      writer.write(sequence, 16);
+      writer.write(samples > 0 ? ages[0] : 0, 16);
+      for (uint8_t s = 0; s < samples; s++) {
+        const int16_t* sample = values + s * count;
+        if (s > 0) {
+          uint16_t step = ages[s - 1] > ages[s] ? ages[s - 1] - ages[s] : 0;
+          writer.write(step < MESSAGE_BACKFILL_MAX_STEP ? step : MESSAGE_BACKFILL_MAX_STEP, 8);
+        }
+        if (s > 0 && isDeltaEncodable(sample, sample - count, count)) {
+          writer.write(1, 1);
+          writeDelta(writer, sample, sample - count, count);
+        } else {
+          writer.write(0, 1);
+          if (!writeAbsolute(writer, sample, count)) return 0;
+        }
+      }
+      uint8_t length = writer.length();
+      return length > 0 ? MESSAGE_BACKFILL_HEADER + length : 0;
+    }
+
+    // decodes the samples of message 4 into values (samples * count) and their ages
+    static bool decodeBackfill(const uint8_t* buffer, uint8_t length, int16_t* values, uint16_t* ages, uint8_t maxValues,
+                               uint8_t* samples, uint8_t* count, uint16_t* sequence) {
+      if (length < MESSAGE_BACKFILL_HEADER || buffer[0] != MESSAGE_BACKFILL) return false;
+      *count = buffer[1] >> 4;
+      *samples = buffer[1] & MESSAGE_V2_SAMPLE_MASK;
+      if (*samples * *count > maxValues) return false;
+      BitReader reader(buffer + MESSAGE_BACKFILL_HEADER, length - MESSAGE_BACKFILL_HEADER);
+      *sequence = reader.read(16);
+      uint16_t age = reader.read(16);
+      for (uint8_t s = 0; s < *samples; s++) {
+        int16_t* sample = values + s * *count;
+        if (s > 0) {
+          uint8_t step = reader.read(8);
+          age = age > step ? age - step : 0;
+        }
+        ages[s] = age;
+        if (reader.read(1)) {
+          if (s == 0) return false;
+          readDelta(reader, sample, *count);
+          if (!applyDelta(sample, sample - *count, *count)) return false;
+        } else {
+          readAbsolute(reader, sample, *count);
+        }
+      }
+      return !reader.failed();
+    }
+
+    // diagnostics message of count states, returns the message length, 0 if it does not fit
+    static uint8_t encodeDiagnostics(const StateReport* states, uint8_t count, uint32_t airtime, uint32_t deferred, uint8_t* buffer, uint8_t size) {
+      if (count > MESSAGE_MAX_STATES || size < MESSAGE_DIAGNOSTICS_HEADER) return 0;
+      buffer[0] = MESSAGE_DIAGNOSTICS;
+      buffer[1] = count << 4;
+      BitWriter writer(buffer + MESSAGE_DIAGNOSTICS_HEADER, size - MESSAGE_DIAGNOSTICS_HEADER);
+      for (uint8_t i = 0; i < count; i++) {
+        writeCounter(writer, states[i].time);
+        writeCounter(writer, states[i].entries);
+        writeCounter(writer, states[i].timeouts);
+        writeCounter(writer, states[i].maxDuration);
+      }
+      writeCounter(writer, airtime);
+      writeCounter(writer, deferred);
+      uint8_t length = writer.length();
+      return length > 0 ? MESSAGE_DIAGNOSTICS_HEADER + length : 0;
+    }
+
+    static bool decodeDiagnostics(const uint8_t* buffer, uint8_t length, StateReport* states, uint8_t maxCount, uint8_t* count,
+                                  uint32_t* airtime, uint32_t* deferred) {
+      if (length < MESSAGE_DIAGNOSTICS_HEADER || buffer[0] != MESSAGE_DIAGNOSTICS) return false;
+      *count = buffer[1] >> 4;
+      if (*count > maxCount) return false;
+      BitReader reader(buffer + MESSAGE_DIAGNOSTICS_HEADER, length - MESSAGE_DIAGNOSTICS_HEADER);
+      for (uint8_t i = 0; i < *count; i++) {
+        states[i].time = readCounter(reader);
+        states[i].entries = readCounter(reader);
+        states[i].timeouts = readCounter(reader);
+        states[i].maxDuration = readCounter(reader);
+      }
+      *airtime = readCounter(reader);
+      *deferred = readCounter(reader);
+      return !reader.failed();
+    }
+
+    // message 5: statistics of count fields (windows * count, oldest first) of consecutive intervals,
+    // the newest ended age minutes ago; returns the message length, 0 if they do not fit
+    static uint8_t encodeAggregate(const AggregateWindow* windows, const FieldStatistics* fields, uint8_t windowCount, uint8_t count,
+                                   uint32_t age, uint8_t* buffer, uint8_t size) {
+      if (count > MESSAGE_V1_MAX_FIELDS || windowCount > MESSAGE_AGGREGATE_MASK || size < MESSAGE_AGGREGATE_HEADER) return 0;
+      buffer[0] = MESSAGE_AGGREGATE;
+      buffer[1] = (count << 4) | windowCount;
+      BitWriter writer(buffer + MESSAGE_AGGREGATE_HEADER, size - MESSAGE_AGGREGATE_HEADER);
+      writeCounter(writer, age);
+      for (uint8_t w = 0; w < windowCount; w++) {
+        writeCounter(writer, windows[w].minutes);
+        writeCounter(writer, windows[w].measures);
+        if (!writeStatistics(writer, fields + w * count, count)) return 0;
+      }
+      uint8_t length = writer.length();
+      return length > 0 ? MESSAGE_AGGREGATE_HEADER + length : 0;
+    }
+
+    static bool decodeAggregate(const uint8_t* buffer, uint8_t length, AggregateWindow* windows, FieldStatistics* fields,
+                                uint8_t maxWindows, uint8_t maxValues, uint8_t* windowCount, uint8_t* count, uint32_t* age) {
+      if (length < MESSAGE_AGGREGATE_HEADER || buffer[0] != MESSAGE_AGGREGATE) return false;
+      *count = buffer[1] >> 4;
+      *windowCount = buffer[1] & MESSAGE_AGGREGATE_MASK;
+      if (*windowCount > maxWindows || *windowCount * *count > maxValues) return false;
+      BitReader reader(buffer + MESSAGE_AGGREGATE_HEADER, length - MESSAGE_AGGREGATE_HEADER);
+      *age = readCounter(reader);
+      for (uint8_t w = 0; w < *windowCount; w++) {
+        windows[w].minutes = readCounter(reader);
+        windows[w].measures = readCounter(reader);
+        readStatistics(reader, fields + w * *count, *count);
+      }
+      return !reader.failed();
+    }
+
+    // message 6, returns the message length, 0 if it does not fit
+    static uint8_t encodeAlert(const AlertReport& alert, uint8_t* buffer, uint8_t size) {
+      if (size < MESSAGE_ALERT_SIZE || alert.broodField > MESSAGE_ALERT_MASK) return 0;
+      buffer[0] = MESSAGE_ALERT;
+      buffer[1] = (alert.broodField << 4) | (alert.flags & MESSAGE_ALERT_MASK);
+      BitWriter writer(buffer + MESSAGE_ALERT_HEADER, size - MESSAGE_ALERT_HEADER);
+      writer.write((uint16_t)alert.weightBefore, 16);
+      writer.write((uint16_t)alert.weight, 16);
+      writer.write((uint16_t)alert.broodBefore, 16);
+      writer.write((uint16_t)alert.brood, 16);
+      return MESSAGE_ALERT_HEADER + writer.length();
+    }
+
+    static bool decodeAlert(const uint8_t* buffer, uint8_t length, AlertReport* alert) {
+      if (length < MESSAGE_ALERT_SIZE || buffer[0] != MESSAGE_ALERT) return false;
+      alert->flags = buffer[1] & MESSAGE_ALERT_MASK;
+      alert->broodField = buffer[1] >> 4;
+      BitReader reader(buffer + MESSAGE_ALERT_HEADER, length - MESSAGE_ALERT_HEADER);
+      alert->weightBefore = (int16_t)reader.read(16);
+      alert->weight = (int16_t)reader.read(16);
+      alert->broodBefore = (int16_t)reader.read(16);
+      alert->brood = (int16_t)reader.read(16);
+      return !reader.failed();
+    }
+
+    // upper bound of the size of one absolute sample in message v2
+    static uint8_t maxSampleSize(uint8_t count) {
+      uint16_t bits = MESSAGE_V2_AGE_BITS + 1 + count;
+      for (uint8_t i = 0; i < count; i++) {
+        bits += fieldFormat(i).bits;
+      }
+      return (bits + 7) / 8;
+    }
+
+    static const FieldFormat& fieldFormat(uint8_t field) {
+      uint8_t last = sizeof(MESSAGE_V1_FORMAT) / sizeof(MESSAGE_V1_FORMAT[0]) - 1;
+      return MESSAGE_V1_FORMAT[field < last ? field : last];
+    }
+
+  private:
+    // samples of count values in one array, for encodeBatch
+    struct ArraySamples {
+      const int16_t* valueArray;
+      const uint8_t* ageArray;
+      uint8_t count;
+      const int16_t* values(uint8_t s) { return valueArray + s * count; }
+      uint8_t age(uint8_t s) { return ageArray[s]; }
+    };
+
+    static uint8_t finish(BitWriter& writer, uint8_t count) {
+      uint8_t length = writer.length();
+      return length > 0 || count == 0 ? MESSAGE_V1_HEADER + length : 0;
+    }
+
+    static void writePresence(BitWriter& writer, const int16_t* values, uint8_t count) {
+      for (uint8_t i = 0; i < count; i++) {
+        writer.write(values[i] != UNDEFINED_VALUE, 1);
+      }
+    }
+
+    static bool writeAbsolute(BitWriter& writer, const int16_t* values, uint8_t count) {
+      writePresence(writer, values, count);
+      for (uint8_t i = 0; i < count; i++) {
+        if (values[i] == UNDEFINED_VALUE) continue;
+        const FieldFormat& format = fieldFormat(i);
+        int32_t stored = (int32_t)values[i] - format.minimum;
+        if (stored < 0 || stored >= (1L << format.bits)) return false;
+        writer.write(stored, format.bits);
+      }
+      return true;
+    }
+
+    static bool isDeltaEncodable(const int16_t* values, const int16_t* reference, uint8_t count) {
+      for (uint8_t i = 0; i < count; i++) {
+        if (values[i] == UNDEFINED_VALUE) continue;
+        if (reference[i] == UNDEFINED_VALUE) return false;
+        if (bitWidth(toZigzag((int32_t)values[i] - reference[i])) >= (1 << MESSAGE_V1_WIDTH_BITS)) return false;
+      }
+      return true;
+    }
+
+    static bool writeDelta(BitWriter& writer, const int16_t* values, const int16_t* reference, uint8_t count) {
+      if (!isDeltaEncodable(values, reference, count)) return false;
+      writePresence(writer, values, count);
+      for (uint8_t i = 0; i < count; i++) {
+        if (values[i] == UNDEFINED_VALUE) continue;
+        uint32_t zigzag = toZigzag((int32_t)values[i] - reference[i]);
+        uint8_t width = bitWidth(zigzag);
+        writer.write(width, MESSAGE_V1_WIDTH_BITS);
+        writer.write(zigzag, width);
+      }
+      return true;
+    }
+
+    static void readAbsolute(BitReader& reader, int16_t* values, uint8_t count) {
+      uint16_t presence = reader.read(count);
+      for (uint8_t i = 0; i < count; i++) {
+        if ((presence & (1 << (count - 1 - i))) == 0) {
+          values[i] = UNDEFINED_VALUE;
+        } else {
+          const FieldFormat& format = fieldFormat(i);
+          values[i] = (int32_t)reader.read(format.bits) + format.minimum;
+        }
+      }
+    }
+
+    static void readDelta(BitReader& reader, int16_t* values, uint8_t count) {
+      uint16_t presence = reader.read(count);
+      for (uint8_t i = 0; i < count; i++) {
+        if ((presence & (1 << (count - 1 - i))) == 0) {
+          values[i] = UNDEFINED_VALUE;
+        } else {
+          uint8_t width = reader.read(MESSAGE_V1_WIDTH_BITS);
+          values[i] = fromZigzag(reader.read(width));
+        }
+      }
+    }
+
+    static bool writeStatistics(BitWriter& writer, const FieldStatistics* fields, uint8_t count) {
+      for (uint8_t i = 0; i < count; i++) {
+        writer.write(fields[i].minimum != UNDEFINED_VALUE, 1);
+      }
+      for (uint8_t i = 0; i < count; i++) {
+        const FieldStatistics& field = fields[i];
+        if (field.minimum == UNDEFINED_VALUE) continue;
+        const FieldFormat& format = fieldFormat(i);
+        int32_t stored = (int32_t)field.minimum - format.minimum;
+        if (stored < 0 || stored >= (1L << format.bits)) return false;
+        writer.write(stored, format.bits);
+        int32_t range = (int32_t)field.maximum - field.minimum;
+        int32_t mean = (int32_t)field.mean - field.minimum;
+        if (range < 0 || mean < 0 || mean > range || field.deviation < 0) return false;
+        uint8_t width = bitWidth(range > field.deviation ? range : field.deviation);
+        if (width >= (1 << MESSAGE_V1_WIDTH_BITS)) return false;
+        writer.write(width, MESSAGE_V1_WIDTH_BITS);
+        writer.write(range, width);
+        writer.write(mean, width);
+        writer.write(field.deviation, width);
+      }
+      return true;
+    }
+
+    static void readStatistics(BitReader& reader, FieldStatistics* fields, uint8_t count) {
+      uint16_t presence = reader.read(count);
+      for (uint8_t i = 0; i < count; i++) {
+        FieldStatistics& field = fields[i];
+        if ((presence & (1 << (count - 1 - i))) == 0) {
+          field.minimum = field.maximum = field.mean = field.deviation = UNDEFINED_VALUE;
+          continue;
+        }
+        const FieldFormat& format = fieldFormat(i);
+        field.minimum = (int32_t)reader.read(format.bits) + format.minimum;
+        uint8_t width = reader.read(MESSAGE_V1_WIDTH_BITS);
+        field.maximum = field.minimum + (int32_t)reader.read(width);
+        field.mean = field.minimum + (int32_t)reader.read(width);
+        field.deviation = reader.read(width);
+      }
+    }
+
+    // saturates at 31 bit
+    static void writeCounter(BitWriter& writer, uint32_t value) {
+      uint32_t max = (1UL << ((1 << MESSAGE_COUNTER_WIDTH_BITS) - 1)) - 1;
+      if (value > max) value = max;
+      uint8_t width = bitWidth(value);
+      writer.write(width, MESSAGE_COUNTER_WIDTH_BITS);
+      writer.write(value, width);
+    }
+
+    static uint32_t readCounter(BitReader& reader) {
+      return reader.read(reader.read(MESSAGE_COUNTER_WIDTH_BITS));
+    }
+
+    static uint32_t toZigzag(int32_t value) {
+      return value < 0 ? ((uint32_t)(-value) << 1) - 1 : (uint32_t)value << 1;
+    }
+
+    static int16_t fromZigzag(uint32_t value) {
+      return (value & 1) ? -(int32_t)((value + 1) >> 1) : (int32_t)(value >> 1);
+    }
+
+    static uint8_t bitWidth(uint32_t value) {
+      uint8_t width = 0;
+      while (value > 0) {
+        width++;
+        value >>= 1;
+      }
+      return width;
+    }
+};
+
+#endif
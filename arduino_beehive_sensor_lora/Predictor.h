@@ -0,0 +1,116 @@
+/**********************************************************
+ * Linear predictor of the sensor values, shared by the node
+ * and the receiver of the samples (dual prediction).
+ * ---
+ * Both sides feed the predictor with the same samples (the
+ * stored and sent ones) at the same minutes: the node with
+ * its clock, the receiver with the ages of message v2. A
+ * field is extrapolated along the line through the newest
+ * sample and an anchor, a sample at least PREDICTION_MIN_SPAN
+ * minutes before it (noise of close samples is not
+ * amplified), for PREDICTION_HORIZON minutes at most.
+ * Without an anchor no value is predicted, a field
+ * undefined in the anchor keeps its newest value.
+ * The node sends a measure only if a field leaves its limit
+ * around the prediction; the receiver reconstructs the
+ * values between two samples from the predictor fed up to
+ * the older one, within the same limits.
+ * Integer math, rounded towards zero, undefined values are
+ * not extrapolated.
+ * Shared by the sketch and the host tests (beehive-simulator).
+ **********************************************************/
+#ifndef __PREDICTOR_H__
+#define __PREDICTOR_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef UNDEFINED_VALUE
+  #define UNDEFINED_VALUE -32768
+#endif
+
+#define PREDICTION_MIN_SPAN   10   // minutes between anchor and newest sample
+#define PREDICTION_HORIZON   120   // minutes of extrapolation, constant after
+
+template <uint8_t FIELDS>
+class Predictor {
+  public:
+    Predictor() {
+      reset();
+    }
+
+    void reset() {
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        anchor[i] = candidate[i] = last[i] = UNDEFINED_VALUE;
+      }
+      samples = 0;
+    }
+
+    // a stored sample at minute of a clock common to all samples; the anchor moves to the newest
+    // sample or to the candidate (the oldest after the anchor) if far enough
+    void add(const int16_t* values, uint32_t minute) {
+      if (samples == 0) {
+        memcpy(candidate, values, sizeof(candidate));
+        candidateMinute = minute;
+        samples = 1;
+      } else if (minute - lastMinute >= PREDICTION_MIN_SPAN) {
+        memcpy(anchor, last, sizeof(anchor));
+        anchorMinute = lastMinute;
+        memcpy(candidate, values, sizeof(candidate));
+        candidateMinute = minute;
+        samples = 2;
+      } else if (minute - candidateMinute >= PREDICTION_MIN_SPAN) {
+        memcpy(anchor, candidate, sizeof(anchor));
+        anchorMinute = candidateMinute;
+        memcpy(candidate, last, sizeof(candidate));
+        candidateMinute = lastMinute;
+        samples = 2;
+      }
+      memcpy(last, values, sizeof(last));
+      lastMinute = minute;
+    }
+
+    inline
+    bool isReady() { return samples >= 2; }
+
+    // predicted value of field at minute, UNDEFINED_VALUE before an anchor or without a newest value,
+    // the newest value without an anchor value
+    int16_t predict(uint8_t field, uint32_t minute) {
+      if (!isReady() || last[field] == UNDEFINED_VALUE) return UNDEFINED_VALUE;
+      if (anchor[field] == UNDEFINED_VALUE) return last[field];
+      uint32_t elapsed = minute - lastMinute;
+      if (elapsed > PREDICTION_HORIZON) elapsed = PREDICTION_HORIZON;
+      int32_t span = lastMinute - anchorMinute;
+      int32_t value = last[field] + ((int32_t)last[field] - anchor[field]) * (int32_t)elapsed / span;
+      if (value < -32767) return -32767;
+      if (value > 32767) return 32767;
+      return value;
+    }
+
+    // any field beyond its limit (> 0) around the prediction, always without a prediction
+    bool isBeyond(const int16_t* values, const int16_t* limits, uint32_t minute) {
+      if (!isReady()) return true;
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        if (limits[i] <= 0) continue;
+        int16_t predicted = predict(i, minute);
+        if (predicted == UNDEFINED_VALUE || values[i] == UNDEFINED_VALUE) {
+          if (predicted != values[i]) return true;
+          continue;
+        }
+        int32_t difference = (int32_t)values[i] - predicted;
+        if (difference >= limits[i] || -difference >= limits[i]) return true;
+      }
+      return false;
+    }
+
+  private:
+    int16_t anchor[FIELDS];
+    int16_t candidate[FIELDS];
+    int16_t last[FIELDS];
+    uint32_t anchorMinute = 0;
+    uint32_t candidateMinute = 0;
+    uint32_t lastMinute = 0;
+    uint8_t samples = 0;  // 1: newest sample only, 2: with anchor
+};
+
+#endif
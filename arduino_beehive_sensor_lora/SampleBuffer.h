@@ -0,0 +1,57 @@
+/**********************************************************
+ * Ring buffer of timestamped sensor samples.
+ * ---
+ * Keeps the last CAPACITY samples of FIELDS compact values
+ * (1/100 units) with the minute of the node clock for
+ * batched messages, read in place by the encoder. Storing
+ * into a full buffer overwrites the oldest sample.
+ **********************************************************/
+#ifndef __SAMPLEBUFFER_H__
+#define __SAMPLEBUFFER_H__
+
+#include <stdint.h>
+
+template <uint8_t CAPACITY, uint8_t FIELDS>
+class SampleBuffer {
+  public:
+    void store(const int16_t* values, uint32_t minute) {
+      uint8_t slot = (first + size) % CAPACITY;
+      if (size == CAPACITY) {
+        first = (first + 1) % CAPACITY;
+      } else {
+        size++;
+      }
+      for (uint8_t i = 0; i < FIELDS; i++) {
+        samples[slot].values[i] = values[i];
+      }
+      samples[slot].minute = minute;
+    }
+
+    // index 0 is the oldest sample
+    const int16_t* values(uint8_t index) { return samples[(first + index) % CAPACITY].values; }
+
+    uint32_t minute(uint8_t index) { return samples[(first + index) % CAPACITY].minute; }
+
+    // removes the oldest samples
+    void drop(uint8_t count) {
+      if (count > size) count = size;
+      first = (first + count) % CAPACITY;
+      size -= count;
+    }
+
+    inline
+    uint8_t count() { return size; }
+
+    inline
+    bool isFull() { return size == CAPACITY; }
+
+  private:
+    struct {
+      int16_t values[FIELDS];
+      uint32_t minute;
+    } samples[CAPACITY];
+    uint8_t first = 0;
+    uint8_t size = 0;
+};
+
+#endif
@@ -2,6 +2,19 @@
  * Wrapper code for HX711, DHT-xx and DallasTemperature sensors.
  * ---
  * Acquiring sensor data from several sources.
+ * All sensors are started at once and their results are
+ * collected as soon as they are ready (acquisition pipeline),
+ * the controller sleeps in between. The HX711 DOUT falling
+ * edge (conversion ready) wakes the controller by interrupt
+ * (CubeCell: GPIO interrupt, AVR: pin change on A0), a timer
+ * (CubeCell) or the watchdog (AVR) wakes it for the DS18B20.
+ * Times are taken from the node clock. The RTC counts the
+ * sleep (CubeCell), the watchdog periods slept are reported
+ * to the clock (AVR). A watchdog period ended early by DOUT
+ * counts the time until the expected sample instead (the
+ * conversion rate of the HX711), at most the period.
+ * The load cell is sampled until WeightFilter considers the
+ * average stable, outliers are left out.
  * Sensor names:
    - 1. Outer temperature - Aussentemperatur (used for weight compensation)
    - 2. Drop temperature - Kälteloch
@@ -20,7 +33,13 @@
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <HX711.h>
+#if !defined(__ASR6501__)
+  #include <LowPower.h>
+#endif
 #include "calibration.h"
+#include "Log.h"
+#include "FixedPoint.h"
+#include "WeightFilter.h"
 
 #if defined(__ASR6501__)
   #define DHT_PIN            GPIO4
@@ -32,18 +51,57 @@
   #define ONEWIRE_PIN         5
   #define LOADCELL_DOUT_PIN  A0
   #define LOADCELL_SCK_PIN   A1
+  #define LOADCELL_PCINT     PCINT8 // A0 on pin change interrupt 1
 #endif
 
 #define TEMPERATURE_PRECISION 12
-#define SETUP_SAMPLING        20
-#define OPERATIONAL_SAMPLING  10
+#define WEIGHT_STANDARD_ERROR  1  // 1/100 kg, sampling stops within (see WeightFilter.h)
+#define LOADCELL_SAMPLE_MS   100  // HX711 at 10 SPS (RATE pin low)
+#define LOADCELL_SETTLING_MS 400  // HX711 output settling after power up
+#define LOADCELL_TIMEOUT_MS 1000  // no sample: scale not ready
+#define MIN_SENSOR_SLEEP_MS   15
+
+#ifndef TEMPERATURE_LAG_MINUTES
+  #define TEMPERATURE_LAG_MINUTES 0  // outer temperature unfiltered
+#endif
+
+#ifdef TEMPERATURE_POINTS
+  const CompensationPoint compensationPoints[] PROGMEM = TEMPERATURE_POINTS;
+  #define COMPENSATION_POINT_COUNT (sizeof(compensationPoints) / sizeof(compensationPoints[0]))
+#else
+  const CompensationPoint* const compensationPoints = 0;
+  #define COMPENSATION_POINT_COUNT 0  // linear trendline
+#endif
+
+const WeightCalibration weightCalibration = {
+  LOADCELL_OFFSET, LOADCELL_DIVIDER,
+  FIXED_COMPENSATION_FACTOR(TEMPERATURE_FACTOR), FIXED_COMPENSATION_OFFSET(TEMPERATURE_OFFSET),
+  compensationPoints, COMPENSATION_POINT_COUNT
+};
+
+#if defined(__ASR6501__)
+  void onSensorWakeup() {} // wakeup only
+#else
+  volatile boolean loadcellWakeup = false;
+  ISR(PCINT1_vect) { loadcellWakeup = true; } // wakeup, see sleepAcquisition()
+#endif
 
 class SensorReader {
   public:
-    void begin() {
+    typedef uint64_t (*TimeFunction)();
+
+    // time of the node clock, includes the sleep reported by take*Ms() (acquisition pipeline,
+    // thermal lag filter)
+    void begin(TimeFunction time) {
+      timeFunction = time;
       dht.begin();
       sensors.begin();
+      sensors.setResolution(TEMPERATURE_PRECISION);
+      sensors.setWaitForConversion(false);
       scale.begin(LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN);
+      #if defined(__ASR6501__)
+        TimerInit(&sensorTimer, onSensorWakeup);
+      #endif
       initialize();
     }
 
@@ -51,97 +109,204 @@ class SensorReader {
       scale.power_down();
     }
 
+    // the scale settles during the next acquisition
     void powerUp() {
       scale.power_up();
       dht.begin();
-      initialize();
+      nextSampleMs = now() + LOADCELL_SETTLING_MS;
     }
 
     void initialize() {
       scaleIsReady = scale.wait_ready_retry(5, 200);
-      if (!scaleIsReady) { Serial.println("Scale not ready"); }
+      if (!scaleIsReady) { Serial.println(F("Scale not ready")); }
       scale.set_scale(LOADCELL_DIVIDER);
       scale.set_offset(LOADCELL_OFFSET);
+      nextSampleMs = now();
     }
 
     void listTemperatureSensors() {
       sensors.begin();
       byte deviceCount = sensors.getDeviceCount();
-      Serial.print("\nFound ");
+      Serial.print(F("\nFound "));
       Serial.print(deviceCount, DEC);
-      Serial.println(" temperature sensor");
+      Serial.println(F(" temperature sensor"));
 
-      Serial.print("Parasite power is: ");
-      if (sensors.isParasitePowerMode()) Serial.println("ON");
-      else Serial.println("OFF");
+      Serial.print(F("Parasite power is: "));
+      if (sensors.isParasitePowerMode()) Serial.println(F("ON"));
+      else Serial.println(F("OFF"));
 
       for (byte i = 0; i < deviceCount; i++) {
         DeviceAddress addr;
         if (sensors.getAddress(addr, i)) {
-            Serial.print("Device Address ");
+            Serial.print(F("Device Address "));
             Serial.print(i);
-            Serial.print(": ");
+            Serial.print(F(": "));
             printBufferAsArray(addr, sizeof(addr));
         } else {
-          Serial.print("Unable to find address for Device ");
+          Serial.print(F("Unable to find address for Device "));
           Serial.println(i);
         }
       }
     }
 
+    // raw average of the load cell samples of the last acquisition (scale calibration)
     void listRawWeight() {
-      long value = scale.read_average(SETUP_SAMPLING);
-      Serial.print("Raw weight read: ");
-      Serial.println(value);
+      Serial.print(F("Raw weight read: "));
+      if (weightFilter.accepted() == 0) {
+        Serial.println(F("none"));
+        return;
+      }
+      Serial.print(weightFilter.sum() / weightFilter.accepted());
+      Serial.print(F(" of "));
+      Serial.print(weightFilter.accepted());
+      Serial.println(F(" samples"));
     }
 
-    void startReading() {
-      sensors.setResolution(TEMPERATURE_PRECISION);
+    // starts all sensors, short readings (DHT, battery) are taken immediately
+    void startAcquisition() {
       sensors.requestTemperatures();
+      conversionEndMs = now() + sensors.millisToWaitForConversion(TEMPERATURE_PRECISION);
+      temperaturesDone = false;
+      for (int i = 0; i < THERMOMETER_COUNT; i++) {
+        temperature[i] = DEVICE_DISCONNECTED_RAW;
+      }
+      weightFilter.reset(abs(LOADCELL_DIVIDER) * (int32_t)WEIGHT_STANDARD_ERROR / 100);
+      scaleIsReady = true; // until the first sample times out
+      if (nextSampleMs < now()) nextSampleMs = now();
+      enableReadyInterrupt();
+
       dht.read(true);
+      roofTemperature = dht.readTemperature();
+      roofHumidity = dht.readHumidity();
+      millivolts = readVcc();
     }
 
-    void stopReading() {}
+    // collects the ready results, true when all sensors are done
+    boolean collectAcquisition() {
+      if (!temperaturesDone && sensors.isConversionComplete()) {
+        for (int i = 0; i < THERMOMETER_COUNT; i++) {
+          temperature[i] = sensors.getTemp(thermometer[i]);
+        }
+        filterOuterTemperature();
+        temperaturesDone = true;
+      }
+      while (!isWeightDone() && scale.is_ready()) {
+        weightFilter.add(scale.read());
+        scaleIsReady = true;
+        nextSampleMs = now() + LOADCELL_SAMPLE_MS;
+      }
+      // the next conversions would end the sleep for the thermometers
+      if (isWeightDone()) disableReadyInterrupt();
+      if (!isWeightDone() && weightFilter.size() == 0 && now() > nextSampleMs + LOADCELL_TIMEOUT_MS) {
+        if (scaleIsReady) { Serial.println(F("Scale not ready")); }
+        scaleIsReady = false;
+      }
+      return temperaturesDone && isWeightDone();
+    }
 
-    // DS18B20 temperature sensors on one-wire bus
-    float getTemperature(int index) {
-      const uint8_t* addr = thermometer[index];
-      float temperature = sensors.getTempC(addr);
+    // sleeps until the next result is expected or DOUT signals a sample,
+    // the caller adds take*Ms() to the node clock before the next call
+    void sleepAcquisition() {
+      uint64_t wakeMs = temperaturesDone ? nextSampleMs : conversionEndMs;
+      if (!isWeightDone() && nextSampleMs < wakeMs) wakeMs = nextSampleMs;
+      unsigned long waitMs = wakeMs > now() + MIN_SENSOR_SLEEP_MS ? (unsigned long)(wakeMs - now()) : MIN_SENSOR_SLEEP_MS;
+
+      Serial.flush();
       #if defined(__ASR6501__)
-        Serial.print("Thermometer ");
-        Serial.print(index);
-        Serial.print(" @ 0x");
-        for (int i = 0; i < 8; i++) {
-            if (addr[i] < 0x10) Serial.print('0');
-            Serial.print(addr[i], HEX);
+        TimerSetValue(&sensorTimer, waitMs);
+        TimerStart(&sensorTimer);
+        lowPowerHandler();
+        TimerStop(&sensorTimer);
+      #else
+        loadcellWakeup = false;
+        if (waitMs >= 500) {
+          LowPower.powerDown(SLEEP_500MS, ADC_OFF, BOD_OFF);
+          waitMs = 500;
+        } else if (waitMs >= 250) {
+          LowPower.powerDown(SLEEP_250MS, ADC_OFF, BOD_OFF);
+          waitMs = 250;
+        } else if (waitMs >= 120) {
+          LowPower.powerDown(SLEEP_120MS, ADC_OFF, BOD_OFF);
+          waitMs = 120;
+        } else if (waitMs >= 60) {
+          LowPower.powerDown(SLEEP_60MS, ADC_OFF, BOD_OFF);
+          waitMs = 60;
+        } else if (waitMs >= 30) {
+          LowPower.powerDown(SLEEP_30MS, ADC_OFF, BOD_OFF);
+          waitMs = 30;
+        } else {
+          LowPower.powerDown(SLEEP_15MS, ADC_OFF, BOD_OFF);
+          waitMs = 15;
+        }
+        // a period ended early by DOUT: the sample came at the conversion rate
+        if (loadcellWakeup) {
+          unsigned long sampleMs = nextSampleMs > now() ? (unsigned long)(nextSampleMs - now()) : 0;
+          loadcellMs += sampleMs < waitMs ? sampleMs : waitMs;
+        } else {
+          watchdogMs += waitMs;
         }
-        Serial.print(" shows ");
-        Serial.print(temperature);
-        Serial.println(" C");
       #endif
-      return temperature; 
     }
 
+    void finishAcquisition() {
+      disableReadyInterrupt();
+      #if defined(__ASR6501__)
+        TimerStop(&sensorTimer);
+      #endif
+    }
+
+    // DS18B20 temperature sensors on one-wire bus
+    float getTemperature(int index) { return DallasTemperature::rawToCelsius(temperature[index]); }
+
     // DHTxx sensor
-    float getRoofTemperature() { return dht.readTemperature(); }
-    float getRoofHumidity() { return dht.readHumidity(); }
+    float getRoofTemperature() { return roofTemperature; }
+    float getRoofHumidity() { return roofHumidity; }
 
     // HX711 with load cell
-    float getWeight() { return scale.get_units(OPERATIONAL_SAMPLING); }
+    float getWeight() {
+      if (weightFilter.accepted() == 0) return UNDEFINED_VALUE;
+      return ((float)weightFilter.sum() / weightFilter.accepted() - scale.get_offset()) / scale.get_scale();
+    }
 
     float getCompensatedWeight() {
-      if (!scaleIsReady) { return -127.0f; }
-      float weight = getWeight();
-      float outerTemperature = sensors.getTempC(thermometer[THERMOMETER_OUTER]);
-      if (isnan(outerTemperature) || outerTemperature == -127.0f) {
-        return weight;
-      } else {
-        return weight - (TEMPERATURE_FACTOR * outerTemperature) - TEMPERATURE_OFFSET;
-      }
+      int16_t weight = getCompensatedWeightValue();
+      return weight == UNDEFINED_VALUE ? -127.0f : weight / 100.0f;
     }
 
     // battery voltage
-    float getVoltage() { return readVcc() / 1000.0; }
+    float getVoltage() { return millivolts / 1000.0; }
+
+    // readings in 1/100 units of the sensor message without float math (see FixedPoint.h)
+    int16_t getTemperatureValue(int index) {
+      int16_t value = FixedPoint::temperature(temperature[index]);
+      LOG_DEBUG(LOG_THERMOMETER, index, value);
+      return value;
+    }
+
+    int16_t getRoofTemperatureValue() { return FixedPoint::tenths(roofTemperature); }
+    int16_t getRoofHumidityValue() { return FixedPoint::tenths(roofHumidity); }
+
+    int16_t getCompensatedWeightValue() {
+      if (!scaleIsReady) return UNDEFINED_VALUE;
+      int16_t outer = filterStarted ? FixedPoint::lagged(filteredOuter) : temperature[THERMOMETER_OUTER];
+      return FixedPoint::weight(weightFilter.sum(), weightFilter.accepted(), outer, weightCalibration);
+    }
+
+    int16_t getVoltageValue() { return FixedPoint::voltage(millivolts); }
+
+    // nominal watchdog periods slept since the last call (AVR), millis() does not count them
+    unsigned long takeWatchdogMs() {
+      unsigned long slept = watchdogMs;
+      watchdogMs = 0;
+      return slept;
+    }
+
+    // sleep ended by DOUT since the last call (AVR), timed by the HX711 conversions
+    unsigned long takeLoadcellMs() {
+      unsigned long slept = loadcellMs;
+      loadcellMs = 0;
+      return slept;
+    }
 
   private:
     DHT dht = DHT(DHT_PIN, DHT22);
@@ -149,15 +314,73 @@ class SensorReader {
     DallasTemperature sensors = DallasTemperature(&oneWire);
     HX711 scale = HX711();
     boolean scaleIsReady = false;
+    #if defined(__ASR6501__)
+      TimerEvent_t sensorTimer;
+    #endif
+
+    // acquisition pipeline, times in ms of now() (64 bit, they do not wrap), sleep in ms since
+    // the last take*Ms()
+    uint64_t conversionEndMs = 0;
+    uint64_t nextSampleMs = 0;
+    unsigned long watchdogMs = 0;
+    unsigned long loadcellMs = 0;
+    boolean temperaturesDone = false;
+    WeightFilter weightFilter;
+
+    int16_t temperature[THERMOMETER_COUNT];  // 1/128 C
+    TimeFunction timeFunction = 0;
+    int32_t filteredOuter = 0;  // see FixedPoint::lag()
+    uint64_t filteredMs = 0;
+    boolean filterStarted = false;
+    float roofTemperature = NAN;
+    float roofHumidity = NAN;
+    long millivolts = 0;
+
+    inline
+    uint64_t now() { return timeFunction(); }
+
+    // outer temperature with the thermal lag of the load cell
+    void filterOuterTemperature() {
+      #if TEMPERATURE_LAG_MINUTES > 0
+        uint64_t time = timeFunction();
+        uint64_t elapsed = time - filteredMs;
+        int16_t outer = temperature[THERMOMETER_OUTER];
+        filteredOuter = FixedPoint::lag(filteredOuter, filterStarted, outer, elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed,
+                                        TEMPERATURE_LAG_MINUTES * 60000UL);
+        filterStarted = filterStarted || outer > FIXED_DISCONNECTED_RAW;
+        filteredMs = time;
+      #endif
+    }
+
+    inline
+    boolean isWeightDone() { return !scaleIsReady || weightFilter.isDone(); }
+
+    void enableReadyInterrupt() {
+      #if defined(__ASR6501__)
+        attachInterrupt(LOADCELL_DOUT_PIN, onSensorWakeup, FALLING);
+      #else
+        PCMSK1 |= _BV(LOADCELL_PCINT);
+        PCICR |= _BV(PCIE1);
+      #endif
+    }
+
+    void disableReadyInterrupt() {
+      #if defined(__ASR6501__)
+        detachInterrupt(LOADCELL_DOUT_PIN);
+      #else
+        PCICR &= ~_BV(PCIE1);
+        PCMSK1 &= ~_BV(LOADCELL_PCINT);
+      #endif
+    }
 
     void printBufferAsArray(byte* buffer, int length) {
-      Serial.print("{ 0x");
+      Serial.print(F("{ 0x"));
       for (uint8_t i = 0; i < length; i++) {
-        if (i > 0) Serial.print(", 0x");
-        if (buffer[i] < 16) Serial.print("0");
+        if (i > 0) Serial.print(F(", 0x"));
+        if (buffer[i] < 16) Serial.print('0');
         Serial.print(buffer[i], HEX);
       }
-      Serial.println(" }");
+      Serial.println(F(" }"));
     }
 
     long readVcc() {
@@ -167,7 +390,6 @@ class SensorReader {
         digitalWrite(VBAT_ADC_CTL, LOW);
         long result = analogRead(ADC) * 2;
         digitalWrite(VBAT_ADC_CTL, HIGH);
-        return result;
       #else
         // see https://forum.arduino.cc/index.php?topic=120693.msg908179#msg908179
         // Read 1.1V reference against AVcc
@@ -178,9 +400,9 @@ class SensorReader {
         long result = ADCL;
         result |= ADCH<<8;
         result = 1126400L / result; // Back-calculate AVcc in mV
-        return result;
       #endif
       interrupts();
+      return result;
     }
 
 };
@@ -0,0 +1,88 @@
+/**********************************************************
+ * Wear levelled storage of the LoRaWAN session in flash
+ * (CubeCell).
+ * ---
+ * Every save writes the session record to the next of
+ * SESSION_SLOTS flash rows, the valid record with the
+ * highest sequence number is the current one. A row is
+ * erased every SESSION_SLOTS saves only.
+ * The uplink frame counter is saved ahead as a reserved
+ * limit: counters below the limit may have been used, a
+ * resumed session starts at the limit and saves again when
+ * the counter reaches it. Counters are never reused after
+ * a reset while the flash is written every
+ * SESSION_FCNT_RESERVE uplinks only.
+ **********************************************************/
+#ifndef __SESSIONSTORE_H__
+#define __SESSIONSTORE_H__
+
+#include <Arduino.h>
+
+#define SESSION_FLASH_ADDR   0x1E000  // below the core's EEPROM emulation and net info at the flash end
+#define SESSION_FLASH_ROW    256
+#define SESSION_SLOTS        8
+#define SESSION_MAGIC        0xBEE5E551UL
+#define SESSION_FCNT_RESERVE 32
+
+typedef struct {
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t netId;
+  uint32_t devAddr;
+  uint8_t  nwkSKey[16];
+  uint8_t  appSKey[16];
+  uint32_t upLinkLimit;     // frame counters below may have been used
+  uint32_t downLinkCounter;
+  uint32_t joins;           // OTAA joins since the flash was cleared
+  uint32_t checksum;
+} SessionRecord;
+
+class SessionStore {
+  public:
+    // finds the current record, false if there is no valid one
+    bool load(SessionRecord* record) {
+      bool found = false;
+      for (uint8_t slot = 0; slot < SESSION_SLOTS; slot++) {
+        SessionRecord candidate;
+        FLASH_read_at(address(slot), (uint8_t*)&candidate, sizeof(candidate));
+        if (isValid(candidate) && (!found || candidate.sequence > record->sequence)) {
+          *record = candidate;
+          found = true;
+        }
+      }
+      if (found) {
+        sequence = record->sequence;
+      }
+      return found;
+    }
+
+    void save(SessionRecord* record) {
+      record->magic = SESSION_MAGIC;
+      record->sequence = ++sequence;
+      record->checksum = checksum(*record);
+      FLASH_update(address(sequence % SESSION_SLOTS), record, sizeof(SessionRecord));
+    }
+
+  private:
+    uint32_t sequence = 0;
+
+    uint32_t address(uint8_t slot) {
+      return SESSION_FLASH_ADDR + (uint32_t)slot * SESSION_FLASH_ROW;
+    }
+
+    bool isValid(const SessionRecord& record) {
+      return record.magic == SESSION_MAGIC && record.checksum == checksum(record);
+    }
+
+    // FNV-1a of the record without the checksum
+    uint32_t checksum(const SessionRecord& record) {
+      const uint8_t* bytes = (const uint8_t*)&record;
+      uint32_t hash = 2166136261UL;
+      for (size_t i = 0; i < sizeof(SessionRecord) - sizeof(record.checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619UL;
+      }
+      return hash;
+    }
+};
+
+#endif
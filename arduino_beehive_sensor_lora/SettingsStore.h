@@ -0,0 +1,83 @@
+/**********************************************************
+ * Storage of the settings changed by downlink commands.
+ * ---
+ * One record in the flash row after the session rows
+ * (CubeCell, see SessionStore.h) or at the start of the
+ * EEPROM (AVR), kept over resets and power loss. Settings
+ * change rarely, a save only writes when they differ.
+ * A record of another layout or with a wrong checksum is
+ * ignored, the sketch starts with its defaults then.
+ **********************************************************/
+#ifndef __SETTINGSSTORE_H__
+#define __SETTINGSSTORE_H__
+
+#include <Arduino.h>
+#if !defined(__ASR6501__)
+  #include <avr/eeprom.h>
+#endif
+#include "CommandParser.h"
+
+#define SETTINGS_FLASH_ADDR   0x1E800  // SESSION_FLASH_ADDR + SESSION_SLOTS rows
+#define SETTINGS_EEPROM_ADDR  0
+#define SETTINGS_MAGIC        0xBEE5
+
+typedef struct {
+  uint16_t magic;
+  uint16_t size;      // sizeof(Settings) of the build
+  Settings settings;
+  uint32_t checksum;
+} SettingsRecord;
+
+class SettingsStore {
+  public:
+    // false if there is no valid record
+    bool load(Settings* settings) {
+      SettingsRecord record;
+      read(&record);
+      if (record.magic != SETTINGS_MAGIC || record.size != sizeof(Settings)
+          || record.checksum != checksum(record) || !CommandParser::isValid(record.settings)) {
+        return false;
+      }
+      *settings = record.settings;
+      return true;
+    }
+
+    void save(const Settings& settings) {
+      SettingsRecord record;
+      read(&record);
+      if (record.magic == SETTINGS_MAGIC && memcmp(&record.settings, &settings, sizeof(Settings)) == 0) {
+        return;
+      }
+      memset(&record, 0, sizeof(record));
+      record.magic = SETTINGS_MAGIC;
+      record.size = sizeof(Settings);
+      record.settings = settings;
+      record.checksum = checksum(record);
+      #if defined(__ASR6501__)
+        FLASH_update(SETTINGS_FLASH_ADDR, &record, sizeof(record));
+      #else
+        eeprom_update_block(&record, (void*)SETTINGS_EEPROM_ADDR, sizeof(record));
+      #endif
+    }
+
+  private:
+    void read(SettingsRecord* record) {
+      #if defined(__ASR6501__)
+        FLASH_read_at(SETTINGS_FLASH_ADDR, (uint8_t*)record, sizeof(SettingsRecord));
+      #else
+        eeprom_read_block(record, (const void*)SETTINGS_EEPROM_ADDR, sizeof(SettingsRecord));
+      #endif
+    }
+
+    // FNV-1a of the record without the checksum
+    uint32_t checksum(const SettingsRecord& record) {
+      const uint8_t* bytes = (const uint8_t*)&record;
+      uint32_t hash = 2166136261UL;
+      for (size_t i = 0; i < sizeof(SettingsRecord) - sizeof(record.checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619UL;
+      }
+      return hash;
+    }
+};
+
+#endif
@@ -0,0 +1,59 @@
+/**********************************************************
+ * High-water mark of the stack.
+ * ---
+ * AVR: begin() paints the free SRAM between the heap and the
+ * stack, unused() counts the painted bytes above the heap
+ * that the stack never reached since. The ATmega328 has no
+ * guard between them, the margin tells how close they came.
+ * Interrupts taken while painting only lower the result.
+ * Other boards have no paint, unused() is STACK_UNKNOWN.
+ **********************************************************/
+#ifndef __STACKMONITOR_H__
+#define __STACKMONITOR_H__
+
+#include <stdint.h>
+
+#define STACK_PAINT        0xA5
+#define STACK_PAINT_MARGIN   16  // below the frame of begin()
+#define STACK_UNKNOWN    0xFFFF
+
+#if defined(__AVR__)
+  extern uint8_t __heap_start;
+  extern void* __brkval;
+#endif
+
+class StackMonitor {
+  public:
+    // first thing in setup()
+    static void begin() {
+      #if defined(__AVR__)
+        uint8_t top;
+        for (uint8_t* p = heapEnd(); p < &top - STACK_PAINT_MARGIN; p++) {
+          *p = STACK_PAINT;
+        }
+      #endif
+    }
+
+    // bytes of stack never used since begin()
+    static uint16_t unused() {
+      #if defined(__AVR__)
+        uint8_t top;
+        uint8_t* p = heapEnd();
+        while (p < &top && *p == STACK_PAINT) {
+          p++;
+        }
+        return p - heapEnd();
+      #else
+        return STACK_UNKNOWN;
+      #endif
+    }
+
+  private:
+    #if defined(__AVR__)
+      static uint8_t* heapEnd() {
+        return __brkval != 0 ? (uint8_t*)__brkval : &__heap_start;
+      }
+    #endif
+};
+
+#endif
@@ -5,141 +5,292 @@
  * - handle entry and exit of states
  * - handle state callback on loop
  * - handle state timeout
+ * - count entries, timeouts, total and worst duration per
+ *   state; the time function includes the time slept
  * Client code moves direct state transitions, there are no
  * application-level events that map to specific transitions.
  * All potential state transitions are allowed.
+ * Interrupts do not move transitions: post() queues a handler
+ * (see EventQueue.h) that loop() calls once the previous
+ * transition is done, one per loop, so a handler sees the
+ * current state and no transition is overwritten. A handler
+ * that has to wait queues itself again with repost().
+ * StateTable<STATES> reads the handlers of a constant table
+ * (PROGMEM on AVR) and allocates nothing on the heap,
+ * StateMachine registers them at runtime (onEnter() etc.).
+ * With STATE_LOGGING 0 the transitions are not printed and
+ * the names (may be 0) are not needed.
  **********************************************************/
 #ifndef __STATEMACHINE_H__
 #define __STATEMACHINE_H__
 
+#if defined(__AVR__)
+  #include <avr/pgmspace.h>
+#else
+  #ifndef PROGMEM
+    #define PROGMEM
+  #endif
+  #ifndef memcpy_P
+    #define memcpy_P memcpy
+  #endif
+#endif
+
+#include "EventQueue.h"
+
+#ifndef STATE_LOGGING
+  #define STATE_LOGGING 1
+#endif
+#define STATE_EVENTS 4  // handlers posted by interrupts and not yet called
+
 #define INVALID_STATE -1
 #define INVALID_DURATION 0
 
 typedef void (*StateHandler)();
-typedef unsigned long (*TimeFunction)();
+typedef uint64_t (*TimeFunction)();
 typedef struct {
-  unsigned long maxDuration;
-  StateHandler  handler;
-} TimeoutHandler;
+  StateHandler  enter;
+  StateHandler  state;        // called on every loop
+  unsigned long maxDuration;  // ms, INVALID_DURATION without timeout
+  StateHandler  timeout;
+  StateHandler  exit;
+} StateDefinition;
+typedef struct {
+  uint64_t time;         // ms in the state since boot
+  uint32_t entries;
+  uint32_t timeouts;     // entries that timed out
+  uint32_t maxDuration;  // ms of the longest stay
+} StateStats;
 
-class StateMachine {
+class StateEngine {
   public:
-    StateMachine(int stateCount, const char** names, TimeFunction millis) 
-    : stateNames(names), 
-      timeFunction(millis),
-      enterHandler(new StateHandler[stateCount]), 
-      stateHandler(new StateHandler[stateCount]), 
-      timeoutHandler(new TimeoutHandler[stateCount]), 
-      exitHandler(new StateHandler[stateCount]) {
-      TimeoutHandler noTimeout = {INVALID_DURATION, 0};
-      for (int i = 0; i < stateCount; i++) {
-        enterHandler[i] = 0;
-        stateHandler[i] = 0;
-        timeoutHandler[i] = noTimeout;
-        exitHandler[i] = 0;
-      }
-    }
-
+    // loop context only, see post()
     void toState(int state) {
-      if (nextState != INVALID_STATE) {
-        Serial.print("Error! Not processed state transition to ");
-        Serial.println(stateName(nextState));
-      }
+      #if STATE_LOGGING
+        if (nextState != INVALID_STATE && nextState != state) {
+          Serial.print(F("Error! Not processed state transition to "));
+          printName(nextState);
+        }
+      #endif
       nextState = state;
     }
 
+    // interrupt context: the handler is called by loop(), false if the queue is full
+    inline
+    bool post(StateHandler handler) { return events.push(handler); }
+
+    // loop context: queues the handler again behind the posted ones, the interrupts are the
+    // only other producer (CubeCell: push() disables them itself and enables them again)
+    bool repost(StateHandler handler) {
+      #if defined(__ASR6501__)
+        return events.push(handler);
+      #else
+        noInterrupts();
+        bool posted = events.push(handler);
+        interrupts();
+        return posted;
+      #endif
+    }
+
+    // handlers waiting for loop(), eg. not to sleep before them
+    inline
+    bool hasEvents() { return !events.isEmpty(); }
+
+    // posted handlers lost in a full queue
+    inline
+    uint8_t lostEvents() { return events.lost(); }
+
     inline
     int state() { return currentState; }
 
     inline
     const char* stateName(int state) {
-      return stateNames[state];
+      return stateNames != 0 ? stateNames[state] : "";
     }
 
     inline
     unsigned long duration() {
-      return timeFunction() - startTime;
-    }
-
-    void onEnter(int state, StateHandler handler) {
-      enterHandler[state] = handler;
+      return (unsigned long)(timeFunction() - startTime);
     }
 
-    void onState(int state, StateHandler handler) {
-      stateHandler[state] = handler;
-    }
-
-    void onTimeout(int state, unsigned long maxDuration, StateHandler handler) {
-      TimeoutHandler timeout = {maxDuration, handler};
-      timeoutHandler[state] = timeout;
-    }
+    inline
+    int stateCount() { return count; }
 
-    void onExit(int state, StateHandler handler) {
-      exitHandler[state] = handler;
+    // counters of the state including the current stay
+    StateStats stats(int state) {
+      StateStats current = statistics[state];
+      if (state == currentState) {
+        unsigned long stay = duration();
+        current.time += stay;
+        if (stay > current.maxDuration) current.maxDuration = stay;
+      }
+      return current;
     }
 
     void loop() {
+      StateHandler event;
+      if (nextState == INVALID_STATE && events.pop(&event)) {
+        event();
+      }
       if (nextState != INVALID_STATE) {
         changeState(nextState);
         nextState = INVALID_STATE;
       }
       if (currentState != INVALID_STATE) {
-        onLoopState(currentState);
-        if (timeoutHandler[currentState].maxDuration != INVALID_DURATION && timeoutHandler[currentState].maxDuration < duration()) {
-          onTimeoutState(currentState);
+        StateDefinition current = definition(currentState);
+        if (current.state != 0) {
+          current.state();
+        }
+        if (current.maxDuration != INVALID_DURATION && current.maxDuration < duration()) {
+          if (!timedOut) {
+            statistics[currentState].timeouts++;
+            timedOut = true;
+          }
+          onTimeoutState(currentState, current.timeout);
         }
       }
     }
 
   protected:
+    const StateDefinition* table;
+
+    StateEngine(int stateCount, const StateDefinition* table, bool programMemory, StateStats* statistics,
+                const char* const* names, TimeFunction time)
+    : table(table),
+      programMemory(programMemory),
+      count(stateCount),
+      stateNames(names),
+      timeFunction(time),
+      statistics(statistics) {}
+
+    StateDefinition definition(int state) {
+      StateDefinition current;
+      if (programMemory) {
+        memcpy_P(&current, table + state, sizeof(current));
+      } else {
+        current = table[state];
+      }
+      return current;
+    }
+
     void changeState(int nextState) {
       if (currentState != INVALID_STATE) {
         onExitState(currentState);
+        countStay(currentState);
       }
       currentState = nextState;
       startTime = timeFunction();
+      timedOut = false;
       if (currentState != INVALID_STATE) {
+        statistics[currentState].entries++;
         onEnterState(currentState);
       }
     }
-  
+
     void onEnterState(int newState) {
-      Serial.print("\nEnter state "); Serial.println(stateName(newState));
-      if (enterHandler[newState] != 0) {
-        enterHandler[newState]();
+      #if STATE_LOGGING
+        Serial.print(F("\nEnter state ")); printName(newState);
+      #endif
+      StateHandler enter = definition(newState).enter;
+      if (enter != 0) {
+        enter();
       }
     }
-    
-    void onLoopState(int state) {
-      if (stateHandler[state] != 0) {
-        stateHandler[state]();
+
+    void onTimeoutState(int state, StateHandler timeout) {
+      #if STATE_LOGGING
+        Serial.print(F("Timeout state ")); printName(state);
+      #else
+        (void)state;
+      #endif
+      if (timeout != 0) {
+        timeout();
       }
     }
-    
-    void onTimeoutState(int state) {
-      Serial.print("Timeout state "); Serial.println(stateName(state));
-      if (timeoutHandler[state].handler != 0) {
-        timeoutHandler[state].handler();
+
+    void onExitState(int oldState) {
+      StateHandler exit = definition(oldState).exit;
+      if (exit != 0) {
+        exit();
       }
+      #if STATE_LOGGING
+        Serial.print(F("Exit state ")); printName(oldState);
+      #endif
     }
-    
-    void onExitState(int oldState) {
-      if (exitHandler[oldState] != 0) {
-        exitHandler[oldState]();
+
+    void countStay(int state) {
+      unsigned long stay = duration();
+      statistics[state].time += stay;
+      if (stay > statistics[state].maxDuration) {
+        statistics[state].maxDuration = stay;
+      }
+    }
+
+  #if STATE_LOGGING
+    void printName(int state) {
+      if (stateNames != 0) {
+        Serial.println(stateNames[state]);
+      } else {
+        Serial.println(state);
       }
-      Serial.print("Exit state "); Serial.println(stateName(oldState));
     }
+  #endif
 
   private:
-    unsigned long startTime;
+    uint64_t startTime = 0;
+    bool programMemory;
+    bool timedOut = false;
+    int count;
     int currentState = INVALID_STATE;
-    volatile int nextState = INVALID_STATE;
-    const char** stateNames;
+    int nextState = INVALID_STATE;
+    EventQueue<StateHandler, STATE_EVENTS> events;
+    const char* const* stateNames;
     TimeFunction timeFunction;
-    StateHandler* enterHandler;
-    StateHandler* stateHandler;
-    TimeoutHandler* timeoutHandler;
-    StateHandler* exitHandler;
+    StateStats* statistics;
+};
+
+// handlers of a constant table of STATES definitions in program memory
+template <uint8_t STATES>
+class StateTable : public StateEngine {
+  public:
+    StateTable(const StateDefinition* table, const char* const* names, TimeFunction time)
+    : StateEngine(STATES, table, true, counters, names, time) {}
+
+  private:
+    StateStats counters[STATES] = {};
+};
+
+// handlers registered at runtime in a table on the heap
+class StateMachine : public StateEngine {
+  public:
+    StateMachine(int stateCount, const char** names, TimeFunction millis)
+    : StateEngine(stateCount, 0, false, new StateStats[stateCount](), names, millis),
+      definitions(new StateDefinition[stateCount]) {
+      StateDefinition noHandlers = {0, 0, INVALID_DURATION, 0, 0};
+      for (int i = 0; i < stateCount; i++) {
+        definitions[i] = noHandlers;
+      }
+      table = definitions;
+    }
+
+    void onEnter(int state, StateHandler handler) {
+      definitions[state].enter = handler;
+    }
+
+    void onState(int state, StateHandler handler) {
+      definitions[state].state = handler;
+    }
+
+    void onTimeout(int state, unsigned long maxDuration, StateHandler handler) {
+      definitions[state].maxDuration = maxDuration;
+      definitions[state].timeout = handler;
+    }
+
+    void onExit(int state, StateHandler handler) {
+      definitions[state].exit = handler;
+    }
+
+  private:
+    StateDefinition* definitions;
 };
 
 #endif
@@ -0,0 +1,109 @@
+/**********************************************************
+ * Outlier rejecting filter of the load cell samples.
+ * ---
+ * Keeps the raw HX711 readings of one measurement sorted.
+ * Readings further than 4.5 median absolute deviations
+ * (about 3 sigma of normal noise, at least the tolerance)
+ * from the median are outliers, eg. a bee landing or a gust
+ * of wind, the others are averaged.
+ * Sampling is done as soon as the standard error of the
+ * average is within the tolerance (after WEIGHT_MIN_SAMPLES)
+ * and continues up to WEIGHT_MAX_SAMPLES while it is noisy.
+ * A tolerance of 0 (uncalibrated divider) stops after
+ * WEIGHT_MIN_SAMPLES.
+ * Integer math only, the tolerance is in raw counts.
+ **********************************************************/
+#ifndef __WEIGHTFILTER_H__
+#define __WEIGHTFILTER_H__
+
+#include <stdint.h>
+
+#define WEIGHT_MIN_SAMPLES  4
+#define WEIGHT_MAX_SAMPLES 16
+
+class WeightFilter {
+  public:
+    void reset(int32_t tolerance) {
+      this->tolerance = tolerance;
+      count = 0;
+      inliers = 0;
+      inlierSum = 0;
+      stable = false;
+    }
+
+    void add(int32_t reading) {
+      if (count >= WEIGHT_MAX_SAMPLES) return;
+      uint8_t i = count++;
+      for (; i > 0 && samples[i - 1] > reading; i--) {
+        samples[i] = samples[i - 1];
+      }
+      samples[i] = reading;
+      evaluate();
+    }
+
+    inline
+    bool isDone() { return stable || count >= WEIGHT_MAX_SAMPLES; }
+
+    // readings taken, readings averaged and their sum
+    inline
+    uint8_t size() { return count; }
+    inline
+    uint8_t accepted() { return inliers; }
+    inline
+    int32_t sum() { return inlierSum; }
+
+  private:
+    int32_t samples[WEIGHT_MAX_SAMPLES];  // ascending
+    uint8_t count = 0;
+    int32_t tolerance = 0;
+    uint8_t inliers = 0;
+    int32_t inlierSum = 0;
+    bool stable = false;
+
+    void evaluate() {
+      int32_t median = count % 2 ? samples[count / 2] : samples[count / 2 - 1] / 2 + samples[count / 2] / 2;
+      int32_t limit = deviation(median, (count + 1) / 2) * 9 / 2;
+      if (limit < tolerance) limit = tolerance;
+
+      inliers = 0;
+      inlierSum = 0;
+      for (uint8_t i = 0; i < count; i++) {
+        if (distance(samples[i], median) <= (uint32_t)limit) {
+          inlierSum += samples[i];
+          inliers++;
+        }
+      }
+      // standard error of the average: squares / (n * (n - 1)) <= tolerance^2
+      int32_t average = inlierSum / inliers;
+      uint64_t squares = 0;
+      for (uint8_t i = 0; i < count; i++) {
+        if (distance(samples[i], median) <= (uint32_t)limit) {
+          uint32_t d = distance(samples[i], average);
+          squares += (uint64_t)d * d;
+        }
+      }
+      stable = count >= WEIGHT_MIN_SAMPLES && inliers >= WEIGHT_MIN_SAMPLES
+               && (tolerance == 0 || squares <= (uint64_t)tolerance * tolerance * inliers * (inliers - 1));
+    }
+
+    inline
+    uint32_t distance(int32_t a, int32_t b) { return a > b ? (uint32_t)(a - b) : (uint32_t)(b - a); }
+
+    // k-th smallest distance of the sorted samples to center, walking outwards
+    uint32_t deviation(int32_t center, uint8_t k) {
+      int8_t lower = -1;
+      while (lower + 1 < count && samples[lower + 1] <= center) lower++;
+      uint8_t upper = lower + 1;
+      uint32_t d = 0;
+      for (uint8_t taken = 0; taken < k; taken++) {
+        if (lower >= 0 && (upper >= count || center - samples[lower] <= samples[upper] - center)) {
+          d = distance(center, samples[lower--]);
+        } else {
+          d = distance(samples[upper++], center);
+        }
+      }
+      return d;
+    }
+};
+
+#endif
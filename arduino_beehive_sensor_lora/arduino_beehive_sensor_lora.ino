@@ -4,8 +4,29 @@
  * ---
  * The sensors are read in intervals and the sensor data message
  * is sent using LoRa. The controller then goes to deep sleep to
- * reduce power.
+ * reduce power. It also sleeps while the sensors are acquiring
+ * (temperature conversion, weight sampling). The interval adapts
+ * to the rate of change and the battery (see MeasureScheduler.h).
+ * Uplinks are deferred while the airtime of the last hour or day
+ * exceeds the duty cycle or fair use budget (see AirtimeBudget.h).
+ * Pending MAC commands and downlinks are flushed with an empty
+ * uplink right away, the sensor data goes in a frame of its own.
+ * A measure is kept if it leaves the change limits around the linear
+ * prediction of the stored samples, the receiver runs the same
+ * predictor on the samples to fill the gaps (see Predictor.h).
+ * Once a day the time spent in each state is sent in a diagnostics
+ * message, when no measures are due.
+ * A sudden change of the weight or of the brood nest temperature
+ * (swarm, theft) shortens the measure interval and is sent as an
+ * alert on port 2 right away (see AlertDetector.h).
+ * The sensor values and MAC events are logged into a RAM ring
+ * (see Log.h), printed in manual mode.
+ * Downlinks on port 10 change the measure intervals, the change
+ * limits, the confirmation interval and the datarate; the settings
+ * are kept over resets (see CommandParser.h, SettingsStore.h).
  * A manual mode stops sending data but continuous to read raw data.
+ * The button and timer interrupts post their handlers to the state
+ * machine, called in the loop (see StateMachine.h, EventQueue.h).
  * - USB/Battery voltage measurement (internal)
  * - DS18B20 temperature sensors (multiple) are read from pin D5 (GPIO5)
  * - DHT22 temperature/humidity sensor is read from pin D4 (GPIO4)
@@ -15,6 +36,12 @@
  * ---
  * message version (aka command):
  *  0: sensor data v0 (short/100)
+ *  1: sensor data v1 (bit packed, optional delta, see MessageCodec.h)
+ *  2: batch of sensor data v1 samples (see MessageCodec.h)
+ *  3: diagnostics, counters of the states since boot (see MessageCodec.h)
+ *  4: backfill of journal samples (see MessageCodec.h)
+ *  5: statistics of the measures per interval (see MessageCodec.h)
+ *  6: alert of a sudden change, port 2 (see MessageCodec.h)
  **********************************************************/
 
 // see credentials.h, calibration.h
@@ -26,8 +53,10 @@
 #define TEST_123    12      // Dragino  - ABP
 
 // see credentials.h, calibration.h
-#define DEVICE_ID   KROKUS
-#define DEVICE_NAME krokus
+#ifndef DEVICE_ID
+  #define DEVICE_ID   KROKUS
+  #define DEVICE_NAME krokus
+#endif
 
 #if defined(__ASR6501__)
   #include "CubeCellLoRa.h"
@@ -36,11 +65,35 @@
   #include "DraginoLoRa.h"
 #endif
 #include "SensorReader.h"
+#include "Log.h"
+#if !defined(__ASR6501__) && !defined(STATE_LOGGING)
+  #define STATE_LOGGING 0   // SRAM of the ATmega328
+#endif
 #include "StateMachine.h"
 #include "Interaction.h"
+#include "MessageCodec.h"
+#include "SampleBuffer.h"
+#include "Aggregator.h"
+#include "AlertDetector.h"
+#include "Predictor.h"
+#include "JournalStore.h"
+#include "MeasureScheduler.h"
+#include "Clock.h"
+#include "CommandParser.h"
+#include "SettingsStore.h"
+#include "StackMonitor.h"
 
 #define UNDEFINED_VALUE -32768
-#define MESSAGE_VERSION 0
+#define MESSAGE_VERSION 2
+#define DELTA_FRAMES    0  // v1 delta frames after an absolute frame, the receiver has to resolve them
+#ifndef DUAL_PREDICTION
+  #define DUAL_PREDICTION 1  // v2 change limits around the prediction of the samples, 0 around the last sample
+#endif
+#define MESSAGE_FIELD_COUNT (4 + THERMOMETER_COUNT)
+
+#if MESSAGE_FIELD_COUNT > MESSAGE_V1_MAX_FIELDS
+  #error "Too many sensor values for message v1"
+#endif
 
 typedef struct {
   byte version;
@@ -66,36 +119,179 @@ typedef union {
 #define HOUR (60*MIN)
 #define DAY  (24*HOUR)
 
-unsigned long getTime();
+uint64_t getTime();
 void onSwitchManualMode();
+void onButtonInterrupt();
+void onWakeupTimer();
+void onManualTimer();
+
+// prototypes are generated by the Arduino IDE, declared for the host build
+void initializeMessage();
+void applySettings();
+void onDownlink(uint8_t port, const uint8_t* data, uint8_t size);
+void applyCommand();
+void beginJoin();
+void joining();
+void onJoinTimeout();
+void beginAcquisition();
+void acquiring();
+void sleepAcquisition();
+void onAcquisitionTimeout();
+void endAcquisition();
+void measure();
+void sendMessage();
+void transmitting();
+void onTransmitTimeout();
+void linkFailed();
+void powerDown();
+void sleeping();
+void onSleepTimeout();
+void wakeUp();
+void powerUp();
+void beginManual();
+void onManualTimeout();
+void manualMode();
+void endManual();
+void measureRawData();
+void readSensors(byte index);
+void printSensorData(byte index);
+uint16_t backfillCount();
 
 #define RAW_MEASURE_INTERVAL    (4*SEC)   // Dragino only allows 8s, 4s, 2s, 1s
-#define MEASURE_INTERVAL        (5*MIN)
+#define MEASURE_INTERVAL        (5*MIN)   // until the rate of change is known
+#define MIN_MEASURE_INTERVAL    (2*MIN)
+#define MAX_MEASURE_INTERVAL    (30*MIN)  // equal bounds for a fixed interval
 #define UNCONDITIONAL_INTERVAL  (30*MIN)
-#define CONFIRMATION_INTERVAL   (12*HOUR)
-#define RESET_INTERVAL          (6*DAY)
+#define CONFIRMATION_INTERVAL   (12*HOUR) // link validation
+#define CALIBRATION_INTERVAL    (1*DAY)   // watchdog against timer0 (AVR)
+#define DIAGNOSTICS_INTERVAL    (1*DAY)
 #define JOIN_WAIT               (60*MIN)
 #define TRANSMISSION_WAIT       (15*SEC)
+#define ACQUISITION_WAIT        (3*SEC)
+#define MAX_BATCH_AGE           (4*HOUR)  // age of the oldest sample of a batch, below 255 min
 #define MAX_TRANSMISSION_FAIL   5
+#define MAX_FLUSH_UPLINKS       2   // per measure, for pending MAC commands and downlinks
+#define MAX_BACKFILL_UPLINKS    1   // per measure, journal samples of a lost link
+#ifndef LINK_CHECK
+  #define LINK_CHECK            1   // validate the link with LinkCheckReq in a data frame, 0 with confirmed frames
+#endif
+#ifndef AGGREGATION
+  #if defined(__ASR6501__)
+    #define AGGREGATION         1   // statistics of the measures per unconditional interval (message 5)
+  #else
+    #define AGGREGATION         0   // a single interval per frame of 51 bytes, above the airtime budget
+  #endif
+#endif
+#define AGGREGATE_MIN_MEASURES  2   // a single measure is sent as sample
+#define AGGREGATE_WINDOWS       5   // intervals kept for a frame of message 5
+#define ALERT_PORT              2   // message 6, apart from the sensor data on port 1
+#define ALERT_INTERVAL          (15*SEC)  // measure interval while a sudden change is checked
+#ifndef ALERT_CONFIRMATION
+  #if defined(__ASR6501__)
+    #define ALERT_CONFIRMATION  1   // confirmed alert, sent again at the next measure without ack
+  #else
+    #define ALERT_CONFIRMATION  0   // the sketch confirms on CubeCell only
+  #endif
+#endif
 
 #define LIMIT_WEIGHT_DIFF       10  // 0.100 kg
 #define LIMIT_TEMPERATURE_DIFF  50  // 0.50 degrees
 #define LIMIT_HUMIDITY_DIFF    200  // 2.0 %
+#define ARM_WEIGHT_DIFF         30  // 0.30 kg, measures at ALERT_INTERVAL above
+#define ALERT_WEIGHT_DIFF      150  // 1.50 kg, a swarm leaves with 1.5..3 kg of bees
+#define ARM_TEMPERATURE_DIFF   100  // 1.00 degrees
+#define ALERT_TEMPERATURE_DIFF 250  // 2.50 degrees, a brood nest is kept within +-0.5
+
+#if defined(__ASR6501__)
+  #define BATTERY_SAVING_VOLTAGE 370  // 3.70 V LiPo, doubled intervals below
+  #define BATTERY_LOW_VOLTAGE    350  // 3.50 V LiPo, max interval below
+#else
+  #define BATTERY_SAVING_VOLTAGE   0  // the measured AVcc is regulated
+  #define BATTERY_LOW_VOLTAGE      0
+#endif
 
 message_t message[2];
 byte lastMsgIndex = 0;
+#if MESSAGE_VERSION == 2
+  #if defined(__ASR6501__)
+    byte payload[222]; // max payload of DR5 (EU868)
+  #else
+    byte payload[51];  // max payload of DR0..2 (EU868)
+  #endif
+  // samples of a batch: 15 on CubeCell, 5 in the 51 bytes on AVR (2 KB SRAM)
+  #define BATCH_SAMPLES MESSAGE_V2_SAMPLES(sizeof(payload), MESSAGE_FIELD_COUNT)
+  SampleBuffer<BATCH_SAMPLES, MESSAGE_FIELD_COUNT> samples;
+  // every stored sample, replayed from backfillNext on after a lost link (see Journal.h)
+  typedef Journal<JournalStore<JOURNAL_RECORD_SIZE(MESSAGE_FIELD_COUNT)>, JOURNAL_SLOTS(MESSAGE_FIELD_COUNT), MESSAGE_FIELD_COUNT> SampleJournal;
+  SampleJournal journal;
+  uint16_t backfillNext = 0;
+  byte backfillUplinks = 0;
+  #if DUAL_PREDICTION
+    Predictor<MESSAGE_FIELD_COUNT> predictor;
+  #endif
+#else
+  byte payload[MESSAGE_V1_MAX_SIZE > sizeof(message_t) ? MESSAGE_V1_MAX_SIZE : sizeof(message_t)];
+#endif
+#if AGGREGATION
+  Aggregator<MESSAGE_FIELD_COUNT> aggregator;
+  uint64_t        aggregateStartMs = 0L;
+  uint64_t        aggregateEndMs = 0L;    // of the newest closed interval
+  AggregateWindow aggregateWindows[AGGREGATE_WINDOWS];
+  FieldStatistics aggregates[AGGREGATE_WINDOWS * MESSAGE_FIELD_COUNT];
+  byte            aggregateCount = 0;
+  boolean         aggregatePending = false;
+#endif
+const AlertLimits alertLimits = {ARM_WEIGHT_DIFF, ALERT_WEIGHT_DIFF, ARM_TEMPERATURE_DIFF, ALERT_TEMPERATURE_DIFF};
+AlertDetector<MESSAGE_FIELD_COUNT> alertDetector(alertLimits);
+AlertReport alert;
+boolean     alertPending = false;
+boolean     alertConfirming = false;  // a confirmed alert is on air
+short keyFrame[MESSAGE_FIELD_COUNT];
+byte keyFrameId = 0;
+byte deltaFrames = DELTA_FRAMES;
 
 unsigned long seqNumber = 0L;
-unsigned long lastMeasureMs = 0L;
-unsigned long lastTransmissionMs = 0L;
-unsigned long lastConfirmationMs = 0L;
-unsigned long sleptMs = 0L;
+uint64_t      lastMeasureMs = 0L;
+uint64_t      nextMeasureMs = 0L;
+uint64_t      lastTransmissionMs = 0L;
+uint64_t      lastSampleMs = 0L;
+uint64_t      lastConfirmationMs = 0L;
+uint64_t      lastCalibrationMs = 0L;
+uint64_t      lastDiagnosticsMs = 0L;
+uint64_t      lastJoinMs = 0L;
+byte          diagnosticsLength = 0;   // diagnostics message in payload
 boolean       requireConfirmation = false;
+boolean       linkCheckPending = false;
+boolean       dataPending = false;     // sensor data waits for a flush uplink
+byte          flushUplinks = 0;
 unsigned int  transmissionFailed = 0;
 
-typedef enum               {JOIN,   MEASURE,   TRANSMIT,   SLEEP,   MANUAL } States;
-const char* stateNames[] = {"Join", "Measure", "Transmit", "Sleep", "Manual"};
-StateMachine node(5, stateNames, getTime);
+typedef enum               {JOIN,   ACQUIRE,   MEASURE,   TRANSMIT,   SLEEP,   MANUAL } States;
+const char* const stateNames[] = {"Join", "Acquire", "Measure", "Transmit", "Sleep", "Manual"};
+// enter, state, timeout after ms, on timeout, exit
+const StateDefinition nodeStates[] PROGMEM = {
+  {beginJoin,        joining,      JOIN_WAIT,            onJoinTimeout,        0},
+  {beginAcquisition, acquiring,    ACQUISITION_WAIT,     onAcquisitionTimeout, endAcquisition},
+  {0,                measure,      INVALID_DURATION,     0,                    0},
+  {sendMessage,      transmitting, TRANSMISSION_WAIT,    onTransmitTimeout,    0},
+  {powerDown,        sleeping,     COMMAND_MAX_INTERVAL * MIN, onSleepTimeout, powerUp}, // timeout: missed wakeup, max interval of a command
+  {beginManual,      manualMode,   INVALID_DURATION,     0,                    endManual}
+};
+Clock nodeClock;
+short changeLimits[MESSAGE_FIELD_COUNT];
+const Settings defaultSettings = {MIN_MEASURE_INTERVAL / MIN, MAX_MEASURE_INTERVAL / MIN, UNCONDITIONAL_INTERVAL / MIN, CONFIRMATION_INTERVAL / MIN,
+                                  LIMIT_WEIGHT_DIFF, LIMIT_TEMPERATURE_DIFF, LIMIT_HUMIDITY_DIFF, SETTINGS_DATARATE_DEFAULT};
+Settings settings;
+SettingsStore settingsStore;
+byte command[COMMAND_MAX_SIZE];  // downlink applied in powerDown()
+byte commandLength = 0;
+const ScheduleBounds scheduleBounds = {MIN_MEASURE_INTERVAL, MAX_MEASURE_INTERVAL, BATTERY_SAVING_VOLTAGE, BATTERY_LOW_VOLTAGE};
+MeasureScheduler<MESSAGE_FIELD_COUNT> scheduler(changeLimits, scheduleBounds, MEASURE_INTERVAL);
+#if STATE_LOGGING
+  StateTable<6> node(nodeStates, stateNames, getTime);
+#else
+  StateTable<6> node(nodeStates, 0, getTime);
+#endif
 
 Interaction interaction;
 
@@ -111,31 +307,30 @@ SensorReader sensor = SensorReader();
 /* Setup ******************************************/
 
 void setup() {
+  StackMonitor::begin();
   Serial.begin(115200);
   delay(500);
+  Log::begin(getTime);
 
   #if defined(__ASR6501__)
     boardInitMcu();
   #endif
-  sensor.begin();
+  sensor.begin(getTime);
+  nodeClock.calibrate();
   initializeMessage();
-  radio.begin();
-  interaction.begin(onSwitchManualMode);
-
-  node.onEnter(JOIN, beginJoin);
-  node.onState(JOIN, joining);
-  node.onTimeout(JOIN, JOIN_WAIT, onJoinTimeout);
-  node.onState(MEASURE, measure);
-  node.onEnter(TRANSMIT, sendMessage);
-  node.onState(TRANSMIT, transmitting);
-  node.onTimeout(TRANSMIT, TRANSMISSION_WAIT, onTransmitTimeout);
-  node.onEnter(SLEEP, powerDown);
-  node.onState(SLEEP, sleeping);
-  node.onTimeout(SLEEP, MEASURE_INTERVAL, onSleepTimeout);
-  node.onExit(SLEEP, powerUp);
-  node.onEnter(MANUAL, beginManual);
-  node.onState(MANUAL, manualMode);
-  node.onExit(MANUAL, endManual);
+  radio.begin(getTime);
+  radio.onReceive(onDownlink);
+  if (!settingsStore.load(&settings)) {
+    settings = defaultSettings;
+  }
+  applySettings();
+  #if MESSAGE_VERSION == 2
+    journal.begin();
+    backfillNext = journal.acknowledged() + 1;
+    Serial.print(journal.count()); Serial.print(F(" samples in journal, "));
+    Serial.print(backfillCount()); Serial.println(F(" to backfill"));
+  #endif
+  interaction.begin(onButtonInterrupt);
 
   node.toState(JOIN);
 }
@@ -149,12 +344,12 @@ void setup() {
 void initializeMessage() {
   #if defined(__ASR6501__)
     Serial.print(ABOUT_MESSAGE);
-    Serial.print(" (");
+    Serial.print(F(" ("));
     Serial.print(sizeof(message[0]));
-    Serial.println(" bytes)");
+    Serial.println(F(" bytes)"));
   #endif
   for (int m = 0; m < 2; m++) {
-    message[m].sensor.version = MESSAGE_VERSION;
+    message[m].sensor.version = 0;
     message[m].sensor.battery = UNDEFINED_VALUE;
     message[m].sensor.weight = UNDEFINED_VALUE;
     message[m].sensor.humidity.roof = UNDEFINED_VALUE;
@@ -165,6 +360,23 @@ void initializeMessage() {
   }
 }
 
+// change limits in the field order of message v1 (the battery does not count as change),
+// measure intervals and datarate
+void applySettings() {
+  changeLimits[0] = 0;
+  changeLimits[1] = settings.limitWeight;
+  changeLimits[2] = settings.limitHumidity;
+  changeLimits[3] = settings.limitTemperature;
+  for (int i = 0; i < THERMOMETER_COUNT; i++) {
+    changeLimits[4 + i] = settings.limitTemperature;
+  }
+  ScheduleBounds bounds = scheduleBounds;
+  bounds.minInterval = settings.minInterval * MIN;
+  bounds.maxInterval = settings.maxInterval * MIN;
+  scheduler.setBounds(bounds);
+  radio.setDatarate(settings.datarate);
+}
+
 /* Loop ******************************************/
 
 void loop() {
@@ -175,21 +387,47 @@ void loop() {
 /* Event handler ******************************************/
 
 bool unconditionalTransmit();
+bool isWithinBudget();
+bool isFlushDue();
+bool isBackfillDue();
+void detectAlert(byte index);
+bool isAlertDue();
+void sendAlert();
+void messageValues(byte index, short* values);
+void aggregate(byte index);
+bool isAggregateDue();
+void sendAggregate();
+void dropAggregates(byte count);
+byte encodeAggregate(byte* count);
+void sendBackfill();
+byte encodeBackfill(byte* count);
+void sleepOrDiagnose();
+byte encodeDiagnostics();
+bool isValidationDue();
 bool withConfirmation();
+byte maxMessageSize();
 bool hasChanged(byte index);
-bool hasChangedWeight(short lastValue, short nextValue);
-bool hasChangedTemperature(short lastValue, short nextValue);
-bool hasChangedHumidity(short lastValue, short nextValue);
+void scheduleMeasure(byte index);
+void printScheduleReason(byte reason);
+byte encodeMessage(byte index);
+void storeSample(byte index);
+uint32_t journalMinutes();
+bool isBatchComplete();
+byte encodeBatch(byte* count);
+byte encodeSamples(byte count, byte maxPayload, bool withSchedule);
 
 // JOIN ---------------------------
 
 void beginJoin() {
+  lastJoinMs = getTime();
   radio.join();
 }
 
+// a due measure does not wait for a pending join, the samples go to the journal
 void joining() {
-  if (!radio.isJoining()) {
-    node.toState(MEASURE);
+  if (!radio.isJoining()
+      || (getTime() - lastJoinMs >= TRANSMISSION_WAIT && getTime() >= nextMeasureMs)) {
+    node.toState(ACQUIRE);
   }
 }
 
@@ -197,31 +435,170 @@ void onJoinTimeout() {
   node.toState(JOIN); // try again
 }
 
+// ACQUIRE ---------------------------
+
+void beginAcquisition() {
+  sensor.startAcquisition();
+}
+
+void acquiring() {
+  if (sensor.collectAcquisition()) {
+    node.toState(MEASURE);
+  } else {
+    sleepAcquisition();
+  }
+}
+
+// sleeps until the next sensor result, the clock counts the sleep
+void sleepAcquisition() {
+  sensor.sleepAcquisition();
+  nodeClock.addSleep(sensor.takeWatchdogMs());
+  nodeClock.addSleepMs(sensor.takeLoadcellMs());
+}
+
+void onAcquisitionTimeout() {
+  Serial.println(F("Sensor acquisition not complete"));
+  node.toState(MEASURE);
+}
+
+void endAcquisition() {
+  sensor.finishAcquisition();
+}
+
 // MEASURE ---------------------------
 
 void measure() {
   lastMeasureMs = getTime();
+  flushUplinks = 0;
+  #if MESSAGE_VERSION == 2
+    backfillUplinks = 0;
+  #endif
   byte index = (lastMsgIndex + 1) % 2;
   readSensors(index);
-  #if defined(__ASR6501__)
-    printSensorData(index);
-  #endif
+  printSensorData(index);
+  scheduleMeasure(index);
+  aggregate(index);
+  detectAlert(index);
   if (unconditionalTransmit() || hasChanged(index)) {
+    #if MESSAGE_VERSION == 2
+      storeSample(index);
+      if (!isBatchComplete() || radio.isJoining()) {
+        Serial.print(samples.count()); Serial.println(F(" samples stored"));
+        sleepOrDiagnose();
+        return;
+      }
+    #endif
+    if (!isWithinBudget()) {
+      node.toState(isAlertDue() ? TRANSMIT : SLEEP);
+      return;
+    }
+    dataPending = true;
     node.toState(TRANSMIT);
   } else {
-    Serial.println("No changes");
+    Serial.println(F("No changes"));
+    sleepOrDiagnose();
+  }
+}
+
+// the diagnostics use a measure without transmission, so do the journal samples of a lost link
+// and the statistics of a closed interval; an alert goes at once
+void sleepOrDiagnose() {
+  if (radio.isJoining()) {
+    node.toState(SLEEP);
+    return;
+  }
+  if (isAlertDue() || isBackfillDue() || isAggregateDue()) {
+    node.toState(TRANSMIT);
+    return;
+  }
+  if (getTime() - lastDiagnosticsMs < DIAGNOSTICS_INTERVAL) {
+    node.toState(SLEEP);
+    return;
+  }
+  lastDiagnosticsMs = getTime();
+  #if defined(__AVR__)
+    LOG_INFO(LOG_UNUSED_STACK, 0, StackMonitor::unused());
+  #endif
+  byte length = encodeDiagnostics();
+  if (length == 0 || !radio.isWithinBudget(length, false, FRAME_PRIORITY_LOW)) {
     node.toState(SLEEP);
+    return;
   }
+  diagnosticsLength = length;
+  node.toState(TRANSMIT);
 }
 
 // TRANSMIT ---------------------------
 
+// an alert goes first, then a flush uplink; the diagnostics, the statistics, the sensor data or
+// the journal samples follow in their own frame
 void sendMessage() {
-  byte index = (lastMsgIndex + 1) % 2;
   lastTransmissionMs = getTime();
-  requireConfirmation = withConfirmation();
-  seqNumber = radio.send(message[index].bytes, sizeof(message[index]), requireConfirmation);
-  lastMsgIndex = index;
+  requireConfirmation = false;
+  if (isAlertDue()) {
+    sendAlert();
+    return;
+  }
+  if (isFlushDue()) {
+    flushUplinks++;
+    radio.flush();
+    return;
+  }
+  if (diagnosticsLength > 0) {
+    seqNumber = radio.send(payload, diagnosticsLength, false);
+    diagnosticsLength = 0;
+    return;
+  }
+  #if AGGREGATION
+    if (aggregatePending) {
+      sendAggregate();
+      return;
+    }
+  #endif
+  #if MESSAGE_VERSION == 2
+    if (!dataPending) {
+      sendBackfill();
+      return;
+    }
+  #endif
+  dataPending = false;
+  #if LINK_CHECK
+    if (isValidationDue()) {
+      if (transmissionFailed > 0) {
+        Serial.println(F("Link check after fail"));
+      } else {
+        Serial.println(F("Link check"));
+      }
+      radio.requestLinkCheck();
+      linkCheckPending = true;
+    }
+  #else
+    requireConfirmation = withConfirmation();
+  #endif
+  #if MESSAGE_VERSION == 2
+    byte count;
+    byte length = encodeBatch(&count);
+  #else
+    byte index = (lastMsgIndex + 1) % 2;
+    byte length = encodeMessage(index);
+    lastMsgIndex = index;
+    lastSampleMs = lastTransmissionMs;
+  #endif
+  seqNumber = radio.send(payload, length, requireConfirmation);
+  if (!radio.isTransmitting()) {
+    // not sent, eg. MAC commands fill the frame: the samples are kept, sent after a flush if due
+    requireConfirmation = false;
+    dataPending = radio.isFlushPending();
+    return;
+  }
+  #if MESSAGE_VERSION == 2
+    // sent up to the batch in RAM unless the journal samples before are still to be replayed
+    bool backfilling = backfillCount() > 0;
+    samples.drop(count);
+    if (!backfilling) {
+      backfillNext = journal.last() + 1 - samples.count();
+    }
+  #endif
 }
 
 void transmitting() {
@@ -231,16 +608,55 @@ void transmitting() {
       requireConfirmation = false;
       lastConfirmationMs = getTime();
     }
+    alertConfirming = false;
+    if (commandLength > 0) {
+      applyCommand();  // before a flush fetches the next downlink
+    }
+    if (linkCheckPending && radio.linkCheck() != LINK_CHECK_PENDING) {
+      // answered in this frame or one of its flush uplinks
+      linkCheckPending = false;
+      if (radio.linkCheck() == LINK_CHECK_PASSED) {
+        transmissionFailed = 0;
+        lastConfirmationMs = getTime();
+        #if MESSAGE_VERSION == 2
+          journal.acknowledge(backfillNext - 1);
+        #endif
+      } else {
+        Serial.println(F("Link check failed"));
+        linkFailed();
+      }
+    }
+    if (isFlushDue() || diagnosticsLength > 0 || isAggregateDue() || dataPending || isBackfillDue()) {
+      node.toState(TRANSMIT);
+      return;
+    }
     node.toState(SLEEP);
   }
 }
 
 void onTransmitTimeout() {
-  transmissionFailed++;
   radio.clear();
   node.toState(SLEEP);
+  linkFailed();
+  if (alertConfirming) {
+    alertConfirming = false;
+    alertPending = true;  // sent again at the next measure
+  }
+}
+
+// a timeout or an unanswered link check, the session is joined again after too many in a row;
+// the samples since the last passed check are replayed from the journal
+void linkFailed() {
+  transmissionFailed++;
+  #if MESSAGE_VERSION == 2
+    uint16_t unconfirmed = journal.acknowledged() + 1;
+    if (isSequenceBefore(unconfirmed, backfillNext)) {
+      backfillNext = unconfirmed;
+    }
+  #endif
   #if defined(__ASR6501__)
     if (transmissionFailed > MAX_TRANSMISSION_FAIL) {
+      radio.forgetSession();
       HW_Reset(0);
     }
   #endif
@@ -248,11 +664,39 @@ void onTransmitTimeout() {
 
 // SLEEP ---------------------------
 
+// called by the radio while transmitting, applied when the transmission is done or timed out
+void onDownlink(uint8_t port, const uint8_t* data, uint8_t size) {
+  if (port != COMMAND_PORT || size > sizeof(command)) return;
+  memcpy(command, data, size);
+  commandLength = size;
+}
+
+// settings of a pending downlink, the next measure within the new bounds
+void applyCommand() {
+  byte status = CommandParser::parse(command, commandLength, defaultSettings, &settings);
+  LOG_INFO(LOG_COMMAND, commandLength > 1 ? command[1] : 0, status);
+  commandLength = 0;
+  if (status != COMMAND_OK) {
+    return;
+  }
+  settingsStore.save(settings);
+  applySettings();
+  nextMeasureMs = lastMeasureMs + scheduler.interval();
+}
+
 void powerDown() {
   sensor.powerDown();
+  if (commandLength > 0) {
+    applyCommand();
+  }
+  if (getTime() - lastCalibrationMs >= CALIBRATION_INTERVAL) {
+    nodeClock.calibrate();
+    lastCalibrationMs = getTime();
+  }
 
-  uint32_t timeToWake = (lastMeasureMs + MEASURE_INTERVAL) - getTime();
-  Serial.print(timeToWake / 1000); Serial.println(" s sleeping");
+  uint64_t now = getTime();
+  uint32_t timeToWake = nextMeasureMs > now ? nextMeasureMs - now : 1;
+  Serial.print(timeToWake / 1000); Serial.println(F(" s sleeping"));
   delay(1);
   Serial.flush();
   #ifdef USBCON
@@ -260,44 +704,59 @@ void powerDown() {
   #endif
 
   #if defined(__ASR6501__)
-    TimerInit(&wakeupTimer, onSleepTimeout);
+    TimerInit(&wakeupTimer, onWakeupTimer);
     TimerSetValue(&wakeupTimer, timeToWake);
     TimerStart(&wakeupTimer);
-    sleptMs += timeToWake;
   #endif
 }
 
 void sleeping() {
+  if (node.hasEvents()) {
+    return;  // eg. a press to debounce
+  }
   #if defined(__ASR6501__)
     lowPowerHandler();
   #else
-    unsigned long timeToWake = (lastMeasureMs + MEASURE_INTERVAL) - getTime();
+    uint64_t now = getTime();
+    if (now >= nextMeasureMs) {
+      wakeUp();
+      return;
+    }
+    unsigned long timeToWake = nextMeasureMs - now;
     if (timeToWake >= 8000) {
       LowPower.powerDown(SLEEP_8S, ADC_OFF, BOD_OFF);
-      sleptMs += 8000;
+      nodeClock.addSleep(8000);
     } else if (timeToWake >= 4000) {
       LowPower.powerDown(SLEEP_4S, ADC_OFF, BOD_OFF);
-      sleptMs += 4000;
+      nodeClock.addSleep(4000);
     } else if (timeToWake >= 2000) {
       LowPower.powerDown(SLEEP_2S, ADC_OFF, BOD_OFF);
-      sleptMs += 2000;
+      nodeClock.addSleep(2000);
     } else {
       LowPower.powerDown(SLEEP_1S, ADC_OFF, BOD_OFF);
-      sleptMs += 1000;
+      nodeClock.addSleep(1000);
     }
   #endif
 }
 
+// interrupt context (CubeCell)
+void onWakeupTimer() {
+  node.post(onSleepTimeout);
+}
+
+// a wakeup posted before the button left the sleep is ignored
 void onSleepTimeout() {
-  node.toState(MEASURE);
-} 
+  if (node.state() == SLEEP) {
+    wakeUp();
+  }
+}
+
+// a pending join is requested again every JOIN_WAIT, the measures go on meanwhile
+void wakeUp() {
+  node.toState(radio.isJoining() && getTime() - lastJoinMs >= JOIN_WAIT ? JOIN : ACQUIRE);
+}
 
 void powerUp() {
-  #if defined(__ASR6501__)
-    if (getTime() >= RESET_INTERVAL) {
-      HW_Reset(0);
-    }
-  #endif
   #ifdef USBCON
     USBDevice.init();
     USBDevice.attach();
@@ -308,7 +767,21 @@ void powerUp() {
 
 // MANUAL ---------------------------
 
+// interrupt context: the first edge of a press is checked in the loop
+void onButtonInterrupt() {
+  if (interaction.notePress() && !node.post(onSwitchManualMode)) {
+    interaction.forgetPress();
+  }
+}
+
+// checked once the press settled, until then the loop goes on
 void onSwitchManualMode() {
+  if (!interaction.isPressSettled()) {
+    if (!node.repost(onSwitchManualMode)) {
+      interaction.forgetPress();
+    }
+    return;
+  }
   if (!interaction.checkSwitchPressed()) return;
 
   if (node.state() == MANUAL) {
@@ -322,24 +795,33 @@ void beginManual() {
   measureRawData();
 
   #if defined(__ASR6501__)
-    TimerInit(&wakeupTimer, onManualTimeout);
+    TimerInit(&wakeupTimer, onManualTimer);
     TimerSetValue(&wakeupTimer, RAW_MEASURE_INTERVAL);
     TimerStart(&wakeupTimer);
-    sleptMs += RAW_MEASURE_INTERVAL;
   #endif
 }
 
+// interrupt context (CubeCell)
+void onManualTimer() {
+  node.post(onManualTimeout);
+}
+
 void onManualTimeout() {
+  if (node.state() != MANUAL) {
+    return;
+  }
   measureRawData();
 
   #if defined(__ASR6501__)
     TimerStart(&wakeupTimer);
-    sleptMs += RAW_MEASURE_INTERVAL;
   #endif
   // remain in manual state
 }
 
 void manualMode() {
+  if (node.hasEvents()) {
+    return;  // eg. a press to debounce
+  }
   Serial.flush();
   #ifdef USBCON
     USBDevice.detach();
@@ -350,16 +832,16 @@ void manualMode() {
   #else
     #if RAW_MEASURE_INTERVAL >= 8000
       LowPower.powerDown(SLEEP_8S, ADC_OFF, BOD_OFF);
-      sleptMs += 8000;
+      nodeClock.addSleep(8000);
     #elif  RAW_MEASURE_INTERVAL >= 4000
       LowPower.powerDown(SLEEP_4S, ADC_OFF, BOD_OFF);
-      sleptMs += 4000;
+      nodeClock.addSleep(4000);
     #elif  RAW_MEASURE_INTERVAL >= 2000
       LowPower.powerDown(SLEEP_2S, ADC_OFF, BOD_OFF);
-      sleptMs += 2000;
+      nodeClock.addSleep(2000);
     #else
       LowPower.powerDown(SLEEP_1S, ADC_OFF, BOD_OFF);
-      sleptMs += 1000;
+      nodeClock.addSleep(1000);
     #endif
     measureRawData();
   #endif
@@ -374,11 +856,16 @@ void manualMode() {
 void measureRawData() {
   interaction.setLed(true);
   sensor.listTemperatureSensors();
+  // runs in the loop (see onManualTimer()), sleeps like ACQUIRE
+  sensor.startAcquisition();
+  while (!sensor.collectAcquisition()) {
+    sleepAcquisition();
+  }
+  sensor.finishAcquisition();
   sensor.listRawWeight();
   readSensors(1);
-  #if defined(__ASR6501__)
-    printSensorData(1);
-  #endif
+  printSensorData(1);
+  Log::drain();
   delay(1);
   interaction.setLed(false);
 }
@@ -392,94 +879,499 @@ void endManual() {
 
 /* Helper methods ******************************************/
 
-unsigned long getTime() {
-  return millis() + sleptMs;
+uint64_t getTime() {
+  return nodeClock.now();
 }
 
-inline
-boolean isUndefined(float value) {
-  return isnan(value) || value == -127.0f;
+// in 1/100 units without float math (see FixedPoint.h)
+void readSensors(byte index) {
+  message[index].sensor.battery = sensor.getVoltageValue();
+  message[index].sensor.weight = sensor.getCompensatedWeightValue();
+  message[index].sensor.humidity.roof = sensor.getRoofHumidityValue();
+  message[index].sensor.temperature.roof = sensor.getRoofTemperatureValue();
+  for (int i = 0; i < THERMOMETER_COUNT; i++) {
+    message[index].sensor.temperature.other[i] = sensor.getTemperatureValue(i);
+  }
+}
+
+// the thermometers are logged by the sensor reader
+void printSensorData(byte index) {
+  LOG_DEBUG(LOG_WEIGHT, 0, message[index].sensor.weight);
+  LOG_DEBUG(LOG_ROOF_TEMPERATURE, 0, message[index].sensor.temperature.roof);
+  LOG_DEBUG(LOG_ROOF_HUMIDITY, 0, message[index].sensor.humidity.roof);
+  LOG_DEBUG(LOG_BATTERY, 0, message[index].sensor.battery);
 }
 
 inline
-boolean isDefined(float value) { return ! isUndefined(value); }
+bool unconditionalTransmit() {
+  unsigned long transmissionInterval = getTime() - lastSampleMs;
+  boolean unconditionalTransmit = transmissionInterval >= (settings.unconditionalInterval * MIN - (scheduler.interval()/2));
+  if (unconditionalTransmit) {
+    Serial.print(transmissionInterval / 1000); Serial.println(F("s since last sample"));
+  }
+  return unconditionalTransmit;
+}
 
+// the MAC or the network server asks for an uplink, an empty frame at low priority
 inline
-short asShort(float value) {
-  if (isUndefined(value)) return UNDEFINED_VALUE;
-  return value * 100;
+bool isFlushDue() {
+  if (!radio.isFlushPending() || flushUplinks >= MAX_FLUSH_UPLINKS) {
+    return false;
+  }
+  if (!radio.isWithinBudget(0, false, FRAME_PRIORITY_LOW)) {
+    Serial.println(F("Flush deferred, airtime budget"));
+    radio.airtime().defer();
+    return false;
+  }
+  return true;
 }
 
-void readSensors(byte index) {
-  sensor.startReading();
-  message[index].sensor.battery = asShort(sensor.getVoltage());
-  message[index].sensor.weight = asShort(sensor.getCompensatedWeight());
-  message[index].sensor.humidity.roof = asShort(sensor.getRoofHumidity());
-  message[index].sensor.temperature.roof = asShort(sensor.getRoofTemperature());
-  for (int i = 0; i < THERMOMETER_COUNT; i++) {
-    message[index].sensor.temperature.other[i] = asShort(sensor.getTemperature(i));
+// journal samples before the batch in RAM that may have been lost, low priority once the link
+// passed a check since the boot or the last fail
+bool isBackfillDue() {
+  #if MESSAGE_VERSION == 2
+    return backfillUplinks < MAX_BACKFILL_UPLINKS && transmissionFailed == 0 && lastConfirmationMs > 0
+        && !linkCheckPending && !radio.isJoining() && backfillCount() > 0;
+  #else
+    return false;
+  #endif
+}
+
+// a sudden change measures at ALERT_INTERVAL until it is confirmed or calm again, the alert waits
+// for no batch; not re-entered from the transmission, a refused alert waits for the next measure
+void detectAlert(byte index) {
+  short values[MESSAGE_FIELD_COUNT];
+  messageValues(index, values);
+  byte flags = alertDetector.update(values);
+  if (flags != 0) {
+    const short* before = alertDetector.alertBefore();
+    const short* after = alertDetector.alertAfter();
+    short brood = alertDetector.alertBroodField();
+    alert.flags = flags;
+    alert.weightBefore = before[ALERT_WEIGHT_FIELD];
+    alert.weight = after[ALERT_WEIGHT_FIELD];
+    alert.broodField = brood == UNDEFINED_VALUE ? 0 : brood;
+    alert.broodBefore = brood == UNDEFINED_VALUE ? UNDEFINED_VALUE : before[brood];
+    alert.brood = brood == UNDEFINED_VALUE ? UNDEFINED_VALUE : after[brood];
+    alertPending = true;
+    Serial.print(F("Alert ")); Serial.print(flags); Serial.print(F(", weight "));
+    Serial.print(alert.weightBefore); Serial.print(F(" -> ")); Serial.println(alert.weight);
+  }
+  if ((alertDetector.isArmed() || alertPending) && nextMeasureMs > lastMeasureMs + ALERT_INTERVAL) {
+    nextMeasureMs = lastMeasureMs + ALERT_INTERVAL;
+    Serial.print(F("Next measure in ")); Serial.print(ALERT_INTERVAL / 1000); Serial.println(F(" s (alert)"));
   }
-  sensor.stopReading();
 }
 
-void printSensorData(byte index) {
-  print(message[index].sensor.weight, " kg");
-  for (int i = 0; i < THERMOMETER_COUNT; i++) {
-    print(message[index].sensor.temperature.other[i], String(" C level ") + i);
+inline
+bool isAlertDue() {
+  return alertPending && !radio.isJoining();
+}
+
+// message 6 on its own port at normal priority, confirmed if the budget allows all trials
+void sendAlert() {
+  alertPending = false;
+  byte length = MessageCodec::encodeAlert(alert, payload, maxMessageSize());
+  if (length == 0) {
+    return;
+  }
+  bool confirmed = ALERT_CONFIRMATION && radio.isWithinBudget(length, true, FRAME_PRIORITY_NORMAL);
+  if (!confirmed && !radio.isWithinBudget(length, false, FRAME_PRIORITY_NORMAL)) {
+    Serial.println(F("Alert deferred, airtime budget"));
+    radio.airtime().defer();
+    alertPending = true;
+    return;
+  }
+  if (confirmed) {
+    Serial.println(F("Alert with confirmation"));
+  } else {
+    Serial.println(F("Alert"));
   }
-  print(message[index].sensor.temperature.roof, " C roof");
-  print(message[index].sensor.humidity.roof, " % rel roof");
-  print(message[index].sensor.battery, " Vbat");
+  seqNumber = radio.send(payload, length, confirmed, ALERT_PORT);
+  if (!radio.isTransmitting()) {
+    alertPending = true;
+    return;
+  }
+  requireConfirmation = confirmed;
+  alertConfirming = confirmed;
+}
+
+// the interval closes with the unconditional interval, its statistics are kept if it holds more
+// than a single measure; a full set of intervals is sent, the oldest is dropped if it was deferred
+void aggregate(byte index) {
+  #if AGGREGATION
+    short values[MESSAGE_FIELD_COUNT];
+    messageValues(index, values);
+    aggregator.add(values);
+    if (getTime() - aggregateStartMs < settings.unconditionalInterval * MIN - (scheduler.interval()/2)) {
+      return;
+    }
+    if (aggregator.count() >= AGGREGATE_MIN_MEASURES) {
+      if (aggregateCount == AGGREGATE_WINDOWS) {
+        dropAggregates(1);
+      }
+      AggregateWindow& window = aggregateWindows[aggregateCount];
+      window.minutes = (getTime() - aggregateStartMs) / MIN;
+      window.measures = aggregator.count();
+      FieldStatistics* fields = aggregates + aggregateCount * MESSAGE_FIELD_COUNT;
+      for (byte i = 0; i < MESSAGE_FIELD_COUNT; i++) {
+        fields[i].minimum = aggregator.minimum(i);
+        fields[i].maximum = aggregator.maximum(i);
+        fields[i].mean = aggregator.mean(i);
+        fields[i].deviation = aggregator.deviation(i);
+      }
+      aggregateCount++;
+      aggregateEndMs = getTime();
+      aggregatePending = aggregateCount == AGGREGATE_WINDOWS;
+    }
+    aggregator.reset();
+    aggregateStartMs = getTime();
+  #else
+    (void)index;
+  #endif
 }
 
 inline
-void print(short compactValue, String suffix) {
-  if (compactValue != UNDEFINED_VALUE) {
-    Serial.print(compactValue / 100.0);
-    Serial.println(suffix);
+bool isAggregateDue() {
+  #if AGGREGATION
+    return aggregatePending && !radio.isJoining();
+  #else
+    return false;
+  #endif
+}
+
+// message 5 of as many intervals as fit at low priority, one frame per set: the newer intervals
+// beyond the payload of a slow datarate are dropped
+void sendAggregate() {
+  #if AGGREGATION
+    aggregatePending = false;
+    byte count;
+    byte length = encodeAggregate(&count);
+    if (length == 0) {
+      Serial.println(F("Statistics do not fit"));
+      dropAggregates(1);
+      return;
+    }
+    if (!radio.isWithinBudget(length, false, FRAME_PRIORITY_LOW)) {
+      Serial.println(F("Statistics deferred, airtime budget"));
+      radio.airtime().defer();
+      return;
+    }
+    Serial.print(F("Statistics of ")); Serial.print(count); Serial.println(F(" intervals"));
+    seqNumber = radio.send(payload, length, false);
+    if (radio.isTransmitting()) {
+      dropAggregates(aggregateCount);
+    }
+  #endif
+}
+
+#if AGGREGATION
+
+// the oldest intervals
+void dropAggregates(byte count) {
+  aggregateCount -= count;
+  memmove(aggregateWindows, aggregateWindows + count, aggregateCount * sizeof(AggregateWindow));
+  memmove(aggregates, aggregates + count * MESSAGE_FIELD_COUNT, aggregateCount * MESSAGE_FIELD_COUNT * sizeof(FieldStatistics));
+}
+
+// the oldest intervals that fit the payload of the current datarate, 0 if the oldest does not
+byte encodeAggregate(byte* count) {
+  byte maxPayload = maxMessageSize();
+  for (*count = aggregateCount; *count > 0; (*count)--) {
+    // the newest interval sent ends where the next one starts
+    unsigned long newestAge = (getTime() - aggregateEndMs) / MIN;
+    for (byte w = *count; w < aggregateCount; w++) {
+      newestAge += aggregateWindows[w].minutes;
+    }
+    byte length = MessageCodec::encodeAggregate(aggregateWindows, aggregates, *count, MESSAGE_FIELD_COUNT, newestAge, payload, maxPayload);
+    if (length > 0) {
+      return length;
+    }
   }
+  return 0;
 }
 
+#endif
+
+// measures are deferred while the airtime budget is exhausted (see AirtimeBudget.h)
 inline
-bool unconditionalTransmit() {
-  unsigned long transmissionInterval = getTime() - lastTransmissionMs;
-  boolean unconditionalTransmit = transmissionInterval >= (UNCONDITIONAL_INTERVAL - (MEASURE_INTERVAL/2));
-  if (unconditionalTransmit) {
-    Serial.print(transmissionInterval / 1000); Serial.println("s since transmission");
+bool isWithinBudget() {
+  if (radio.isWithinBudget(maxMessageSize(), false, FRAME_PRIORITY_NORMAL)) {
+    return true;
   }
-  return unconditionalTransmit;
+  Serial.println(F("Airtime budget exhausted, transmission deferred"));
+  radio.airtime().defer();
+  return false;
+}
+
+// at the confirmation interval of the settings or after a fail
+boolean isValidationDue() {
+  return transmissionFailed > 0
+      || (settings.confirmationInterval > 0 && getTime() - lastConfirmationMs >= settings.confirmationInterval * MIN);
 }
 
 inline
 boolean withConfirmation() {
   #if defined(__ASR6501__)
-    if (transmissionFailed > 0) {
-      Serial.println("Require confirmation after fail");
-      return true;
+    if (!isValidationDue()) {
+      return false;
     }
-    unsigned long confirmationInterval = getTime() - lastConfirmationMs;
-    boolean confirmation = confirmationInterval >= CONFIRMATION_INTERVAL;
-    if (confirmation) {
-      Serial.println("Require confirmation");
+    // all trials of a confirmed frame are low priority
+    if (!radio.isWithinBudget(maxMessageSize(), true, FRAME_PRIORITY_LOW)) {
+      Serial.println(F("Confirmation deferred, airtime budget"));
+      radio.airtime().defer();
+      return false;
     }
-    return confirmation;
+    if (transmissionFailed > 0) {
+      Serial.println(F("Require confirmation after fail"));
+    } else {
+      Serial.println(F("Require confirmation"));
+    }
+    return true;
   #else
     return false;
   #endif
 }
 
+// payload limit of the current datarate
+byte maxMessageSize() {
+  return min((int)radio.maxPayload(), (int)sizeof(payload));
+}
+
+// values in the field order of message v1
+void messageValues(byte index, short* values) {
+  values[0] = message[index].sensor.battery;
+  values[1] = message[index].sensor.weight;
+  values[2] = message[index].sensor.humidity.roof;
+  values[3] = message[index].sensor.temperature.roof;
+  for (int i = 0; i < THERMOMETER_COUNT; i++) {
+    values[4 + i] = message[index].sensor.temperature.other[i];
+  }
+}
+
+// message v1 if all values fit, v0 otherwise
+byte encodeMessage(byte index) {
+  #if MESSAGE_VERSION == 1
+    short values[MESSAGE_FIELD_COUNT];
+    messageValues(index, values);
+
+    byte absolute[MESSAGE_V1_MAX_SIZE];
+    byte nextId = (keyFrameId + 1) & MESSAGE_V1_ID_MASK;
+    byte absoluteLength = MessageCodec::encodeAbsolute(values, MESSAGE_FIELD_COUNT, nextId, absolute, sizeof(absolute));
+    #if DELTA_FRAMES > 0
+      if (deltaFrames < DELTA_FRAMES) {
+        byte deltaLength = MessageCodec::encodeDelta(values, keyFrame, MESSAGE_FIELD_COUNT, keyFrameId, payload, sizeof(payload));
+        if (deltaLength > 0 && (absoluteLength == 0 || deltaLength < absoluteLength)) {
+          deltaFrames++;
+          return deltaLength;
+        }
+      }
+    #endif
+    if (absoluteLength > 0) {
+      memcpy(payload, absolute, absoluteLength);
+      memcpy(keyFrame, values, sizeof(keyFrame));
+      keyFrameId = nextId;
+      deltaFrames = 0;
+      return absoluteLength;
+    }
+  #endif
+  memcpy(payload, message[index].bytes, sizeof(message[index]));
+  return sizeof(message[index]);
+}
+
+#if MESSAGE_VERSION == 2
+
+void storeSample(byte index) {
+  short values[MESSAGE_FIELD_COUNT];
+  messageValues(index, values);
+  lastSampleMs = getTime();
+  samples.store(values, lastSampleMs / MIN);
+  journal.append(values, journalMinutes());
+  #if DUAL_PREDICTION
+    predictor.add(values, lastSampleMs / MIN);
+  #endif
+  lastMsgIndex = index;
+}
+
+// node time of the journal, continued from its newest sample after a reset
+uint32_t journalMinutes() {
+  return journal.minutesAtBegin() + getTime() / MIN;
+}
+
+// journal samples from backfillNext up to the batch in RAM, the overwritten ones are lost
+uint16_t backfillCount() {
+  if (isSequenceBefore(backfillNext, journal.oldest())) {
+    backfillNext = journal.oldest();
+  }
+  uint16_t batchStart = journal.last() + 1 - samples.count();
+  return isSequenceBefore(backfillNext, batchStart) ? batchStart - backfillNext : 0;
+}
+
+// message 4 of the oldest journal samples to replay, deferred by the airtime budget
+void sendBackfill() {
+  backfillUplinks++;
+  byte count;
+  byte length = encodeBackfill(&count);
+  if (length == 0) {
+    return;
+  }
+  if (!radio.isWithinBudget(length, false, FRAME_PRIORITY_LOW)) {
+    Serial.println(F("Backfill deferred, airtime budget"));
+    radio.airtime().defer();
+    return;
+  }
+  Serial.print(F("Backfill of ")); Serial.print(count); Serial.println(F(" samples"));
+  seqNumber = radio.send(payload, length, false);
+  if (radio.isTransmitting()) {
+    backfillNext += count;
+  }
+}
+
+// as many consecutive journal samples as fit, a longer gap than a step of message 4
+// ends the frame; an unreadable or unrepresentable sample is skipped
+byte encodeBackfill(byte* count) {
+  short values[BATCH_SAMPLES * MESSAGE_FIELD_COUNT];
+  uint16_t ages[BATCH_SAMPLES];
+  uint16_t available = min(backfillCount(), (uint16_t)BATCH_SAMPLES);
+  uint32_t now = journalMinutes();
+  byte read = 0;
+  for (; read < available; read++) {
+    SampleJournal::Record record;
+    if (!journal.read(backfillNext + read, &record)) break;
+    uint32_t age = (now - record.minutes) & JOURNAL_MAX_MINUTES;
+    ages[read] = min(age, (uint32_t)MESSAGE_BACKFILL_MAX_AGE);
+    if (read > 0 && ages[read - 1] - ages[read] > MESSAGE_BACKFILL_MAX_STEP) break;
+    memcpy(values + read * MESSAGE_FIELD_COUNT, record.values, sizeof(record.values));
+  }
+  byte maxPayload = maxMessageSize();
+  for (*count = read; *count > 0; (*count)--) {
+    byte length = MessageCodec::encodeBackfill(values, ages, *count, MESSAGE_FIELD_COUNT, backfillNext, payload, maxPayload);
+    if (length > 0) {
+      return length;
+    }
+  }
+  backfillNext++;
+  return 0;
+}
+
+// complete if another sample might not fit the payload of the current datarate
+bool isBatchComplete() {
+  // a measure interval longer than twice the batch age completes every batch
+  unsigned long maxAge = MAX_BATCH_AGE - min(scheduler.interval()/2, (unsigned long)MAX_BATCH_AGE);
+  if (samples.isFull() || getTime() / MIN - samples.minute(0) >= maxAge / MIN) {
+    return true;
+  }
+  byte maxPayload = maxMessageSize();
+  byte length = encodeSamples(samples.count(), maxPayload, false);
+  return length == 0 || length + MessageCodec::maxSampleSize(MESSAGE_FIELD_COUNT) > maxPayload;
+}
+
+// the buffered samples for the encoder, read in place
+struct BatchSamples {
+  uint32_t minute;  // of the node clock now
+  const short* values(byte s) { return samples.values(s); }
+  // whole minutes of the node clock, the receiver gets the minutes between the samples exactly
+  byte age(byte s) { return min(minute - samples.minute(s), (uint32_t)MESSAGE_V2_MAX_AGE); }
+};
+
+// message v2 of the oldest samples, 0 if they do not fit
+byte encodeSamples(byte count, byte maxPayload, bool withSchedule) {
+  BatchSamples batch = { (uint32_t)(getTime() / MIN) };
+  ScheduleReport schedule;
+  schedule.interval = min(scheduler.interval() / MIN, 255UL);
+  schedule.reason = scheduler.reason();
+  schedule.rate = min(scheduler.rate() / (SCHEDULE_RATE_UNIT / 8), 63);
+  return MessageCodec::encodeBatch(batch, count, MESSAGE_FIELD_COUNT, payload, maxPayload, withSchedule ? &schedule : 0);
+}
+
+// as many samples as fit, the rest waits for the next batch, the schedule
+// goes along if it fits too; the encoded samples are dropped once sent
+byte encodeBatch(byte* count) {
+  byte maxPayload = maxMessageSize();
+  for (*count = samples.count(); *count > 0; (*count)--) {
+    byte length = encodeSamples(*count, maxPayload, true);
+    if (length == 0) {
+      length = encodeSamples(*count, maxPayload, false);
+    }
+    if (length > 0) {
+      return length;
+    }
+  }
+  // the oldest sample is not representable in v1, send it as v0
+  const short* values = samples.values(0);
+  message_t single;
+  single.sensor.version = 0;
+  single.sensor.battery = values[0];
+  single.sensor.weight = values[1];
+  single.sensor.humidity.roof = values[2];
+  single.sensor.temperature.roof = values[3];
+  for (int i = 0; i < THERMOMETER_COUNT; i++) {
+    single.sensor.temperature.other[i] = values[4 + i];
+  }
+  memcpy(payload, single.bytes, sizeof(single));
+  *count = 1;
+  return sizeof(single);
+}
+
+#endif
+
+// diagnostics message of the states and the airtime since boot, 0 if it does not fit
+byte encodeDiagnostics() {
+  StateReport states[MESSAGE_MAX_STATES];
+  byte count = min(node.stateCount(), MESSAGE_MAX_STATES);
+  for (byte i = 0; i < count; i++) {
+    StateStats stats = node.stats(i);
+    states[i].time = stats.time / SEC;
+    states[i].entries = stats.entries;
+    states[i].timeouts = stats.timeouts;
+    states[i].maxDuration = stats.maxDuration / SEC;
+    #if defined(__ASR6501__)
+      Serial.print(node.stateName(i)); Serial.print(F(": ")); Serial.print(states[i].time); Serial.print(F(" s, "));
+      Serial.print(stats.entries); Serial.print(F(" entries, ")); Serial.print(stats.timeouts); Serial.print(F(" timeouts, max "));
+      Serial.print(stats.maxDuration); Serial.println(F(" ms"));
+    #endif
+  }
+  AirtimeBudget& airtime = radio.airtime();
+  return MessageCodec::encodeDiagnostics(states, count, airtime.total() / SEC, airtime.deferred(), payload, maxMessageSize());
+}
+
+// next measure from the rate of change since the last measure
+void scheduleMeasure(byte index) {
+  short values[MESSAGE_FIELD_COUNT];
+  messageValues(index, values);
+  nextMeasureMs = lastMeasureMs + scheduler.update(values, lastMeasureMs);
+  Serial.print(F("Next measure in ")); Serial.print(scheduler.interval() / 1000);
+  Serial.print(F(" s (")); printScheduleReason(scheduler.reason()); Serial.println(')');
+}
+
+void printScheduleReason(byte reason) {
+  switch (reason) {
+    case SCHEDULE_ACTIVE:  Serial.print(F("active")); break;
+    case SCHEDULE_DAILY:   Serial.print(F("daily")); break;
+    case SCHEDULE_BATTERY: Serial.print(F("battery")); break;
+    default:               Serial.print(F("quiet"));
+  }
+}
+
 inline
 bool hasChangedValue(short lastValue, short nextValue, short limit) {
   return abs(lastValue - nextValue) >= limit;
 }
 
+// any field beyond its change limit around the prediction of the samples or since the last sample
 bool hasChanged(byte index) {
-  for (int i = 0; i < THERMOMETER_COUNT; i++) {
-    if (hasChangedValue(message[lastMsgIndex].sensor.temperature.other[i], message[index].sensor.temperature.other[i], LIMIT_TEMPERATURE_DIFF)) {
-      return true;
+  short values[MESSAGE_FIELD_COUNT];
+  messageValues(index, values);
+  #if MESSAGE_VERSION == 2 && DUAL_PREDICTION
+    return predictor.isBeyond(values, changeLimits, getTime() / MIN);
+  #else
+    short lastValues[MESSAGE_FIELD_COUNT];
+    messageValues(lastMsgIndex, lastValues);
+    for (int i = 0; i < MESSAGE_FIELD_COUNT; i++) {
+      if (changeLimits[i] > 0 && hasChangedValue(lastValues[i], values[i], changeLimits[i])) {
+        return true;
+      }
     }
-  }
-  return hasChangedValue(message[lastMsgIndex].sensor.weight, message[index].sensor.weight, LIMIT_WEIGHT_DIFF)
-      || hasChangedValue(message[lastMsgIndex].sensor.temperature.roof, message[index].sensor.temperature.roof, LIMIT_TEMPERATURE_DIFF)
-      || hasChangedValue(message[lastMsgIndex].sensor.humidity.roof, message[index].sensor.humidity.roof, LIMIT_HUMIDITY_DIFF);
+    return false;
+  #endif
 }
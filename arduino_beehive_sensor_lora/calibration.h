@@ -4,6 +4,13 @@
  * ---
  * Go to manual mode (press USR button) to list all sensors
  * and read raw weight readings.
+ * The load cell drift follows the linear trendline over the
+ * outer temperature unless a device defines a piecewise
+ * linear model, eg. fitted by compensation-fit of the
+ * beehive simulator (see FixedPoint.h):
+ *   #define TEMPERATURE_POINTS { FIXED_COMPENSATION_POINT(-5.0, +0.42), \
+ *                                FIXED_COMPENSATION_POINT(30.0, -0.61) }
+ *   #define TEMPERATURE_LAG_MINUTES 60  // thermal lag of the load cell
  **********************************************************/
 #ifndef __CALIBRATION_H__
 #define __CALIBRATION_H__
@@ -0,0 +1,243 @@
+/**********************************************************
+ * Energy benchmark of the sensor script.
+ * ---
+ * Runs the sketch on the simulated board for a number of
+ * MEASURE -> TRANSMIT -> SLEEP cycles or days and reports the
+ * awake time, charge and airtime per cycle. Compare runs of
+ * the same days if the measure interval changes.
+ * A hardware reset of the sketch ends the process of the
+ * simulated device; the benchmark boots a fresh process
+ * (RAM lost) while the totals are kept in shared memory.
+ *
+ * --downlink PORT:HEX queues a downlink at the network
+ * server for the first uplink (eg. a command of the sketch,
+ * see CommandParser.h), lost downlinks are sent again.
+ *
+ * usage: benchmark-<board> [--cycles N | --days N] [--max-resets N] [--downlink PORT:HEX] [--verbose] [--help]
+ *                          [name=value ...]
+ **********************************************************/
+#include "Simulation.h"
+#include "Firmware.h"
+#include "Radio.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#define DEFAULT_CYCLES 2000
+#define MAX_CYCLE_TIME (3600 * SIM_SEC)
+
+static std::vector<sim::Downlink> downlinks;
+
+static void usage(const sim::Config& config) {
+  fprintf(stderr, "usage: benchmark-%s [--cycles N | --days N] [--max-resets N] [--downlink PORT:HEX] [--verbose] [--help] [name=value ...]\n",
+          config.board.c_str());
+  fprintf(stderr, "simulation parameters (currents in mA, latencies in ms):\n");
+  config.list(stderr);
+}
+
+// airtime budget as seen by the sketch, deferred frames summed over boots,
+// state counters and clock of the current boot
+static void sampleFirmware(sim::Totals* totals) {
+  totals->clockError = (int64_t)sim::nodeTime() - (int64_t)(sim::board().sinceBoot() / SIM_MS)
+                       - (int64_t)sim::board().config.clockStart;
+  static uint16_t deferred = 0;
+  AirtimeBudget& airtime = sim::airtime();
+  totals->budgetHour = std::max(totals->budgetHour, airtime.lastHour());
+  totals->budgetDay = std::max(totals->budgetDay, airtime.lastDay());
+  totals->deferred += (uint16_t)(airtime.deferred() - deferred);
+  deferred = airtime.deferred();
+  totals->stateCount = std::min(sim::stateCount(), SIM_MAX_STATES);
+  for (uint32_t state = 0; state < totals->stateCount; state++) {
+    sim::StateCounters counters = sim::stateCounters(state);
+    totals->stateTime[state] = counters.time;
+    totals->stateEntries[state] = counters.entries;
+    totals->stateTimeouts[state] = counters.timeouts;
+    totals->stateMaxDuration[state] = counters.maxDuration;
+  }
+}
+
+// one boot of the simulated device until the cycles are done or a reset
+static void runDevice(const sim::Config& config, sim::Totals* totals, uint32_t cycles, uint64_t duration, bool verbose) {
+  sim::Board board(config, totals);
+  board.verbose = verbose;
+  sim::install(&board);
+  sim::attachFirmware();
+  board.boot();
+  if (totals->boots == 1) {
+    for (size_t i = 0; i < downlinks.size(); i++) {
+      sim::network().queue(downlinks[i].port, downlinks[i].data.data(), downlinks[i].data.size());
+    }
+  }
+
+  setup();
+  bool measuring = false;
+  uint32_t measurements = totals->cycles + (totals->boots > 1 ? 1 : 0);
+  while (true) {
+    loop();
+    board.run((uint64_t)config.loopCost);
+    if (sim::isMeasuring() && !measuring) {
+      sampleFirmware(totals);
+      if (measurements++ > 0) totals->cycles++;
+      if (totals->cycles >= cycles) break;
+    }
+    if (duration > 0 && board.now() >= duration) {
+      sampleFirmware(totals);
+      break;
+    }
+    measuring = sim::isMeasuring();
+    if (board.now() > (uint64_t)(totals->cycles + 1) * MAX_CYCLE_TIME) {
+      fprintf(stderr, "No progress after %u cycles\n", totals->cycles);
+      fflush(stdout);
+      _exit(1);
+    }
+  }
+  fflush(stdout);
+  _exit(0);
+}
+
+// PORT:HEX, eg. 10:0101000A003C
+static bool parseDownlink(const char* argument) {
+  sim::Downlink downlink;
+  char* hex;
+  long port = strtol(argument, &hex, 10);
+  if (port < 1 || port > 223 || *hex != ':' || strlen(hex + 1) % 2 != 0) return false;
+  for (const char* digit = hex + 1; *digit != 0; digit += 2) {
+    char byte[3] = {digit[0], digit[1], 0};
+    char* end;
+    downlink.data.push_back((uint8_t)strtol(byte, &end, 16));
+    if (*end != 0) return false;
+  }
+  downlink.port = (uint8_t)port;
+  downlinks.push_back(downlink);
+  return true;
+}
+
+static double mAh(double chargeMicros) {
+  return chargeMicros / 3.6e9;
+}
+
+static void report(const sim::Config& config, const sim::Totals& totals) {
+  double cycles = totals.cycles > 0 ? totals.cycles : 1;
+  double days = (double)totals.now / SIM_DAY;
+  double charge = 0;
+  for (int i = 0; i < sim::CONSUMER_COUNT; i++) charge += totals.charge[i];
+
+  printf("board           %s\n", config.board.c_str());
+  printf("cycles          %u (%.2f days)\n", totals.cycles, days);
+  printf("boots           %u (%u resets)\n", totals.boots, totals.resets);
+  printf("joins           %u\n", totals.joins);
+  printf("uplinks         %u (%u retransmissions, %u rejected, %u lost)\n", totals.uplinks, totals.retransmissions, totals.rejected,
+         totals.lost);
+  printf("datarates      ");
+  for (int datarate = 0; datarate < SIM_DATARATES; datarate++) printf(" DR%d %u", datarate, totals.uplinkDatarates[datarate]);
+  printf("\n");
+  printf("downlinks       %u\n", totals.downlinks);
+  printf("link checks     %u (%u answered)\n", totals.linkChecks, totals.linkChecksAnswered);
+  printf("samples         %u received\n", totals.batchSamples);
+  printf("backfill        %u frames, %u samples\n", totals.backfills, totals.backfillSamples);
+  printf("statistics      %u frames, %u intervals\n", totals.aggregates, totals.aggregateWindows);
+  printf("alerts          %u", totals.alerts);
+  if (totals.alertLatency > 0) printf(" (swarm reported after %.1f s)", (double)totals.alertLatency / SIM_SEC);
+  printf("\n");
+  uint32_t erases = 0, maxErases = 0;
+  for (size_t row = 0; row < sizeof(totals.flashErases) / sizeof(totals.flashErases[0]); row++) {
+    erases += totals.flashErases[row];
+    maxErases = std::max(maxErases, totals.flashErases[row]);
+  }
+  printf("airtime budget  max %.1f s/hour, %.1f s/day, %u deferred\n", totals.budgetHour / 1000.0, totals.budgetDay / 1000.0, totals.deferred);
+  printf("flash writes    %u (max %u per row), %u EEPROM bytes\n", erases, maxErases, totals.eepromWrites);
+  printf("node clock      %+.1f s off (last boot)\n", totals.clockError / 1000.0);
+  printf("per cycle\n");
+  printf("  awake         %10.1f ms\n", totals.awake / cycles / 1000.0);
+  printf("  asleep        %10.1f ms\n", totals.asleep / cycles / 1000.0);
+  printf("  airtime       %10.1f ms\n", totals.airtime / cycles / 1000.0);
+  printf("  loadcell      %10.1f samples\n", totals.loadcellSamples / cycles);
+  printf("  charge        %10.5f mAh\n", mAh(charge) / cycles);
+  for (int i = 0; i < sim::CONSUMER_COUNT; i++) {
+    printf("    %-12s%10.5f mAh\n", sim::consumerNames[i], mAh(totals.charge[i]) / cycles);
+  }
+  uint64_t stateTotal = 0;
+  for (uint32_t state = 0; state < totals.stateCount; state++) stateTotal += totals.stateTime[state];
+  printf("states (last boot)    entries  timeouts       time    max\n");
+  for (uint32_t state = 0; state < totals.stateCount; state++) {
+    printf("  %-18s%9u %9u %9.2f %% %6.1f s\n", sim::stateName(state), totals.stateEntries[state], totals.stateTimeouts[state],
+           stateTotal > 0 ? 100.0 * totals.stateTime[state] / stateTotal : 0.0, totals.stateMaxDuration[state] / 1000.0);
+  }
+  printf("average current %10.4f mA\n", days > 0 ? mAh(charge) / (days * 24) : 0.0);
+  printf("battery runtime %10.1f days (%.0f mAh)\n", days > 0 ? config.batteryCapacity / (mAh(charge) / days) : 0.0, config.batteryCapacity);
+}
+
+int main(int argc, char* argv[]) {
+  sim::Config config = sim::Config::forBoard(SIM_BOARD);
+  uint32_t cycles = DEFAULT_CYCLES;
+  uint64_t duration = 0;
+  long maxResets = -1;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+      duration = (uint64_t)(atof(argv[++i]) * SIM_DAY);
+      cycles = UINT32_MAX;
+    } else if (strcmp(argv[i], "--max-resets") == 0 && i + 1 < argc) {
+      maxResets = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--downlink") == 0 && i + 1 < argc) {
+      if (!parseDownlink(argv[++i])) {
+        usage(config);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--help") == 0) {
+      usage(config);
+      return 0;
+    } else if (!config.set(argv[i])) {
+      usage(config);
+      return 2;
+    }
+  }
+
+  sim::Totals* totals = (sim::Totals*)mmap(NULL, sizeof(sim::Totals), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (totals == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  memset(totals, 0, sizeof(sim::Totals));
+  totals->random = 0x9E3779B97F4A7C15ULL * ((uint64_t)config.seed + 1);
+
+  while (true) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      runDevice(config, totals, cycles, duration, verbose);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == sim::Board::RESET_EXIT) {
+      totals->resets++;
+      continue;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "Simulated device failed after %u cycles\n", totals->cycles);
+      return 1;
+    }
+    break;
+  }
+
+  report(config, *totals);
+  if (maxResets >= 0 && totals->resets > maxResets) {
+    fprintf(stderr, "%u resets, expected at most %ld\n", totals->resets, maxResets);
+    return 1;
+  }
+  return 0;
+}
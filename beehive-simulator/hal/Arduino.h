@@ -0,0 +1,251 @@
+/**********************************************************
+ * Simulated Arduino core for the host build.
+ * ---
+ * The subset of the Arduino API used by the sensor script
+ * (time, serial, pins, interrupts) on top of the simulated
+ * board, see Simulation.h. With __ASR6501__ defined the
+ * CubeCell core functions (timers, low power handler, reset)
+ * are available, otherwise the AVR registers used to read
+ * the supply voltage.
+ **********************************************************/
+#ifndef __SIM_ARDUINO_H__
+#define __SIM_ARDUINO_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// functions instead of the core macros, safe next to the standard library
+template <typename T> inline T min(T a, T b) { return a < b ? a : b; }
+template <typename T> inline T max(T a, T b) { return a > b ? a : b; }
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+/* String and Serial ******************************************/
+
+class __FlashStringHelper;
+#define F(text) (reinterpret_cast<const __FlashStringHelper*>(text))
+
+class String {
+  public:
+    String(const char* text = "") : value(text) {}
+    String(char c) : value(1, c) {}
+    String(int number, unsigned char base = DEC);
+    String(unsigned int number, unsigned char base = DEC);
+    String(long number, unsigned char base = DEC);
+    String(unsigned long number, unsigned char base = DEC);
+    String(double number, unsigned char digits = 2);
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    friend String operator+(const String& left, const String& right) {
+      String sum(left);
+      sum += right;
+      return sum;
+    }
+
+  private:
+    std::string value;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char* text);
+    size_t write(const uint8_t* buffer, size_t size);
+
+    size_t print(const __FlashStringHelper* text);
+    size_t print(const String& text);
+    size_t print(const char text[]);
+    size_t print(char c);
+    size_t print(unsigned char number, int base = DEC);
+    size_t print(int number, int base = DEC);
+    size_t print(unsigned int number, int base = DEC);
+    size_t print(long number, int base = DEC);
+    size_t print(unsigned long number, int base = DEC);
+    size_t print(double number, int digits = 2);
+
+    size_t println(const __FlashStringHelper* text);
+    size_t println(const String& text);
+    size_t println(const char text[]);
+    size_t println(char c);
+    size_t println(unsigned char number, int base = DEC);
+    size_t println(int number, int base = DEC);
+    size_t println(unsigned int number, int base = DEC);
+    size_t println(long number, int base = DEC);
+    size_t println(unsigned long number, int base = DEC);
+    size_t println(double number, int digits = 2);
+    size_t println();
+
+  private:
+    size_t printNumber(unsigned long number, uint8_t base);
+    size_t printFloat(double number, uint8_t digits);
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    void end() {}
+    size_t write(uint8_t c);
+    using Print::write;
+    void flush();
+    int available() { return 0; }
+    int read() { return -1; }
+    operator bool() { return true; }
+
+  private:
+    uint64_t drainedAt = 0;   // time when the UART buffer is empty
+    bool lineStart = true;
+};
+
+extern HardwareSerial Serial;
+
+/* Board specific ******************************************/
+
+#if defined(__ASR6501__)
+
+  #define GPIO0 0
+  #define GPIO1 1
+  #define GPIO2 2
+  #define GPIO3 3
+  #define GPIO4 4
+  #define GPIO5 5
+  #define GPIO6 6
+  #define GPIO7 7
+  #define VBAT_ADC_CTL GPIO7
+  #define ADC   20
+  #define Vext  21
+  #define RGB   22
+
+  typedef struct TimerEvent_s {
+    uint32_t ReloadValue;
+    bool IsRunning;
+    void (*Callback)(void);
+    unsigned eventId;
+  } TimerEvent_t;
+
+  void TimerInit(TimerEvent_t* obj, void (*callback)(void));
+  void TimerSetValue(TimerEvent_t* obj, uint32_t value);
+  void TimerStart(TimerEvent_t* obj);
+  void TimerStop(TimerEvent_t* obj);
+
+  void boardInitMcu();
+  void lowPowerHandler();
+  void HW_Reset(int mode);
+
+  // RTC in ms since boot, keeps running in deep sleep
+  uint32_t TimerGetCurrentTime();
+
+  // flash of the ASR650x core, kept over resets (rows of 256 bytes)
+  uint8_t FLASH_update(uint32_t address, const void* data, uint32_t size);
+  int FLASH_read_at(uint32_t address, uint8_t* data, size_t size);
+
+#else
+
+  #define A0 14
+  #define A1 15
+  #define A2 16
+  #define A3 17
+  #define A4 18
+  #define A5 19
+
+  #define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+
+  #define _BV(bit) (1 << (bit))
+  #define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+
+  #define REFS0 6
+  #define MUX3  3
+  #define MUX2  2
+  #define MUX1  1
+  #define ADSC  6
+
+  // starting a conversion (ADSC) samples the 1.1V reference against AVcc
+  struct AdcControlRegister {
+    uint8_t value;
+    AdcControlRegister& operator|=(uint8_t bits);
+    operator uint8_t() const { return value; }
+  };
+
+  extern uint8_t ADMUX;
+  extern AdcControlRegister ADCSRA;
+  extern uint8_t ADCL;
+  extern uint8_t ADCH;
+
+  // pin change interrupt 1 on A0..A5
+  #define PCIE1   1
+  #define PCIF1   1
+  #define PCINT8  0
+  #define PCINT9  1
+  #define PCINT10 2
+  #define PCINT11 3
+  #define PCINT12 4
+  #define PCINT13 5
+
+  extern uint8_t PCICR;
+  extern uint8_t PCIFR;
+  extern uint8_t PCMSK1;
+
+  // watchdog, enabling the interrupt (WDIE) starts the period,
+  // its ISR is defined by the LowPower library
+  #define WDIF 7
+  #define WDIE 6
+  #define WDP3 5
+  #define WDCE 4
+  #define WDE  3
+  #define WDP2 2
+  #define WDP1 1
+  #define WDP0 0
+
+  struct WatchdogControlRegister {
+    uint8_t value;
+    WatchdogControlRegister& operator=(uint8_t bits);
+    WatchdogControlRegister& operator|=(uint8_t bits);
+    operator uint8_t();
+  };
+
+  extern WatchdogControlRegister WDTCSR;
+
+  #define ISR(vector) extern "C" void vector()
+  #define PCINT1_vect __vector_pcint1
+  #define WDT_vect    __vector_wdt
+
+#endif
+
+#endif
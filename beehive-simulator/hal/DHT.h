@@ -0,0 +1,33 @@
+/**********************************************************
+ * Simulated DHT22 sensor for the host build.
+ * ---
+ * Same interface as the Adafruit DHT library, including the
+ * 2 s minimum interval between reads unless forced.
+ **********************************************************/
+#ifndef __SIM_DHT_H__
+#define __SIM_DHT_H__
+
+#include "Arduino.h"
+
+#define DHT11  11
+#define DHT12  12
+#define DHT21  21
+#define DHT22  22
+#define AM2301 21
+
+class DHT {
+  public:
+    DHT(uint8_t /* pin */, uint8_t /* type */, uint8_t /* count */ = 6) {}
+    void begin(uint8_t usec = 55);
+    bool read(bool force = false);
+    float readTemperature(bool S = false, bool force = false);
+    float readHumidity(bool force = false);
+
+  private:
+    unsigned long lastReadTime = 0;
+    bool lastResult = false;
+    float temperature = NAN;
+    float humidity = NAN;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/**********************************************************
+ * Simulated DS18B20 driver for the host build.
+ * ---
+ * Same interface as the DallasTemperature library. The
+ * thermometers on the bus are attached by the firmware glue,
+ * see sim::World. Bus searches, scratchpad accesses and the
+ * conversion time advance the simulated clock, temperatures
+ * are latched at the end of a conversion (85 C after power-on).
+ **********************************************************/
+#ifndef __SIM_DALLASTEMPERATURE_H__
+#define __SIM_DALLASTEMPERATURE_H__
+
+#include "Arduino.h"
+#include "OneWire.h"
+
+typedef uint8_t DeviceAddress[8];
+
+#define DEVICE_DISCONNECTED_C   -127
+#define DEVICE_DISCONNECTED_F   -196.6
+#define DEVICE_DISCONNECTED_RAW -7040
+
+#define MAX_SIM_THERMOMETERS 8
+
+class DallasTemperature {
+  public:
+    DallasTemperature(OneWire* /* wire */) {}
+
+    void begin();
+    uint8_t getDeviceCount() { return devices; }
+    bool getAddress(uint8_t* address, uint8_t index);
+    bool isConnected(const uint8_t* address);
+    bool isParasitePowerMode() { return false; }
+
+    void setResolution(uint8_t resolution);
+    bool setResolution(const uint8_t* address, uint8_t resolution, bool skipGlobalBitResolutionCalculation = false);
+    uint8_t getResolution() { return bitResolution; }
+    uint8_t getResolution(const uint8_t* address);
+
+    void setWaitForConversion(bool flag) { waitForConversion = flag; }
+    bool getWaitForConversion() { return waitForConversion; }
+    void setCheckForConversion(bool /* flag */) {}
+    bool getCheckForConversion() { return true; }
+
+    void requestTemperatures();
+    bool requestTemperaturesByAddress(const uint8_t* address);
+    bool isConversionComplete();
+    int16_t millisToWaitForConversion(uint8_t resolution);
+
+    int16_t getTemp(const uint8_t* address);   // 1/128 C
+    float getTempC(const uint8_t* address);
+    static float rawToCelsius(int16_t raw) { return raw <= DEVICE_DISCONNECTED_RAW ? DEVICE_DISCONNECTED_C : raw * 0.0078125f; }
+
+  private:
+    uint8_t devices = 0;
+    uint8_t bitResolution = 9;
+    bool waitForConversion = true;
+    uint64_t conversionEnd = 0;
+    uint8_t resolution[MAX_SIM_THERMOMETERS];
+    int16_t scratchpad[MAX_SIM_THERMOMETERS];   // 1/16 C as in the device
+    bool initialized = false;
+
+    int deviceIndex(const uint8_t* address);
+    void startConversion(int first, int last);
+};
+
+#endif
@@ -0,0 +1,48 @@
+/**********************************************************
+ * Simulated HX711 load cell ADC for the host build.
+ * ---
+ * Same interface as the HX711 library. Conversions run
+ * continuously at the configured rate while powered up and
+ * pull DOUT low (raising a pin interrupt if attached),
+ * read() busy-waits for the next conversion like the
+ * library waiting for DOUT to go low.
+ **********************************************************/
+#ifndef __SIM_HX711_H__
+#define __SIM_HX711_H__
+
+#include "Arduino.h"
+
+class HX711 {
+  public:
+    void begin(uint8_t dout, uint8_t pd_sck, uint8_t gain = 128);
+    bool is_ready();
+    void wait_ready(unsigned long delay_ms = 0);
+    bool wait_ready_retry(int retries = 3, unsigned long delay_ms = 0);
+    bool wait_ready_timeout(unsigned long timeout = 1000, unsigned long delay_ms = 0);
+    void set_gain(uint8_t gain = 128);
+    long read();
+    long read_average(uint8_t times = 10);
+    double get_value(uint8_t times = 1);
+    float get_units(uint8_t times = 1);
+    void tare(uint8_t times = 10);
+    void set_scale(float scale = 1.f) { SCALE = scale; }
+    float get_scale() { return SCALE; }
+    void set_offset(long offset = 0) { OFFSET = offset; }
+    long get_offset() { return OFFSET; }
+    void power_down();
+    void power_up();
+
+  private:
+    float SCALE = 1;
+    long OFFSET = 0;
+    uint8_t dout = 0;
+    bool powered = true;
+    bool ready = false;     // DOUT low
+    uint64_t readyAt = 0;   // simulation time of the next conversion
+    unsigned conversion = 0;
+
+    void startConversions();
+    void convert();
+};
+
+#endif
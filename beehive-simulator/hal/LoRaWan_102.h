@@ -0,0 +1,219 @@
+/**********************************************************
+ * Simulated LoRaMac (LoRaWAN 1.0.2) of the CubeCell core
+ * for the host build.
+ * ---
+ * The types and primitives used by LoRaMacDirect, backed
+ * by a simulated radio and network server, see LoRaMac.cpp.
+ * Only the EU868 region is simulated and network ADR is not,
+ * the requested datarate is used for every uplink.
+ **********************************************************/
+#ifndef __SIM_LORAWAN_102_H__
+#define __SIM_LORAWAN_102_H__
+
+#include "Arduino.h"
+
+#ifndef LORAWAN_NET_RESERVE
+  #define LORAWAN_NET_RESERVE 0
+#endif
+#ifndef LORAWAN_ADR
+  #define LORAWAN_ADR 1
+#endif
+
+#define DR_0 0
+#define DR_1 1
+#define DR_2 2
+#define DR_3 3
+#define DR_4 4
+#define DR_5 5
+#define DR_6 6
+#define DR_7 7
+
+typedef uint32_t TimerTime_t;
+
+typedef enum { LORAMAC_REGION_EU868 = 5 } LoRaMacRegion_t;
+#define ACTIVE_REGION LORAMAC_REGION_EU868
+
+typedef enum { CLASS_A, CLASS_B, CLASS_C } DeviceClass_t;
+
+typedef enum {
+  LORAMAC_STATUS_OK,
+  LORAMAC_STATUS_BUSY,
+  LORAMAC_STATUS_SERVICE_UNKNOWN,
+  LORAMAC_STATUS_PARAMETER_INVALID,
+  LORAMAC_STATUS_FREQUENCY_INVALID,
+  LORAMAC_STATUS_DATARATE_INVALID,
+  LORAMAC_STATUS_FREQ_AND_DR_INVALID,
+  LORAMAC_STATUS_NO_NETWORK_JOINED,
+  LORAMAC_STATUS_LENGTH_ERROR,
+  LORAMAC_STATUS_DEVICE_OFF,
+  LORAMAC_STATUS_REGION_NOT_SUPPORTED,
+} LoRaMacStatus_t;
+
+typedef enum {
+  LORAMAC_EVENT_INFO_STATUS_OK = 0,
+  LORAMAC_EVENT_INFO_STATUS_ERROR,
+  LORAMAC_EVENT_INFO_STATUS_TX_TIMEOUT,
+  LORAMAC_EVENT_INFO_STATUS_RX1_TIMEOUT,
+  LORAMAC_EVENT_INFO_STATUS_RX2_TIMEOUT,
+  LORAMAC_EVENT_INFO_STATUS_RX1_ERROR,
+  LORAMAC_EVENT_INFO_STATUS_RX2_ERROR,
+  LORAMAC_EVENT_INFO_STATUS_JOIN_FAIL,
+  LORAMAC_EVENT_INFO_STATUS_DOWNLINK_REPEATED,
+  LORAMAC_EVENT_INFO_STATUS_TX_DR_PAYLOAD_SIZE_ERROR,
+  LORAMAC_EVENT_INFO_STATUS_DOWNLINK_TOO_MANY_FRAMES_LOSS,
+  LORAMAC_EVENT_INFO_STATUS_ADDRESS_FAIL,
+  LORAMAC_EVENT_INFO_STATUS_MIC_FAIL,
+  LORAMAC_EVENT_INFO_STATUS_MULTICAST_FAIL,
+  LORAMAC_EVENT_INFO_STATUS_BEACON_LOCKED,
+  LORAMAC_EVENT_INFO_STATUS_BEACON_LOST,
+  LORAMAC_EVENT_INFO_STATUS_BEACON_NOT_FOUND,
+} LoRaMacEventInfoStatus_t;
+
+typedef enum { MCPS_UNCONFIRMED, MCPS_CONFIRMED, MCPS_MULTICAST, MCPS_PROPRIETARY } Mcps_t;
+typedef enum { MLME_JOIN, MLME_LINK_CHECK, MLME_TXCW, MLME_TXCW_1, MLME_SCHEDULE_UPLINK } Mlme_t;
+typedef enum { RX_SLOT_WIN_1, RX_SLOT_WIN_2, RX_SLOT_WIN_CLASS_C, RX_SLOT_WIN_PING_SLOT } LoRaMacRxSlot_t;
+
+typedef struct {
+  uint8_t fPort;
+  void* fBuffer;
+  uint16_t fBufferSize;
+  int8_t Datarate;
+} McpsReqUnconfirmed_t;
+
+typedef struct {
+  uint8_t fPort;
+  void* fBuffer;
+  uint16_t fBufferSize;
+  int8_t Datarate;
+  uint8_t NbTrials;
+} McpsReqConfirmed_t;
+
+typedef struct {
+  Mcps_t Type;
+  union {
+    McpsReqUnconfirmed_t Unconfirmed;
+    McpsReqConfirmed_t Confirmed;
+  } Req;
+} McpsReq_t;
+
+typedef struct {
+  Mcps_t McpsRequest;
+  LoRaMacEventInfoStatus_t Status;
+  uint8_t Datarate;
+  int8_t TxPower;
+  bool AckReceived;
+  uint8_t NbRetries;
+  TimerTime_t TxTimeOnAir;
+  uint32_t UpLinkCounter;
+  uint32_t UpLinkFrequency;
+} McpsConfirm_t;
+
+typedef struct {
+  Mcps_t McpsIndication;
+  LoRaMacEventInfoStatus_t Status;
+  uint8_t Multicast;
+  uint8_t Port;
+  uint8_t RxDatarate;
+  uint8_t FramePending;
+  uint8_t* Buffer;
+  uint8_t BufferSize;
+  bool RxData;
+  int16_t Rssi;
+  int8_t Snr;
+  LoRaMacRxSlot_t RxSlot;
+  bool AckReceived;
+  uint32_t DownLinkCounter;
+} McpsIndication_t;
+
+typedef struct {
+  uint8_t* DevEui;
+  uint8_t* AppEui;
+  uint8_t* AppKey;
+} MlmeReqJoin_t;
+
+typedef struct {
+  Mlme_t Type;
+  union {
+    MlmeReqJoin_t Join;
+  } Req;
+} MlmeReq_t;
+
+typedef struct {
+  Mlme_t MlmeRequest;
+  LoRaMacEventInfoStatus_t Status;
+  TimerTime_t TxTimeOnAir;
+  uint8_t DemodMargin;
+  uint8_t NbGateways;
+  uint8_t NbRetries;
+} MlmeConfirm_t;
+
+typedef struct {
+  Mlme_t MlmeIndication;
+  LoRaMacEventInfoStatus_t Status;
+} MlmeIndication_t;
+
+typedef enum {
+  MIB_DEVICE_CLASS,
+  MIB_NETWORK_JOINED,
+  MIB_ADR,
+  MIB_NET_ID,
+  MIB_DEV_ADDR,
+  MIB_NWK_SKEY,
+  MIB_APP_SKEY,
+  MIB_PUBLIC_NETWORK,
+  MIB_CHANNELS_DATARATE,
+  MIB_UPLINK_COUNTER,
+  MIB_DOWNLINK_COUNTER,
+} Mib_t;
+
+typedef union {
+  DeviceClass_t Class;
+  bool IsNetworkJoined;
+  bool AdrEnable;
+  uint32_t NetID;
+  uint32_t DevAddr;
+  uint8_t* NwkSKey;
+  uint8_t* AppSKey;
+  bool EnablePublicNetwork;
+  int8_t ChannelsDatarate;
+  uint32_t UpLinkCounter;
+  uint32_t DownLinkCounter;
+} MibParam_t;
+
+typedef struct {
+  Mib_t Type;
+  MibParam_t Param;
+} MibRequestConfirm_t;
+
+typedef struct {
+  uint8_t MaxPossiblePayload;
+  uint8_t CurrentPayloadSize;
+} LoRaMacTxInfo_t;
+
+typedef struct {
+  void (*MacMcpsConfirm)(McpsConfirm_t* McpsConfirm);
+  void (*MacMcpsIndication)(McpsIndication_t* McpsIndication);
+  void (*MacMlmeConfirm)(MlmeConfirm_t* MlmeConfirm);
+  void (*MacMlmeIndication)(MlmeIndication_t* MlmeIndication);
+} LoRaMacPrimitives_t;
+
+typedef struct {
+  uint8_t (*GetBatteryLevel)(void);
+  float (*GetTemperatureLevel)(void);
+} LoRaMacCallback_t;
+
+LoRaMacStatus_t LoRaMacInitialization(LoRaMacPrimitives_t* primitives, LoRaMacCallback_t* callbacks, LoRaMacRegion_t region);
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t size, LoRaMacTxInfo_t* txInfo);
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t* mibGet);
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t* mibSet);
+LoRaMacStatus_t LoRaMacMlmeRequest(MlmeReq_t* mlmeRequest);
+LoRaMacStatus_t LoRaMacMcpsRequest(McpsReq_t* mcpsRequest);
+
+uint8_t BoardGetBatteryLevel(void);
+
+struct Radio_s {
+  void (*IrqProcess)(void);
+};
+extern const struct Radio_s Radio;
+
+#endif
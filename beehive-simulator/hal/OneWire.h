@@ -0,0 +1,15 @@
+/**********************************************************
+ * Simulated 1-wire bus for the host build. The bus timing
+ * is part of the simulated DallasTemperature driver.
+ **********************************************************/
+#ifndef __SIM_ONEWIRE_H__
+#define __SIM_ONEWIRE_H__
+
+#include "Arduino.h"
+
+class OneWire {
+  public:
+    OneWire(uint8_t /* pin */) {}
+};
+
+#endif
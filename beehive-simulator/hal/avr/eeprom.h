@@ -0,0 +1,15 @@
+/**********************************************************
+ * Simulated avr-libc EEPROM functions for the host build.
+ * ---
+ * The EEPROM of the ATmega328P is kept over resets in the
+ * totals of the simulation, see Simulation.h.
+ **********************************************************/
+#ifndef __SIM_AVR_EEPROM_H__
+#define __SIM_AVR_EEPROM_H__
+
+#include <stddef.h>
+
+void eeprom_read_block(void* dst, const void* src, size_t size);
+void eeprom_update_block(const void* src, void* dst, size_t size);
+
+#endif
@@ -0,0 +1,6 @@
+/**********************************************************
+ * LoRa credentials for the host build. The simulated
+ * network accepts any keys, the template values are used
+ * unless the sketch folder contains a credentials.h.
+ **********************************************************/
+#include "../../arduino_beehive_sensor_lora/credentials-template.h"
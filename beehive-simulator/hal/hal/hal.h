@@ -0,0 +1,21 @@
+/**********************************************************
+ * Simulated LMIC hardware abstraction for the host build.
+ **********************************************************/
+#ifndef __SIM_LMIC_HAL_H__
+#define __SIM_LMIC_HAL_H__
+
+#include "../lmic.h"
+
+#define NUM_DIO 3
+#define LMIC_UNUSED_PIN 0xff
+
+struct lmic_pinmap {
+  u1_t nss;
+  u1_t rxtx;
+  u1_t rst;
+  u1_t dio[NUM_DIO];
+};
+
+extern const lmic_pinmap lmic_pins;
+
+#endif
@@ -0,0 +1,117 @@
+/**********************************************************
+ * Simulated LMIC (IBM LoRaWAN in C) for the host build.
+ * ---
+ * The subset of the LMIC API used by DraginoLoRa, backed by
+ * the simulated radio, see Lmic.cpp. Events are delivered
+ * to onEvent() from os_runloop_once(). ABP only, EU868,
+ * duty cycle limits of the bands are not simulated. The
+ * link check mode sets ADRACKReq and reports EV_LINK_DEAD
+ * and EV_LINK_ALIVE like lmic.c. Unacknowledged confirmed
+ * frames are retransmitted up to TXCONF_ATTEMPTS times,
+ * every second one a datarate lower.
+ **********************************************************/
+#ifndef __SIM_LMIC_H__
+#define __SIM_LMIC_H__
+
+#include "Arduino.h"
+
+typedef uint8_t  bit_t;
+typedef uint8_t  u1_t;
+typedef int8_t   s1_t;
+typedef uint16_t u2_t;
+typedef int16_t  s2_t;
+typedef uint32_t u4_t;
+typedef int32_t  s4_t;
+typedef u4_t     devaddr_t;
+typedef u1_t     dr_t;
+typedef u1_t*    xref2u1_t;
+
+enum _dr_eu868_t { DR_SF12 = 0, DR_SF11, DR_SF10, DR_SF9, DR_SF8, DR_SF7, DR_SF7B, DR_FSK, DR_NONE };
+enum { BAND_MILLI = 0, BAND_CENTI = 1, BAND_DECI = 2, BAND_AUX = 3 };
+
+#define DR_RANGE_MAP(drlo, drhi) (((u2_t)0xFFFF << (drlo)) & ((u2_t)0xFFFF >> (15 - (drhi))))
+
+enum _ev_t {
+  EV_SCAN_TIMEOUT = 1, EV_BEACON_FOUND, EV_BEACON_MISSED, EV_BEACON_TRACKED, EV_JOINING,
+  EV_JOINED, EV_RFU1, EV_JOIN_FAILED, EV_REJOIN_FAILED, EV_TXCOMPLETE, EV_LOST_TSYNC,
+  EV_RESET, EV_RXCOMPLETE, EV_LINK_DEAD, EV_LINK_ALIVE
+};
+typedef enum _ev_t ev_t;
+
+enum {
+  OP_NONE     = 0x0000,
+  OP_SCAN     = 0x0001,
+  OP_TRACK    = 0x0002,
+  OP_JOINING  = 0x0004,
+  OP_TXDATA   = 0x0008,
+  OP_POLL     = 0x0010,
+  OP_REJOIN   = 0x0020,
+  OP_SHUTDOWN = 0x0040,
+  OP_TXRXPEND = 0x0080,
+  OP_RNDTX    = 0x0100,
+  OP_PINGINI  = 0x0200,
+  OP_PINGABLE = 0x0400,
+  OP_NEXTCHNL = 0x0800,
+  OP_LINKDEAD = 0x1000,
+  OP_TESTMODE = 0x2000,
+  OP_UNJOIN   = 0x4000,
+};
+
+enum {
+  TXRX_ACK    = 0x80,
+  TXRX_NACK   = 0x40,
+  TXRX_NOPORT = 0x20,
+  TXRX_PORT   = 0x10,
+  TXRX_DNW1   = 0x01,
+  TXRX_DNW2   = 0x02,
+  TXRX_PING   = 0x04,
+};
+
+#define MAX_LEN_FRAME   64
+#define TXCONF_ATTEMPTS  8
+
+struct lmic_t {
+  u4_t     netid;
+  devaddr_t devaddr;
+  u4_t     seqnoUp;
+  u4_t     seqnoDn;
+  u2_t     opmode;
+  dr_t     datarate;
+  s1_t     txpow;
+  dr_t     dn2Dr;
+  bit_t    adrEnabled;
+  s1_t     adrAckReq;  // uplinks without downlink, >= 0 sets ADRACKReq, see Lmic.cpp
+  u1_t     txCnt;      // retransmissions of the confirmed frame
+  u1_t     pendTxPort;
+  u1_t     pendTxConf;
+  u1_t     pendTxLen;
+  u1_t     pendTxData[MAX_LEN_FRAME];
+  u1_t     txrxFlags;
+  u1_t     dataBeg;
+  u1_t     dataLen;
+  u1_t     frame[MAX_LEN_FRAME];
+  s2_t     rssi;    // dBm + 64, as read from the SX127x
+  s1_t     snr;     // dB * 4
+};
+
+extern struct lmic_t LMIC;
+
+void os_init();
+void os_runloop_once();
+
+void LMIC_reset();
+bit_t LMIC_setupChannel(u1_t channel, u4_t frequency, u2_t drmap, s1_t band);
+void LMIC_setLinkCheckMode(bit_t enabled);
+void LMIC_setAdrMode(bit_t enabled);
+void LMIC_setSession(u4_t netid, devaddr_t devaddr, xref2u1_t nwkKey, xref2u1_t artKey);
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow);
+int LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed);
+void LMIC_clrTxData();
+
+// implemented by the application
+void onEvent(ev_t ev);
+void os_getArtEui(u1_t* buf);
+void os_getDevEui(u1_t* buf);
+void os_getDevKey(u1_t* buf);
+
+#endif
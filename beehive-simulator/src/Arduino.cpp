@@ -0,0 +1,366 @@
+/**********************************************************
+ * Simulated Arduino core, see hal/Arduino.h
+ * ---
+ * Output on Serial costs the time to shift the bytes out of
+ * the UART once its buffer is full, and flush() waits until
+ * the buffer is drained.
+ **********************************************************/
+#include "Arduino.h"
+#include "Simulation.h"
+#include "avr/eeprom.h"
+
+#include <stdio.h>
+
+using sim::board;
+
+/* Time ******************************************/
+
+// 32 bit like the MCU, millis() wraps after 49.7 days (clockStart ms at boot)
+unsigned long millis() {
+  return (uint32_t)((uint64_t)board().config.clockStart + board().uptime() / 1000);
+}
+
+unsigned long micros() {
+  return (uint32_t)((uint64_t)board().config.clockStart * 1000 + board().uptime());
+}
+
+void delay(unsigned long ms) {
+  board().run((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  board().run(us);
+}
+
+/* Pins ******************************************/
+
+static uint8_t pinModes[32];
+static uint8_t pinValues[32];
+
+typedef struct {
+  void (*handler)();
+  int mode;
+} PinInterrupt;
+
+static PinInterrupt pinInterrupts[32];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  pinModes[pin % 32] = mode;
+  if (mode == INPUT_PULLUP) pinValues[pin % 32] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  pinValues[pin % 32] = value;
+}
+
+int digitalRead(uint8_t pin) {
+  return pinValues[pin % 32];
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+  PinInterrupt pinInterrupt = {handler, mode};
+  pinInterrupts[interrupt % 32] = pinInterrupt;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  pinInterrupts[interrupt % 32].handler = 0;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+#if !defined(__ASR6501__)
+  uint8_t PCICR;
+  uint8_t PCIFR;
+  uint8_t PCMSK1;
+
+  extern "C" __attribute__((weak)) void __vector_pcint1() {}
+#endif
+
+namespace sim {
+
+void drivePin(uint8_t pin, uint8_t level) {
+  uint8_t previous = pinValues[pin % 32];
+  pinValues[pin % 32] = level;
+  if (previous == level) return;
+
+  #if defined(__ASR6501__)
+    int interrupt = pin;
+  #else
+    int interrupt = digitalPinToInterrupt(pin);
+    if (pin >= A0 && pin <= A5 && (PCICR & _BV(PCIE1)) && (PCMSK1 & _BV(pin - A0))) {
+      board().wakeup();
+      __vector_pcint1();
+    }
+  #endif
+  if (interrupt < 0 || pinInterrupts[interrupt].handler == 0) return;
+  int mode = pinInterrupts[interrupt].mode;
+  if (mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH)) {
+    board().wakeup();
+    pinInterrupts[interrupt].handler();
+  }
+}
+
+}
+
+/* String ******************************************/
+
+static std::string formatNumber(unsigned long number, unsigned char base) {
+  if (base < 2) base = 10;
+  char buffer[8 * sizeof(long) + 1];
+  char* digit = &buffer[sizeof(buffer) - 1];
+  *digit = '\0';
+  do {
+    char c = number % base;
+    number /= base;
+    *--digit = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (number);
+  return std::string(digit);
+}
+
+static std::string formatSigned(long number, unsigned char base) {
+  if (base == DEC && number < 0) return "-" + formatNumber(-number, base);
+  return formatNumber((uint32_t)number, base); // 32 bit long on the targets
+}
+
+static std::string formatFloat(double number, unsigned char digits) {
+  if (isnan(number)) return "nan";
+  if (isinf(number)) return "inf";
+  if (number > 4294967040.0 || number < -4294967040.0) return "ovf";
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, number);
+  return buffer;
+}
+
+String::String(int number, unsigned char base) : value(formatSigned(number, base)) {}
+String::String(unsigned int number, unsigned char base) : value(formatNumber(number, base)) {}
+String::String(long number, unsigned char base) : value(formatSigned(number, base)) {}
+String::String(unsigned long number, unsigned char base) : value(formatNumber((uint32_t)number, base)) {}
+String::String(double number, unsigned char digits) : value(formatFloat(number, digits)) {}
+
+/* Print ******************************************/
+
+size_t Print::write(const char* text) {
+  return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) write(buffer[i]);
+  return size;
+}
+
+size_t Print::print(const __FlashStringHelper* text) { return write(reinterpret_cast<const char*>(text)); }
+size_t Print::print(const String& text) { return write(text.c_str()); }
+size_t Print::print(const char text[]) { return write(text); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char number, int base) { return printNumber(number, base); }
+size_t Print::print(unsigned int number, int base) { return printNumber(number, base); }
+size_t Print::print(unsigned long number, int base) { return printNumber(number, base); }
+size_t Print::print(int number, int base) { return print((long)number, base); }
+size_t Print::print(long number, int base) { return write(formatSigned(number, base).c_str()); }
+size_t Print::print(double number, int digits) { return printFloat(number, digits); }
+
+size_t Print::println(const __FlashStringHelper* text) { return print(text) + println(); }
+size_t Print::println(const String& text) { return print(text) + println(); }
+size_t Print::println(const char text[]) { return print(text) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char number, int base) { return print(number, base) + println(); }
+size_t Print::println(int number, int base) { return print(number, base) + println(); }
+size_t Print::println(unsigned int number, int base) { return print(number, base) + println(); }
+size_t Print::println(long number, int base) { return print(number, base) + println(); }
+size_t Print::println(unsigned long number, int base) { return print(number, base) + println(); }
+size_t Print::println(double number, int digits) { return print(number, digits) + println(); }
+size_t Print::println() { return write("\r\n"); }
+
+size_t Print::printNumber(unsigned long number, uint8_t base) {
+  return write(formatNumber((uint32_t)number, base).c_str());
+}
+
+size_t Print::printFloat(double number, uint8_t digits) {
+  return write(formatFloat(number, digits).c_str());
+}
+
+/* Serial ******************************************/
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long /* baud */) {
+  drainedAt = board().now();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  sim::Board& b = board();
+  uint64_t byteTime = (uint64_t)(10 * 1e6 / b.config.serialBaud);
+  uint64_t buffered = (uint64_t)b.config.serialBuffer * byteTime;
+  if (drainedAt < b.now()) drainedAt = b.now();
+  drainedAt += byteTime;
+  if (drainedAt - b.now() > buffered) {
+    b.runUntil(drainedAt - buffered);
+  }
+  if (b.verbose) {
+    if (lineStart) printf("%10.3f ", b.now() / 1e6);
+    if (c != '\r') putchar(c);
+    lineStart = (c == '\n');
+  }
+  return 1;
+}
+
+void HardwareSerial::flush() {
+  if (drainedAt > board().now()) {
+    board().runUntil(drainedAt);
+  }
+}
+
+/* Board specific ******************************************/
+
+#if defined(__ASR6501__)
+
+int analogRead(uint8_t pin) {
+  board().run(100);
+  if (pin == ADC) {
+    return (int)(sim::world().battery() * 1000 / 2); // mV behind the 1:2 divider
+  }
+  return 0;
+}
+
+void TimerInit(TimerEvent_t* obj, void (*callback)(void)) {
+  obj->ReloadValue = 0;
+  obj->IsRunning = false;
+  obj->Callback = callback;
+  obj->eventId = 0;
+}
+
+void TimerSetValue(TimerEvent_t* obj, uint32_t value) {
+  obj->ReloadValue = value;
+}
+
+void TimerStart(TimerEvent_t* obj) {
+  TimerStop(obj);
+  obj->IsRunning = true;
+  obj->eventId = board().schedule((uint64_t)obj->ReloadValue * 1000, [obj]() {
+    obj->IsRunning = false;
+    obj->eventId = 0;
+    obj->Callback();
+  });
+}
+
+void TimerStop(TimerEvent_t* obj) {
+  if (obj->IsRunning) {
+    board().cancel(obj->eventId);
+    obj->IsRunning = false;
+    obj->eventId = 0;
+  }
+}
+
+void boardInitMcu() {}
+
+void lowPowerHandler() {
+  if (!board().sleepUntilEvent()) {
+    fprintf(stderr, "Deep sleep without wakeup source at %.3f s\n", board().now() / 1e6);
+    exit(1);
+  }
+}
+
+void HW_Reset(int /* mode */) {
+  board().reset();
+}
+
+uint32_t TimerGetCurrentTime() {
+  return (uint32_t)((uint64_t)board().config.clockStart + board().sinceBoot() / 1000);
+}
+
+uint8_t FLASH_update(uint32_t address, const void* data, uint32_t size) {
+  if (address + size > SIM_FLASH_SIZE) return 1;
+  for (uint32_t row = address / SIM_FLASH_ROW; row <= (address + size - 1) / SIM_FLASH_ROW; row++) {
+    board().totals->flashErases[row]++;
+    board().run((uint64_t)(board().config.flashWrite * SIM_MS));
+  }
+  memcpy(board().totals->flash + address, data, size);
+  return 0;
+}
+
+int FLASH_read_at(uint32_t address, uint8_t* data, size_t size) {
+  if (address + size > SIM_FLASH_SIZE) return -1;
+  memcpy(data, board().totals->flash + address, size);
+  return 0;
+}
+
+#else
+
+void eeprom_read_block(void* dst, const void* src, size_t size) {
+  size_t address = (size_t)src;
+  if (address + size > SIM_EEPROM_SIZE) return;
+  memcpy(dst, board().totals->eeprom + address, size);
+}
+
+// 3.3 ms per changed byte
+void eeprom_update_block(const void* src, void* dst, size_t size) {
+  size_t address = (size_t)dst;
+  if (address + size > SIM_EEPROM_SIZE) return;
+  const uint8_t* bytes = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) {
+    if (board().totals->eeprom[address + i] != bytes[i]) {
+      board().totals->eeprom[address + i] = bytes[i];
+      board().totals->eepromWrites++;
+      board().run(3300);
+    }
+  }
+}
+
+int analogRead(uint8_t /* pin */) {
+  board().run(110);
+  return 0;
+}
+
+uint8_t ADMUX;
+AdcControlRegister ADCSRA;
+uint8_t ADCL;
+uint8_t ADCH;
+
+WatchdogControlRegister WDTCSR;
+static unsigned watchdogEvent = 0;
+
+extern "C" void __vector_wdt();
+
+WatchdogControlRegister& WatchdogControlRegister::operator=(uint8_t bits) {
+  static const uint64_t periods[] = {16, 32, 64, 125, 250, 500, 1000, 2000, 4000, 8000};
+  value = bits;
+  if (watchdogEvent != 0) {
+    board().cancel(watchdogEvent);
+    watchdogEvent = 0;
+  }
+  if (value & _BV(WDIE)) {
+    uint8_t prescaler = (value & 0x07) | ((value & _BV(WDP3)) ? 0x08 : 0);
+    uint64_t period = (uint64_t)(periods[prescaler % 10] * SIM_MS * (1.0 + board().config.watchdogDrift));
+    watchdogEvent = board().schedule(period, []() {
+      watchdogEvent = 0;
+      __vector_wdt();
+    });
+  }
+  return *this;
+}
+
+WatchdogControlRegister& WatchdogControlRegister::operator|=(uint8_t bits) {
+  value |= bits;
+  return *this;
+}
+
+// polling the register costs a few cycles
+WatchdogControlRegister::operator uint8_t() {
+  board().run(2);
+  return value;
+}
+
+AdcControlRegister& AdcControlRegister::operator|=(uint8_t bits) {
+  value |= bits;
+  if (value & _BV(ADSC)) {
+    board().run(104); // 13 ADC clocks at 125 kHz
+    long result = (long)(1126400L / (sim::world().battery() * 1000));
+    ADCL = result & 0xFF;
+    ADCH = (result >> 8) & 0x03;
+    value &= ~_BV(ADSC);
+  }
+  return *this;
+}
+
+#endif
@@ -0,0 +1,52 @@
+/**********************************************************
+ * Host build of the sensor script.
+ * ---
+ * Compiles the sketch against the simulated core and
+ * attaches its calibration (load cell, thermometer
+ * addresses) to the simulated hive. The probes let the
+ * benchmark follow the state machine of the sketch.
+ **********************************************************/
+#include "Arduino.h"
+#include "Simulation.h"
+#include "Firmware.h"
+
+#include "arduino_beehive_sensor_lora.ino"
+
+namespace sim {
+
+void attachFirmware() {
+  world().attachLoadcell(LOADCELL_OFFSET, LOADCELL_DIVIDER, TEMPERATURE_FACTOR, TEMPERATURE_OFFSET);
+  for (int i = 0; i < THERMOMETER_COUNT; i++) {
+    if (thermometer[i][0] != 0) {
+      world().attachThermometer(thermometer[i], i == THERMOMETER_OUTER ? 0 : i);
+    }
+  }
+}
+
+bool isMeasuring() {
+  return node.state() == MEASURE;
+}
+
+AirtimeBudget& airtime() {
+  return radio.airtime();
+}
+
+int stateCount() {
+  return node.stateCount();
+}
+
+const char* stateName(int state) {
+  return stateNames[state];
+}
+
+StateCounters stateCounters(int state) {
+  StateStats stats = node.stats(state);
+  StateCounters counters = {stats.time, stats.entries, stats.timeouts, stats.maxDuration};
+  return counters;
+}
+
+uint64_t nodeTime() {
+  return nodeClock.now();
+}
+
+}
@@ -0,0 +1,32 @@
+/**********************************************************
+ * Host build of the sensor script, see Firmware.cpp
+ **********************************************************/
+#ifndef __SIM_FIRMWARE_H__
+#define __SIM_FIRMWARE_H__
+
+#include "AirtimeBudget.h"
+
+void setup();
+void loop();
+
+namespace sim {
+
+// counters of a state of the sketch, see StateMachine.h
+struct StateCounters {
+  uint64_t time;         // ms
+  uint32_t entries;
+  uint32_t timeouts;
+  uint32_t maxDuration;  // ms
+};
+
+void attachFirmware();
+bool isMeasuring();
+AirtimeBudget& airtime();
+int stateCount();
+const char* stateName(int state);
+StateCounters stateCounters(int state);
+uint64_t nodeTime();
+
+}
+
+#endif
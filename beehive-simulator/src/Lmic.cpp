@@ -0,0 +1,201 @@
+/**********************************************************
+ * Simulated LMIC, see hal/lmic.h
+ * ---
+ * A data frame is sent right away, followed by the RX1 and
+ * RX2 windows and the retransmissions of a confirmed frame.
+ * The completion is reported to onEvent() on the next
+ * os_runloop_once() like the LMIC job queue does.
+ **********************************************************/
+#if !defined(__ASR6501__)
+#include "lmic.h"
+#include "hal/hal.h"
+#include "Simulation.h"
+#include "Radio.h"
+
+#include <vector>
+
+using sim::board;
+
+// link check counter of lmic.c: ADRACKReq after LINK_CHECK_DEAD silent uplinks, EV_LINK_DEAD after as many more
+#define LINK_CHECK_CONT  12
+#define LINK_CHECK_DEAD  24
+#define LINK_CHECK_INIT  (-LINK_CHECK_DEAD)
+#define LINK_CHECK_OFF   (-128)
+#define RETRY_PERIOD     (3000*SIM_MS)  // RETRY_PERIOD_secs of lmic.c, plus up to 2 s random
+
+struct lmic_t LMIC;
+
+static std::vector<unsigned> jobs;
+static bool completed = false;
+static ev_t linkEvent = EV_RESET;  // EV_LINK_DEAD or EV_LINK_ALIVE before EV_TXCOMPLETE
+
+static void schedule(uint64_t delay, sim::Board::Action action) {
+  jobs.push_back(board().schedule(delay, action));
+}
+
+static void cancelJobs() {
+  for (size_t i = 0; i < jobs.size(); i++) board().cancel(jobs[i]);
+  jobs.clear();
+}
+
+void os_init() {
+  memset(&LMIC, 0, sizeof(LMIC));
+  board().run(5000); // radio reset and SPI setup
+}
+
+void os_runloop_once() {
+  if (completed) {
+    completed = false;
+    LMIC.opmode &= ~(OP_TXDATA | OP_TXRXPEND);
+    if (linkEvent != EV_RESET) {
+      ev_t ev = linkEvent;
+      linkEvent = EV_RESET;
+      onEvent(ev);
+    }
+    onEvent(EV_TXCOMPLETE);
+  }
+}
+
+void LMIC_reset() {
+  cancelJobs();
+  completed = false;
+  linkEvent = EV_RESET;
+  u1_t dn2Dr = LMIC.dn2Dr;
+  memset(&LMIC, 0, sizeof(LMIC));
+  LMIC.dn2Dr = dn2Dr;
+  LMIC.adrAckReq = LINK_CHECK_INIT;
+  LMIC.adrEnabled = 1;
+  LMIC.datarate = DR_SF7;
+}
+
+bit_t LMIC_setupChannel(u1_t /* channel */, u4_t /* frequency */, u2_t /* drmap */, s1_t /* band */) {
+  return 1;
+}
+
+void LMIC_setLinkCheckMode(bit_t enabled) {
+  LMIC.adrAckReq = enabled ? LINK_CHECK_INIT : LINK_CHECK_OFF;
+}
+
+void LMIC_setAdrMode(bit_t enabled) {
+  LMIC.adrEnabled = enabled;
+}
+
+void LMIC_setSession(u4_t netid, devaddr_t devaddr, xref2u1_t /* nwkKey */, xref2u1_t /* artKey */) {
+  LMIC.netid = netid;
+  LMIC.devaddr = devaddr;
+  LMIC.seqnoUp = 0;
+  LMIC.seqnoDn = 0;
+  LMIC.opmode &= ~(OP_JOINING | OP_TXRXPEND);
+}
+
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow) {
+  LMIC.datarate = dr;
+  LMIC.txpow = txpow;
+}
+
+// link check counter after the RX windows
+static void checkLink(bool received) {
+  if (LMIC.adrAckReq == LINK_CHECK_OFF) return;
+  if (received) {
+    LMIC.adrAckReq = LINK_CHECK_INIT;
+    if (LMIC.opmode & OP_LINKDEAD) {
+      LMIC.opmode &= ~OP_LINKDEAD;
+      linkEvent = EV_LINK_ALIVE;
+    }
+  } else if (++LMIC.adrAckReq > LINK_CHECK_DEAD) {
+    if (LMIC.datarate > DR_SF12) LMIC.datarate--;
+    LMIC.adrAckReq = LINK_CHECK_CONT;
+    LMIC.opmode |= OP_LINKDEAD;
+    linkEvent = EV_LINK_DEAD;
+  }
+}
+
+// the payload follows the FPort in the frame, like the MAC header of LMIC
+static void finishFrame(u1_t flags, u1_t dataLen) {
+  LMIC.txrxFlags = flags;
+  LMIC.dataBeg = 1;
+  LMIC.dataLen = dataLen;
+  jobs.clear();
+}
+
+static void transmitFrame();
+
+// lmic.c retransmits an unacknowledged confirmed frame and lowers the datarate every second trial
+static void afterReceiveWindows(bool ackReceived) {
+  if (LMIC.pendTxConf && !ackReceived && LMIC.txCnt + 1 < TXCONF_ATTEMPTS) {
+    LMIC.txCnt++;
+    if (LMIC.txCnt % 2 == 0 && LMIC.datarate > DR_SF12) LMIC.datarate--;
+    schedule(RETRY_PERIOD + (uint64_t)(board().random() * 2000 * SIM_MS), transmitFrame);
+  } else {
+    completed = true;
+  }
+}
+
+static void transmitFrame() {
+  jobs.clear();
+  dr_t datarate = LMIC.datarate;
+  u1_t confirmed = LMIC.pendTxConf;
+  uint64_t airtime = sim::transmit(datarate, LORAWAN_OVERHEAD + LMIC.pendTxLen);
+  if (LMIC.txCnt == 0) {
+    board().totals->uplinks++;
+    LMIC.seqnoUp++;
+  } else {
+    board().totals->retransmissions++;
+  }
+  bool received = sim::uplinkReceived(datarate);
+  if (received) sim::network().deliver(LMIC.pendTxPort, LMIC.pendTxData, LMIC.pendTxLen);
+  // the network answers ADRACKReq with a downlink
+  bool linkCheck = LMIC.adrAckReq >= 0;
+  if (linkCheck) board().totals->linkChecks++;
+  bool answered = received && (confirmed || linkCheck || sim::network().hasDownlink());
+
+  schedule(airtime + RECEIVE_DELAY1, [datarate, answered, confirmed, linkCheck]() {
+    if (answered && sim::downlinkReceived(datarate)) {
+      if (linkCheck) board().totals->linkChecksAnswered++;
+      sim::Downlink downlink;
+      downlink.port = 0;
+      if (sim::network().hasDownlink()) downlink = sim::network().next();
+      schedule(sim::receive(datarate, LORAWAN_OVERHEAD + downlink.data.size()), [downlink, confirmed]() {
+        LMIC.frame[0] = downlink.port;
+        memcpy(LMIC.frame + 1, downlink.data.data(), downlink.data.size());
+        LMIC.seqnoDn++;
+        LMIC.rssi = sim::rssi() + 64;
+        LMIC.snr = sim::snr() * 4;
+        u1_t flags = TXRX_DNW1 | (confirmed ? TXRX_ACK : 0) | (downlink.port ? TXRX_PORT : TXRX_NOPORT);
+        checkLink(true);
+        finishFrame(flags, downlink.data.size());
+        afterReceiveWindows(confirmed);
+      });
+    } else {
+      sim::listen(datarate);
+      schedule(RECEIVE_DELAY2 - RECEIVE_DELAY1, [confirmed]() {
+        schedule(sim::listen(LMIC.dn2Dr), [confirmed]() {
+          checkLink(false);
+          finishFrame(TXRX_DNW2 | (confirmed ? TXRX_NACK : 0), 0);
+          afterReceiveWindows(false);
+        });
+      });
+    }
+  });
+}
+
+int LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed) {
+  if (dlen > MAX_LEN_FRAME) return -2;
+  LMIC.pendTxPort = port;
+  LMIC.pendTxConf = confirmed;
+  LMIC.pendTxLen = dlen;
+  memcpy(LMIC.pendTxData, data, dlen);
+  LMIC.txCnt = 0;
+  LMIC.opmode |= OP_TXDATA | OP_TXRXPEND;
+  transmitFrame();
+  return 0;
+}
+
+void LMIC_clrTxData() {
+  cancelJobs();
+  completed = false;
+  LMIC.opmode &= ~(OP_TXDATA | OP_TXRXPEND | OP_POLL);
+  LMIC.pendTxLen = 0;
+}
+
+#endif
@@ -0,0 +1,339 @@
+/**********************************************************
+ * Simulated LoRaMac of the CubeCell core, see
+ * hal/LoRaWan_102.h
+ * ---
+ * Radio activity (TX, RX windows, retransmissions of
+ * confirmed frames) runs on timer events, the primitives of
+ * the application are called from Radio.IrqProcess() like
+ * the radio IRQ handling of the real stack.
+ **********************************************************/
+#if defined(__ASR6501__)
+#include "LoRaWan_102.h"
+#include "Simulation.h"
+#include "Radio.h"
+
+#include <vector>
+
+using sim::board;
+
+#define JOIN_DATARATE   DR_5
+#define JOIN_REQUEST    23
+#define JOIN_ACCEPT     33
+#define ACK_TIMEOUT     (2000*SIM_MS)
+#define TX_POWER        14
+#define LINK_CHECK_REQ  1    // FOpts bytes
+#define LINK_CHECK_ANS  3
+
+static LoRaMacPrimitives_t* primitives = 0;
+static bool joined = false;
+static bool adr = false;
+static bool busy = false;
+static bool linkCheckPending = false;
+static DeviceClass_t deviceClass = CLASS_A;
+static uint32_t netId = 0;
+static uint32_t devAddr = 0;
+static uint8_t nwkSKey[16];
+static uint8_t appSKey[16];
+static uint32_t upLinkCounter = 0;
+static uint32_t downLinkCounter = 0;
+static int8_t channelsDatarate = DR_0;
+static std::vector<sim::Board::Action> pending;
+static uint8_t rxBuffer[256];
+
+static void deliver(sim::Board::Action action) {
+  pending.push_back(action);
+}
+
+static void irqProcess() {
+  std::vector<sim::Board::Action> actions;
+  actions.swap(pending);
+  for (size_t i = 0; i < actions.size(); i++) actions[i]();
+}
+
+const struct Radio_s Radio = { irqProcess };
+
+LoRaMacStatus_t LoRaMacInitialization(LoRaMacPrimitives_t* macPrimitives, LoRaMacCallback_t* /* callbacks */, LoRaMacRegion_t /* region */) {
+  if (macPrimitives == 0) return LORAMAC_STATUS_PARAMETER_INVALID;
+  primitives = macPrimitives;
+  joined = false;
+  busy = false;
+  linkCheckPending = false;
+  deviceClass = CLASS_A;
+  upLinkCounter = 0;
+  downLinkCounter = 0;
+  channelsDatarate = DR_0;
+  pending.clear();
+  board().run(2000);
+  return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t size, LoRaMacTxInfo_t* txInfo) {
+  txInfo->MaxPossiblePayload = sim::maxPayload(channelsDatarate) - (linkCheckPending ? LINK_CHECK_REQ : 0);
+  txInfo->CurrentPayloadSize = size;
+  return size <= txInfo->MaxPossiblePayload ? LORAMAC_STATUS_OK : LORAMAC_STATUS_LENGTH_ERROR;
+}
+
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t* mibGet) {
+  switch (mibGet->Type) {
+    case MIB_DEVICE_CLASS:      mibGet->Param.Class = deviceClass; break;
+    case MIB_NETWORK_JOINED:    mibGet->Param.IsNetworkJoined = joined; break;
+    case MIB_ADR:               mibGet->Param.AdrEnable = adr; break;
+    case MIB_NET_ID:            mibGet->Param.NetID = netId; break;
+    case MIB_DEV_ADDR:          mibGet->Param.DevAddr = devAddr; break;
+    case MIB_NWK_SKEY:          mibGet->Param.NwkSKey = nwkSKey; break;
+    case MIB_APP_SKEY:          mibGet->Param.AppSKey = appSKey; break;
+    case MIB_CHANNELS_DATARATE: mibGet->Param.ChannelsDatarate = channelsDatarate; break;
+    case MIB_UPLINK_COUNTER:    mibGet->Param.UpLinkCounter = upLinkCounter; break;
+    case MIB_DOWNLINK_COUNTER:  mibGet->Param.DownLinkCounter = downLinkCounter; break;
+    default: return LORAMAC_STATUS_SERVICE_UNKNOWN;
+  }
+  return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t* mibSet) {
+  switch (mibSet->Type) {
+    case MIB_DEVICE_CLASS:      deviceClass = mibSet->Param.Class; break;
+    case MIB_NETWORK_JOINED:    joined = mibSet->Param.IsNetworkJoined; break;
+    case MIB_ADR:               adr = mibSet->Param.AdrEnable; break;
+    case MIB_NET_ID:            netId = mibSet->Param.NetID; break;
+    case MIB_DEV_ADDR:          devAddr = mibSet->Param.DevAddr; break;
+    case MIB_NWK_SKEY:          memcpy(nwkSKey, mibSet->Param.NwkSKey, sizeof(nwkSKey)); break;
+    case MIB_APP_SKEY:          memcpy(appSKey, mibSet->Param.AppSKey, sizeof(appSKey)); break;
+    case MIB_CHANNELS_DATARATE: channelsDatarate = mibSet->Param.ChannelsDatarate; break;
+    case MIB_UPLINK_COUNTER:    upLinkCounter = mibSet->Param.UpLinkCounter; break;
+    case MIB_DOWNLINK_COUNTER:  downLinkCounter = mibSet->Param.DownLinkCounter; break;
+    case MIB_PUBLIC_NETWORK:
+      break;
+    default: return LORAMAC_STATUS_SERVICE_UNKNOWN;
+  }
+  return LORAMAC_STATUS_OK;
+}
+
+/* Join ******************************************/
+
+static void confirmJoin(LoRaMacEventInfoStatus_t status, uint64_t airtime) {
+  busy = false;
+  deliver([status, airtime]() {
+    MlmeConfirm_t confirm = {};
+    confirm.MlmeRequest = MLME_JOIN;
+    confirm.Status = status;
+    confirm.TxTimeOnAir = airtime / 1000;
+    primitives->MacMlmeConfirm(&confirm);
+  });
+}
+
+LoRaMacStatus_t LoRaMacMlmeRequest(MlmeReq_t* mlmeRequest) {
+  if (mlmeRequest->Type == MLME_LINK_CHECK) {
+    // sent with the next uplink
+    if (!joined) return LORAMAC_STATUS_NO_NETWORK_JOINED;
+    linkCheckPending = true;
+    return LORAMAC_STATUS_OK;
+  }
+  if (mlmeRequest->Type != MLME_JOIN) return LORAMAC_STATUS_SERVICE_UNKNOWN;
+  if (busy) return LORAMAC_STATUS_BUSY;
+  busy = true;
+  joined = false;
+  board().totals->joins++;
+
+  uint64_t airtime = sim::transmit(JOIN_DATARATE, JOIN_REQUEST);
+  bool accepted = board().random() >= board().config.joinLoss;
+  board().schedule(airtime + JOIN_ACCEPT_DELAY1, [accepted, airtime]() {
+    if (accepted) {
+      board().schedule(sim::receive(JOIN_DATARATE, JOIN_ACCEPT), [airtime]() {
+        joined = true;
+        netId = 0x13;
+        devAddr = 0x26000000 | (uint32_t)(board().random() * 0xFFFFFF);
+        for (int i = 0; i < 16; i++) {
+          nwkSKey[i] = (uint8_t)(board().random() * 256);
+          appSKey[i] = (uint8_t)(board().random() * 256);
+        }
+        upLinkCounter = 0;
+        downLinkCounter = 0;
+        board().totals->serverDevAddr = devAddr;
+        board().totals->serverFCntUp = 0;
+        confirmJoin(LORAMAC_EVENT_INFO_STATUS_OK, airtime);
+      });
+    } else {
+      sim::listen(JOIN_DATARATE);
+      board().schedule(JOIN_ACCEPT_DELAY2 - JOIN_ACCEPT_DELAY1, [airtime]() {
+        board().schedule(sim::listen(DR_0), [airtime]() {
+          confirmJoin(LORAMAC_EVENT_INFO_STATUS_JOIN_FAIL, airtime);
+        });
+      });
+    }
+  });
+  return LORAMAC_STATUS_OK;
+}
+
+/* Data ******************************************/
+
+typedef struct {
+  Mcps_t type;
+  uint8_t port;
+  uint8_t size;
+  int8_t datarate;
+  uint8_t trials;
+  uint8_t trial;
+  uint64_t airtime;
+  bool linkCheck;      // LinkCheckReq in FOpts
+  int16_t demodMargin; // of the LinkCheckAns, -1 without
+  std::vector<uint8_t> data;
+} Uplink;
+
+static void transmitUplink(Uplink uplink);
+
+static void confirmUplink(const Uplink& uplink, bool ackReceived) {
+  busy = false;
+  upLinkCounter++;
+  uint32_t counter = upLinkCounter;
+  deliver([uplink, ackReceived, counter]() {
+    if (uplink.linkCheck) {
+      MlmeConfirm_t confirm = {};
+      confirm.MlmeRequest = MLME_LINK_CHECK;
+      confirm.Status = uplink.demodMargin >= 0 ? LORAMAC_EVENT_INFO_STATUS_OK : LORAMAC_EVENT_INFO_STATUS_RX2_TIMEOUT;
+      confirm.DemodMargin = uplink.demodMargin >= 0 ? uplink.demodMargin : 0;
+      confirm.NbGateways = uplink.demodMargin >= 0 ? 1 : 0;
+      primitives->MacMlmeConfirm(&confirm);
+    }
+    McpsConfirm_t confirm = {};
+    confirm.McpsRequest = uplink.type;
+    confirm.Status = (uplink.type == MCPS_CONFIRMED && !ackReceived) ? LORAMAC_EVENT_INFO_STATUS_ERROR : LORAMAC_EVENT_INFO_STATUS_OK;
+    confirm.Datarate = uplink.datarate;
+    confirm.TxPower = TX_POWER;
+    confirm.AckReceived = ackReceived;
+    confirm.NbRetries = uplink.trial;
+    confirm.TxTimeOnAir = uplink.airtime / 1000;
+    confirm.UpLinkCounter = counter;
+    confirm.UpLinkFrequency = 868100000;
+    primitives->MacMcpsConfirm(&confirm);
+  });
+}
+
+static void indicateDownlink(const Uplink& uplink, const sim::Downlink& downlink, bool ackReceived) {
+  downLinkCounter++;
+  uint32_t counter = downLinkCounter;
+  bool framePending = sim::network().hasDownlink();
+  int16_t rssi = sim::rssi();
+  int8_t snr = sim::snr();
+  deliver([uplink, downlink, ackReceived, counter, framePending, rssi, snr]() {
+    McpsIndication_t indication = {};
+    indication.McpsIndication = MCPS_UNCONFIRMED;
+    indication.Status = LORAMAC_EVENT_INFO_STATUS_OK;
+    indication.Port = downlink.port;
+    indication.RxDatarate = uplink.datarate;
+    indication.FramePending = framePending;
+    memcpy(rxBuffer, downlink.data.data(), downlink.data.size());
+    indication.Buffer = rxBuffer;
+    indication.BufferSize = downlink.data.size();
+    indication.RxData = downlink.data.size() > 0;
+    indication.Rssi = rssi;
+    indication.Snr = snr;
+    indication.RxSlot = RX_SLOT_WIN_1;
+    indication.AckReceived = ackReceived;
+    indication.DownLinkCounter = counter;
+    primitives->MacMcpsIndication(&indication);
+  });
+}
+
+static void afterReceiveWindows(Uplink uplink, bool ackReceived) {
+  if (uplink.type == MCPS_CONFIRMED && !ackReceived && uplink.trial < uplink.trials) {
+    uint64_t backoff = ACK_TIMEOUT - 1000 * SIM_MS + (uint64_t)(board().random() * 2000 * SIM_MS);
+    board().schedule(backoff, [uplink]() { transmitUplink(uplink); });
+  } else {
+    confirmUplink(uplink, ackReceived);
+  }
+}
+
+// datarate adaptation of confirmed retransmissions, see LoRaMacDirect.h
+static int8_t retransmissionDatarate(const Uplink& uplink) {
+  int8_t datarate = uplink.datarate - (uplink.trial - 1) / 2;
+  return datarate < DR_0 ? DR_0 : datarate;
+}
+
+// network server: drops frames of an unknown session or with a reused frame counter,
+// retransmissions of the last frame are accepted
+static bool acceptFrameCounter() {
+  sim::Totals* totals = board().totals;
+  if (devAddr != totals->serverDevAddr || upLinkCounter + 1 < totals->serverFCntUp) {
+    totals->rejected++;
+    return false;
+  }
+  totals->serverFCntUp = upLinkCounter + 1;
+  return true;
+}
+
+static void transmitUplink(Uplink uplink) {
+  uplink.trial++;
+  if (uplink.trial == 1) {
+    board().totals->uplinks++;
+  } else {
+    board().totals->retransmissions++;
+  }
+  int8_t datarate = uplink.type == MCPS_CONFIRMED ? retransmissionDatarate(uplink) : uplink.datarate;
+  uint8_t size = LORAWAN_OVERHEAD + uplink.size - (uplink.size == 0 ? 1 : 0) + (uplink.linkCheck ? LINK_CHECK_REQ : 0);
+  uint64_t airtime = sim::transmit(datarate, size);
+  uplink.airtime += airtime;
+  bool received = sim::uplinkReceived(datarate) && acceptFrameCounter();
+  if (received) sim::network().deliver(uplink.port, uplink.data.data(), uplink.size);
+  bool answered = received && (uplink.type == MCPS_CONFIRMED || uplink.linkCheck || sim::network().hasDownlink());
+  if (received && uplink.linkCheck) {
+    uplink.demodMargin = sim::demodMargin(datarate);
+  }
+
+  board().schedule(airtime + RECEIVE_DELAY1, [uplink, datarate, received, answered]() {
+    if (answered && sim::downlinkReceived(datarate)) {
+      if (uplink.linkCheck) board().totals->linkChecksAnswered++;
+      sim::Downlink downlink;
+      downlink.port = 0;
+      if (sim::network().hasDownlink()) downlink = sim::network().next();
+      bool ackReceived = uplink.type == MCPS_CONFIRMED;
+      uint8_t size = LORAWAN_OVERHEAD + downlink.data.size() + (uplink.linkCheck ? LINK_CHECK_ANS : 0);
+      board().schedule(sim::receive(datarate, size), [uplink, downlink, ackReceived]() {
+        indicateDownlink(uplink, downlink, ackReceived);
+        afterReceiveWindows(uplink, ackReceived);
+      });
+    } else {
+      sim::listen(datarate);
+      Uplink unanswered = uplink;
+      unanswered.demodMargin = -1;
+      board().schedule(RECEIVE_DELAY2 - RECEIVE_DELAY1, [unanswered]() {
+        board().schedule(sim::listen(RX2_DATARATE), [unanswered]() {
+          afterReceiveWindows(unanswered, false);
+        });
+      });
+    }
+  });
+}
+
+LoRaMacStatus_t LoRaMacMcpsRequest(McpsReq_t* mcpsRequest) {
+  if (!joined) return LORAMAC_STATUS_NO_NETWORK_JOINED;
+  if (busy) return LORAMAC_STATUS_BUSY;
+
+  Uplink uplink = {};
+  uplink.type = mcpsRequest->Type;
+  if (uplink.type == MCPS_CONFIRMED) {
+    uplink.port = mcpsRequest->Req.Confirmed.fPort;
+    uplink.size = mcpsRequest->Req.Confirmed.fBuffer ? mcpsRequest->Req.Confirmed.fBufferSize : 0;
+    if (uplink.size > 0) uplink.data.assign((uint8_t*)mcpsRequest->Req.Confirmed.fBuffer, (uint8_t*)mcpsRequest->Req.Confirmed.fBuffer + uplink.size);
+    uplink.datarate = mcpsRequest->Req.Confirmed.Datarate;
+    uplink.trials = mcpsRequest->Req.Confirmed.NbTrials;
+  } else {
+    uplink.port = mcpsRequest->Req.Unconfirmed.fPort;
+    uplink.size = mcpsRequest->Req.Unconfirmed.fBuffer ? mcpsRequest->Req.Unconfirmed.fBufferSize : 0;
+    if (uplink.size > 0) uplink.data.assign((uint8_t*)mcpsRequest->Req.Unconfirmed.fBuffer, (uint8_t*)mcpsRequest->Req.Unconfirmed.fBuffer + uplink.size);
+    uplink.datarate = mcpsRequest->Req.Unconfirmed.Datarate;
+    uplink.trials = 1;
+  }
+  uplink.linkCheck = linkCheckPending;
+  uplink.demodMargin = -1;
+  if (uplink.size + (uplink.linkCheck ? LINK_CHECK_REQ : 0) > sim::maxPayload(uplink.datarate)) return LORAMAC_STATUS_LENGTH_ERROR;
+
+  if (uplink.linkCheck) board().totals->linkChecks++;
+  linkCheckPending = false;
+  channelsDatarate = uplink.datarate;
+  busy = true;
+  transmitUplink(uplink);
+  return LORAMAC_STATUS_OK;
+}
+
+#endif
@@ -0,0 +1,29 @@
+/**********************************************************
+ * Simulated Low-Power library, see hal/LowPower.h
+ **********************************************************/
+#if !defined(__ASR6501__)
+#include "LowPower.h"
+#include "Simulation.h"
+
+#include <avr/wdt.h>
+
+LowPowerClass LowPower;
+
+// as the library: the watchdog interrupt only ends the sleep
+ISR(WDT_vect) {
+  wdt_disable();
+}
+
+void LowPowerClass::powerDown(period_t period, adc_t /* adc */, bod_t /* bod */) {
+  static const uint64_t periods[] = {15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000};
+  if (period == SLEEP_FOREVER) {
+    if (!sim::board().sleepUntilEvent()) {
+      fprintf(stderr, "Power down without wakeup source at %.3f s\n", sim::board().now() / 1e6);
+      exit(1);
+    }
+    return;
+  }
+  sim::board().sleep((uint64_t)(periods[period] * SIM_MS * (1.0 + sim::board().config.watchdogDrift)));
+}
+
+#endif
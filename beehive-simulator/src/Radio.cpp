@@ -0,0 +1,132 @@
+/**********************************************************
+ * Simulated LoRa radio and network server, see Radio.h
+ **********************************************************/
+#include "Simulation.h"
+#include "Radio.h"
+
+#include <math.h>
+
+namespace sim {
+
+uint8_t spreadingFactor(uint8_t datarate) {
+  return datarate >= 5 ? 7 : 12 - datarate;
+}
+
+static uint16_t bandwidth(uint8_t datarate) {
+  return datarate == 6 ? 250 : 125;
+}
+
+uint64_t symbolTime(uint8_t datarate) {
+  return ((uint64_t)1000 << spreadingFactor(datarate)) / bandwidth(datarate);
+}
+
+uint64_t timeOnAir(uint8_t datarate, uint8_t size) {
+  int sf = spreadingFactor(datarate);
+  int lowDatarateOptimize = (bandwidth(datarate) == 125 && sf >= 11) ? 1 : 0;
+  double symbol = (double)(1 << sf) / bandwidth(datarate); // ms
+  double preamble = (8 + 4.25) * symbol;
+  double bits = 8.0 * size - 4.0 * sf + 28 + 16; // explicit header with CRC
+  double payloadSymbols = 8 + fmax(ceil(bits / (4.0 * (sf - 2 * lowDatarateOptimize))) * 5, 0); // CR 4/5
+  return (uint64_t)((preamble + payloadSymbols * symbol) * 1000);
+}
+
+uint8_t maxPayload(uint8_t datarate) {
+  return datarate <= 2 ? 51 : (datarate == 3 ? 115 : 222);
+}
+
+uint64_t transmit(uint8_t datarate, uint8_t size) {
+  uint64_t duration = timeOnAir(datarate, size);
+  board().pulse(TRANSMITTER, board().config.radioTx, duration);
+  board().transmitted(duration);
+  return duration;
+}
+
+uint64_t receive(uint8_t datarate, uint8_t size) {
+  uint64_t duration = timeOnAir(datarate, size);
+  board().pulse(RECEIVER, board().config.radioRx, duration);
+  return duration;
+}
+
+uint64_t listen(uint8_t datarate) {
+  uint64_t duration = (uint64_t)(board().config.rxWindowSymbols * symbolTime(datarate));
+  board().pulse(RECEIVER, board().config.radioRx, duration);
+  return duration;
+}
+
+// SX1276 demodulation limits at 125 kHz (DR6 250 kHz): SNR in dB, sensitivity in dBm
+static const double SNR_LIMIT[] = { -20, -17.5, -15, -12.5, -10, -7.5, -7.5 };
+static const double SENSITIVITY[] = { -137, -134.5, -132, -129, -126, -123, -120 };
+
+// a frame is demodulated if its SNR and RSSI are above the limits of its datarate
+static bool linkReaches(uint8_t datarate) {
+  uint8_t limit = datarate < 6 ? datarate : 6;
+  return snr() >= SNR_LIMIT[limit] && rssi() >= SENSITIVITY[limit];
+}
+
+bool uplinkReceived(uint8_t datarate) {
+  board().totals->uplinkDatarates[datarate < SIM_DATARATES ? datarate : SIM_DATARATES - 1]++;
+  bool received = linkReaches(datarate) && board().random() >= board().config.uplinkLoss;
+  if (!received) board().totals->lost++;
+  return received;
+}
+
+bool downlinkReceived(uint8_t datarate) {
+  return linkReaches(datarate) && board().random() >= board().config.downlinkLoss;
+}
+
+// LinkCheckAns: SNR of an uplink above the demodulation limit of its datarate
+uint8_t demodMargin(uint8_t datarate) {
+  double margin = snr() - SNR_LIMIT[datarate < 6 ? datarate : 6];
+  return margin > 0 ? (uint8_t)lround(margin) : 0;
+}
+
+int16_t rssi() {
+  return (int16_t)lround(board().config.linkRssi + 3.0 * board().gaussian());
+}
+
+int8_t snr() {
+  return (int8_t)lround(board().config.linkSnr + 1.5 * board().gaussian());
+}
+
+/* Network ******************************************/
+
+static Network theNetwork;
+
+Network& network() { return theNetwork; }
+
+void Network::queue(uint8_t port, const uint8_t* data, uint8_t size) {
+  Downlink downlink;
+  downlink.port = port;
+  downlink.data.assign(data, data + size);
+  downlinks.push_back(downlink);
+}
+
+Downlink Network::next() {
+  Downlink downlink = downlinks.front();
+  downlinks.pop_front();
+  board().totals->downlinks++;
+  return downlink;
+}
+
+// counts the samples of the batches and the ones replayed from the journal, the statistics intervals and the alerts of the
+// sketch (see MessageCodec.h), the latency of the first alert after a swarm
+void Network::deliver(uint8_t port, const uint8_t* data, uint8_t size) {
+  if (port == 2 && size >= 2 && data[0] == 6) {
+    Totals& totals = *board().totals;
+    totals.alerts++;
+    uint64_t swarm = (uint64_t)(board().config.swarmTime * 3600 * SIM_SEC);
+    if (board().config.swarmTime > 0 && totals.alertLatency == 0 && totals.now >= swarm) {
+      totals.alertLatency = totals.now - swarm;
+    }
+  } else if (size >= 2 && data[0] == 2) {
+    board().totals->batchSamples += data[1] & 0x0F;
+  } else if (size >= 2 && data[0] == 4) {
+    board().totals->backfills++;
+    board().totals->backfillSamples += data[1] & 0x0F;
+  } else if (size >= 2 && data[0] == 5) {
+    board().totals->aggregates++;
+    board().totals->aggregateWindows += data[1] & 0x0F;
+  }
+}
+
+}
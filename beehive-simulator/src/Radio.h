@@ -0,0 +1,63 @@
+/**********************************************************
+ * Simulated LoRa radio and network server (EU868).
+ * ---
+ * Time-on-air according to the Semtech LoRa modem designer
+ * formula (AN1200.13), current draw of TX and RX windows,
+ * frame loss and the downlinks queued by the network server
+ * for the next RX1 window.
+ **********************************************************/
+#ifndef __SIM_RADIO_H__
+#define __SIM_RADIO_H__
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#define LORAWAN_OVERHEAD 13   // MHDR, FHDR without options, FPort, MIC
+#define RECEIVE_DELAY1   (1000*SIM_MS)
+#define RECEIVE_DELAY2   (2000*SIM_MS)
+#define JOIN_ACCEPT_DELAY1 (5000*SIM_MS)
+#define JOIN_ACCEPT_DELAY2 (6000*SIM_MS)
+#define RX2_DATARATE     3    // SF9 as used by TTN
+
+namespace sim {
+
+uint8_t spreadingFactor(uint8_t datarate);
+uint64_t symbolTime(uint8_t datarate);
+uint64_t timeOnAir(uint8_t datarate, uint8_t size);
+uint8_t maxPayload(uint8_t datarate);
+
+// radio activity with current draw and airtime, returns the duration
+uint64_t transmit(uint8_t datarate, uint8_t size);
+uint64_t receive(uint8_t datarate, uint8_t size);
+uint64_t listen(uint8_t datarate);
+
+// frame at datarate received, lost by the link limits (linkSnr, linkRssi) or the loss rates
+bool uplinkReceived(uint8_t datarate);
+bool downlinkReceived(uint8_t datarate);
+uint8_t demodMargin(uint8_t datarate);
+int16_t rssi();
+int8_t snr();
+
+struct Downlink {
+  uint8_t port;
+  std::vector<uint8_t> data;
+};
+
+class Network {
+  public:
+    void queue(uint8_t port, const uint8_t* data, uint8_t size);
+    bool hasDownlink() const { return !downlinks.empty(); }
+    Downlink next();
+    // application payload of a received uplink
+    void deliver(uint8_t port, const uint8_t* data, uint8_t size);
+
+  private:
+    std::deque<Downlink> downlinks;
+};
+
+Network& network();
+
+}
+
+#endif
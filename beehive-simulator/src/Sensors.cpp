@@ -0,0 +1,272 @@
+/**********************************************************
+ * Simulated sensor drivers, see hal/HX711.h, hal/DHT.h and
+ * hal/DallasTemperature.h
+ **********************************************************/
+#include "HX711.h"
+#include "DHT.h"
+#include "DallasTemperature.h"
+#include "Simulation.h"
+
+using sim::board;
+using sim::world;
+
+static uint64_t ms(double value) { return (uint64_t)(value * 1000); }
+
+/* HX711 ******************************************/
+
+void HX711::begin(uint8_t dout, uint8_t /* pd_sck */, uint8_t gain) {
+  this->dout = dout;
+  startConversions();
+  set_gain(gain);
+}
+
+// first conversion after the output settling time
+void HX711::startConversions() {
+  board().cancel(conversion);
+  ready = false;
+  sim::drivePin(dout, HIGH);
+  uint64_t settling = ms(board().config.loadcellSettling);
+  readyAt = board().now() + settling;
+  conversion = board().schedule(settling, [this]() { convert(); }, false);
+}
+
+void HX711::convert() {
+  uint64_t period = (uint64_t)(1e6 / board().config.loadcellRate);
+  ready = true;
+  readyAt = board().now() + period;
+  conversion = board().schedule(period, [this]() { convert(); }, false);
+  sim::drivePin(dout, LOW);
+}
+
+bool HX711::is_ready() {
+  return powered && ready;
+}
+
+void HX711::wait_ready(unsigned long /* delay_ms */) {
+  if (!powered) return; // would block forever
+  while (!ready) board().runUntil(readyAt);
+}
+
+bool HX711::wait_ready_retry(int retries, unsigned long delay_ms) {
+  for (int count = 0; count < retries; count++) {
+    if (is_ready()) return true;
+    delay(delay_ms);
+  }
+  return false;
+}
+
+bool HX711::wait_ready_timeout(unsigned long timeout, unsigned long delay_ms) {
+  unsigned long start = millis();
+  while (millis() - start < timeout) {
+    if (is_ready()) return true;
+    delay(delay_ms > 0 ? delay_ms : 1);
+  }
+  return false;
+}
+
+void HX711::set_gain(uint8_t /* gain */) {
+  read();
+}
+
+long HX711::read() {
+  wait_ready();
+  if (!powered) return 0;
+  board().run(60); // 25 clock pulses
+  board().totals->loadcellSamples++;
+  long value = world().loadcellReading();
+  ready = false;
+  sim::drivePin(dout, HIGH);
+  return value;
+}
+
+long HX711::read_average(uint8_t times) {
+  long sum = 0;
+  for (uint8_t i = 0; i < times; i++) {
+    sum += read();
+  }
+  return sum / times;
+}
+
+double HX711::get_value(uint8_t times) {
+  return read_average(times) - OFFSET;
+}
+
+float HX711::get_units(uint8_t times) {
+  return get_value(times) / SCALE;
+}
+
+void HX711::tare(uint8_t times) {
+  set_offset(read_average(times));
+}
+
+void HX711::power_down() {
+  if (!powered) return;
+  board().run(64);
+  board().consume(sim::LOADCELL, board().config.loadcellSleep - board().config.loadcellActive);
+  board().cancel(conversion);
+  powered = false;
+  ready = false;
+  sim::drivePin(dout, HIGH);
+}
+
+void HX711::power_up() {
+  if (powered) return;
+  board().consume(sim::LOADCELL, board().config.loadcellActive - board().config.loadcellSleep);
+  powered = true;
+  startConversions();
+}
+
+/* DHT ******************************************/
+
+#define DHT_MIN_INTERVAL 2000
+
+void DHT::begin(uint8_t /* usec */) {
+  lastReadTime = millis() - DHT_MIN_INTERVAL;
+}
+
+bool DHT::read(bool force) {
+  unsigned long currentTime = millis();
+  if (!force && (currentTime - lastReadTime) < DHT_MIN_INTERVAL) {
+    return lastResult;
+  }
+  lastReadTime = currentTime;
+  uint64_t duration = ms(board().config.hygrometerRead);
+  board().pulse(sim::HYGROMETER, board().config.hygrometerMeasure, duration);
+  board().run(duration);
+  temperature = roundf(world().roofTemperature() * 10) / 10;
+  humidity = roundf(world().roofHumidity() * 10) / 10;
+  lastResult = true;
+  return lastResult;
+}
+
+float DHT::readTemperature(bool /* S */, bool force) {
+  return read(force) ? temperature : NAN;
+}
+
+float DHT::readHumidity(bool force) {
+  return read(force) ? humidity : NAN;
+}
+
+/* DallasTemperature ******************************************/
+
+void DallasTemperature::begin() {
+  sim::Board& b = board();
+  devices = world().thermometerCount() < MAX_SIM_THERMOMETERS ? world().thermometerCount() : MAX_SIM_THERMOMETERS;
+  if (!initialized) {
+    for (int i = 0; i < MAX_SIM_THERMOMETERS; i++) {
+      resolution[i] = 12;     // factory default
+      scratchpad[i] = 85 * 16; // power-on reset value
+    }
+    initialized = true;
+  }
+  b.run(ms((devices + 1) * b.config.thermometerSearch + devices * b.config.thermometerScratchpad));
+  bitResolution = devices > 0 ? 9 : bitResolution;
+  for (int i = 0; i < devices; i++) {
+    if (resolution[i] > bitResolution) bitResolution = resolution[i];
+  }
+}
+
+bool DallasTemperature::getAddress(uint8_t* address, uint8_t index) {
+  board().run(ms((index + 1) * board().config.thermometerSearch));
+  if (index >= devices) return false;
+  memcpy(address, world().thermometerAddress(index), 8);
+  return true;
+}
+
+int DallasTemperature::deviceIndex(const uint8_t* address) {
+  for (int i = 0; i < devices; i++) {
+    if (memcmp(world().thermometerAddress(i), address, 8) == 0) return i;
+  }
+  return -1;
+}
+
+bool DallasTemperature::isConnected(const uint8_t* address) {
+  board().run(ms(board().config.thermometerScratchpad));
+  return deviceIndex(address) >= 0;
+}
+
+void DallasTemperature::setResolution(uint8_t newResolution) {
+  bitResolution = newResolution < 9 ? 9 : (newResolution > 12 ? 12 : newResolution);
+  DeviceAddress address;
+  for (int i = 0; i < devices; i++) {
+    getAddress(address, i);
+    setResolution(address, bitResolution, true);
+  }
+}
+
+bool DallasTemperature::setResolution(const uint8_t* address, uint8_t newResolution, bool skipGlobalBitResolutionCalculation) {
+  if (!isConnected(address)) return false;
+  int index = deviceIndex(address);
+  if (resolution[index] != newResolution) {
+    board().run(ms(2 * board().config.thermometerScratchpad + 20)); // write, copy to EEPROM
+    resolution[index] = newResolution;
+  }
+  if (!skipGlobalBitResolutionCalculation) {
+    bitResolution = newResolution;
+    for (int i = 0; i < devices; i++) {
+      board().run(ms(board().config.thermometerScratchpad));
+      if (resolution[i] > bitResolution) bitResolution = resolution[i];
+    }
+  }
+  return true;
+}
+
+uint8_t DallasTemperature::getResolution(const uint8_t* address) {
+  if (!isConnected(address)) return 0;
+  return resolution[deviceIndex(address)];
+}
+
+int16_t DallasTemperature::millisToWaitForConversion(uint8_t bits) {
+  double full = board().config.thermometerConversion;
+  switch (bits) {
+    case 9:  return full / 8;
+    case 10: return full / 4;
+    case 11: return full / 2;
+    default: return full;
+  }
+}
+
+void DallasTemperature::startConversion(int first, int last) {
+  sim::Board& b = board();
+  uint64_t duration = ms(millisToWaitForConversion(bitResolution));
+  conversionEnd = b.now() + duration;
+  b.pulse(sim::THERMOMETERS, b.config.thermometerConvert * (last - first), duration);
+  b.schedule(duration, [this, first, last]() {
+    for (int i = first; i < last; i++) {
+      double t = world().temperature(world().thermometerLevel(world().thermometerAddress(i)));
+      t += 0.03 * board().gaussian();
+      int16_t value = (int16_t)lround(t * 16);
+      scratchpad[i] = value & ~((1 << (12 - resolution[i])) - 1);
+    }
+  }, false);
+  if (waitForConversion) {
+    b.runUntil(conversionEnd);
+  }
+}
+
+void DallasTemperature::requestTemperatures() {
+  board().run(2000); // reset, skip ROM, convert
+  startConversion(0, devices);
+}
+
+bool DallasTemperature::requestTemperaturesByAddress(const uint8_t* address) {
+  int index = deviceIndex(address);
+  board().run(ms(board().config.thermometerScratchpad));
+  if (index < 0) return false;
+  startConversion(index, index + 1);
+  return true;
+}
+
+bool DallasTemperature::isConversionComplete() {
+  board().run(70); // one read slot
+  return board().now() >= conversionEnd;
+}
+
+int16_t DallasTemperature::getTemp(const uint8_t* address) {
+  if (!isConnected(address)) return DEVICE_DISCONNECTED_RAW;
+  return scratchpad[deviceIndex(address)] << 3;
+}
+
+float DallasTemperature::getTempC(const uint8_t* address) {
+  return rawToCelsius(getTemp(address));
+}
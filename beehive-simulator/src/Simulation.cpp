@@ -0,0 +1,364 @@
+/**********************************************************
+ * Simulated board, see Simulation.h
+ **********************************************************/
+#include "Simulation.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace sim {
+
+const char* consumerNames[CONSUMER_COUNT] = {"cpu", "loadcell", "thermometers", "hygrometer", "transmitter", "receiver"};
+
+/* Config ******************************************/
+
+typedef struct {
+  const char* name;
+  double Config::*field;
+} ConfigEntry;
+
+#define CONFIG_ENTRY(field) {#field, &Config::field}
+
+static const ConfigEntry configEntries[] = {
+  CONFIG_ENTRY(cpuActive),
+  CONFIG_ENTRY(cpuSleep),
+  CONFIG_ENTRY(loadcellActive),
+  CONFIG_ENTRY(loadcellSleep),
+  CONFIG_ENTRY(loadcellRate),
+  CONFIG_ENTRY(loadcellSettling),
+  CONFIG_ENTRY(thermometerConvert),
+  CONFIG_ENTRY(thermometerIdle),
+  CONFIG_ENTRY(thermometerConversion),
+  CONFIG_ENTRY(thermometerScratchpad),
+  CONFIG_ENTRY(thermometerSearch),
+  CONFIG_ENTRY(hygrometerMeasure),
+  CONFIG_ENTRY(hygrometerIdle),
+  CONFIG_ENTRY(hygrometerRead),
+  CONFIG_ENTRY(radioTx),
+  CONFIG_ENTRY(radioRx),
+  CONFIG_ENTRY(rxWindowSymbols),
+  CONFIG_ENTRY(uplinkLoss),
+  CONFIG_ENTRY(downlinkLoss),
+  CONFIG_ENTRY(joinLoss),
+  CONFIG_ENTRY(linkRssi),
+  CONFIG_ENTRY(linkSnr),
+  CONFIG_ENTRY(serialBaud),
+  CONFIG_ENTRY(serialBuffer),
+  CONFIG_ENTRY(loopCost),
+  CONFIG_ENTRY(flashWrite),
+  CONFIG_ENTRY(watchdogDrift),
+  CONFIG_ENTRY(clockStart),
+  CONFIG_ENTRY(batteryCapacity),
+  CONFIG_ENTRY(batteryVoltage),
+  CONFIG_ENTRY(weight),
+  CONFIG_ENTRY(weightNoise),
+  CONFIG_ENTRY(weightSpikes),
+  CONFIG_ENTRY(weightSpike),
+  CONFIG_ENTRY(swarmTime),
+  CONFIG_ENTRY(swarmWeight),
+  CONFIG_ENTRY(swarmMinutes),
+  CONFIG_ENTRY(ambient),
+  CONFIG_ENTRY(ambientSwing),
+  CONFIG_ENTRY(brood),
+  CONFIG_ENTRY(humidity),
+  CONFIG_ENTRY(seed),
+};
+
+Config Config::forBoard(const std::string& board) {
+  Config config;
+  config.board = board;
+  config.loadcellActive = 1.5;
+  config.loadcellSleep = 0.001;
+  config.loadcellRate = 10;
+  config.loadcellSettling = 400;
+  config.thermometerConvert = 1.5;
+  config.thermometerIdle = 0.001;
+  config.thermometerConversion = 750;
+  config.thermometerScratchpad = 11;
+  config.thermometerSearch = 13.5;
+  config.hygrometerMeasure = 1.5;
+  config.hygrometerIdle = 0.05;
+  config.hygrometerRead = 6;
+  config.rxWindowSymbols = 8;
+  config.uplinkLoss = 0.02;
+  config.downlinkLoss = 0.05;
+  config.joinLoss = 0.0;
+  config.linkRssi = -95;
+  config.linkSnr = 5;
+  config.serialBaud = 115200;
+  config.loopCost = 50;
+  config.flashWrite = 20;
+  config.watchdogDrift = 0.08;
+  config.clockStart = 0;
+  config.batteryVoltage = 3.9;
+  config.weight = 35.0;
+  config.weightNoise = 0.02;
+  config.weightSpikes = 0.01;
+  config.weightSpike = 1.0;
+  config.swarmTime = 0;
+  config.swarmWeight = 2.5;
+  config.swarmMinutes = 5;
+  config.ambient = 12.0;
+  config.ambientSwing = 6.0;
+  config.brood = 34.5;
+  config.humidity = 65.0;
+  config.seed = 1;
+  if (board == "dragino") {
+    // ATmega328P @ 16 MHz with RFM95 (SX1276)
+    config.cpuActive = 15.0;
+    config.cpuSleep = 0.02;
+    config.radioTx = 40.0;
+    config.radioRx = 11.0;
+    config.serialBuffer = 64;
+    config.batteryCapacity = 2000;
+  } else {
+    // CubeCell ASR6501 (ARM M0+ @ 48 MHz with SX1262)
+    config.cpuActive = 10.0;
+    config.cpuSleep = 0.0035;
+    config.radioTx = 45.0;
+    config.radioRx = 6.0;
+    config.serialBuffer = 256;
+    config.batteryCapacity = 230;
+  }
+  return config;
+}
+
+bool Config::set(const std::string& assignment) {
+  size_t separator = assignment.find('=');
+  if (separator == std::string::npos) return false;
+  std::string name = assignment.substr(0, separator);
+  const char* value = assignment.c_str() + separator + 1;
+  char* end;
+  double number = strtod(value, &end);
+  if (end == value || *end != '\0') return false;
+  for (size_t i = 0; i < sizeof(configEntries) / sizeof(configEntries[0]); i++) {
+    if (name == configEntries[i].name) {
+      this->*configEntries[i].field = number;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Config::list(FILE* out) const {
+  for (size_t i = 0; i < sizeof(configEntries) / sizeof(configEntries[0]); i++) {
+    fprintf(out, "  %s=%g\n", configEntries[i].name, this->*configEntries[i].field);
+  }
+}
+
+/* Board ******************************************/
+
+static Board* installedBoard = 0;
+
+Board& board() { return *installedBoard; }
+void install(Board* board) { installedBoard = board; }
+
+void Board::boot() {
+  events.clear();
+  for (int i = 0; i < CONSUMER_COUNT; i++) draw[i] = 0.0;
+  draw[LOADCELL] = config.loadcellActive; // HX711 is powered while PD_SCK is low
+  draw[THERMOMETERS] = config.thermometerIdle * world().thermometerCount();
+  draw[HYGROMETER] = config.hygrometerIdle;
+  awakeSinceBoot = 0;
+  bootTime = totals->now;
+  asleep = false;
+  totals->boots++;
+}
+
+void Board::reset() {
+  fflush(stdout);
+  _exit(RESET_EXIT);
+}
+
+void Board::run(uint64_t us) {
+  runUntil(now() + us);
+}
+
+void Board::runUntil(uint64_t time) {
+  bool wasAsleep = asleep;
+  asleep = false;
+  advance(time);
+  asleep = wasAsleep;
+}
+
+// watchdog sleep, ends early on a pin interrupt
+void Board::sleep(uint64_t us) {
+  hibernate(now() + us, false);
+}
+
+// deep sleep until a timer/radio event or a pin interrupt
+bool Board::sleepUntilEvent() {
+  return hibernate(now() + SIM_DAY, true);
+}
+
+bool Board::hibernate(uint64_t time, bool wakeOnEvents) {
+  asleep = true;
+  woken = false;
+  while (!woken && !events.empty() && events.front().time <= time) {
+    Event event = events.front();
+    events.erase(events.begin());
+    integrate(event.time);
+    asleep = false; // interrupt handlers run with the MCU awake
+    event.action();
+    asleep = true;
+    if (wakeOnEvents && event.interrupt) woken = true;
+  }
+  if (!woken && !wakeOnEvents) integrate(time);
+  asleep = false;
+  return woken;
+}
+
+unsigned Board::schedule(uint64_t delay, Action action, bool interrupt) {
+  Event event = {now() + delay, nextId++, interrupt, action};
+  std::vector<Event>::iterator position = events.begin();
+  while (position != events.end() && position->time <= event.time) position++;
+  events.insert(position, event);
+  return event.id;
+}
+
+void Board::cancel(unsigned id) {
+  for (std::vector<Event>::iterator event = events.begin(); event != events.end(); event++) {
+    if (event->id == id) {
+      events.erase(event);
+      return;
+    }
+  }
+}
+
+void Board::consume(Consumer consumer, double mA) {
+  draw[consumer] += mA;
+}
+
+void Board::pulse(Consumer consumer, double mA, uint64_t us) {
+  consume(consumer, mA);
+  schedule(us, [this, consumer, mA]() { consume(consumer, -mA); }, false);
+}
+
+double Board::random() {
+  uint64_t x = totals->random;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  totals->random = x;
+  return ((x * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double Board::gaussian() {
+  double u = random();
+  double v = random();
+  if (u < 1e-12) u = 1e-12;
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+void Board::advance(uint64_t time) {
+  while (!events.empty() && events.front().time <= time) {
+    Event event = events.front();
+    events.erase(events.begin());
+    integrate(event.time);
+    bool wasAsleep = asleep;
+    asleep = false; // interrupt handlers run with the MCU awake
+    event.action();
+    asleep = wasAsleep;
+  }
+  integrate(time);
+}
+
+void Board::integrate(uint64_t time) {
+  if (time <= totals->now) return;
+  uint64_t dt = time - totals->now;
+  for (int i = 0; i < CONSUMER_COUNT; i++) {
+    totals->charge[i] += draw[i] * dt;
+  }
+  if (asleep) {
+    totals->charge[CPU] += config.cpuSleep * dt;
+    totals->asleep += dt;
+  } else {
+    totals->charge[CPU] += config.cpuActive * dt;
+    totals->awake += dt;
+    awakeSinceBoot += dt;
+  }
+  totals->now = time;
+}
+
+/* World ******************************************/
+
+static World theWorld;
+
+World& world() { return theWorld; }
+
+void World::attachLoadcell(long offset, double divider, double temperatureFactor, double temperatureOffset) {
+  loadcellOffset = offset;
+  loadcellDivider = divider;
+  compensationFactor = temperatureFactor;
+  compensationOffset = temperatureOffset;
+}
+
+void World::attachThermometer(const uint8_t* address, int level) {
+  Thermometer thermometer;
+  memcpy(thermometer.address, address, 8);
+  thermometer.level = level;
+  thermometers.push_back(thermometer);
+}
+
+int World::thermometerLevel(const uint8_t* address) const {
+  for (size_t i = 0; i < thermometers.size(); i++) {
+    if (memcmp(thermometers[i].address, address, 8) == 0) return thermometers[i].level;
+  }
+  return -1;
+}
+
+double World::dayPhase() const {
+  return fmod((double)board().now() / SIM_DAY, 1.0);
+}
+
+// coldest at 03:00, warmest at 15:00
+double World::ambient() const {
+  const Config& config = board().config;
+  return config.ambient + config.ambientSwing * sin(2.0 * M_PI * (dayPhase() - 0.375));
+}
+
+// level 0 is outside, levels 1.. are drop hole and comb heights
+double World::temperature(int level) const {
+  static const double broodShare[] = {0.0, 0.3, 0.8, 0.95, 0.85};
+  double share = broodShare[std::min(level, 4)];
+  return ambient() + share * (board().config.brood - ambient());
+}
+
+double World::roofTemperature() const {
+  return ambient() + 3.0;
+}
+
+double World::roofHumidity() const {
+  return board().config.humidity - 15.0 * sin(2.0 * M_PI * (dayPhase() - 0.375));
+}
+
+// foragers leave in the morning and bring nectar in the evening, a swarm leaves within minutes
+double World::weight() const {
+  const Config& config = board().config;
+  double days = (double)board().now() / SIM_DAY;
+  double swarm = 0;
+  if (config.swarmTime > 0) {
+    double minutes = ((double)board().now() / SIM_SEC - config.swarmTime * 3600) / 60;
+    swarm = config.swarmWeight * std::max(0.0, std::min(1.0, minutes / std::max(config.swarmMinutes, 1.0)));
+  }
+  return config.weight + 0.05 * days + 0.2 * sin(2.0 * M_PI * (dayPhase() - 0.25)) - swarm;
+}
+
+// raw HX711 counts incl. the temperature drift of the load cell and disturbances
+long World::loadcellReading() const {
+  double drift = compensationFactor * ambient() + compensationOffset;
+  double noise = board().config.weightNoise * board().gaussian();
+  if (board().random() < board().config.weightSpikes) {
+    noise += board().config.weightSpike * (0.5 + board().random()) * (board().random() < 0.5 ? -1 : 1);
+  }
+  return loadcellOffset + (long)(loadcellDivider * (weight() + drift + noise));
+}
+
+double World::battery() const {
+  return board().config.batteryVoltage;
+}
+
+}
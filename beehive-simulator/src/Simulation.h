@@ -0,0 +1,242 @@
+/**********************************************************
+ * Simulated board for the host build of the sensor script.
+ * ---
+ * Keeps a virtual clock and the charge drawn by every
+ * consumer on the board (MCU, sensors, radio). Simulated
+ * drivers advance the clock for their latencies and switch
+ * their current draw on and off. Pending events (timers,
+ * radio windows) fire like interrupts while the clock moves,
+ * devices driving an input pin raise the attached pin
+ * interrupts which also wake the MCU from sleep.
+ * Time is kept in microseconds since simulation start, the
+ * Arduino millis() only counts awake time since boot.
+ **********************************************************/
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define SIM_MS  1000ULL
+#define SIM_SEC (1000ULL*SIM_MS)
+#define SIM_DAY (86400ULL*SIM_SEC)
+
+#define SIM_FLASH_SIZE (128*1024)   // ASR6501 flash
+#define SIM_FLASH_ROW  256
+#define SIM_EEPROM_SIZE 1024        // ATmega328P EEPROM
+#define SIM_DATARATES   7           // EU868 DR0..DR6
+#define SIM_MAX_STATES 8            // states of the sketch reported
+
+namespace sim {
+
+typedef enum { CPU, LOADCELL, THERMOMETERS, HYGROMETER, TRANSMITTER, RECEIVER, CONSUMER_COUNT } Consumer;
+extern const char* consumerNames[CONSUMER_COUNT];
+
+/*
+ * Currents in mA, latencies in ms unless noted otherwise.
+ * Every value can be overridden by name, see Config::set().
+ */
+struct Config {
+  std::string board;
+  double cpuActive;           // MCU running
+  double cpuSleep;            // MCU deep sleep incl. board quiescent current
+  double loadcellActive;      // HX711 powered up
+  double loadcellSleep;       // HX711 powered down
+  double loadcellRate;        // HX711 samples per second (RATE pin)
+  double loadcellSettling;    // HX711 output settling time after power up
+  double thermometerConvert;  // per DS18B20 during conversion
+  double thermometerIdle;     // per DS18B20 standby
+  double thermometerConversion; // DS18B20 conversion time at 12 bit
+  double thermometerScratchpad; // 1-wire reset, select and scratchpad read/write
+  double thermometerSearch;   // 1-wire search for one ROM address
+  double hygrometerMeasure;   // DHT22 during measurement
+  double hygrometerIdle;      // DHT22 standby
+  double hygrometerRead;      // DHT22 start signal and 40 bit transfer
+  double radioTx;             // radio transmitting
+  double radioRx;             // radio receiving in RX window
+  double rxWindowSymbols;     // preamble symbols scanned in an empty RX window
+  double uplinkLoss;          // probability an uplink is not received
+  double downlinkLoss;        // probability a downlink/ack is not received
+  double joinLoss;            // probability a join request fails
+  double linkRssi;            // dBm mean downlink RSSI
+  double linkSnr;             // dB mean downlink SNR
+  double serialBaud;
+  double serialBuffer;        // bytes buffered by the UART before print() blocks
+  double loopCost;            // us per loop() iteration
+  double flashWrite;          // erase and program of one flash row
+  double watchdogDrift;       // relative error of the AVR watchdog period (128 kHz oscillator)
+  double clockStart;          // ms of millis() and the RTC at boot, eg. just before their 32 bit wraparound
+  double batteryCapacity;     // mAh, for the projected runtime
+  double batteryVoltage;      // V
+  double weight;              // kg hive weight
+  double weightNoise;         // kg per HX711 sample
+  double weightSpikes;        // probability of a disturbance per HX711 sample (bee landing, wind)
+  double weightSpike;         // kg mean size of a disturbance
+  double swarmTime;           // hours after the start a swarm leaves the hive, 0 without
+  double swarmWeight;         // kg of bees leaving with the swarm
+  double swarmMinutes;        // duration of the departure
+  double ambient;             // C daily mean outside temperature
+  double ambientSwing;        // C daily amplitude
+  double brood;               // C brood nest temperature
+  double humidity;            // % rel mean humidity under the roof
+  double seed;
+
+  static Config forBoard(const std::string& board);
+  bool set(const std::string& assignment);
+  void list(FILE* out) const;
+};
+
+/*
+ * Accumulated over all boots of the simulated device.
+ */
+struct Totals {
+  uint64_t now;                 // us since simulation start
+  uint64_t awake;               // us with MCU active
+  uint64_t asleep;              // us with MCU in low power
+  double   charge[CONSUMER_COUNT]; // mA*us
+  uint64_t airtime;             // us on air
+  uint32_t uplinks;
+  uint32_t retransmissions;
+  uint32_t joins;
+  uint32_t boots;
+  uint32_t resets;
+  uint32_t cycles;
+  uint32_t rejected;            // uplinks dropped by the network, reused frame counter
+  uint32_t downlinks;           // application downlinks delivered by the network
+  uint32_t lost;                // uplink trials not received, link limits or uplinkLoss
+  uint32_t uplinkDatarates[SIM_DATARATES]; // uplink trials per datarate
+  uint32_t linkChecks;          // uplinks with LinkCheckReq (CubeCell) or ADRACKReq (LMIC)
+  uint32_t linkChecksAnswered;
+  uint32_t batchSamples;        // samples of the batches (message v2) received by the network
+  uint32_t backfills;            // journal replay frames (message 4) received by the network
+  uint32_t backfillSamples;
+  uint32_t aggregates;           // statistics frames (message 5) received by the network
+  uint32_t aggregateWindows;     // intervals of the statistics frames
+  uint32_t alerts;              // alert frames (message 6, port 2) received by the network
+  uint64_t alertLatency;        // us from the start of the swarm to the first alert after it, 0 without
+  uint32_t budgetHour;          // max ms on air in an hour, accounted by the sketch
+  uint32_t budgetDay;           // max ms on air in a day, accounted by the sketch
+  uint32_t deferred;            // frames deferred by the airtime budget of the sketch
+  uint32_t loadcellSamples;     // HX711 readings
+  int64_t  clockError;          // ms the clock of the sketch is ahead of the time since the last boot
+  uint32_t stateCount;          // states of the sketch, counters of the last boot
+  uint64_t stateTime[SIM_MAX_STATES];
+  uint32_t stateEntries[SIM_MAX_STATES];
+  uint32_t stateTimeouts[SIM_MAX_STATES];
+  uint32_t stateMaxDuration[SIM_MAX_STATES];
+  uint64_t random;
+  // network server session, kept over device resets
+  uint32_t serverDevAddr;
+  uint32_t serverFCntUp;        // next frame counter accepted
+  // device flash, kept over device resets
+  uint8_t  flash[SIM_FLASH_SIZE];
+  uint32_t flashErases[SIM_FLASH_SIZE / SIM_FLASH_ROW];
+  uint8_t  eeprom[SIM_EEPROM_SIZE];
+  uint32_t eepromWrites;        // bytes written
+};
+
+class Board {
+  public:
+    typedef std::function<void()> Action;
+
+    Board(const Config& config, Totals* totals) : config(config), totals(totals) {}
+
+    void boot();
+    [[noreturn]] void reset();
+
+    uint64_t now() const { return totals->now; }
+    uint64_t uptime() const { return awakeSinceBoot; }
+    uint64_t sinceBoot() const { return totals->now - bootTime; }
+    bool isAsleep() const { return asleep; }
+
+    void run(uint64_t us);
+    void runUntil(uint64_t time);
+    void sleep(uint64_t us);
+    bool sleepUntilEvent();
+    void wakeup() { woken = true; }
+
+    unsigned schedule(uint64_t delay, Action action, bool interrupt = true);
+    void cancel(unsigned id);
+
+    void consume(Consumer consumer, double mA);
+    void pulse(Consumer consumer, double mA, uint64_t us);
+    void transmitted(uint64_t us) { totals->airtime += us; }
+
+    double random();
+    double gaussian();
+
+    const Config& config;
+    Totals* totals;
+    bool verbose = false;
+
+    static const int RESET_EXIT = 3;
+
+  private:
+    struct Event {
+      uint64_t time;
+      unsigned id;
+      bool interrupt;   // wakes the MCU from sleep
+      Action action;
+    };
+    std::vector<Event> events;
+    unsigned nextId = 1;
+    double draw[CONSUMER_COUNT];
+    uint64_t awakeSinceBoot = 0;
+    uint64_t bootTime = 0;
+    bool asleep = false;
+    bool woken = false;
+
+    void advance(uint64_t time);
+    bool hibernate(uint64_t time, bool wakeOnEvents);
+    void integrate(uint64_t time);
+};
+
+Board& board();
+void install(Board* board);
+
+// a device drives an input pin of the MCU, see Arduino.cpp
+void drivePin(uint8_t pin, uint8_t level);
+
+/*
+ * Physical environment of the hive, evaluated at the current
+ * simulation time. The firmware glue attaches the load cell
+ * calibration and the thermometer addresses of the device.
+ */
+class World {
+  public:
+    void attachLoadcell(long offset, double divider, double temperatureFactor, double temperatureOffset);
+    void attachThermometer(const uint8_t* address, int level);
+    int thermometerLevel(const uint8_t* address) const;
+    int thermometerCount() const { return (int)thermometers.size(); }
+    const uint8_t* thermometerAddress(int index) const { return thermometers[index].address; }
+
+    double ambient() const;
+    double temperature(int level) const;
+    double roofTemperature() const;
+    double roofHumidity() const;
+    double weight() const;
+    long loadcellReading() const;
+    double battery() const;
+
+  private:
+    struct Thermometer {
+      uint8_t address[8];
+      int level;
+    };
+    std::vector<Thermometer> thermometers;
+    long loadcellOffset = 0;
+    double loadcellDivider = 1.0;
+    double compensationFactor = 0.0;
+    double compensationOffset = 0.0;
+
+    double dayPhase() const;
+};
+
+World& world();
+
+}
+
+#endif
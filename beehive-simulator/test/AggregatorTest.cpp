@@ -0,0 +1,93 @@
+/**********************************************************
+ * Tests of the running statistics of the measures.
+ * ---
+ * Feeds Aggregator.h of the sketch with measures and checks
+ * minimum, maximum, mean and standard deviation against
+ * the two pass results, undefined values and the reset;
+ * exits non-zero on the first failed check.
+ **********************************************************/
+#include "Aggregator.h"
+#include "Check.h"
+
+#include <math.h>
+
+#define FIELDS 3
+
+static void testEmpty() {
+  Aggregator<FIELDS> aggregator;
+  CHECK(aggregator.count() == 0);
+  for (int i = 0; i < FIELDS; i++) {
+    CHECK(aggregator.minimum(i) == UNDEFINED_VALUE && aggregator.maximum(i) == UNDEFINED_VALUE);
+    CHECK(aggregator.mean(i) == UNDEFINED_VALUE && aggregator.deviation(i) == UNDEFINED_VALUE);
+  }
+}
+
+static void testStatistics() {
+  Aggregator<FIELDS> aggregator;
+  // weight dip of a swarm, a constant and negative temperatures
+  const int16_t weights[] = { 4210, 4212, 4209, 3850, 3861, 3858 };
+  const int16_t temperatures[] = { -120, -80, -95, -101, -77, -130 };
+  for (int s = 0; s < 6; s++) {
+    int16_t values[FIELDS] = { weights[s], 412, temperatures[s] };
+    aggregator.add(values);
+  }
+  CHECK(aggregator.count() == 6);
+  CHECK(aggregator.minimum(0) == 3850 && aggregator.maximum(0) == 4212);
+  CHECK(aggregator.minimum(2) == -130 && aggregator.maximum(2) == -77);
+  CHECK(aggregator.mean(1) == 412 && aggregator.deviation(1) == 0);
+
+  const int16_t* series[] = { weights, 0, temperatures };
+  for (int i = 0; i < FIELDS; i += 2) {
+    double sum = 0, squares = 0;
+    for (int s = 0; s < 6; s++) sum += series[i][s];
+    double mean = sum / 6;
+    for (int s = 0; s < 6; s++) squares += (series[i][s] - mean) * (series[i][s] - mean);
+    CHECK(abs(aggregator.mean(i) - (int)lround(mean)) <= 1);
+    CHECK(abs(aggregator.deviation(i) - (int)lround(sqrt(squares / 6))) <= 1);
+  }
+}
+
+static void testUndefinedValues() {
+  Aggregator<FIELDS> aggregator;
+  int16_t first[FIELDS] = { 100, UNDEFINED_VALUE, UNDEFINED_VALUE };
+  int16_t second[FIELDS] = { 300, UNDEFINED_VALUE, 7 };
+  aggregator.add(first);
+  aggregator.add(second);
+  CHECK(aggregator.count() == 2);
+  CHECK(aggregator.mean(0) == 200 && aggregator.deviation(0) == 100);
+  CHECK(aggregator.minimum(1) == UNDEFINED_VALUE && aggregator.deviation(1) == UNDEFINED_VALUE);
+  CHECK(aggregator.minimum(2) == 7 && aggregator.mean(2) == 7 && aggregator.deviation(2) == 0);
+}
+
+static void testExtremes() {
+  Aggregator<FIELDS> aggregator;
+  for (int s = 0; s < 1000; s++) {
+    int16_t values[FIELDS] = { (int16_t)(s % 2 ? 32767 : -32767), (int16_t)(s % 3), 0 };
+    aggregator.add(values);
+  }
+  CHECK(aggregator.minimum(0) == -32767 && aggregator.maximum(0) == 32767);
+  CHECK(abs(aggregator.mean(0)) <= 1);
+  CHECK(abs(aggregator.deviation(0) - 32767) <= 1);
+  CHECK(aggregator.mean(1) == 1 && aggregator.deviation(1) == 1);  // 0.816
+}
+
+static void testReset() {
+  Aggregator<FIELDS> aggregator;
+  int16_t values[FIELDS] = { 5, 6, 7 };
+  aggregator.add(values);
+  aggregator.reset();
+  CHECK(aggregator.count() == 0 && aggregator.minimum(0) == UNDEFINED_VALUE);
+  int16_t next[FIELDS] = { -5, 6, 7 };
+  aggregator.add(next);
+  CHECK(aggregator.count() == 1 && aggregator.minimum(0) == -5 && aggregator.maximum(0) == -5 && aggregator.mean(0) == -5);
+}
+
+int main() {
+  testEmpty();
+  testStatistics();
+  testUndefinedValues();
+  testExtremes();
+  testReset();
+  printf("Aggregator tests passed\n");
+  return 0;
+}
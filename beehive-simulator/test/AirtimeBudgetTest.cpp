@@ -0,0 +1,90 @@
+/**********************************************************
+ * Tests of the airtime accounting.
+ * ---
+ * Checks AirtimeBudget.h of the sketch against known
+ * time-on-air values and the rolling hour and day budgets
+ * on a virtual clock; exits non-zero on the first failed
+ * check.
+ **********************************************************/
+#include "AirtimeBudget.h"
+#include "Check.h"
+
+#define MIN_MS  60000ULL
+#define HOUR_MS (60 * MIN_MS)
+
+static uint64_t clockMs = 0;
+
+static uint64_t virtualTime() {
+  return clockMs;
+}
+
+static void testTimeOnAir() {
+  // Semtech LoRa calculator, explicit header, CRC, CR 4/5
+  CHECK(AirtimeBudget::timeOnAir(7, 125, 1, 20) == 56576);
+  CHECK(AirtimeBudget::timeOnAir(7, 125, 1, 64) == 118016);
+  CHECK(AirtimeBudget::timeOnAir(12, 125, 1, 64) == 2793472);
+  // 51 bytes application payload, 13 bytes LoRaWAN overhead
+  CHECK(AirtimeBudget::frameTime(5, 51) == 118016);
+  CHECK(AirtimeBudget::frameTime(0, 51) == 2793472);
+  CHECK(AirtimeBudget::frameTime(6, 51) < AirtimeBudget::frameTime(5, 51));
+  // DR2, DR2, DR1, DR1, DR0
+  uint32_t trials = AirtimeBudget::trialsTime(2, 10, 5);
+  CHECK(trials == 2 * AirtimeBudget::frameTime(2, 10) + 2 * AirtimeBudget::frameTime(1, 10) + AirtimeBudget::frameTime(0, 10));
+}
+
+static void testRollingWindows() {
+  AirtimeBudget budget;
+  clockMs = 0;
+  budget.begin(virtualTime);
+  budget.add(1000000);
+  clockMs = 30 * MIN_MS;
+  budget.add(2000000);
+  CHECK(budget.lastHour() == 3000);
+  CHECK(budget.lastDay() == 3000);
+  // the first slot leaves the hour window
+  clockMs = 65 * MIN_MS;
+  CHECK(budget.lastHour() == 2000);
+  CHECK(budget.lastDay() == 3000);
+  clockMs = 2 * HOUR_MS;
+  CHECK(budget.lastHour() == 0);
+  // the first hour leaves the day window
+  clockMs = 24 * HOUR_MS + 10 * MIN_MS;
+  CHECK(budget.lastDay() == 0);
+  CHECK(budget.total() == 3000);
+  // long sleep clears all buckets
+  budget.add(500000);
+  clockMs = 30 * 24 * HOUR_MS;
+  CHECK(budget.lastHour() == 0 && budget.lastDay() == 0);
+  CHECK(budget.total() == 3500);
+}
+
+static void testBudgetDecisions() {
+  AirtimeBudget budget;
+  clockMs = 0;
+  budget.begin(virtualTime);
+  // 22 s of the 30 s day budget
+  for (int i = 0; i < 22; i++) {
+    clockMs += HOUR_MS;
+    budget.add(1000000);
+  }
+  CHECK(budget.allows(2000000, FRAME_PRIORITY_LOW));
+  // low priority keeps the reserve of 6 s
+  CHECK(!budget.allows(3000000, FRAME_PRIORITY_LOW));
+  CHECK(budget.allows(3000000, FRAME_PRIORITY_NORMAL));
+  CHECK(!budget.allows(9000000, FRAME_PRIORITY_NORMAL));
+  // the retransmissions at SF12 do not fit, the first trials do
+  uint8_t trials = budget.affordableTrials(2, 51, 8, FRAME_PRIORITY_LOW);
+  CHECK(trials > 0 && trials < 8);
+  CHECK(AirtimeBudget::trialsTime(2, 51, trials) <= 2000000);
+  // the oldest hours leave the window
+  clockMs += 20 * HOUR_MS;
+  CHECK(budget.affordableTrials(2, 51, 8, FRAME_PRIORITY_LOW) == 8);
+}
+
+int main() {
+  testTimeOnAir();
+  testRollingWindows();
+  testBudgetDecisions();
+  printf("AirtimeBudget tests passed\n");
+  return 0;
+}
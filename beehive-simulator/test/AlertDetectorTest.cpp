@@ -0,0 +1,115 @@
+/**********************************************************
+ * Tests of the detector of sudden changes.
+ * ---
+ * Feeds AlertDetector.h of the sketch with measures of a
+ * swarm, a beekeeper at the hive, a slow drift and a cold
+ * brood nest and checks arming, the alert flags and values
+ * and the disarming; exits non-zero on the first failed
+ * check.
+ **********************************************************/
+#include "AlertDetector.h"
+#include "Check.h"
+
+// battery, weight, humidity, roof, outer, drop, lower, middle, upper
+#define FIELDS 9
+
+static const AlertLimits LIMITS = { 30, 150, 100, 250 };
+
+static void measure(int16_t* values, int16_t weight, int16_t brood) {
+  const int16_t sample[FIELDS] = { 390, weight, 6500, 1500, 1200, 2400, brood, (int16_t)(brood + 20), (int16_t)(brood - 10) };
+  for (int i = 0; i < FIELDS; i++) values[i] = sample[i];
+}
+
+static uint8_t update(AlertDetector<FIELDS>& detector, int16_t weight, int16_t brood) {
+  int16_t values[FIELDS];
+  measure(values, weight, brood);
+  return detector.update(values);
+}
+
+static void testSwarm() {
+  AlertDetector<FIELDS> detector(LIMITS);
+  CHECK(update(detector, 4200, 3450) == 0 && !detector.isArmed());
+  CHECK(update(detector, 4205, 3450) == 0 && !detector.isArmed());
+  // the swarm leaves within minutes
+  CHECK(update(detector, 4100, 3450) == 0 && detector.isArmed());
+  CHECK(update(detector, 3900, 3450) == 0 && detector.isArmed());
+  CHECK(update(detector, 3800, 3450) == ALERT_WEIGHT);
+  CHECK(!detector.isArmed());
+  CHECK(detector.alertBefore()[ALERT_WEIGHT_FIELD] == 4205 && detector.alertAfter()[ALERT_WEIGHT_FIELD] == 3800);
+  // once: the new level is the baseline
+  CHECK(update(detector, 3795, 3450) == 0 && !detector.isArmed());
+}
+
+static void testBeekeeper() {
+  AlertDetector<FIELDS> detector(LIMITS);
+  update(detector, 4200, 3450);
+  // a frame lifted out and put back: a single measure beyond the alert step
+  CHECK(update(detector, 3900, 3450) == 0 && detector.isArmed());
+  CHECK(update(detector, 4198, 3450) == 0 && detector.isArmed());
+  for (int i = 0; i < ALERT_CALM_MEASURES - 2; i++) {
+    CHECK(update(detector, 4200, 3450) == 0 && detector.isArmed());
+  }
+  CHECK(update(detector, 4200, 3450) == 0 && !detector.isArmed());
+}
+
+static void testDrift() {
+  AlertDetector<FIELDS> detector(LIMITS);
+  update(detector, 4200, 3450);
+  // nectar flow: the baseline follows changes below the arm limit
+  for (int i = 1; i <= 100; i++) {
+    CHECK(update(detector, 4200 + 20 * i, 3450) == 0 && !detector.isArmed());
+  }
+  // a change beyond the arm limit that neither settles nor reaches the alert step disarms in time
+  update(detector, 6240, 3450);
+  CHECK(detector.isArmed());
+  for (int i = 1; i < ALERT_ARMED_MEASURES; i++) {
+    CHECK(update(detector, 6240 + (i % 2) * 100, 3450) == 0);
+  }
+  CHECK(!detector.isArmed());
+}
+
+static void testBroodTemperature() {
+  AlertDetector<FIELDS> detector(LIMITS);
+  update(detector, 4200, 3450);
+  CHECK(update(detector, 4200, 3300) == 0 && detector.isArmed());
+  CHECK(update(detector, 4200, 3150) == 0);
+  CHECK(update(detector, 4200, 3100) == ALERT_TEMPERATURE);
+  CHECK(detector.alertBroodField() == 6);
+  CHECK(detector.alertBefore()[6] == 3450 && detector.alertAfter()[6] == 3100);
+}
+
+static void testTheft() {
+  AlertDetector<FIELDS> detector(LIMITS);
+  update(detector, 4200, 3450);
+  // lifted off the scale and cooling down
+  update(detector, 0, 3150);
+  CHECK(update(detector, 0, 3000) == (ALERT_WEIGHT | ALERT_TEMPERATURE));
+}
+
+static void testUndefinedValues() {
+  AlertDetector<FIELDS> detector(LIMITS);
+  update(detector, UNDEFINED_VALUE, 3450);
+  // a load cell reading again after a failure does not arm
+  CHECK(update(detector, 4200, 3450) == 0 && !detector.isArmed());
+  CHECK(update(detector, UNDEFINED_VALUE, 3450) == 0 && !detector.isArmed());
+
+  // without brood nest thermometer
+  AlertDetector<5> single(LIMITS);
+  int16_t values[5] = { 390, 4200, 6500, 1500, 1200 };
+  single.update(values);
+  values[1] = 1000;
+  single.update(values);
+  CHECK(single.update(values) == ALERT_WEIGHT);
+  CHECK(single.alertBroodField() == UNDEFINED_VALUE);
+}
+
+int main() {
+  testSwarm();
+  testBeekeeper();
+  testDrift();
+  testBroodTemperature();
+  testTheft();
+  testUndefinedValues();
+  printf("AlertDetector tests passed\n");
+  return 0;
+}
@@ -0,0 +1,20 @@
+/**********************************************************
+ * Check of the host tests.
+ * ---
+ * CHECK(condition) prints the failed condition with its file
+ * and line and exits non-zero, the test stops at the first
+ * failed check.
+ **********************************************************/
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK(condition) \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    exit(1); \
+  }
+
+#endif
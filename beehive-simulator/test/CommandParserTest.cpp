@@ -0,0 +1,144 @@
+/**********************************************************
+ * Tests of the downlink commands.
+ * ---
+ * Parses downlinks with CommandParser.h of the sketch and
+ * checks the changed settings, the rejected downlinks
+ * (version, unknown command, truncated, out of range) and
+ * that a rejected downlink leaves the settings unchanged;
+ * exits non-zero on the first failed check.
+ **********************************************************/
+#include "CommandParser.h"
+#include "Check.h"
+
+#include <string.h>
+
+static const Settings DEFAULTS = {2, 30, 30, 720, 10, 50, 200, SETTINGS_DATARATE_DEFAULT};
+
+static uint8_t parse(const uint8_t* buffer, uint8_t size, Settings* settings) {
+  return CommandParser::parse(buffer, size, DEFAULTS, settings);
+}
+
+static bool equals(const Settings& a, const Settings& b) {
+  return memcmp(&a, &b, sizeof(Settings)) == 0;
+}
+
+static void testDefaultsValid() {
+  CHECK(CommandParser::isValid(DEFAULTS));
+}
+
+static void testMeasureInterval() {
+  Settings settings = DEFAULTS;
+  const uint8_t fixed[] = {COMMAND_VERSION, COMMAND_MEASURE_INTERVAL, 0x00, 0x3C, 0x00, 0x3C};
+  CHECK(parse(fixed, sizeof(fixed), &settings) == COMMAND_OK);
+  CHECK(settings.minInterval == 60 && settings.maxInterval == 60);
+  CHECK(settings.unconditionalInterval == DEFAULTS.unconditionalInterval);
+
+  const uint8_t inverted[] = {COMMAND_VERSION, COMMAND_MEASURE_INTERVAL, 0x00, 0x3C, 0x00, 0x0A};
+  CHECK(parse(inverted, sizeof(inverted), &settings) == COMMAND_OUT_OF_RANGE);
+  const uint8_t tooLong[] = {COMMAND_VERSION, COMMAND_MEASURE_INTERVAL, 0x00, 0x0A, 0x02, 0xD1};
+  CHECK(parse(tooLong, sizeof(tooLong), &settings) == COMMAND_OUT_OF_RANGE);
+  const uint8_t zero[] = {COMMAND_VERSION, COMMAND_MEASURE_INTERVAL, 0x00, 0x00, 0x00, 0x0A};
+  CHECK(parse(zero, sizeof(zero), &settings) == COMMAND_OUT_OF_RANGE);
+  CHECK(settings.minInterval == 60 && settings.maxInterval == 60);
+}
+
+// several commands of one downlink, big endian values
+static void testMultipleCommands() {
+  Settings settings = DEFAULTS;
+  const uint8_t downlink[] = {COMMAND_VERSION,
+                              COMMAND_LIMIT_WEIGHT, 0x00, 0x14,
+                              COMMAND_LIMIT_TEMPERATURE, 0x01, 0x2C,
+                              COMMAND_LIMIT_HUMIDITY, 0x03, 0xE8,
+                              COMMAND_UNCONDITIONAL_INTERVAL, 0x00, 0x78,
+                              COMMAND_CONFIRMATION_INTERVAL, 0x00, 0x00,
+                              COMMAND_DATARATE, 0x05};
+  CHECK(parse(downlink, sizeof(downlink), &settings) == COMMAND_OK);
+  CHECK(settings.limitWeight == 20);
+  CHECK(settings.limitTemperature == 300);
+  CHECK(settings.limitHumidity == 1000);
+  CHECK(settings.unconditionalInterval == 120);
+  CHECK(settings.confirmationInterval == 0);
+  CHECK(settings.datarate == 5);
+  CHECK(settings.minInterval == DEFAULTS.minInterval);
+}
+
+static void testDefaults() {
+  Settings settings = DEFAULTS;
+  const uint8_t change[] = {COMMAND_VERSION, COMMAND_LIMIT_WEIGHT, 0x00, 0x14, COMMAND_DATARATE, 0x03};
+  CHECK(parse(change, sizeof(change), &settings) == COMMAND_OK);
+  const uint8_t defaults[] = {COMMAND_VERSION, COMMAND_DEFAULTS};
+  CHECK(parse(defaults, sizeof(defaults), &settings) == COMMAND_OK);
+  CHECK(equals(settings, DEFAULTS));
+
+  // commands after the defaults apply on top of them
+  const uint8_t defaultsAndLimit[] = {COMMAND_VERSION, COMMAND_DEFAULTS, COMMAND_LIMIT_HUMIDITY, 0x00, 0x64};
+  CHECK(parse(defaultsAndLimit, sizeof(defaultsAndLimit), &settings) == COMMAND_OK);
+  CHECK(settings.limitHumidity == 100);
+  CHECK(settings.limitWeight == DEFAULTS.limitWeight);
+}
+
+static void testRejected() {
+  Settings settings = DEFAULTS;
+  const uint8_t empty[] = {0};
+  CHECK(parse(empty, 0, &settings) == COMMAND_BAD_VERSION);
+  const uint8_t version[] = {COMMAND_VERSION + 1, COMMAND_LIMIT_WEIGHT, 0x00, 0x14};
+  CHECK(parse(version, sizeof(version), &settings) == COMMAND_BAD_VERSION);
+  const uint8_t unknown[] = {COMMAND_VERSION, 0x42, 0x00, 0x14};
+  CHECK(parse(unknown, sizeof(unknown), &settings) == COMMAND_UNKNOWN);
+  const uint8_t truncated[] = {COMMAND_VERSION, COMMAND_MEASURE_INTERVAL, 0x00, 0x0A, 0x00};
+  CHECK(parse(truncated, sizeof(truncated), &settings) == COMMAND_TRUNCATED);
+  const uint8_t datarate[] = {COMMAND_VERSION, COMMAND_DATARATE, 0x06};
+  CHECK(parse(datarate, sizeof(datarate), &settings) == COMMAND_OUT_OF_RANGE);
+  const uint8_t limit[] = {COMMAND_VERSION, COMMAND_LIMIT_TEMPERATURE, 0x80, 0x00};
+  CHECK(parse(limit, sizeof(limit), &settings) == COMMAND_OUT_OF_RANGE);
+  CHECK(equals(settings, DEFAULTS));
+
+  // a version without commands is a valid no-op
+  const uint8_t nothing[] = {COMMAND_VERSION};
+  CHECK(parse(nothing, sizeof(nothing), &settings) == COMMAND_OK);
+  CHECK(equals(settings, DEFAULTS));
+}
+
+// the unconditional interval covers at least half the max measure interval
+static void testUnconditionalInterval() {
+  Settings settings = DEFAULTS;
+  const uint8_t longer[] = {COMMAND_VERSION, COMMAND_MEASURE_INTERVAL, 0x00, 0x0A, 0x00, 0x3D};
+  CHECK(parse(longer, sizeof(longer), &settings) == COMMAND_OUT_OF_RANGE);
+  const uint8_t shorter[] = {COMMAND_VERSION, COMMAND_UNCONDITIONAL_INTERVAL, 0x00, 0x0E};
+  CHECK(parse(shorter, sizeof(shorter), &settings) == COMMAND_OUT_OF_RANGE);
+  const uint8_t zero[] = {COMMAND_VERSION, COMMAND_UNCONDITIONAL_INTERVAL, 0x00, 0x00};
+  CHECK(parse(zero, sizeof(zero), &settings) == COMMAND_OUT_OF_RANGE);
+  CHECK(equals(settings, DEFAULTS));
+
+  const uint8_t both[] = {COMMAND_VERSION, COMMAND_UNCONDITIONAL_INTERVAL, 0x01, 0x68,
+                          COMMAND_MEASURE_INTERVAL, 0x00, 0x0A, 0x02, 0xD0};
+  CHECK(parse(both, sizeof(both), &settings) == COMMAND_OK);
+  CHECK(settings.unconditionalInterval == 360 && settings.maxInterval == 720);
+
+  Settings stored = DEFAULTS;
+  stored.maxInterval = 61;
+  CHECK(!CommandParser::isValid(stored));
+}
+
+// a downlink with a bad command does not apply the valid ones before it
+static void testAtomic() {
+  Settings settings = DEFAULTS;
+  const uint8_t downlink[] = {COMMAND_VERSION, COMMAND_LIMIT_WEIGHT, 0x00, 0x14, COMMAND_DATARATE, 0x09};
+  CHECK(parse(downlink, sizeof(downlink), &settings) == COMMAND_OUT_OF_RANGE);
+  CHECK(equals(settings, DEFAULTS));
+  const uint8_t tail[] = {COMMAND_VERSION, COMMAND_LIMIT_WEIGHT, 0x00, 0x14, COMMAND_LIMIT_HUMIDITY, 0x00};
+  CHECK(parse(tail, sizeof(tail), &settings) == COMMAND_TRUNCATED);
+  CHECK(equals(settings, DEFAULTS));
+}
+
+int main() {
+  testDefaultsValid();
+  testMeasureInterval();
+  testMultipleCommands();
+  testDefaults();
+  testRejected();
+  testUnconditionalInterval();
+  testAtomic();
+  printf("CommandParser tests passed\n");
+  return 0;
+}
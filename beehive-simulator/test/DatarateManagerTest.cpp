@@ -0,0 +1,112 @@
+/**********************************************************
+ * Tests of the datarate selection.
+ * ---
+ * Feeds DatarateManager.h of the sketch with downlink and
+ * LinkCheckAns reports of strong and weak links and checks
+ * the selected datarate, the margin kept and the fall back
+ * on missing acks and missing reports; exits non-zero on
+ * the first failed check.
+ **********************************************************/
+#include "DatarateManager.h"
+#include "Check.h"
+
+#define DR_DEFAULT 2
+
+static void testStrongLink() {
+  DatarateManager manager;
+  manager.begin(DR_DEFAULT);
+  CHECK(manager.datarate() == DR_DEFAULT);
+  manager.addDownlink(-95, 5);
+  CHECK(manager.datarate() == DR_DEFAULT);  // a single report does not count
+  manager.addDownlink(-97, 4);
+  CHECK(manager.datarate() == DATARATE_MAX);
+  CHECK(manager.margin() == 24);
+}
+
+// the weaker of SNR and RSSI limits the datarate
+static void testWeakLink() {
+  DatarateManager manager;
+  manager.begin(DR_DEFAULT);
+  manager.addDownlink(-90, -12);  // 8 dB above the SF12 limit
+  manager.addDownlink(-90, -12);
+  CHECK(manager.datarate() == DATARATE_MIN);
+
+  manager.begin(DR_DEFAULT);
+  manager.addDownlink(-125, 10);  // 12 dB above the SF12 sensitivity
+  manager.addDownlink(-125, 10);
+  CHECK(manager.datarate() == 2);  // 6 dB margin, 2.5 dB per step
+}
+
+// the margin of a link check is relative to the datarate of the uplink
+static void testLinkCheck() {
+  DatarateManager manager;
+  manager.begin(DR_DEFAULT);
+  manager.addLinkCheck(10, 2);  // 15 dB at DR0
+  manager.addLinkCheck(10, 2);
+  CHECK(manager.margin() == 15);
+  CHECK(manager.datarate() == 3);
+  manager.addLinkCheck(0, 3);  // 7 dB at DR0, average 11 dB
+  manager.addLinkCheck(0, 3);
+  CHECK(manager.datarate() == 2);
+}
+
+// the datarate follows the average of the last reports
+static void testHistory() {
+  DatarateManager manager;
+  manager.begin(DR_DEFAULT);
+  for (int i = 0; i < DATARATE_HISTORY; i++) manager.addDownlink(-80, 5);
+  CHECK(manager.datarate() == DATARATE_MAX);
+  manager.addDownlink(-80, -18);  // one fading report
+  CHECK(manager.datarate() == DATARATE_MAX);
+  for (int i = 0; i < DATARATE_HISTORY; i++) manager.addDownlink(-80, -10);
+  CHECK(manager.datarate() == 1);
+}
+
+static void testMissingAcks() {
+  DatarateManager manager;
+  manager.begin(DR_DEFAULT);
+  manager.addDownlink(-80, 5);
+  manager.addDownlink(-80, 5);
+  CHECK(manager.datarate() == DATARATE_MAX);
+  manager.addConfirmation(false);
+  manager.addConfirmation(true);
+  manager.addConfirmation(false);
+  CHECK(manager.datarate() == DATARATE_MAX);  // not in a row
+  manager.addConfirmation(false);
+  CHECK(manager.datarate() == DATARATE_MAX - 1);
+  CHECK(manager.margin() == 0);  // history starts over
+
+  // a report raises it again after the minimum reports only
+  manager.addDownlink(-80, 5);
+  CHECK(manager.datarate() == DATARATE_MAX - 1);
+  manager.addDownlink(-80, 5);
+  CHECK(manager.datarate() == DATARATE_MAX);
+
+  for (int i = 0; i < 20 * DATARATE_FAILURES; i++) manager.addConfirmation(false);
+  CHECK(manager.datarate() == DATARATE_MIN);
+}
+
+static void testStaleReports() {
+  DatarateManager manager;
+  manager.begin(DR_DEFAULT);
+  manager.addDownlink(-80, 5);
+  manager.addDownlink(-80, 5);
+  for (int i = 0; i < DATARATE_STALE_UPLINKS - 1; i++) manager.addUplink();
+  CHECK(manager.datarate() == DATARATE_MAX);
+  manager.addDownlink(-80, 5);  // a report restarts the count
+  for (int i = 0; i < DATARATE_STALE_UPLINKS - 1; i++) manager.addUplink();
+  CHECK(manager.datarate() == DATARATE_MAX);
+  manager.addUplink();
+  CHECK(manager.datarate() == DATARATE_MAX - 1);
+}
+
+int main() {
+  testStrongLink();
+  testWeakLink();
+  testLinkCheck();
+  testHistory();
+  testMissingAcks();
+  testStaleReports();
+  printf("DatarateManager tests passed\n");
+  return 0;
+}
@@ -0,0 +1,169 @@
+/**********************************************************
+ * Tests of the integer sensor conversion.
+ * ---
+ * Compares FixedPoint.h of the sketch with the float path
+ * it replaces (reading in float, asShort() truncating
+ * value * 100) over the sensor ranges and random load cell
+ * readings, checks the piecewise linear drift model and the
+ * thermal lag filter; exits non-zero on the first failed
+ * check.
+ **********************************************************/
+#include "FixedPoint.h"
+#include "Check.h"
+
+#include <math.h>
+
+#define DISCONNECTED_C -127.0f
+
+// float path of the sketch before the integer conversion
+static int16_t asShort(float value) {
+  if (isnan(value) || value == DISCONNECTED_C) return UNDEFINED_VALUE;
+  return value * 100;
+}
+
+static float rawToCelsius(int16_t raw) {
+  return raw <= FIXED_DISCONNECTED_RAW ? DISCONNECTED_C : raw * 0.0078125f;
+}
+
+static float floatWeight(int32_t sum, uint8_t samples, int16_t outerRaw, int32_t offset, float divider, float factor, float constant) {
+  float weight = ((float)sum / samples - offset) / divider;
+  float outer = rawToCelsius(outerRaw);
+  if (outer == DISCONNECTED_C) return weight;
+  return weight - (factor * outer) - constant;
+}
+
+static void testTemperatureBitExact() {
+  // 12 bit resolution, -55..125 C in 1/16 C
+  for (int32_t raw = FIXED_DISCONNECTED_RAW; raw <= 125 * 128; raw += 8) {
+    CHECK(FixedPoint::temperature(raw) == asShort(rawToCelsius(raw)));
+  }
+  CHECK(FixedPoint::temperature(FIXED_DISCONNECTED_RAW) == UNDEFINED_VALUE);
+  CHECK(FixedPoint::temperature(-5) == asShort(rawToCelsius(-5)));
+}
+
+static void testVoltage() {
+  for (int32_t mv = 2000; mv <= 5500; mv++) {
+    int16_t fixed = FixedPoint::voltage(mv);
+    CHECK(fixed == mv / 10);
+    int16_t reference = asShort(mv / 1000.0);
+    CHECK(fixed - reference >= 0 && fixed - reference <= 1);
+  }
+}
+
+static void testTenths() {
+  for (int tenths = -400; tenths <= 1000; tenths++) {
+    float value = tenths * 0.1f;  // DHT library
+    int16_t fixed = FixedPoint::tenths(value);
+    CHECK(fixed == tenths * 10);
+    int16_t reference = asShort(value);
+    CHECK(abs(fixed - reference) <= 1);
+  }
+  CHECK(FixedPoint::tenths(NAN) == UNDEFINED_VALUE);
+}
+
+static void testWeightWithinTolerance() {
+  // calibrations of calibration.h
+  const struct { int32_t offset; int32_t divider; float factor; float constant; } devices[] = {
+    { 481976, 10458, -9.6755E-02f, +9.3877E-01f },
+    {  17838, 10263, -0.1432f,     +3.4714f },
+    { -43496, 25365, -7.1332E-03f, -1.6111E+00f }
+  };
+  srand(7);
+  int exact = 0, total = 0;
+  for (size_t d = 0; d < sizeof(devices) / sizeof(devices[0]); d++) {
+    WeightCalibration calibration = {
+      devices[d].offset, devices[d].divider,
+      FIXED_COMPENSATION_FACTOR(devices[d].factor), FIXED_COMPENSATION_OFFSET(devices[d].constant), 0, 0
+    };
+    for (int i = 0; i < 20000; i++) {
+      uint8_t samples = 1 + rand() % 10;
+      int32_t kg10 = rand() % 1600 - 100;  // -10..150 kg
+      int32_t reading = devices[d].offset + kg10 * devices[d].divider / 10 + rand() % 2000 - 1000;
+      int32_t sum = reading * samples + rand() % samples;
+      int16_t outer = i % 50 == 0 ? FIXED_DISCONNECTED_RAW : (rand() % (60 * 16) - 20 * 16) * 8;  // -20..40 C
+      int16_t fixed = FixedPoint::weight(sum, samples, outer, calibration);
+      int16_t reference = asShort(floatWeight(sum, samples, outer, devices[d].offset, devices[d].divider, devices[d].factor, devices[d].constant));
+      if (abs(fixed - reference) > 1) {
+        fprintf(stderr, "sum %d samples %u outer %d: fixed %d float %d\n", sum, samples, outer, fixed, reference);
+      }
+      CHECK(abs(fixed - reference) <= 1);
+      exact += fixed == reference;
+      total++;
+    }
+  }
+  printf("weight: %d of %d bit-exact\n", exact, total);
+  CHECK(exact * 10 > total * 9);
+  WeightCalibration calibration = { 0, 1000, 0, 0, 0, 0 };
+  CHECK(FixedPoint::weight(0, 0, 0, calibration) == UNDEFINED_VALUE);
+  CHECK(FixedPoint::weight(-12345, 1, FIXED_DISCONNECTED_RAW, calibration) == -1234);
+  // uncalibrated load cell (divider 0)
+  WeightCalibration uncalibrated = { 0, 0, 0, 0, 0, 0 };
+  CHECK(FixedPoint::weight(-12345, 1, FIXED_DISCONNECTED_RAW, uncalibrated) == UNDEFINED_VALUE);
+}
+
+static void testPiecewiseDrift() {
+  const CompensationPoint points[] PROGMEM = {
+    FIXED_COMPENSATION_POINT(-10.0, +1.0),
+    FIXED_COMPENSATION_POINT(0.0, 0.0),
+    FIXED_COMPENSATION_POINT(20.0, -0.5),
+    FIXED_COMPENSATION_POINT(30.0, -2.5)
+  };
+  WeightCalibration calibration = { 0, 1000, 0, 0, points, 4 };
+  // at the points, 1/16 of 1/100 kg
+  CHECK(FixedPoint::drift(-10 * 128, calibration) == 1600);
+  CHECK(FixedPoint::drift(0, calibration) == 0);
+  CHECK(FixedPoint::drift(30 * 128, calibration) == -4000);
+  // interpolated and extrapolated by the outer segments
+  CHECK(FixedPoint::drift(10 * 128, calibration) == -400);
+  CHECK(FixedPoint::drift(25 * 128, calibration) == -2400);
+  CHECK(FixedPoint::drift(-20 * 128, calibration) == 3200);
+  CHECK(FixedPoint::drift(40 * 128, calibration) == -7200);
+  // 20 kg at 25 C minus the drift of -2.0 kg
+  CHECK(FixedPoint::weight(20000, 1, 25 * 128, calibration) == 2150);
+  CHECK(FixedPoint::weight(20000, 1, FIXED_DISCONNECTED_RAW, calibration) == 2000);
+
+  // two points on the trendline match the linear model
+  const float factor = -0.1432f, constant = 3.4714f;
+  const CompensationPoint line[] PROGMEM = {
+    FIXED_COMPENSATION_POINT(-20.0, factor * -20.0 + constant),
+    FIXED_COMPENSATION_POINT(40.0, factor * 40.0 + constant)
+  };
+  WeightCalibration linear = { 17838, 10263, FIXED_COMPENSATION_FACTOR(factor), FIXED_COMPENSATION_OFFSET(constant), 0, 0 };
+  WeightCalibration piecewise = linear;
+  piecewise.points = line;
+  piecewise.pointCount = 2;
+  for (int16_t raw = -20 * 128; raw <= 40 * 128; raw += 8) {
+    int32_t sum = 17838 + 35 * 10263;
+    CHECK(abs(FixedPoint::weight(sum, 1, raw, piecewise) - FixedPoint::weight(sum, 1, raw, linear)) <= 1);
+  }
+}
+
+static void testThermalLag() {
+  const uint32_t lagMs = 60 * 60000UL;
+  int32_t filtered = FixedPoint::lag(0, false, FIXED_DISCONNECTED_RAW, 0, lagMs);
+  CHECK(filtered == 0);
+  filtered = FixedPoint::lag(filtered, false, 10 * 128, 0, lagMs);
+  CHECK(FixedPoint::lagged(filtered) == 10 * 128);
+  // a step of 10 C reaches 1 - 1/e after one time constant in small steps
+  for (int minute = 0; minute < 60; minute++) {
+    filtered = FixedPoint::lag(filtered, true, 20 * 128, 60000UL, lagMs);
+  }
+  float reached = (FixedPoint::lagged(filtered) - 10 * 128) / (10 * 128.0f);
+  CHECK(reached > 0.62f && reached < 0.64f);
+  // disconnected readings keep the filter, long pauses follow the reading
+  CHECK(FixedPoint::lag(filtered, true, FIXED_DISCONNECTED_RAW, 60000UL, lagMs) == filtered);
+  filtered = FixedPoint::lag(filtered, true, 20 * 128, 0xFFFFFFFFUL, lagMs);
+  CHECK(abs(FixedPoint::lagged(filtered) - 20 * 128) <= 2);
+  CHECK(FixedPoint::lagged(FixedPoint::lag(filtered, true, -5 * 128, 60000UL, 0)) == -5 * 128);
+}
+
+int main() {
+  testTemperatureBitExact();
+  testVoltage();
+  testTenths();
+  testWeightWithinTolerance();
+  testPiecewiseDrift();
+  testThermalLag();
+  printf("FixedPoint tests passed\n");
+  return 0;
+}
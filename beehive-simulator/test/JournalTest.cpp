@@ -0,0 +1,169 @@
+/**********************************************************
+ * Tests of the sample journal.
+ * ---
+ * Runs Journal.h of the sketch on a RAM storage: appends,
+ * reads, the recovery of the newest record after a reset,
+ * the overwrite of the oldest records, corrupt records and
+ * the wrap around of the sequence; exits non-zero on the
+ * first failed check.
+ **********************************************************/
+#include "Journal.h"
+#include "Check.h"
+
+#include <string.h>
+
+#define FIELDS 3
+#define SLOTS  8
+#define RECORD JOURNAL_RECORD_SIZE(FIELDS)
+
+// the slots of all journals, kept over a "reset" as flash or EEPROM
+static uint8_t memory[SLOTS * RECORD];
+
+class RamStorage {
+  public:
+    void read(uint16_t slot, uint8_t* data, uint8_t size) {
+      memcpy(data, memory + slot * RECORD, size);
+    }
+
+    void write(uint16_t slot, const uint8_t* data, uint8_t size) {
+      memcpy(memory + slot * RECORD, data, size);
+    }
+};
+
+typedef Journal<RamStorage, SLOTS, FIELDS> TestJournal;
+
+static void erase() {
+  memset(memory, 0xFF, sizeof(memory));
+}
+
+static uint16_t append(TestJournal& journal, int16_t value, uint32_t minutes) {
+  int16_t values[FIELDS] = { value, (int16_t)-value, 2500 };
+  return journal.append(values, minutes);
+}
+
+static void checkRecord(TestJournal& journal, uint16_t sequence, int16_t value, uint32_t minutes) {
+  TestJournal::Record record;
+  CHECK(journal.read(sequence, &record));
+  CHECK(record.sequence == sequence && record.minutes == minutes);
+  CHECK(record.values[0] == value && record.values[1] == -value && record.values[2] == 2500);
+}
+
+static void testEmpty() {
+  erase();
+  TestJournal journal;
+  CHECK(!journal.begin());
+  CHECK(journal.count() == 0 && journal.minutesAtBegin() == 0);
+  CHECK(journal.oldest() == 0 && journal.last() == 0xFFFF);
+  CHECK(journal.acknowledged() == 0xFFFF);
+  TestJournal::Record record;
+  CHECK(!journal.read(0, &record));
+}
+
+static void testAppendRead() {
+  erase();
+  TestJournal journal;
+  journal.begin();
+  CHECK(append(journal, 100, 5) == 0);
+  CHECK(append(journal, 101, 10) == 1);
+  CHECK(append(journal, -102, 15) == 2);
+  CHECK(journal.count() == 3 && journal.oldest() == 0 && journal.last() == 2);
+  checkRecord(journal, 0, 100, 5);
+  checkRecord(journal, 2, -102, 15);
+  TestJournal::Record record;
+  CHECK(!journal.read(3, &record));
+}
+
+static void testBeginAfterReset() {
+  erase();
+  {
+    TestJournal journal;
+    journal.begin();
+    for (int i = 0; i < 5; i++) append(journal, i, 30 * i);
+    journal.acknowledge(2);
+    append(journal, 5, 150);   // writes the acknowledged sequence
+    journal.acknowledge(4);    // lost by the reset
+  }
+  TestJournal journal;
+  CHECK(journal.begin());
+  CHECK(journal.count() == 6 && journal.oldest() == 0 && journal.last() == 5);
+  CHECK(journal.acknowledged() == 2);
+  CHECK(journal.minutesAtBegin() == 150);
+  checkRecord(journal, 1, 1, 30);
+  CHECK(append(journal, 6, 151) == 6);
+  checkRecord(journal, 6, 6, 151);
+}
+
+static void testOverwrite() {
+  erase();
+  TestJournal journal;
+  journal.begin();
+  for (int i = 0; i < 20; i++) append(journal, i, i);
+  CHECK(journal.count() == SLOTS && journal.oldest() == 20 - SLOTS && journal.last() == 19);
+  // the overwritten samples are not acknowledged, they are lost
+  CHECK(journal.acknowledged() == journal.oldest() - 1);
+  TestJournal::Record record;
+  CHECK(!journal.read(20 - SLOTS - 1, &record));
+  checkRecord(journal, 20 - SLOTS, 20 - SLOTS, 20 - SLOTS);
+
+  TestJournal restarted;
+  CHECK(restarted.begin());
+  CHECK(restarted.count() == SLOTS && restarted.last() == 19);
+  CHECK(restarted.acknowledged() == restarted.oldest() - 1);
+
+  // not beyond the newest sample or backwards
+  journal.acknowledge(25);
+  CHECK(journal.acknowledged() == journal.oldest() - 1);
+  journal.acknowledge(15);
+  CHECK(journal.acknowledged() == 15);
+  journal.acknowledge(14);
+  CHECK(journal.acknowledged() == 15);
+}
+
+static void testCorruptRecord() {
+  erase();
+  {
+    TestJournal journal;
+    journal.begin();
+    for (int i = 0; i < 6; i++) append(journal, i, i);
+  }
+  // a torn write of the newest record, a flipped bit in an older one
+  memory[5 * RECORD + 3] ^= 0x10;
+  memory[1 * RECORD + RECORD - 4] ^= 0x01;
+  TestJournal journal;
+  CHECK(journal.begin());
+  CHECK(journal.last() == 4);
+  CHECK(journal.count() == 3 && journal.oldest() == 2);
+  checkRecord(journal, 4, 4, 4);
+  CHECK(append(journal, 5, 6) == 5);
+  checkRecord(journal, 5, 5, 6);
+}
+
+static void testSequenceWrap() {
+  CHECK(isSequenceBefore(0xFFFF, 0));
+  CHECK(!isSequenceBefore(0, 0xFFFF));
+  CHECK(!isSequenceBefore(7, 7));
+
+  erase();
+  {
+    TestJournal journal;
+    journal.begin();
+    for (uint32_t i = 0; i < 0x10003; i++) append(journal, i & 0x7FFF, i);
+  }
+  TestJournal journal;
+  CHECK(journal.begin());
+  CHECK(journal.last() == 2 && journal.oldest() == (uint16_t)(3 - SLOTS));
+  CHECK(journal.count() == SLOTS);
+  checkRecord(journal, 0xFFFF, 0x7FFF, 0xFFFF);
+  checkRecord(journal, 1, 1, 0x10001);
+}
+
+int main() {
+  testEmpty();
+  testAppendRead();
+  testBeginAfterReset();
+  testOverwrite();
+  testCorruptRecord();
+  testSequenceWrap();
+  printf("Journal tests passed\n");
+  return 0;
+}
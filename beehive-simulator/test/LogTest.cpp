@@ -0,0 +1,71 @@
+/**********************************************************
+ * Tests of the deferred log.
+ * ---
+ * Writes records into the ring of Log.h, checks the order
+ * and the overwritten records, and the hex line format read
+ * by log-decoder; exits non-zero on the first failed check.
+ **********************************************************/
+#include "Arduino.h"
+#include "Simulation.h"
+
+#define LOG_LEVEL     LOG_LEVEL_INFO
+#define LOG_DEFERRED  1
+#define LOG_RING_SIZE 4
+#include "Log.h"
+#include "Check.h"
+
+static uint64_t clockMs = 0;
+
+static uint64_t virtualTime() {
+  return clockMs;
+}
+
+static void testLevels() {
+  LOG_INFO(LOG_WEIGHT, 0, 3500);
+  LOG_DEBUG(LOG_THERMOMETER, 1, 2062);  // compiled out
+  CHECK(Log::count() == 1 && Log::record(0).event == LOG_WEIGHT);
+}
+
+static void testRingOverwritesOldest() {
+  for (int i = 1; i < 6; i++) {
+    clockMs = i * 1000;
+    LOG_INFO(LOG_THERMOMETER, i, -i);
+  }
+  CHECK(Log::count() == LOG_RING_SIZE);
+  CHECK(Log::lost() == 1);
+  CHECK(Log::record(0).index == 2 && Log::record(0).time == 2000);
+  CHECK(Log::record(3).index == 5 && Log::record(3).value == -5);
+  Log::drain();
+  CHECK(Log::count() == 0 && Log::lost() == 0);
+}
+
+static void testLineRoundTrip() {
+  LogRecord record = { 0x89ABCDEF, LOG_MAC_STATUS, LOG_MLME_CONFIRM, -32768 };
+  char line[2 * LOG_RECORD_SIZE + 1];
+  Log::format(record, line);
+  CHECK(strcmp(line, "89ABCDEF05018000") == 0);
+  LogRecord parsed;
+  CHECK(Log::parse(line, &parsed));
+  CHECK(parsed.time == record.time && parsed.event == record.event && parsed.index == record.index && parsed.value == record.value);
+  CHECK(Log::parse("89abcdef05018000", &parsed) && parsed.time == 0x89ABCDEF);
+  CHECK(!Log::parse("89ABCDEF0501800", &parsed));
+  CHECK(!Log::parse("89ABCDEF0501800G", &parsed));
+  CHECK(strcmp(Log::event(LOG_WEIGHT).unit, "kg") == 0);
+  CHECK(strcmp(Log::event(200).name, "unknown") == 0);
+}
+
+int main() {
+  sim::Config config = sim::Config::forBoard("dragino");
+  static sim::Totals totals;
+  sim::Board board(config, &totals);
+  sim::install(&board);
+  board.boot();
+  Log::begin(virtualTime);
+
+  testLevels();
+  Log::drain();
+  testRingOverwritesOldest();
+  testLineRoundTrip();
+  printf("Log tests passed\n");
+  return 0;
+}
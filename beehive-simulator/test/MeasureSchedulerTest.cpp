@@ -0,0 +1,100 @@
+/**********************************************************
+ * Tests of the adaptive measure interval.
+ * ---
+ * Feeds MeasureScheduler.h of the sketch with synthetic
+ * measures and checks the chosen intervals; exits non-zero
+ * on the first failed check.
+ **********************************************************/
+#include "MeasureScheduler.h"
+#include "Check.h"
+
+#include <string.h>
+
+#define FIELDS 5
+#define MIN_MS  60000UL
+#define HOUR_MS (60 * MIN_MS)
+
+// battery, weight, humidity, roof temperature, one thermometer
+static const int16_t LIMITS[FIELDS] = { 0, 10, 200, 50, 50 };
+static const int16_t SAMPLE[FIELDS] = { 390, 3500, 6500, 1500, 3400 };
+static const ScheduleBounds BOUNDS = { 2 * MIN_MS, 30 * MIN_MS, 370, 350 };
+
+// measures every interval until time, value of field changes by step per hour
+static uint64_t run(MeasureScheduler<FIELDS>& scheduler, int16_t* values, uint8_t field, double step, uint64_t time, uint64_t until) {
+  double start = values[field];
+  uint64_t from = time;
+  while (time < until) {
+    values[field] = (int16_t)(start + step * (time - from) / HOUR_MS);
+    time += scheduler.update(values, time);
+  }
+  return time;
+}
+
+static void testQuietUsesMaxInterval() {
+  MeasureScheduler<FIELDS> scheduler(LIMITS, BOUNDS, 5 * MIN_MS);
+  int16_t values[FIELDS];
+  memcpy(values, SAMPLE, sizeof(values));
+  CHECK(scheduler.update(values, 0) == 5 * MIN_MS);
+  values[1] += 1; // below the noise of 1/8 limit
+  CHECK(scheduler.update(values, 5 * MIN_MS) == 30 * MIN_MS);
+  CHECK(scheduler.reason() == SCHEDULE_QUIET);
+  // the battery does not count as change
+  values[0] -= 20;
+  CHECK(scheduler.update(values, 35 * MIN_MS) == 30 * MIN_MS);
+}
+
+static void testFastChangeShortensInterval() {
+  MeasureScheduler<FIELDS> scheduler(LIMITS, BOUNDS, 5 * MIN_MS);
+  int16_t values[FIELDS];
+  memcpy(values, SAMPLE, sizeof(values));
+  // roof temperature rises 2 limits per hour: half a limit every 15 min
+  uint64_t time = run(scheduler, values, 3, 100, 0, 4 * HOUR_MS);
+  CHECK(scheduler.reason() == SCHEDULE_ACTIVE);
+  CHECK(scheduler.interval() >= 13 * MIN_MS && scheduler.interval() <= 17 * MIN_MS);
+  // a step of 3 limits is followed immediately, about 12 limits per hour
+  values[1] += 30;
+  unsigned long interval = scheduler.update(values, time);
+  CHECK(interval >= 2 * MIN_MS && interval <= 3 * MIN_MS);
+  CHECK(scheduler.reason() == SCHEDULE_ACTIVE);
+}
+
+static void testDailyProfileWakesEarly() {
+  MeasureScheduler<FIELDS> scheduler(LIMITS, BOUNDS, 5 * MIN_MS);
+  int16_t values[FIELDS];
+  memcpy(values, SAMPLE, sizeof(values));
+  // quiet day, active hour 8..9 (weight 4 limits per hour)
+  uint64_t time = run(scheduler, values, 1, 0, 0, 8 * HOUR_MS);
+  time = run(scheduler, values, 1, 40, time, 9 * HOUR_MS);
+  time = run(scheduler, values, 1, 0, time, 31 * HOUR_MS);
+  CHECK(scheduler.interval() == 30 * MIN_MS);
+  // next day the last measure before 08:00 expects the activity
+  time = run(scheduler, values, 1, 0, time, 32 * HOUR_MS);
+  CHECK(scheduler.reason() == SCHEDULE_DAILY);
+  CHECK(scheduler.interval() < 30 * MIN_MS);
+}
+
+static void testLowBatteryStretchesInterval() {
+  MeasureScheduler<FIELDS> scheduler(LIMITS, BOUNDS, 5 * MIN_MS);
+  int16_t values[FIELDS];
+  memcpy(values, SAMPLE, sizeof(values));
+  uint64_t time = run(scheduler, values, 3, 100, 0, 2 * HOUR_MS);
+  unsigned long active = scheduler.interval();
+  values[0] = 360;
+  values[3] += 25;
+  unsigned long saving = scheduler.update(values, time);
+  CHECK(saving > 1.8 * active && saving < 2.2 * active);
+  CHECK(scheduler.reason() == SCHEDULE_BATTERY);
+  values[0] = 340;
+  values[3] += 25;
+  CHECK(scheduler.update(values, time + saving) == 30 * MIN_MS);
+  CHECK(scheduler.reason() == SCHEDULE_BATTERY);
+}
+
+int main() {
+  testQuietUsesMaxInterval();
+  testFastChangeShortensInterval();
+  testDailyProfileWakesEarly();
+  testLowBatteryStretchesInterval();
+  printf("MeasureScheduler tests passed\n");
+  return 0;
+}
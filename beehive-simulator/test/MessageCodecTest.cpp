@@ -0,0 +1,441 @@
+/**********************************************************
+ * Round trip tests of the sensor message v1/v2, of the
+ * backfill and of the statistics message codec.
+ * ---
+ * Encodes sensor values with MessageCodec.h of the sketch
+ * and checks that decoding restores them; exits non-zero
+ * on the first failed check.
+ **********************************************************/
+#include "MessageCodec.h"
+#include "SampleBuffer.h"
+#include "Check.h"
+
+#include <string.h>
+
+#define FIELDS 9
+
+static const int16_t SAMPLE[FIELDS] = { 412, 4321, 5630, 2215, 3012, 3177, 2988, 3044, 3101 };
+
+static void checkValues(const int16_t* expected, const int16_t* actual, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    CHECK(expected[i] == actual[i]);
+  }
+}
+
+static void testAbsoluteRoundTrip() {
+  uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+  uint8_t length = MessageCodec::encodeAbsolute(SAMPLE, FIELDS, 5, buffer, sizeof(buffer));
+  CHECK(length > 0 && length < 2 + 2 * FIELDS);
+  CHECK(buffer[0] == MESSAGE_V1);
+
+  int16_t values[MESSAGE_V1_MAX_FIELDS];
+  uint8_t count, id;
+  bool delta;
+  CHECK(MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+  CHECK(count == FIELDS && id == 5 && !delta);
+  checkValues(SAMPLE, values, FIELDS);
+}
+
+static void testUndefinedValuesOmitted() {
+  int16_t sample[FIELDS];
+  memcpy(sample, SAMPLE, sizeof(sample));
+  uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+  uint8_t complete = MessageCodec::encodeAbsolute(sample, FIELDS, 0, buffer, sizeof(buffer));
+  sample[1] = UNDEFINED_VALUE;
+  sample[6] = UNDEFINED_VALUE;
+  uint8_t length = MessageCodec::encodeAbsolute(sample, FIELDS, 0, buffer, sizeof(buffer));
+  CHECK(length > 0 && length < complete);
+
+  int16_t values[MESSAGE_V1_MAX_FIELDS];
+  uint8_t count, id;
+  bool delta;
+  CHECK(MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+  checkValues(sample, values, FIELDS);
+}
+
+static void testDeltaRoundTrip() {
+  int16_t sample[FIELDS];
+  for (int i = 0; i < FIELDS; i++) sample[i] = SAMPLE[i] + (i % 3) - 1;
+  sample[3] = UNDEFINED_VALUE;
+  uint8_t absolute[MESSAGE_V1_MAX_SIZE];
+  uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+  uint8_t absoluteLength = MessageCodec::encodeAbsolute(sample, FIELDS, 3, absolute, sizeof(absolute));
+  uint8_t length = MessageCodec::encodeDelta(sample, SAMPLE, FIELDS, 3, buffer, sizeof(buffer));
+  CHECK(length > 0 && length < absoluteLength);
+
+  int16_t values[MESSAGE_V1_MAX_FIELDS];
+  uint8_t count, id;
+  bool delta;
+  CHECK(MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+  CHECK(count == FIELDS && id == 3 && delta);
+  CHECK(MessageCodec::applyDelta(values, SAMPLE, count));
+  checkValues(sample, values, FIELDS);
+}
+
+static void testUnchangedDelta() {
+  uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+  uint8_t length = MessageCodec::encodeDelta(SAMPLE, SAMPLE, FIELDS, 1, buffer, sizeof(buffer));
+  // presence bitmap and a 0 width per field
+  CHECK(length == MESSAGE_V1_HEADER + (FIELDS * (1 + MESSAGE_V1_WIDTH_BITS) + 7) / 8);
+
+  int16_t values[MESSAGE_V1_MAX_FIELDS];
+  uint8_t count, id;
+  bool delta;
+  CHECK(MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+  CHECK(MessageCodec::applyDelta(values, SAMPLE, count));
+  checkValues(SAMPLE, values, FIELDS);
+}
+
+static void testNotRepresentable() {
+  uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+  int16_t sample[FIELDS];
+  memcpy(sample, SAMPLE, sizeof(sample));
+
+  // battery below 0 V does not fit the absolute format
+  sample[0] = -1;
+  CHECK(MessageCodec::encodeAbsolute(sample, FIELDS, 0, buffer, sizeof(buffer)) == 0);
+
+  // difference to an undefined reference
+  int16_t reference[FIELDS];
+  memcpy(reference, SAMPLE, sizeof(reference));
+  reference[2] = UNDEFINED_VALUE;
+  CHECK(MessageCodec::encodeDelta(SAMPLE, reference, FIELDS, 0, buffer, sizeof(buffer)) == 0);
+
+  // difference wider than 15 bits
+  memcpy(sample, SAMPLE, sizeof(sample));
+  memcpy(reference, SAMPLE, sizeof(reference));
+  sample[1] = 16000;
+  reference[1] = -16000;
+  CHECK(MessageCodec::encodeDelta(sample, reference, FIELDS, 0, buffer, sizeof(buffer)) == 0);
+
+  // buffer too small
+  CHECK(MessageCodec::encodeAbsolute(SAMPLE, FIELDS, 0, buffer, 6) == 0);
+}
+
+static void testTruncatedDecode() {
+  uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+  uint8_t length = MessageCodec::encodeAbsolute(SAMPLE, FIELDS, 0, buffer, sizeof(buffer));
+  int16_t values[MESSAGE_V1_MAX_FIELDS];
+  uint8_t count, id;
+  bool delta;
+  CHECK(!MessageCodec::decode(buffer, length - 2, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+  CHECK(!MessageCodec::decode(buffer, 1, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+  CHECK(!MessageCodec::decode(buffer, length, values, FIELDS - 1, &count, &id, &delta));
+  buffer[0] = 0;
+  CHECK(!MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &count, &id, &delta));
+}
+
+static int16_t randomValue(uint8_t field) {
+  if (rand() % 8 == 0) return UNDEFINED_VALUE;
+  const FieldFormat& format = MessageCodec::fieldFormat(field);
+  return format.minimum + rand() % (1L << format.bits);
+}
+
+static void testRandomRoundTrip() {
+  srand(1);
+  for (int run = 0; run < 10000; run++) {
+    uint8_t count = rand() % (MESSAGE_V1_MAX_FIELDS + 1);
+    int16_t reference[MESSAGE_V1_MAX_FIELDS];
+    int16_t sample[MESSAGE_V1_MAX_FIELDS];
+    for (uint8_t i = 0; i < count; i++) {
+      reference[i] = randomValue(i);
+      sample[i] = randomValue(i);
+    }
+
+    uint8_t buffer[MESSAGE_V1_MAX_SIZE];
+    int16_t values[MESSAGE_V1_MAX_FIELDS];
+    uint8_t decodedCount, id;
+    bool delta;
+    uint8_t length = MessageCodec::encodeAbsolute(sample, count, run, buffer, sizeof(buffer));
+    CHECK(length > 0);
+    CHECK(MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &decodedCount, &id, &delta));
+    CHECK(decodedCount == count && id == (run & MESSAGE_V1_ID_MASK) && !delta);
+    checkValues(sample, values, count);
+
+    length = MessageCodec::encodeDelta(sample, reference, count, run, buffer, sizeof(buffer));
+    if (length == 0) continue;
+    CHECK(MessageCodec::decode(buffer, length, values, MESSAGE_V1_MAX_FIELDS, &decodedCount, &id, &delta));
+    CHECK(decodedCount == count && delta);
+    CHECK(MessageCodec::applyDelta(values, reference, count));
+    checkValues(sample, values, count);
+  }
+}
+
+static void testBatchRoundTrip() {
+  int16_t batch[4 * FIELDS];
+  uint8_t ages[4] = { 120, 90, 31, 0 };
+  for (int s = 0; s < 4; s++) {
+    for (int i = 0; i < FIELDS; i++) batch[s * FIELDS + i] = SAMPLE[i] + s * (i - 4);
+  }
+  batch[2 * FIELDS + 3] = UNDEFINED_VALUE;   // absolute sample after an undefined value
+  batch[3 * FIELDS + 1] = -16384;            // difference wider than 15 bits
+
+  uint8_t buffer[222];
+  uint8_t length = MessageCodec::encodeBatch(batch, ages, 4, FIELDS, buffer, sizeof(buffer));
+  CHECK(length > 0 && length < 4 * MessageCodec::maxSampleSize(FIELDS));
+  CHECK(buffer[0] == MESSAGE_V2);
+
+  int16_t values[4 * FIELDS];
+  uint8_t decodedAges[4], samples, count;
+  CHECK(MessageCodec::decodeBatch(buffer, length, values, decodedAges, sizeof(values) / sizeof(values[0]), &samples, &count));
+  CHECK(samples == 4 && count == FIELDS);
+  checkValues(batch, values, 4 * FIELDS);
+  for (int s = 0; s < 4; s++) CHECK(decodedAges[s] == ages[s]);
+
+  // samples of a batch do not fit
+  CHECK(MessageCodec::encodeBatch(batch, ages, 4, FIELDS, buffer, length - 1) == 0);
+  CHECK(!MessageCodec::decodeBatch(buffer, length, values, decodedAges, FIELDS, &samples, &count));
+}
+
+static void testBatchSampleSize() {
+  // an absolute sample of extreme values stays within the bound
+  int16_t sample[FIELDS];
+  for (int i = 0; i < FIELDS; i++) {
+    const FieldFormat& format = MessageCodec::fieldFormat(i);
+    sample[i] = format.minimum + (1L << format.bits) - 1;
+  }
+  uint8_t age = 255;
+  uint8_t buffer[MESSAGE_V2_HEADER + 32];
+  uint8_t length = MessageCodec::encodeBatch(sample, &age, 1, FIELDS, buffer, sizeof(buffer));
+  CHECK(length == MESSAGE_V2_HEADER + MessageCodec::maxSampleSize(FIELDS));
+}
+
+// the samples of a wrapped ring buffer, read in place
+struct RingSamples {
+  SampleBuffer<4, FIELDS>* buffer;
+  uint32_t minute;
+  const int16_t* values(uint8_t s) { return buffer->values(s); }
+  uint8_t age(uint8_t s) { return minute - buffer->minute(s); }
+};
+
+static void testBatchInPlace() {
+  SampleBuffer<4, FIELDS> ring;
+  int16_t batch[4 * FIELDS];
+  uint8_t ages[4];
+  for (int s = 0; s < 6; s++) {
+    int16_t sample[FIELDS];
+    for (int i = 0; i < FIELDS; i++) sample[i] = SAMPLE[i] + s * (i - 4);
+    ring.store(sample, 1000 + 10 * s);
+    if (s >= 2) {
+      memcpy(batch + (s - 2) * FIELDS, sample, sizeof(sample));
+      ages[s - 2] = 1060 - (1000 + 10 * s);
+    }
+  }
+  RingSamples source = { &ring, 1060 };
+  uint8_t expected[222], buffer[222];
+  uint8_t length = MessageCodec::encodeBatch(batch, ages, 4, FIELDS, expected, sizeof(expected));
+  CHECK(length > 0);
+  CHECK(MessageCodec::encodeBatch(source, 4, FIELDS, buffer, sizeof(buffer)) == length);
+  CHECK(memcmp(expected, buffer, length) == 0);
+}
+
+static void testBatchCapacity() {
+  CHECK((MESSAGE_V2_ABSOLUTE_BITS(FIELDS) + 7) / 8 == MessageCodec::maxSampleSize(FIELDS));
+  CHECK(MESSAGE_V2_SAMPLES(51, FIELDS) == 5);
+  CHECK(MESSAGE_V2_SAMPLES(222, FIELDS) == MESSAGE_V2_MAX_SAMPLES);
+  // unchanged samples after an absolute one of extreme values fill the payload
+  int16_t batch[6 * FIELDS];
+  uint8_t ages[6] = { 0 };
+  for (int i = 0; i < FIELDS; i++) {
+    const FieldFormat& format = MessageCodec::fieldFormat(i);
+    batch[i] = format.minimum + (1L << format.bits) - 1;
+  }
+  for (int s = 1; s < 6; s++) memcpy(batch + s * FIELDS, batch, FIELDS * sizeof(int16_t));
+  uint8_t buffer[51];
+  CHECK(MessageCodec::encodeBatch(batch, ages, 5, FIELDS, buffer, sizeof(buffer)) > 0);
+  CHECK(MessageCodec::encodeBatch(batch, ages, 6, FIELDS, buffer, sizeof(buffer)) == 0);
+}
+
+static void testBatchSchedule() {
+  int16_t batch[2 * FIELDS];
+  uint8_t ages[2] = { 12, 0 };
+  memcpy(batch, SAMPLE, sizeof(SAMPLE));
+  memcpy(batch + FIELDS, SAMPLE, sizeof(SAMPLE));
+  ScheduleReport schedule = { 17, 2, 80 };  // rate saturates at 63
+
+  uint8_t buffer[64];
+  uint8_t plain = MessageCodec::encodeBatch(batch, ages, 2, FIELDS, buffer, sizeof(buffer));
+  uint8_t length = MessageCodec::encodeBatch(batch, ages, 2, FIELDS, buffer, sizeof(buffer), &schedule);
+  CHECK(length == plain + 2 || length == plain + 3);
+
+  int16_t values[2 * FIELDS];
+  uint8_t decodedAges[2], samples, count;
+  ScheduleReport decoded = { 0, 0, 0 };
+  bool scheduled = false;
+  CHECK(MessageCodec::decodeBatch(buffer, length, values, decodedAges, 2 * FIELDS, &samples, &count, &decoded, &scheduled));
+  CHECK(scheduled && decoded.interval == 17 && decoded.reason == 2 && decoded.rate == 63);
+  checkValues(batch, values, 2 * FIELDS);
+
+  // a batch without schedule
+  plain = MessageCodec::encodeBatch(batch, ages, 2, FIELDS, buffer, sizeof(buffer));
+  CHECK(MessageCodec::decodeBatch(buffer, plain, values, decodedAges, 2 * FIELDS, &samples, &count, &decoded, &scheduled));
+  CHECK(!scheduled);
+}
+
+static void testDiagnostics() {
+  StateReport states[3] = {
+    { 864000, 1, 0, 5 },
+    { 0, 0, 0, 0 },
+    { 0xFFFFFFFFUL, 3000, 48, 1800 }  // time saturates at 31 bit
+  };
+  uint8_t buffer[51];
+  uint8_t length = MessageCodec::encodeDiagnostics(states, 3, 95, 2, buffer, sizeof(buffer));
+  CHECK(length > MESSAGE_DIAGNOSTICS_HEADER && buffer[0] == MESSAGE_DIAGNOSTICS);
+
+  StateReport decoded[3];
+  uint8_t count;
+  uint32_t airtime, deferred;
+  CHECK(MessageCodec::decodeDiagnostics(buffer, length, decoded, 3, &count, &airtime, &deferred));
+  CHECK(count == 3 && airtime == 95 && deferred == 2);
+  CHECK(decoded[0].time == 864000 && decoded[0].entries == 1 && decoded[0].timeouts == 0 && decoded[0].maxDuration == 5);
+  CHECK(decoded[1].time == 0 && decoded[1].entries == 0);
+  CHECK(decoded[2].time == 0x7FFFFFFFUL && decoded[2].entries == 3000 && decoded[2].timeouts == 48 && decoded[2].maxDuration == 1800);
+
+  CHECK(!MessageCodec::decodeDiagnostics(buffer, length - 2, decoded, 3, &count, &airtime, &deferred));
+  CHECK(!MessageCodec::decodeDiagnostics(buffer, length, decoded, 2, &count, &airtime, &deferred));
+  CHECK(MessageCodec::encodeDiagnostics(states, 3, 95, 2, buffer, 8) == 0);
+}
+
+static void testBackfillRoundTrip() {
+  int16_t batch[3 * FIELDS];
+  uint16_t ages[3] = { 4000, 3970, 3715 };   // the last step is saturated at 255 minutes
+  for (int s = 0; s < 3; s++) {
+    for (int i = 0; i < FIELDS; i++) batch[s * FIELDS + i] = SAMPLE[i] + s * (4 - i);
+  }
+  batch[2 * FIELDS + 1] = -16384;           // absolute sample in a backfill too
+
+  uint8_t buffer[222];
+  uint8_t length = MessageCodec::encodeBackfill(batch, ages, 3, FIELDS, 0xFFFE, buffer, sizeof(buffer));
+  CHECK(length > 0 && buffer[0] == MESSAGE_BACKFILL);
+
+  int16_t values[3 * FIELDS];
+  uint16_t decodedAges[3], sequence;
+  uint8_t samples, count;
+  CHECK(MessageCodec::decodeBackfill(buffer, length, values, decodedAges, sizeof(values) / sizeof(values[0]), &samples, &count, &sequence));
+  CHECK(samples == 3 && count == FIELDS && sequence == 0xFFFE);
+  checkValues(batch, values, 3 * FIELDS);
+  CHECK(decodedAges[0] == 4000 && decodedAges[1] == 3970 && decodedAges[2] == 3715);
+
+  CHECK(MessageCodec::encodeBackfill(batch, ages, 3, FIELDS, 0, buffer, length - 1) == 0);
+  CHECK(!MessageCodec::decodeBackfill(buffer, length - 1, values, decodedAges, sizeof(values) / sizeof(values[0]), &samples, &count, &sequence));
+  CHECK(!MessageCodec::decodeBackfill(buffer, length, values, decodedAges, FIELDS, &samples, &count, &sequence));
+  buffer[0] = MESSAGE_V2;
+  CHECK(!MessageCodec::decodeBackfill(buffer, length, values, decodedAges, sizeof(values) / sizeof(values[0]), &samples, &count, &sequence));
+}
+
+// a delta sample of one field on the undefined value of the sample before, the encoders write
+// an absolute sample instead
+static void testDeltaOnUndefined() {
+  uint8_t buffer[16];
+  buffer[0] = MESSAGE_V2;
+  buffer[1] = (1 << 4) | 2;
+  BitWriter batch(buffer + MESSAGE_V2_HEADER, sizeof(buffer) - MESSAGE_V2_HEADER);
+  batch.write(30, MESSAGE_V2_AGE_BITS);
+  batch.write(0, 1);  // absolute, undefined
+  batch.write(0, 1);
+  batch.write(0, MESSAGE_V2_AGE_BITS);
+  batch.write(1, 1);  // delta +1
+  batch.write(1, 1);
+  batch.write(2, MESSAGE_V1_WIDTH_BITS);
+  batch.write(2, 2);
+  int16_t values[2];
+  uint8_t ages[2], samples, count;
+  CHECK(!MessageCodec::decodeBatch(buffer, MESSAGE_V2_HEADER + batch.length(), values, ages, 2, &samples, &count));
+
+  buffer[0] = MESSAGE_BACKFILL;
+  BitWriter backfill(buffer + MESSAGE_BACKFILL_HEADER, sizeof(buffer) - MESSAGE_BACKFILL_HEADER);
+  backfill.write(7, 16);
+  backfill.write(30, 16);
+  backfill.write(0, 1);
+  backfill.write(0, 1);
+  backfill.write(30, 8);
+  backfill.write(1, 1);
+  backfill.write(1, 1);
+  backfill.write(2, MESSAGE_V1_WIDTH_BITS);
+  backfill.write(2, 2);
+  uint16_t backfillAges[2], sequence;
+  CHECK(!MessageCodec::decodeBackfill(buffer, MESSAGE_BACKFILL_HEADER + backfill.length(), values, backfillAges, 2, &samples, &count, &sequence));
+}
+
+static void testAggregateRoundTrip() {
+  AggregateWindow windows[2] = { { 30, 12 }, { 31, 1 } };
+  FieldStatistics fields[2 * FIELDS];
+  for (int w = 0; w < 2; w++) {
+    for (int i = 0; i < FIELDS; i++) {
+      FieldStatistics& field = fields[w * FIELDS + i];
+      field.minimum = SAMPLE[i] - 50 * w;
+      field.maximum = SAMPLE[i] + 7 * i;
+      field.mean = SAMPLE[i] + 3 * i;
+      field.deviation = 2 * i;
+    }
+  }
+  fields[1].minimum = -16384;                        // full range of the weight
+  fields[1].maximum = 16383;
+  fields[1].deviation = 16000;
+  fields[FIELDS + 4].minimum = UNDEFINED_VALUE;     // thermometer without a reading
+  fields[FIELDS + 4].maximum = fields[FIELDS + 4].mean = fields[FIELDS + 4].deviation = UNDEFINED_VALUE;
+
+  uint8_t buffer[222];
+  uint8_t length = MessageCodec::encodeAggregate(windows, fields, 2, FIELDS, 3, buffer, sizeof(buffer));
+  CHECK(length > 0 && buffer[0] == MESSAGE_AGGREGATE);
+
+  AggregateWindow decodedWindows[2];
+  FieldStatistics decoded[2 * FIELDS];
+  uint8_t windowCount, count;
+  uint32_t age;
+  CHECK(MessageCodec::decodeAggregate(buffer, length, decodedWindows, decoded, 2, 2 * FIELDS, &windowCount, &count, &age));
+  CHECK(windowCount == 2 && count == FIELDS && age == 3);
+  CHECK(decodedWindows[0].minutes == 30 && decodedWindows[0].measures == 12);
+  CHECK(decodedWindows[1].minutes == 31 && decodedWindows[1].measures == 1);
+  for (int i = 0; i < 2 * FIELDS; i++) {
+    CHECK(decoded[i].minimum == fields[i].minimum && decoded[i].maximum == fields[i].maximum);
+    CHECK(decoded[i].mean == fields[i].mean && decoded[i].deviation == fields[i].deviation);
+  }
+
+  // a mean out of the range and too small buffers are rejected
+  CHECK(MessageCodec::encodeAggregate(windows, fields, 2, FIELDS, 3, buffer, length - 1) == 0);
+  CHECK(!MessageCodec::decodeAggregate(buffer, length - 1, decodedWindows, decoded, 2, 2 * FIELDS, &windowCount, &count, &age));
+  CHECK(!MessageCodec::decodeAggregate(buffer, length, decodedWindows, decoded, 1, 2 * FIELDS, &windowCount, &count, &age));
+  fields[0].mean = fields[0].maximum + 1;
+  CHECK(MessageCodec::encodeAggregate(windows, fields, 2, FIELDS, 3, buffer, sizeof(buffer)) == 0);
+}
+
+static void testAlertRoundTrip() {
+  AlertReport alert = { 0x03, 7, 4210, 1890, 3450, UNDEFINED_VALUE };
+  uint8_t buffer[MESSAGE_ALERT_SIZE];
+  uint8_t length = MessageCodec::encodeAlert(alert, buffer, sizeof(buffer));
+  CHECK(length == MESSAGE_ALERT_SIZE && buffer[0] == MESSAGE_ALERT && buffer[1] == 0x73);
+
+  AlertReport decoded;
+  CHECK(MessageCodec::decodeAlert(buffer, length, &decoded));
+  CHECK(decoded.flags == 0x03 && decoded.broodField == 7);
+  CHECK(decoded.weightBefore == 4210 && decoded.weight == 1890);
+  CHECK(decoded.broodBefore == 3450 && decoded.brood == UNDEFINED_VALUE);
+
+  CHECK(MessageCodec::encodeAlert(alert, buffer, length - 1) == 0);
+  CHECK(!MessageCodec::decodeAlert(buffer, length - 1, &decoded));
+  buffer[0] = MESSAGE_AGGREGATE;
+  CHECK(!MessageCodec::decodeAlert(buffer, length, &decoded));
+}
+
+int main() {
+  testAbsoluteRoundTrip();
+  testUndefinedValuesOmitted();
+  testDeltaRoundTrip();
+  testUnchangedDelta();
+  testNotRepresentable();
+  testTruncatedDecode();
+  testRandomRoundTrip();
+  testBatchRoundTrip();
+  testBatchSampleSize();
+  testBatchInPlace();
+  testBatchCapacity();
+  testBatchSchedule();
+  testDiagnostics();
+  testBackfillRoundTrip();
+  testDeltaOnUndefined();
+  testAggregateRoundTrip();
+  testAlertRoundTrip();
+  printf("MessageCodec tests passed\n");
+  return 0;
+}
@@ -0,0 +1,138 @@
+/**********************************************************
+ * Tests of the dual prediction of the sensor values.
+ * ---
+ * Runs Predictor.h of the sketch on a node that keeps a
+ * measure only beyond the limits around the prediction and
+ * on a receiver fed with the kept samples, checks that the
+ * receiver reconstructs every measure within the limits and
+ * keeps fewer samples than the limits around the last sample
+ * for a daily cycle with noise; and the anchor, the horizon
+ * and undefined values; exits non-zero on the first failed
+ * check.
+ **********************************************************/
+#include "Predictor.h"
+#include "Check.h"
+
+#include <math.h>
+
+// battery, weight, temperature
+#define FIELDS 3
+#define DAYS 5
+#define INTERVAL 5  // minutes between measures
+
+static const int16_t LIMITS[FIELDS] = { 0, 10, 50 };
+
+static uint32_t seed = 1;
+
+static double noise() {
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 16) & 0x7FFF) / 32768.0 - 0.5;
+}
+
+// nectar flow of 1 kg a day with foragers out at noon, daily swing of 8 C
+static void measure(uint32_t minute, int16_t* values) {
+  double day = minute / 1440.0;
+  values[0] = 390;
+  values[1] = (int16_t)lround(3500 + 100 * day - 30 * sin(2 * M_PI * (day - 0.25)) + 4 * noise());
+  values[2] = (int16_t)lround(1500 + 800 * sin(2 * M_PI * (day - 0.375)) + 10 * noise());
+}
+
+static bool isChangedSinceLast(const int16_t* values, const int16_t* last) {
+  for (int i = 0; i < FIELDS; i++) {
+    if (LIMITS[i] > 0 && abs(values[i] - last[i]) >= LIMITS[i]) return true;
+  }
+  return false;
+}
+
+static void testReconstruction() {
+  Predictor<FIELDS> node;
+  Predictor<FIELDS> receiver;
+  int16_t last[FIELDS];
+  int kept = 0, keptSinceLast = 0, measures = 0;
+  int32_t maxError[FIELDS] = { 0 };
+  for (uint32_t minute = 0; minute < DAYS * 1440; minute += INTERVAL) {
+    int16_t values[FIELDS];
+    measure(minute, values);
+    measures++;
+    if (minute == 0 || isChangedSinceLast(values, last)) {
+      memcpy(last, values, sizeof(last));
+      keptSinceLast++;
+    }
+    if (node.isBeyond(values, LIMITS, minute)) {
+      node.add(values, minute);
+      receiver.add(values, minute);
+      kept++;
+      continue;
+    }
+    // suppressed: the receiver fills the gap with its prediction of the samples so far
+    CHECK(receiver.isReady());
+    for (int i = 1; i < FIELDS; i++) {
+      int32_t error = abs(receiver.predict(i, minute) - values[i]);
+      CHECK(error < LIMITS[i]);
+      if (error > maxError[i]) maxError[i] = error;
+    }
+  }
+  printf("%d measures, %d kept around the prediction, %d around the last sample, max error %d, %d\n",
+         measures, kept, keptSinceLast, maxError[1], maxError[2]);
+  CHECK(kept * 2 < keptSinceLast);
+}
+
+static void testAnchor() {
+  Predictor<FIELDS> predictor;
+  int16_t first[FIELDS] = { 390, 1000, 2000 };
+  int16_t close[FIELDS] = { 390, 1010, 2000 };
+  int16_t later[FIELDS] = { 390, 1040, 1900 };
+  predictor.add(first, 100);
+  CHECK(!predictor.isReady() && predictor.predict(1, 110) == UNDEFINED_VALUE);
+  CHECK(predictor.isBeyond(first, LIMITS, 110));
+  // closer than the span: no anchor yet
+  predictor.add(close, 100 + PREDICTION_MIN_SPAN - 1);
+  CHECK(!predictor.isReady());
+  predictor.add(later, 100 + 2 * PREDICTION_MIN_SPAN);
+  CHECK(predictor.isReady());
+  // the line through close and later
+  uint32_t span = PREDICTION_MIN_SPAN + 1;
+  CHECK(predictor.predict(1, 100 + 2 * PREDICTION_MIN_SPAN) == 1040);
+  CHECK(predictor.predict(1, 100 + 2 * PREDICTION_MIN_SPAN + span) == 1070);
+  CHECK(predictor.predict(2, 100 + 2 * PREDICTION_MIN_SPAN + span) == 1800);
+  // constant beyond the horizon
+  CHECK(predictor.predict(1, 100 + 2 * PREDICTION_MIN_SPAN + PREDICTION_HORIZON)
+        == predictor.predict(1, 100 + 2 * PREDICTION_MIN_SPAN + 10 * PREDICTION_HORIZON));
+}
+
+static void testUndefinedValues() {
+  Predictor<FIELDS> predictor;
+  int16_t first[FIELDS] = { 390, UNDEFINED_VALUE, 2000 };
+  int16_t second[FIELDS] = { 390, 1000, UNDEFINED_VALUE };
+  predictor.add(first, 0);
+  predictor.add(second, 30);
+  CHECK(predictor.predict(1, 60) == 1000);             // newest value without the anchor value
+  CHECK(predictor.predict(2, 60) == UNDEFINED_VALUE);  // undefined newest value
+  int16_t values[FIELDS] = { 390, 1005, UNDEFINED_VALUE };
+  CHECK(!predictor.isBeyond(values, LIMITS, 60));
+  values[2] = 2000;  // thermometer back
+  CHECK(predictor.isBeyond(values, LIMITS, 60));
+  values[2] = UNDEFINED_VALUE;
+  values[1] = UNDEFINED_VALUE;  // load cell lost
+  CHECK(predictor.isBeyond(values, LIMITS, 60));
+}
+
+static void testExtremes() {
+  Predictor<FIELDS> predictor;
+  int16_t low[FIELDS] = { 0, -16384, -8192 };
+  int16_t high[FIELDS] = { 1023, 16383, 8191 };
+  predictor.add(low, 0);
+  predictor.add(high, PREDICTION_MIN_SPAN);
+  CHECK(predictor.predict(1, PREDICTION_MIN_SPAN + PREDICTION_HORIZON) == 32767);
+  predictor.add(low, 2 * PREDICTION_MIN_SPAN);
+  CHECK(predictor.predict(1, 2 * PREDICTION_MIN_SPAN + PREDICTION_HORIZON) == -32767);
+}
+
+int main() {
+  testReconstruction();
+  testAnchor();
+  testUndefinedValues();
+  testExtremes();
+  printf("Predictor tests passed\n");
+  return 0;
+}
@@ -0,0 +1,180 @@
+/**********************************************************
+ * Tests of the state machine of the sketch.
+ * ---
+ * Runs the handler table (StateTable) and the runtime
+ * registration (StateMachine) of StateMachine.h through
+ * the same transitions on the simulated clock and checks
+ * the handler calls and the state counters; the handlers
+ * posted by interrupts (a timer racing with a transition,
+ * a full queue, a bouncing button of Interaction.h); exits
+ * non-zero on the first failed check.
+ **********************************************************/
+#include "Arduino.h"
+#include "Simulation.h"
+#include "StateMachine.h"
+#include "Interaction.h"
+#include "Check.h"
+
+#define TIMEOUT_MS 1000
+
+typedef enum { FIRST, SECOND, STATE_COUNT } States;
+const char* stateNames[] = { "First", "Second" };
+
+static int entered, looped, timedOut, exited;
+
+static uint64_t now() { return millis(); }
+static void onEnter() { entered++; }
+static void onLoop() { looped++; }
+static void onTimeout() { timedOut++; }
+static void onExit() { exited++; }
+
+const StateDefinition states[] PROGMEM = {
+  { onEnter, onLoop, TIMEOUT_MS, onTimeout, onExit },
+  { 0, 0, INVALID_DURATION, 0, 0 }
+};
+
+static void run(StateEngine& node) {
+  entered = looped = timedOut = exited = 0;
+  node.toState(FIRST);
+  node.loop();
+  CHECK(node.state() == FIRST && entered == 1 && looped == 1);
+  delay(TIMEOUT_MS + 1);
+  node.loop();
+  node.loop();
+  CHECK(timedOut == 2 && looped == 3);
+  node.toState(SECOND);
+  node.loop();
+  CHECK(node.state() == SECOND && exited == 1);
+  node.toState(FIRST);
+  node.loop();
+  delay(10);
+
+  StateStats first = node.stats(FIRST);
+  CHECK(first.entries == 2 && first.timeouts == 1);
+  CHECK(first.maxDuration >= TIMEOUT_MS + 1);
+  CHECK(first.time >= TIMEOUT_MS + 11);
+  StateStats second = node.stats(SECOND);
+  CHECK(second.entries == 1 && second.timeouts == 0 && second.time < first.time);
+  CHECK(node.stateCount() == STATE_COUNT);
+  CHECK(strcmp(node.stateName(SECOND), "Second") == 0);
+}
+
+static StateTable<STATE_COUNT>* posting;
+static int woken;
+static Interaction interaction;
+
+static void toSecond() { posting->toState(SECOND); }
+static void onWakeup() { woken++; posting->toState(FIRST); }
+static void onButton() {
+  if (!interaction.isPressSettled()) {
+    if (!posting->repost(onButton)) interaction.forgetPress();
+    return;
+  }
+  if (interaction.checkSwitchPressed()) {
+    posting->toState(posting->state() == FIRST ? SECOND : FIRST);
+  }
+}
+static void onButtonInterrupt() {
+  if (interaction.notePress() && !posting->post(onButton)) {
+    interaction.forgetPress();
+  }
+}
+
+static void testPostedEvents() {
+  StateTable<STATE_COUNT> node(states, stateNames, now);
+  posting = &node;
+  woken = 0;
+  node.toState(SECOND);
+  // a timer interrupt before the transition is done: both happen, in order
+  CHECK(node.post(onWakeup));
+  node.loop();
+  CHECK(node.state() == SECOND && woken == 0);
+  node.loop();
+  CHECK(node.state() == FIRST && woken == 1);
+
+  // one handler per loop, each sees the state left by the one before
+  for (int i = 0; i < STATE_EVENTS; i++) {
+    CHECK(node.post(i % 2 == 0 ? toSecond : onWakeup));
+  }
+  CHECK(!node.post(onWakeup) && node.lostEvents() == 1);
+  node.loop();
+  CHECK(node.state() == SECOND);
+  node.loop();
+  CHECK(node.state() == FIRST && woken == 2);
+  node.loop();
+  node.loop();
+  CHECK(node.state() == FIRST && woken == 3);
+  node.loop();
+  CHECK(node.state() == FIRST && woken == 3);
+
+  // ring indexes wrap around
+  for (int i = 0; i < 300; i++) {
+    CHECK(node.post(i % 2 == 0 ? toSecond : onWakeup));
+    node.loop();
+  }
+  CHECK(node.state() == FIRST && woken == 153 && node.lostEvents() == 1);
+}
+
+static void testBouncingButton() {
+  StateTable<STATE_COUNT> node(states, stateNames, now);
+  posting = &node;
+  node.toState(FIRST);
+  node.loop();
+  interaction.begin(onButtonInterrupt);
+  // press with bounces: a single event, checked after the debounce time
+  uint64_t start = millis();
+  for (int i = 0; i < 3; i++) {
+    sim::drivePin(BUTTON_PIN, LOW);
+    sim::drivePin(BUTTON_PIN, HIGH);
+  }
+  sim::drivePin(BUTTON_PIN, LOW);
+  // the loop goes on until the press settled
+  node.loop();
+  CHECK(node.state() == FIRST && node.hasEvents() && millis() - start < BUTTON_DEBOUNCE);
+  while (millis() - start < BUTTON_DEBOUNCE) {
+    delay(1);
+    node.loop();
+  }
+  node.loop();
+  CHECK(node.state() == SECOND && !node.hasEvents());
+  node.loop();
+  CHECK(node.state() == SECOND);
+  // bounces of the release: the button is up, no change
+  sim::drivePin(BUTTON_PIN, HIGH);
+  sim::drivePin(BUTTON_PIN, LOW);
+  sim::drivePin(BUTTON_PIN, HIGH);
+  node.loop();
+  delay(BUTTON_DEBOUNCE);
+  node.loop();
+  CHECK(node.state() == SECOND && !node.hasEvents());
+  // the next press
+  sim::drivePin(BUTTON_PIN, LOW);
+  delay(BUTTON_DEBOUNCE);
+  node.loop();
+  CHECK(node.state() == FIRST);
+  sim::drivePin(BUTTON_PIN, HIGH);
+}
+
+int main() {
+  sim::Config config = sim::Config::forBoard("dragino");
+  static sim::Totals totals;
+  sim::Board board(config, &totals);
+  sim::install(&board);
+  board.boot();
+
+  StateTable<STATE_COUNT> table(states, stateNames, now);
+  run(table);
+
+  StateMachine machine(STATE_COUNT, stateNames, now);
+  machine.onEnter(FIRST, onEnter);
+  machine.onState(FIRST, onLoop);
+  machine.onTimeout(FIRST, TIMEOUT_MS, onTimeout);
+  machine.onExit(FIRST, onExit);
+  run(machine);
+
+  testPostedEvents();
+  testBouncingButton();
+
+  printf("StateMachine tests passed\n");
+  return 0;
+}
@@ -0,0 +1,100 @@
+/**********************************************************
+ * Tests of the load cell filter.
+ * ---
+ * Feeds WeightFilter.h of the sketch with steady, spiking
+ * and noisy HX711 readings and checks the early stop, the
+ * rejected outliers and the extended sampling; exits
+ * non-zero on the first failed check.
+ **********************************************************/
+#include "WeightFilter.h"
+#include "Check.h"
+
+#include <math.h>
+
+#define DIVIDER   25365  // counts per kg
+#define TOLERANCE (DIVIDER / 100)
+
+static double gaussian() {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+// samples until done, noise and spike in kg
+static void sample(WeightFilter& filter, int32_t offset, double noise, int spikeAt, double spike) {
+  filter.reset(TOLERANCE);
+  for (int i = 0; !filter.isDone(); i++) {
+    double kg = noise * gaussian() + (i == spikeAt ? spike : 0);
+    filter.add(offset + (int32_t)lround(kg * DIVIDER));
+  }
+}
+
+static void testSteady() {
+  WeightFilter filter;
+  sample(filter, 500000, 0, -1, 0);
+  CHECK(filter.size() == WEIGHT_MIN_SAMPLES && filter.accepted() == WEIGHT_MIN_SAMPLES);
+  CHECK(filter.sum() == 500000 * WEIGHT_MIN_SAMPLES);
+  // negative readings and zero tolerance
+  filter.reset(0);
+  for (int i = 0; i < WEIGHT_MIN_SAMPLES; i++) filter.add(-43496);
+  CHECK(filter.isDone() && filter.sum() == -43496 * WEIGHT_MIN_SAMPLES);
+  // zero tolerance (uncalibrated divider) does not sample the noise up to the maximum
+  filter.reset(0);
+  for (int i = 0; !filter.isDone(); i++) filter.add(1000 + i % 3 * 100);
+  CHECK(filter.size() == WEIGHT_MIN_SAMPLES);
+}
+
+static void testSpikeRejected() {
+  WeightFilter filter;
+  srand(3);
+  int worstFiltered = 0;
+  for (int run = 0; run < 1000; run++) {
+    // 1 kg gust in the second sample
+    sample(filter, 0, 0.02, 1, 1.0);
+    CHECK(filter.accepted() < filter.size());
+    int filtered = abs(filter.sum() / filter.accepted());
+    if (filtered > worstFiltered) worstFiltered = filtered;
+  }
+  // the plain average of 10 samples moves by 1/10 kg
+  printf("spike: worst %.3f kg\n", (double)worstFiltered / DIVIDER);
+  CHECK(worstFiltered < DIVIDER / 20);
+}
+
+static void testEarlyStop() {
+  WeightFilter filter;
+  srand(5);
+  int total = 0, runs = 1000;
+  double squares = 0;
+  for (int run = 0; run < runs; run++) {
+    sample(filter, 0, 0.02, -1, 0);
+    total += filter.size();
+    double error = (double)filter.sum() / filter.accepted();
+    squares += error * error;
+  }
+  double rms = sqrt(squares / runs);
+  printf("noise 0.02 kg: %.1f samples on average, rms %.4f kg\n", (double)total / runs, rms / DIVIDER);
+  CHECK(total < 8 * runs);
+  CHECK(rms < 1.5 * TOLERANCE);
+}
+
+static void testNoisyExtends() {
+  WeightFilter filter;
+  srand(7);
+  int total = 0, runs = 1000;
+  for (int run = 0; run < runs; run++) {
+    sample(filter, 0, 0.1, -1, 0);
+    total += filter.size();
+    CHECK(filter.size() <= WEIGHT_MAX_SAMPLES);
+  }
+  printf("noise 0.10 kg: %.1f samples on average\n", (double)total / runs);
+  CHECK(total > 14 * runs);
+}
+
+int main() {
+  testSteady();
+  testSpikeRejected();
+  testEarlyStop();
+  testNoisyExtends();
+  printf("WeightFilter tests passed\n");
+  return 0;
+}
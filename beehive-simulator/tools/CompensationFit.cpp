@@ -0,0 +1,246 @@
+/**********************************************************
+ * Fitting of the load cell temperature compensation.
+ * ---
+ * Reads the uplinks of a hive as exported for beehive-chart
+ * (eg. sample-shakra.json), removes the linear compensation
+ * the sketch applied (--factor, --offset of calibration.h)
+ * and fits the drift of the load cell as a piecewise linear
+ * function of the outer temperature, filtered with the
+ * thermal lag filter of FixedPoint.h for each lag of the
+ * search. The hive weight is modelled as a linear trend
+ * over the recording, the drift keeps the mean weight of
+ * the recording. Prints the residuals, the weight changes
+ * above the uplink limit (LIMIT_WEIGHT_DIFF) with the linear
+ * model and with the fitted one, and the defines for
+ * calibration.h.
+ *
+ * usage: compensation-fit [--factor F] [--offset O] [--points N]
+ *                         [--max-lag minutes] < readings.json
+ **********************************************************/
+#include "FixedPoint.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_POINTS        8
+#define MAX_READINGS  50000
+#define LIMIT_WEIGHT_DIFF 0.10  // kg, see the sketch
+
+typedef struct {
+  double time;    // s since the first reading
+  double weight;  // kg as sent
+  double outer;   // C
+} Reading;
+
+static const int LAGS[] = { 0, 15, 30, 60, 90, 120, 180, 240, 360, 480 };  // minutes
+
+static Reading readings[MAX_READINGS];
+static int readingCount = 0;
+
+// next "key": "value" after position, value copied without quotes, NULL if none
+static const char* findValue(const char* position, const char* key, char* value, size_t size) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+  const char* found = strstr(position, pattern);
+  if (found == NULL) return NULL;
+  const char* start = strchr(found + strlen(pattern), '"');
+  if (start == NULL) return NULL;
+  const char* end = strchr(start + 1, '"');
+  if (end == NULL) return NULL;
+  size_t length = (size_t)(end - start - 1) < size - 1 ? (size_t)(end - start - 1) : size - 1;
+  memcpy(value, start + 1, length);
+  value[length] = 0;
+  return end + 1;
+}
+
+static bool parseTimestamp(const char* text, double* seconds) {
+  struct tm tm = {};
+  double fraction = 0;
+  if (sscanf(text, "%d-%d-%dT%d:%d:%lf", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &fraction) != 6) {
+    return false;
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  *seconds = (double)timegm(&tm) + fraction;
+  return true;
+}
+
+static void readJson(FILE* input) {
+  size_t size = 0, capacity = 1 << 16;
+  char* text = (char*)malloc(capacity);
+  size_t n;
+  while ((n = fread(text + size, 1, capacity - size - 1, input)) > 0) {
+    size += n;
+    if (size + 1 == capacity) {
+      capacity *= 2;
+      text = (char*)realloc(text, capacity);
+    }
+  }
+  text[size] = 0;
+
+  // one reading from a timestamp to the next
+  double first = 0;
+  const char* position = text;
+  char value[64];
+  while ((position = findValue(position, "timestamp", value, sizeof(value))) != NULL && readingCount < MAX_READINGS) {
+    double time;
+    if (!parseTimestamp(value, &time)) continue;
+    const char* next = strstr(position, "\"timestamp\"");
+    char weight[32], outer[32];
+    const char* w = findValue(position, "weight", weight, sizeof(weight));
+    const char* o = findValue(position, "outer", outer, sizeof(outer));
+    if (w == NULL || o == NULL || (next != NULL && (w > next || o > next)) || weight[0] == 0 || outer[0] == 0) continue;
+    if (readingCount == 0) first = time;
+    Reading& reading = readings[readingCount++];
+    reading.time = time - first;
+    reading.weight = atof(weight);
+    reading.outer = atof(outer);
+  }
+  free(text);
+}
+
+// outer temperature of each reading through the lag filter of the sketch, C
+static void filterTemperatures(int lagMinutes, double* lagged) {
+  int32_t filtered = 0;
+  bool started = false;
+  for (int i = 0; i < readingCount; i++) {
+    int16_t raw = (int16_t)lround(readings[i].outer * 128);
+    double elapsed = i > 0 ? readings[i].time - readings[i - 1].time : 0;
+    filtered = FixedPoint::lag(filtered, started, raw, (uint32_t)(elapsed * 1000), lagMinutes * 60000UL);
+    started = true;
+    lagged[i] = FixedPoint::lagged(filtered) / 128.0;
+  }
+}
+
+// piecewise linear basis: weight of each knot at temperature t
+static void basis(double t, const double* knots, int count, double* row) {
+  for (int k = 0; k < count; k++) row[k] = 0;
+  int segment = 0;
+  while (segment < count - 2 && t > knots[segment + 1]) segment++;
+  double u = (t - knots[segment]) / (knots[segment + 1] - knots[segment]);
+  row[segment] = 1 - u;
+  row[segment + 1] = u;
+}
+
+// least squares of weight = knots(temperature) + slope * time, Gauss elimination
+static double fit(const double* weight, const double* temperature, const double* knots, int count, double* drift) {
+  int unknowns = count + 1;
+  double a[MAX_POINTS + 1][MAX_POINTS + 2] = {};
+  double row[MAX_POINTS + 1];
+  double days = readings[readingCount - 1].time / 86400.0;
+  for (int i = 0; i < readingCount; i++) {
+    basis(temperature[i], knots, count, row);
+    row[count] = days > 0 ? readings[i].time / 86400.0 / days : 0;
+    for (int r = 0; r < unknowns; r++) {
+      for (int c = 0; c < unknowns; c++) a[r][c] += row[r] * row[c];
+      a[r][unknowns] += row[r] * weight[i];
+    }
+  }
+  for (int r = 0; r < unknowns; r++) a[r][r] += 1e-9;  // knots without readings
+  for (int p = 0; p < unknowns; p++) {
+    int best = p;
+    for (int r = p + 1; r < unknowns; r++) if (fabs(a[r][p]) > fabs(a[best][p])) best = r;
+    for (int c = 0; c <= unknowns; c++) { double swap = a[p][c]; a[p][c] = a[best][c]; a[best][c] = swap; }
+    for (int r = 0; r < unknowns; r++) {
+      if (r == p) continue;
+      double f = a[r][p] / a[p][p];
+      for (int c = p; c <= unknowns; c++) a[r][c] -= f * a[p][c];
+    }
+  }
+  double solution[MAX_POINTS + 1];
+  for (int r = 0; r < unknowns; r++) solution[r] = a[r][unknowns] / a[r][r];
+
+  double squares = 0;
+  for (int i = 0; i < readingCount; i++) {
+    basis(temperature[i], knots, count, row);
+    double model = solution[count] * (days > 0 ? readings[i].time / 86400.0 / days : 0);
+    for (int k = 0; k < count; k++) model += row[k] * solution[k];
+    squares += (weight[i] - model) * (weight[i] - model);
+  }
+  for (int k = 0; k < count; k++) drift[k] = solution[k];
+  return sqrt(squares / readingCount);
+}
+
+// weight changes between consecutive readings above the uplink limit
+static int countChanges(const double* weight) {
+  int changes = 0;
+  for (int i = 1; i < readingCount; i++) {
+    if (fabs(weight[i] - weight[i - 1]) > LIMIT_WEIGHT_DIFF) changes++;
+  }
+  return changes;
+}
+
+int main(int argc, char** argv) {
+  double factor = 0, offset = 0;
+  int points = 4, maxLag = 480;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--factor") == 0) factor = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--offset") == 0) offset = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--points") == 0) points = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--max-lag") == 0) maxLag = atoi(argv[i + 1]);
+    else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+  }
+  readJson(stdin);
+  if (readingCount < 4) {
+    fprintf(stderr, "%d readings with weight and outer temperature, 4 needed\n", readingCount);
+    return 1;
+  }
+
+  // load cell reading before the linear compensation of the sketch
+  static double raw[MAX_READINGS], compensated[MAX_READINGS], lagged[MAX_READINGS];
+  double minimum = readings[0].outer, maximum = readings[0].outer, mean = 0;
+  for (int i = 0; i < readingCount; i++) {
+    raw[i] = readings[i].weight + factor * readings[i].outer + offset;
+    if (readings[i].outer < minimum) minimum = readings[i].outer;
+    if (readings[i].outer > maximum) maximum = readings[i].outer;
+    mean += readings[i].weight / readingCount;
+  }
+  // one segment per 2 C and per 4 readings at most
+  int count = points < 2 ? 2 : points > MAX_POINTS ? MAX_POINTS : points;
+  while (count > 2 && ((maximum - minimum) / (count - 1) < 2.0 || readingCount < 4 * count)) count--;
+  printf("readings %d over %.1f days, outer %.2f .. %.2f C, %d points\n",
+         readingCount, readings[readingCount - 1].time / 86400.0, minimum, maximum, count);
+
+  double knots[MAX_POINTS], drift[MAX_POINTS], bestDrift[MAX_POINTS];
+  double bestRms = INFINITY;
+  int bestLag = 0;
+  printf("lag min   rms kg\n");
+  for (size_t l = 0; l < sizeof(LAGS) / sizeof(LAGS[0]) && LAGS[l] <= maxLag; l++) {
+    filterTemperatures(LAGS[l], lagged);
+    for (int k = 0; k < count; k++) knots[k] = minimum + (maximum - minimum) * k / (count - 1);
+    if (maximum - minimum < 0.1) knots[count - 1] = minimum + 0.1;
+    double rms = fit(raw, lagged, knots, count, drift);
+    printf("%7d  %7.4f\n", LAGS[l], rms);
+    if (rms < bestRms - 1e-6) {
+      bestRms = rms;
+      bestLag = LAGS[l];
+      memcpy(bestDrift, drift, sizeof(drift));
+    }
+  }
+
+  // drift relative to the mean weight of the recording, compensated as the sketch does
+  filterTemperatures(bestLag, lagged);
+  double level = 0, row[MAX_POINTS];
+  for (int i = 0; i < readingCount; i++) {
+    basis(lagged[i], knots, count, row);
+    double model = 0;
+    for (int k = 0; k < count; k++) model += row[k] * bestDrift[k];
+    compensated[i] = raw[i] - model;
+    level += compensated[i] / readingCount;
+  }
+  for (int i = 0; i < readingCount; i++) compensated[i] += mean - level;
+  for (int k = 0; k < count; k++) bestDrift[k] -= mean - level;
+
+  printf("best lag %d min, rms %.4f kg\n", bestLag, bestRms);
+  for (int i = 0; i < readingCount; i++) raw[i] = readings[i].weight;
+  printf("changes > %.2f kg: linear %d, fitted %d\n", LIMIT_WEIGHT_DIFF, countChanges(raw), countChanges(compensated));
+  printf("\n#define TEMPERATURE_POINTS { ");
+  for (int k = 0; k < count; k++) {
+    printf("%sFIXED_COMPENSATION_POINT(%.2f, %+.4f)", k > 0 ? ", \\\n                             " : "", knots[k], bestDrift[k]);
+  }
+  printf(" }\n#define TEMPERATURE_LAG_MINUTES %d\n", bestLag);
+  return 0;
+}
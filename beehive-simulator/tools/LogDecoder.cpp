@@ -0,0 +1,55 @@
+/**********************************************************
+ * Decoder of the deferred log of the sensor script.
+ * ---
+ * Reads a serial capture of the sketch (manual mode or a
+ * drain on request), decodes the "LOG <16 hex digits>"
+ * lines with the event table of Log.h and prints them with
+ * the time since boot. Other lines pass unchanged.
+ *
+ * usage: log-decoder < capture.txt
+ **********************************************************/
+#include "Arduino.h"
+#include "Log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UNDEFINED_VALUE -32768
+
+// LoRaMacEventInfoStatus_t of LoRaMac 1.0.2
+static const char* MAC_STATUS[] = {
+  "OK", "ERROR", "TX_TIMEOUT", "RX1_TIMEOUT", "RX2_TIMEOUT", "RX1_ERROR", "RX2_ERROR", "JOIN_FAIL",
+  "DOWNLINK_REPEATED", "TX_DR_PAYLOAD_SIZE_ERROR", "DOWNLINK_TOO_MANY_FRAMES_LOSS", "ADDRESS_FAIL",
+  "MIC_FAIL", "MULTICAST_FAIL", "BEACON_LOCKED", "BEACON_LOST", "BEACON_NOT_FOUND"
+};
+static const char* MAC_CALLBACK[] = { "MCPS confirm", "MLME confirm", "MCPS indication", "MLME indication" };
+
+static void print(const LogRecord& record) {
+  const LogEvent& event = Log::event(record.event);
+  printf("%10.3f s  ", record.time / 1000.0);
+  if (record.event == LOG_MAC_STATUS) {
+    const char* callback = record.index < sizeof(MAC_CALLBACK) / sizeof(MAC_CALLBACK[0]) ? MAC_CALLBACK[record.index] : "?";
+    const char* status = record.value >= 0 && (size_t)record.value < sizeof(MAC_STATUS) / sizeof(MAC_STATUS[0]) ? MAC_STATUS[record.value] : "?";
+    printf("%s %s: %s\n", event.name, callback, status);
+  } else if (record.value == UNDEFINED_VALUE) {
+    printf("%s %u: undefined\n", event.name, record.index);
+  } else if (event.divisor > 1) {
+    printf("%s %u: %.2f %s\n", event.name, record.index, (double)record.value / event.divisor, event.unit);
+  } else {
+    printf("%s %u: %d %s\n", event.name, record.index, record.value, event.unit);
+  }
+}
+
+int main() {
+  char line[256];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    const char* start = strstr(line, LOG_PREFIX);
+    LogRecord record;
+    if (start != NULL && Log::parse(start + strlen(LOG_PREFIX), &record)) {
+      print(record);
+    } else {
+      fputs(line, stdout);
+    }
+  }
+  return 0;
+}
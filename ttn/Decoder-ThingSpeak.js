@@ -2,7 +2,12 @@ function Decoder(bytes, port) {
   // Decode an ThingSpeak formatted uplink message from a buffer
   // (array) of bytes to an object of fields.
 
-  // Payload: 00 88 01 25 00 8E 12 AC 08 0E 08 14 08 9E 07 C9 07 91 07 (19 bytes)
+  // Payload v0: 00 88 01 25 00 8E 12 AC 08 0E 08 14 08 9E 07 C9 07 91 07 (19 bytes)
+  // Payload v1: 01 91 FF B1 10 09 52 8E A2 B2 80 EA 05 27 9E 9F 26 79 10 (19 bytes),
+  //             a delta frame has no fields (differences to the absolute frame with the same id)
+  // Payload v2: batch of v1 samples, "samples" lists all with their age in minutes,
+  //             "sensor" is the latest sample, "schedule" the next measure interval
+  // Payload 3:  diagnostics of the node, no fields (see Decoder.js)
   // {
   //   "field1": 20.62, // Aussentemperatur
   //   "field2": 20.68, // Kälteloch
@@ -32,7 +37,7 @@ function Decoder(bytes, port) {
   // }
 
   function asShort(index) {
-    if (bytes.length < index) return null;
+    if (bytes.length < index + 2) return null;
     var x = (bytes[index+1] << 8) | bytes[index];
     if ((x & 0x8000) > 0) {
       return -(x ^ 0xffff) - 1;
@@ -40,31 +45,126 @@ function Decoder(bytes, port) {
     return x;
   }
 
-  function asFloat(index) {
-    var value = asShort(index);
-    if (!value || value == -32768) {
+  // message v0: packed shorts (little endian) in 1/100
+  function valuesV0() {
+    var values = [];
+    for (var index = 1; index + 1 < bytes.length; index += 2) {
+      values.push(asShort(index));
+    }
+    return values;
+  }
+
+  // message v1/v2: bit packed, see MessageCodec.h of the sketch
+  var FORMAT = [[0, 10], [-16384, 15], [0, 14], [-8192, 14]];
+  var position = 16;
+
+  function readBits(bits) {
+    var value = 0;
+    for (var i = 0; i < bits; i++, position++) {
+      if ((position >> 3) >= bytes.length) throw new Error('message too short');
+      value = value * 2 + ((bytes[position >> 3] >> (7 - (position & 7))) & 1);
+    }
+    return value;
+  }
+
+  function readValues(count, reference) {
+    var presence = readBits(count);
+    var values = [];
+    for (var i = 0; i < count; i++) {
+      if ((presence & (1 << (count - 1 - i))) === 0) {
+        values.push(-32768);
+      } else if (reference) {
+        var zigzag = readBits(readBits(4));
+        values.push((zigzag % 2 === 1 ? -(zigzag + 1) / 2 : zigzag / 2) + reference[i]);
+      } else {
+        var format = FORMAT[Math.min(i, FORMAT.length - 1)];
+        values.push(readBits(format[1]) + format[0]);
+      }
+    }
+    return values;
+  }
+
+  function asFloat(values, index) {
+    var value = values[index];
+    if (value === undefined || value === null || value == -32768 || (!value && version === 0)) {
       return null;
     } else {
       return value / 100.0;
     }
   }
 
-  var sensorData = {
-    version: bytes[0],
-    battery: asFloat(1),
-    weight: asFloat(3),
-    humidity: {
-      roof: asFloat(5)
-    },
-    temperature: {
-      roof: asFloat(7),
-      outer: asFloat(9),
-      drop: asFloat(11),
-      lower: asFloat(13),
-      middle: asFloat(15),
-      upper: asFloat(17)
+  function asSensorData(values) {
+    return {
+      version: version,
+      battery: asFloat(values, 0),
+      weight: asFloat(values, 1),
+      humidity: {
+        roof: asFloat(values, 2)
+      },
+      temperature: {
+        roof: asFloat(values, 3),
+        outer: asFloat(values, 4),
+        drop: asFloat(values, 5),
+        lower: asFloat(values, 6),
+        middle: asFloat(values, 7),
+        upper: asFloat(values, 8)
+      }
+    };
+  }
+
+  var version = bytes[0];
+  if (version == 3) {
+    return {
+      status: 'diagnostics'
+    };
+  }
+  if (version == 6) {
+    return {
+      status: 'alert'
+    };
+  }
+
+  var sensorData;
+  var samples = [];
+  var schedule = null;
+  if (version == 2) {
+    // batch of samples with their age in minutes, oldest first
+    var count = bytes[1] >> 4;
+    var previous = null;
+    for (var s = 0; s < (bytes[1] & 0x0f); s++) {
+      var age = readBits(8);
+      var values = readValues(count, readBits(1) ? previous : null);
+      var sample = asSensorData(values);
+      sample.age = age;
+      samples.push(sample);
+      previous = values;
+    }
+    sensorData = samples.length > 0 ? samples[samples.length - 1] : asSensorData([]);
+    // optional: minutes to the next measure, reason and rate of change (limits per hour)
+    if (bytes.length * 8 - position >= 16) {
+      var REASONS = ['active', 'daily', 'battery', 'quiet'];
+      schedule = {
+        interval: readBits(8),
+        reason: REASONS[readBits(2)],
+        rate: readBits(6) / 8.0
+      };
     }
-  };
+  } else if (version == 1) {
+    // a delta frame holds the differences to the absolute frame with the same id, no readings:
+    // ThingSpeak can not resolve them, the values stay unset
+    var frame = bytes[1] & 0x07;
+    if ((bytes[1] & 0x08) !== 0) {
+      return {
+        status: 'version 1, delta of frame ' + frame,
+        sensor: { version: version, frame: frame, delta: true } // ignored by ThingSpeak
+      };
+    }
+    sensorData = asSensorData(readValues(bytes[1] >> 4, null));
+    sensorData.frame = frame;
+    sensorData.delta = false;
+  } else {
+    sensorData = asSensorData(valuesV0());
+  }
 
   return { // ThingSpeak format
     field1: sensorData.temperature.outer,
@@ -75,7 +175,10 @@ function Decoder(bytes, port) {
     field6: sensorData.temperature.roof,
     field7: sensorData.humidity.roof,
     field8: sensorData.weight,
-    status: 'version ' + sensorData.version + ', ' + sensorData.battery + " V",
-    sensor: sensorData // ignored by ThingSpeak
+    status: 'version ' + sensorData.version + ', ' + sensorData.battery + " V"
+      + (schedule ? ', next in ' + schedule.interval + ' min (' + schedule.reason + ')' : ''),
+    sensor: sensorData, // ignored by ThingSpeak
+    samples: samples,   // ignored by ThingSpeak, only the latest sample of a batch is stored
+    schedule: schedule  // ignored by ThingSpeak
   }
 }
@@ -2,7 +2,22 @@ function Decoder(bytes, port) {
   // Decode an ThingSpeak formatted uplink message from a buffer
   // (array) of bytes to an object of fields.
 
-  // Payload: 00 88 01 25 00 8E 12 AC 08 0E 08 14 08 9E 07 C9 07 91 07 (19 bytes)
+  // Payload v0: 00 88 01 25 00 8E 12 AC 08 0E 08 14 08 9E 07 C9 07 91 07 (19 bytes)
+  // Payload v1: 01 91 FF B1 10 09 52 8E A2 B2 80 EA 05 27 9E 9F 26 79 10 (19 bytes),
+  //             "frame" id and "delta": false; a delta frame has no values in "sensor",
+  //             "differences" holds them to the absolute frame with the same id
+  // Payload v2: batch of v1 samples, "samples" lists all with their age in minutes,
+  //             "sensor" is the latest sample, "schedule" the next measure interval
+  // Payload 3:  diagnostics, "states" with time (s), entries, timeouts and longest stay (s)
+  //             since boot, "airtime" (s) and "deferred" frames
+  // Payload 4:  backfill of journal samples that may have been lost, "backfill" with the
+  //             "sequence" of the first sample and the "samples" with their age in minutes;
+  //             samples may arrive twice, the sequence identifies them
+  // Payload 5:  "statistics" of consecutive intervals, oldest first, each with its "minutes", "measures"
+  //             and the "minimum", "maximum", "mean" and "deviation" of the fields; the newest interval
+  //             ended "age" minutes ago
+  // Payload 6:  "alert" of a sudden change on port 2 (swarm, theft), the "weight" and the
+  //             "temperature" of the brood nest level with the largest change "before" and "after"
   // {
   //   "sensor": {
   //     "version": 0,
@@ -23,7 +38,7 @@ function Decoder(bytes, port) {
   // }
 
   function asShort(index) {
-    if (bytes.length < index) return null;
+    if (bytes.length < index + 2) return null;
     var x = (bytes[index+1] << 8) | bytes[index];
     if ((x & 0x8000) > 0) {
       return -(x ^ 0xffff) - 1;
@@ -31,31 +46,229 @@ function Decoder(bytes, port) {
     return x;
   }
 
-  function asFloat(index) {
-    var value = asShort(index);
-    if (!value || value == -32768) {
+  // message v0: packed shorts (little endian) in 1/100
+  function valuesV0() {
+    var values = [];
+    for (var index = 1; index + 1 < bytes.length; index += 2) {
+      values.push(asShort(index));
+    }
+    return values;
+  }
+
+  // message v1/v2: bit packed, see MessageCodec.h of the sketch
+  var FORMAT = [[0, 10], [-16384, 15], [0, 14], [-8192, 14]];
+  var position = 16;
+
+  function readBits(bits) {
+    var value = 0;
+    for (var i = 0; i < bits; i++, position++) {
+      if ((position >> 3) >= bytes.length) throw new Error('message too short');
+      value = value * 2 + ((bytes[position >> 3] >> (7 - (position & 7))) & 1);
+    }
+    return value;
+  }
+
+  // 5 bit width n and n bits unsigned value
+  function readCounter() {
+    return readBits(readBits(5));
+  }
+
+  function readValues(count, reference) {
+    var presence = readBits(count);
+    var values = [];
+    for (var i = 0; i < count; i++) {
+      if ((presence & (1 << (count - 1 - i))) === 0) {
+        values.push(-32768);
+      } else if (reference) {
+        var zigzag = readBits(readBits(4));
+        values.push((zigzag % 2 === 1 ? -(zigzag + 1) / 2 : zigzag / 2) + reference[i]);
+      } else {
+        var format = FORMAT[Math.min(i, FORMAT.length - 1)];
+        values.push(readBits(format[1]) + format[0]);
+      }
+    }
+    return values;
+  }
+
+  function asFloat(values, index) {
+    var value = values[index];
+    if (value === undefined || value === null || value == -32768 || (!value && version === 0)) {
       return null;
     } else {
       return value / 100.0;
     }
   }
 
-  var sensorData = {
-    version: bytes[0],
-    battery: asFloat(1),
-    weight: asFloat(3),
-    humidity: {
-      roof: asFloat(5)
-    },
-    temperature: {
-      roof: asFloat(7),
-      outer: asFloat(9),
-      drop: asFloat(11),
-      lower: asFloat(13),
-      middle: asFloat(15),
-      upper: asFloat(17)
+  function asSensorData(values) {
+    return {
+      version: version,
+      battery: asFloat(values, 0),
+      weight: asFloat(values, 1),
+      humidity: {
+        roof: asFloat(values, 2)
+      },
+      temperature: {
+        roof: asFloat(values, 3),
+        outer: asFloat(values, 4),
+        drop: asFloat(values, 5),
+        lower: asFloat(values, 6),
+        middle: asFloat(values, 7),
+        upper: asFloat(values, 8)
+      }
+    };
+  }
+
+  var version = bytes[0];
+  if (version == 6) {
+    var LEVELS = ['battery', 'weight', 'humidity', 'roof', 'outer', 'drop', 'lower', 'middle', 'upper'];
+    var signed = function() {
+      var x = readBits(16);
+      return x >= 0x8000 ? x - 0x10000 : x;
+    };
+    var alertValues = [signed(), signed(), signed(), signed()];
+    var alert = {
+      reasons: [],
+      weight: { before: asFloat(alertValues, 0), after: asFloat(alertValues, 1) }
+    };
+    if (bytes[1] & 0x01) alert.reasons.push('weight');
+    if (bytes[1] & 0x02) alert.reasons.push('temperature');
+    if (bytes[1] >> 4) {
+      alert.temperature = { level: LEVELS[bytes[1] >> 4], before: asFloat(alertValues, 2), after: asFloat(alertValues, 3) };
+    }
+    return { alert: alert };
+  }
+
+  if (version == 3) {
+    var STATES = ['join', 'acquire', 'measure', 'transmit', 'sleep', 'manual'];
+    var counter = readCounter;
+    var states = {};
+    for (var st = 0; st < (bytes[1] >> 4); st++) {
+      states[STATES[st] || st] = {
+        time: counter(),
+        entries: counter(),
+        timeouts: counter(),
+        maxDuration: counter()
+      };
+    }
+    return {
+      diagnostics: {
+        states: states,
+        airtime: counter(),
+        deferred: counter()
+      }
+    };
+  }
+
+  if (version == 5) {
+    var statisticsFields = bytes[1] >> 4;
+    var statisticsAge = readCounter();
+    var intervals = [];
+    for (var w = 0; w < (bytes[1] & 0x0f); w++) {
+      var interval = { minutes: readCounter(), measures: readCounter() };
+      var present = readBits(statisticsFields);
+      var minimum = [], maximum = [], mean = [], deviation = [];
+      for (var f = 0; f < statisticsFields; f++) {
+        if ((present & (1 << (statisticsFields - 1 - f))) === 0) {
+          minimum.push(-32768); maximum.push(-32768); mean.push(-32768); deviation.push(-32768);
+          continue;
+        }
+        var fieldFormat = FORMAT[Math.min(f, FORMAT.length - 1)];
+        var low = readBits(fieldFormat[1]) + fieldFormat[0];
+        var width = readBits(4);
+        minimum.push(low);
+        maximum.push(low + readBits(width));
+        mean.push(low + readBits(width));
+        deviation.push(readBits(width));
+      }
+      interval.minimum = asSensorData(minimum);
+      interval.maximum = asSensorData(maximum);
+      interval.mean = asSensorData(mean);
+      interval.deviation = asSensorData(deviation);
+      intervals.push(interval);
+    }
+    return {
+      statistics: {
+        age: statisticsAge,
+        intervals: intervals
+      }
+    };
+  }
+
+  if (version == 4) {
+    // consecutive journal samples, oldest first, minutes between them after the first age
+    var fields = bytes[1] >> 4;
+    var sequence = readBits(16);
+    var sampleAge = readBits(16);
+    var replayed = [];
+    var last = null;
+    for (var r = 0; r < (bytes[1] & 0x0f); r++) {
+      if (r > 0) sampleAge = Math.max(sampleAge - readBits(8), 0);
+      var replayedValues = readValues(fields, readBits(1) ? last : null);
+      var replayedSample = asSensorData(replayedValues);
+      replayedSample.age = sampleAge;
+      replayedSample.sequence = (sequence + r) & 0xffff;
+      replayed.push(replayedSample);
+      last = replayedValues;
+    }
+    return {
+      backfill: {
+        sequence: sequence,
+        samples: replayed
+      }
+    };
+  }
+
+  var sensorData;
+  var samples = [];
+  var schedule = null;
+  if (version == 2) {
+    // batch of samples with their age in minutes, oldest first
+    var count = bytes[1] >> 4;
+    var previous = null;
+    for (var s = 0; s < (bytes[1] & 0x0f); s++) {
+      var age = readBits(8);
+      var values = readValues(count, readBits(1) ? previous : null);
+      var sample = asSensorData(values);
+      sample.age = age;
+      samples.push(sample);
+      previous = values;
+    }
+    sensorData = samples.length > 0 ? samples[samples.length - 1] : asSensorData([]);
+    // optional: minutes to the next measure, reason and rate of change (limits per hour)
+    if (bytes.length * 8 - position >= 16) {
+      var REASONS = ['active', 'daily', 'battery', 'quiet'];
+      schedule = {
+        interval: readBits(8),
+        reason: REASONS[readBits(2)],
+        rate: readBits(6) / 8.0
+      };
+    }
+  } else if (version == 1) {
+    // a delta frame holds the differences to the absolute frame with the same id, no readings:
+    // the values stay unset, a backend adds the differences to the values of that frame
+    var frame = bytes[1] & 0x07;
+    if ((bytes[1] & 0x08) !== 0) {
+      var zero = [];
+      for (var i = 0; i < 15; i++) zero.push(0);
+      return {
+        sensor: { version: version, frame: frame, delta: true },
+        differences: asSensorData(readValues(bytes[1] >> 4, zero))
+      };
+    }
+    sensorData = asSensorData(readValues(bytes[1] >> 4, null));
+    sensorData.frame = frame;
+    sensorData.delta = false;
+  } else {
+    sensorData = asSensorData(valuesV0());
+  }
+
+  if (version == 2) {
+    return {
+      sensor: sensorData,
+      samples: samples,
+      schedule: schedule
     }
-  };
+  }
 
   return {
     sensor: sensorData
@@ -0,0 +1,54 @@
+function Encoder(object, port) {
+  // Encode a downlink command of the sensor script (port 10, see
+  // CommandParser.h) from an object of settings, missing ones
+  // are left unchanged:
+  // {
+  //   "measureInterval": { "min": 10, "max": 60 }, // minutes, equal for a fixed interval
+  //   "unconditionalInterval": 30,                // minutes, at least half the max measure interval
+  //   "limits": { "weight": 0.2, "temperature": 0.5, "humidity": 2.0 },
+  //   "confirmationInterval": 720,                // minutes between link checks, 0 never
+  //   "datarate": 2,                              // DR0..5, "default" as built
+  //   "defaults": true                            // the settings as built, before the others
+  // }
+  // eg. { "measureInterval": { "min": 60, "max": 60 } } -> 01 01 00 3C 00 3C
+  var bytes = [1]; // version
+
+  function short(value) {
+    bytes.push((value >> 8) & 0xFF, value & 0xFF);
+  }
+
+  if (object.defaults) {
+    bytes.push(0x7F);
+  }
+  if (object.measureInterval) {
+    bytes.push(0x01);
+    short(object.measureInterval.min);
+    short(object.measureInterval.max);
+  }
+  if (object.unconditionalInterval !== undefined) {
+    bytes.push(0x02);
+    short(object.unconditionalInterval);
+  }
+  if (object.limits) {
+    if (object.limits.weight !== undefined) {
+      bytes.push(0x03);
+      short(Math.round(object.limits.weight * 100));
+    }
+    if (object.limits.temperature !== undefined) {
+      bytes.push(0x04);
+      short(Math.round(object.limits.temperature * 100));
+    }
+    if (object.limits.humidity !== undefined) {
+      bytes.push(0x05);
+      short(Math.round(object.limits.humidity * 100));
+    }
+  }
+  if (object.confirmationInterval !== undefined) {
+    bytes.push(0x06);
+    short(object.confirmationInterval);
+  }
+  if (object.datarate !== undefined) {
+    bytes.push(0x07, object.datarate === "default" ? 0xFF : object.datarate);
+  }
+  return bytes;
+}